@@ -0,0 +1,75 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the batch packet validator against per-packet checks.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/packet_batch_validator.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_PKTS = 32;
+
+struct AudioPktBatch
+{
+    AudioPktBatch()
+    {
+        for (int i = 0; i < NUM_PKTS; i++)
+        {
+            prepare_audio_mute_pkt(&pkts[i], i);
+            set_audio_pkt_crc(&pkts[i]);
+        }
+        // a few broken packets
+        pkts[3].magic_stop = 0;
+        pkts[17].cmd_msb = 42;
+        set_audio_pkt_crc(&pkts[17]);
+    }
+
+    AudioCtrlPkt pkts[NUM_PKTS];
+};
+
+AudioPktBatch batch;
+
+BENCHMARK("batch_validator/32_pkts/per_pkt_magic_words", [] {
+    bench::clobber_memory();
+    uint64_t valid = 0;
+    for (int i = 0; i < NUM_PKTS; i++)
+    {
+        valid |= static_cast<uint64_t>(check_audio_pkt_for_magic_words(&batch.pkts[i])) << i;
+    }
+    bench::do_not_optimize(valid);
+});
+
+BENCHMARK("batch_validator/32_pkts/magic_and_cmd", [] {
+    bench::clobber_memory();
+    PktBatchSummary summary;
+    uint64_t valid = validate_audio_pkt_batch(batch.pkts, NUM_PKTS, 0, &summary);
+    bench::do_not_optimize(valid);
+});
+
+BENCHMARK("batch_validator/32_pkts/magic_cmd_and_crc", [] {
+    bench::clobber_memory();
+    PktBatchSummary summary;
+    uint64_t valid = validate_audio_pkt_batch(batch.pkts, NUM_PKTS, PKT_BATCH_CHECK_CRC, &summary);
+    bench::do_not_optimize(valid);
+});
+
+} // anonymous namespace
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Minimal self-contained benchmark harness. Benchmarks register
+ *        themselves with BENCHMARK() and are run by bench_main.cpp.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef AUDIO_CONTROL_PROTOCOL_BENCH_COMMON_H_
+#define AUDIO_CONTROL_PROTOCOL_BENCH_COMMON_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ * @brief Prevents the compiler from optimizing away the computation of value.
+ */
+template <typename T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Like do_not_optimize(), but for scalars read from memory: the value
+ *        has to be loaded in a register instead of being referenced in place.
+ */
+template <typename T>
+inline void force_load(T value)
+{
+    asm volatile("" : "+r"(value));
+}
+
+/**
+ * @brief Forces the compiler to assume all memory has been modified.
+ */
+inline void clobber_memory()
+{
+    asm volatile("" : : : "memory");
+}
+
+using BenchmarkFunction = std::function<void()>;
+
+struct Benchmark
+{
+    std::string name;
+    BenchmarkFunction function;
+    int items_per_op;           // Items processed per call, for throughput reports, or 0
+    BenchmarkFunction setup;    // Called once before running the benchmark, can be empty
+};
+
+inline std::vector<Benchmark>& registered_benchmarks()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct BenchmarkRegistrar
+{
+    BenchmarkRegistrar(const char* name, BenchmarkFunction function, int items_per_op = 0)
+    {
+        registered_benchmarks().push_back({name, std::move(function), items_per_op, nullptr});
+    }
+};
+
+/**
+ * @brief Memory shared by the cold cache benchmarks, larger than the last
+ *        level cache of the machines we run on (server parts have 100 MB+).
+ */
+constexpr size_t COLD_ARENA_SIZE = 256 * 1024 * 1024;
+
+inline uint8_t* cold_arena()
+{
+    static std::unique_ptr<uint8_t[]> arena(new uint8_t[COLD_ARENA_SIZE]);
+    return arena.get();
+}
+
+/**
+ * @brief Pool of packets filling the cold arena. next() picks packets in a
+ *        pseudo random order, so that neither the caches nor the hardware
+ *        prefetchers hold the packet being accessed.
+ */
+template <typename PacketType>
+class ColdPacketPool
+{
+public:
+    static constexpr size_t NUM_PACKETS = COLD_ARENA_SIZE / sizeof(PacketType);
+
+    template <typename Init>
+    void setup(Init init)
+    {
+        _packets = reinterpret_cast<PacketType*>(cold_arena());
+        for (size_t i = 0; i < NUM_PACKETS; i++)
+        {
+            init(&_packets[i]);
+        }
+        _random_state = 0x12345678u;
+    }
+
+    PacketType* next()
+    {
+        _random_state ^= _random_state << 13;
+        _random_state ^= _random_state >> 17;
+        _random_state ^= _random_state << 5;
+        return &_packets[(uint64_t(_random_state) * NUM_PACKETS) >> 32];
+    }
+
+private:
+    PacketType* _packets = nullptr;
+    uint32_t _random_state = 0x12345678u;
+};
+
+/**
+ * @brief Registers a hot cache and a cold cache benchmark of an operation on
+ *        a packet. init prepares a packet and body runs the operation on it,
+ *        returning a scalar which is kept alive. The hot cache version runs on
+ *        the same packet over and over, the cold cache one on a different
+ *        packet of a ColdPacketPool at every call, followed by a full memory
+ *        fence so that each call pays the whole miss latency. Compare the cold
+ *        timings with the one of an empty body to remove the fence cost.
+ */
+template <typename PacketType>
+struct PacketBenchmarkRegistrar
+{
+    template <typename Init, typename Body>
+    PacketBenchmarkRegistrar(const char* name, Init init, Body body)
+    {
+        auto hot_packet = std::make_shared<PacketType>();
+        registered_benchmarks().push_back({std::string(name) + "/hot",
+                                           [=] {
+                                               clobber_memory();
+                                               force_load(body(hot_packet.get()));
+                                           },
+                                           0,
+                                           [=] { init(hot_packet.get()); }});
+
+        auto pool = std::make_shared<ColdPacketPool<PacketType>>();
+        registered_benchmarks().push_back({std::string(name) + "/cold",
+                                           [=] {
+                                               clobber_memory();
+                                               force_load(body(pool->next()));
+                                               // wait for the cache misses, otherwise the cpu overlaps them
+                                               std::atomic_thread_fence(std::memory_order_seq_cst);
+                                           },
+                                           0,
+                                           [=] { pool->setup(init); }});
+    }
+};
+
+} // namespace bench
+
+#define BENCH_GLUE_(a, b) a ## b
+#define BENCH_GLUE(a, b) BENCH_GLUE_(a, b)
+
+/**
+ * @brief Registers a benchmark. The body is the operation to be timed and is
+ *        called repeatedly by the runner.
+ */
+#define BENCHMARK(name, body) \
+    static bench::BenchmarkRegistrar BENCH_GLUE(_bench_registrar_, __COUNTER__)(name, body)
+
+/**
+ * @brief Registers a benchmark processing num_items items per call, for which
+ *        the throughput in items/ns is reported as well.
+ */
+#define BENCHMARK_ITEMS(name, num_items, body) \
+    static bench::BenchmarkRegistrar BENCH_GLUE(_bench_registrar_, __COUNTER__)(name, body, num_items)
+
+/**
+ * @brief Registers the hot and cold cache benchmarks of an operation on a
+ *        packet, see PacketBenchmarkRegistrar.
+ */
+#define PACKET_BENCHMARK(name, packet_type, init, body) \
+    static bench::PacketBenchmarkRegistrar<packet_type> BENCH_GLUE(_bench_registrar_, __COUNTER__)(name, init, body)
+
+#endif // AUDIO_CONTROL_PROTOCOL_BENCH_COMMON_H_
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Runs the registered benchmarks and prints the time per operation,
+ *        and the throughput for benchmarks registered with BENCHMARK_ITEMS().
+ *
+ *        Usage: audio_control_protocol_bench [--json] [name filter]
+ *
+ *        With --json the results are printed as a json document, together with
+ *        the compiler, the optimization level and target of the build and the
+ *        simd and crc kernels used, to be stored and compared across runs.
+ *        Otherwise the target and kernels are printed on the first line.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "audio_control_protocol/packet_crc.h"
+#include "audio_control_protocol/simd_helpers.h"
+
+#include "bench_common.h"
+
+#ifndef AUDIO_CONTROL_PROTOCOL_BENCH_OPT_LEVEL
+#define AUDIO_CONTROL_PROTOCOL_BENCH_OPT_LEVEL "default"
+#endif
+
+#ifndef AUDIO_CONTROL_PROTOCOL_BENCH_TARGET
+#define AUDIO_CONTROL_PROTOCOL_BENCH_TARGET "default"
+#endif
+
+namespace {
+
+constexpr auto MIN_RUN_TIME = std::chrono::milliseconds(200);
+constexpr int BATCH_SIZE = 1000;
+
+struct Result
+{
+    double ns_per_op;
+    long iterations;
+};
+
+Result run_benchmark(const bench::Benchmark& benchmark)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (benchmark.setup)
+    {
+        benchmark.setup();
+    }
+
+    // warm up caches and branch predictors
+    for (int i = 0; i < BATCH_SIZE; i++)
+    {
+        benchmark.function();
+    }
+
+    long iterations = 0;
+    auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    while (elapsed < MIN_RUN_TIME)
+    {
+        for (int i = 0; i < BATCH_SIZE; i++)
+        {
+            benchmark.function();
+        }
+        iterations += BATCH_SIZE;
+        elapsed = clock::now() - start;
+    }
+
+    return {std::chrono::duration<double, std::nano>(elapsed).count() / iterations, iterations};
+}
+
+std::string json_string(const char* text)
+{
+    std::string escaped = "\"";
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += static_cast<unsigned char>(*c) < 0x20 ? ' ' : *c;
+    }
+    return escaped + "\"";
+}
+
+const char* compiler_name()
+{
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#else
+    return "unknown";
+#endif
+}
+
+// The kernel used by pkt_crc32c_update() in this build and on this cpu
+const char* crc_kernel_name()
+{
+#if defined(PKT_CRC_HW_DISPATCH)
+    return audio_ctrl::pkt_crc_cpu_has_hw() ? "sse4.2, selected at run time" : "slice8, no sse4.2 at run time";
+#elif defined(PKT_CRC_SSE42)
+    return "sse4.2";
+#elif defined(PKT_CRC_HAS_HW_KERNEL)
+    return "armv8 crc";
+#elif defined(PKT_CRC_FORCE_PORTABLE)
+    return "portable";
+#else
+    return "slice8";
+#endif
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    bool json = false;
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+
+    if (json)
+    {
+        std::printf("{\n  \"context\": {\n");
+        std::printf("    \"compiler\": %s,\n", json_string(compiler_name()).c_str());
+        std::printf("    \"opt_level\": %s,\n", json_string(AUDIO_CONTROL_PROTOCOL_BENCH_OPT_LEVEL).c_str());
+        std::printf("    \"target\": %s,\n", json_string(AUDIO_CONTROL_PROTOCOL_BENCH_TARGET).c_str());
+        std::printf("    \"simd\": %s,\n", json_string(audio_ctrl::simd::NAME).c_str());
+        std::printf("    \"crc\": %s\n", json_string(crc_kernel_name()).c_str());
+        std::printf("  },\n  \"benchmarks\": [");
+    }
+    else
+    {
+        std::printf("target: %s, simd: %s, crc: %s\n", AUDIO_CONTROL_PROTOCOL_BENCH_TARGET, audio_ctrl::simd::NAME,
+                    crc_kernel_name());
+    }
+
+    const char* separator = "\n";
+    for (const auto& benchmark : bench::registered_benchmarks())
+    {
+        if (filter && std::strstr(benchmark.name.c_str(), filter) == nullptr)
+        {
+            continue;
+        }
+        Result result = run_benchmark(benchmark);
+        if (json)
+        {
+            std::printf("%s    {\"name\": %s, \"ns_per_op\": %.3f, \"iterations\": %ld",
+                        separator, json_string(benchmark.name.c_str()).c_str(), result.ns_per_op, result.iterations);
+            if (benchmark.items_per_op > 0)
+            {
+                std::printf(", \"items_per_ns\": %.3f", benchmark.items_per_op / result.ns_per_op);
+            }
+            std::printf("}");
+            separator = ",\n";
+        }
+        else if (benchmark.items_per_op > 0)
+        {
+            std::printf("%-48s %10.2f ns/op %10.2f items/ns\n", benchmark.name.c_str(), result.ns_per_op,
+                        benchmark.items_per_op / result.ns_per_op);
+        }
+        else
+        {
+            std::printf("%-48s %10.2f ns/op\n", benchmark.name.c_str(), result.ns_per_op);
+        }
+        std::fflush(stdout);
+    }
+
+    if (json)
+    {
+        std::printf("\n  ]\n}\n");
+    }
+
+    return 0;
+}
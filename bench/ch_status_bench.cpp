@@ -0,0 +1,55 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the bulk channel status api, muting and unmuting all
+ *        the channels of a 256 channel status array, against the per-channel
+ *        helpers.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/audio_ch_status_mirror.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+AudioChStatus status[AUDIO_CH_STATUS_MAX_CHANNELS];
+AudioChStatusMirror mirror(status, AUDIO_CH_STATUS_MAX_CHANNELS);
+bool muted = false;
+
+BENCHMARK_ITEMS("ch_status/set_audio_ch_mute", AUDIO_CH_STATUS_MAX_CHANNELS, [] {
+    bench::clobber_memory();
+    muted = !muted;
+    bool changed = set_audio_ch_mute(status, 0, AUDIO_CH_STATUS_MAX_CHANNELS, muted);
+    bench::do_not_optimize(changed);
+});
+
+BENCHMARK_ITEMS("ch_status/mirror/set_mute", AUDIO_CH_STATUS_MAX_CHANNELS, [] {
+    bench::clobber_memory();
+    muted = !muted;
+    AudioChMask changed = mirror.set_mute(0, AUDIO_CH_STATUS_MAX_CHANNELS, muted);
+    bench::do_not_optimize(changed);
+});
+
+BENCHMARK_ITEMS("ch_status/mirror/resync", AUDIO_CH_STATUS_MAX_CHANNELS, [] {
+    bench::clobber_memory();
+    const AudioChMask& unmuted = mirror.resync();
+    bench::do_not_optimize(unmuted);
+});
+
+} // anonymous namespace
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the channel layout plan, converting one 64 frame
+ *        period between the hardware buffer and planar float buffers.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <vector>
+
+#include "audio_control_protocol/channel_layout_plan.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace device_ctrl;
+
+constexpr int NUM_FRAMES = 64;
+
+class LayoutFixture
+{
+public:
+    LayoutFixture(int num_channels, bool interleaved) : _hw_buffer(num_channels * NUM_FRAMES),
+                                                        _channels(num_channels, std::vector<float>(NUM_FRAMES))
+    {
+        std::vector<audio_channel_info_data> infos(num_channels);
+        for (int ch = 0; ch < num_channels; ch++)
+        {
+            infos[ch] = {};
+            infos[ch].sw_ch_id = static_cast<uint8_t>(ch);
+            infos[ch].hw_ch_id = static_cast<uint8_t>(ch);
+            infos[ch].direction = INPUT_DIRECTION;
+            infos[ch].sample_format = INT24_LJ;
+            infos[ch].start_offset_in_words = interleaved ? ch : ch * NUM_FRAMES;
+            infos[ch].stride_in_words = interleaved ? num_channels : 1;
+            _channel_ptrs.push_back(_channels[ch].data());
+        }
+        for (size_t i = 0; i < _hw_buffer.size(); i++)
+        {
+            _hw_buffer[i] = static_cast<int32_t>(i * 2654435761u) & 0xFFFFFF00;
+        }
+        _plan.compile(infos.data(), num_channels, INPUT_DIRECTION);
+    }
+
+    void deinterleave()
+    {
+        bench::clobber_memory();
+        _plan.deinterleave(_hw_buffer.data(), _channel_ptrs.data(), NUM_FRAMES);
+        bench::do_not_optimize(_channels[0][0]);
+    }
+
+    void interleave()
+    {
+        bench::clobber_memory();
+        _plan.interleave(_channel_ptrs.data(), _hw_buffer.data(), NUM_FRAMES);
+        bench::do_not_optimize(_hw_buffer[0]);
+    }
+
+private:
+    ChannelLayoutPlan _plan;
+    std::vector<int32_t> _hw_buffer;
+    std::vector<std::vector<float>> _channels;
+    std::vector<float*> _channel_ptrs;
+};
+
+LayoutFixture stereo(2, true);
+LayoutFixture eight_channels(8, true);
+LayoutFixture sixteen_channels(16, true);
+LayoutFixture many_channels(64, true);
+LayoutFixture strided_channels(64, false);
+
+BENCHMARK("channel_layout/deinterleave/2ch", [] { stereo.deinterleave(); });
+BENCHMARK("channel_layout/deinterleave/8ch", [] { eight_channels.deinterleave(); });
+BENCHMARK("channel_layout/deinterleave/16ch", [] { sixteen_channels.deinterleave(); });
+BENCHMARK("channel_layout/deinterleave/64ch", [] { many_channels.deinterleave(); });
+BENCHMARK("channel_layout/deinterleave/64ch_strided", [] { strided_channels.deinterleave(); });
+
+BENCHMARK("channel_layout/interleave/2ch", [] { stereo.interleave(); });
+BENCHMARK("channel_layout/interleave/8ch", [] { eight_channels.interleave(); });
+BENCHMARK("channel_layout/interleave/16ch", [] { sixteen_channels.interleave(); });
+BENCHMARK("channel_layout/interleave/64ch", [] { many_channels.interleave(); });
+BENCHMARK("channel_layout/interleave/64ch_strided", [] { strided_channels.interleave(); });
+
+} // anonymous namespace
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the packet crc kernels. Computing or verifying the crc
+ *        of an audio control packet should stay well below 100 ns.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/audio_packet_helper.h"
+#include "audio_control_protocol/device_packet_helper.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+AudioCtrlPkt make_audio_pkt()
+{
+    AudioCtrlPkt pkt;
+    uint8_t midi_data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    for (int i = 0; i < AUDIO_CTRL_PKT_PAYLOAD_SIZE; i++)
+    {
+        midi_data[i] = static_cast<uint8_t>(i);
+    }
+    prepare_midi_data_pkt(&pkt, midi_data, AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+    pkt.seq = 1234;
+    set_audio_pkt_crc(&pkt);
+    return pkt;
+}
+
+device_ctrl::device_ctrl_pkt make_device_pkt()
+{
+    device_ctrl::device_ctrl_pkt pkt;
+    device_ctrl::prepare_ping_cmd_query_pkt(&pkt, 0xdeadbeef);
+    device_ctrl::set_device_pkt_crc(&pkt);
+    return pkt;
+}
+
+AudioCtrlPkt audio_pkt = make_audio_pkt();
+device_ctrl::device_ctrl_pkt device_pkt = make_device_pkt();
+
+template <uint32_t (*kernel)(uint32_t, const uint8_t*, uint32_t)>
+void crc_kernel_bench()
+{
+    bench::clobber_memory();
+    uint32_t crc = kernel(PKT_CRC32C_INIT, reinterpret_cast<const uint8_t*>(&audio_pkt),
+                          AUDIO_CTRL_PKT_CRC_OFFSET);
+    bench::do_not_optimize(crc);
+}
+
+BENCHMARK("crc/kernel/portable", crc_kernel_bench<pkt_crc32c_update_portable>);
+BENCHMARK("crc/kernel/slice8", crc_kernel_bench<pkt_crc32c_update_slice8>);
+#if defined(PKT_CRC_HW_DISPATCH)
+// Only registered if the cpu has the crc32 instruction
+const bool hw_kernel_registered = pkt_crc_cpu_has_hw() &&
+                                  (bench::BenchmarkRegistrar("crc/kernel/hw", crc_kernel_bench<pkt_crc32c_update_hw>),
+                                   true);
+#elif defined(PKT_CRC_HAS_HW_KERNEL)
+BENCHMARK("crc/kernel/hw", crc_kernel_bench<pkt_crc32c_update_hw>);
+#endif
+// The kernel selected by pkt_crc32c_update(), at run time with PKT_CRC_HW_DISPATCH
+BENCHMARK("crc/kernel/default", crc_kernel_bench<pkt_crc32c_update>);
+
+BENCHMARK("crc/set_audio_pkt_crc", [] {
+    bench::clobber_memory();
+    set_audio_pkt_crc(&audio_pkt);
+    bench::do_not_optimize(audio_pkt.crc);
+});
+
+BENCHMARK("crc/check_audio_pkt_crc", [] {
+    bench::clobber_memory();
+    int valid = check_audio_pkt_crc(&audio_pkt);
+    bench::do_not_optimize(valid);
+});
+
+BENCHMARK("crc/check_device_pkt_crc", [] {
+    bench::clobber_memory();
+    int valid = device_ctrl::check_device_pkt_crc(&device_pkt);
+    bench::do_not_optimize(valid);
+});
+
+} // anonymous namespace
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the gain ramp processor on a 64 channel, 64 frame
+ *        period, with all the channels stable or all of them ramping.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <vector>
+
+#include "audio_control_protocol/gain_ramp_processor.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_CHANNELS = 64;
+constexpr int NUM_FRAMES = 64;
+constexpr int RAMP_LENGTH = 1 << 30;    // Long enough to never complete
+
+class RampFixture
+{
+public:
+    RampFixture(GainRampShape shape, bool ramping) : _processor(NUM_CHANNELS, ramping ? RAMP_LENGTH : 1, shape),
+                                                     _channels(NUM_CHANNELS, std::vector<float>(NUM_FRAMES, 0.5f))
+    {
+        for (auto& channel : _channels)
+        {
+            _channel_ptrs.push_back(channel.data());
+        }
+        _processor.set_unmuted_channels(make_audio_ch_mask(0, NUM_CHANNELS));
+        _processor.process(_channel_ptrs.data(), NUM_FRAMES);
+    }
+
+    void process()
+    {
+        bench::clobber_memory();
+        _processor.process(_channel_ptrs.data(), NUM_FRAMES);
+        bench::do_not_optimize(_channels[0][0]);
+    }
+
+private:
+    GainRampProcessor _processor;
+    std::vector<std::vector<float>> _channels;
+    std::vector<float*> _channel_ptrs;
+};
+
+RampFixture stable(GainRampShape::LINEAR, false);
+RampFixture linear_ramps(GainRampShape::LINEAR, true);
+RampFixture equal_power_ramps(GainRampShape::EQUAL_POWER, true);
+
+BENCHMARK("gain_ramp/64ch/stable", [] { stable.process(); });
+BENCHMARK("gain_ramp/64ch/linear", [] { linear_ramps.process(); });
+BENCHMARK("gain_ramp/64ch/equal_power", [] { equal_power_ramps.process(); });
+
+} // anonymous namespace
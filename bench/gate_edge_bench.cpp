@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the gate edge detector with all 16 gates unchanged and
+ *        toggling every packet, with and without edge offsets.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/gate_edge_detector.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_GATES = AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES;
+
+// Edges spread in reverse gate order, so that all of them are reordered
+AudioCtrlPkt make_gate_pkt()
+{
+    AudioCtrlPkt pkt;
+    create_default_audio_ctrl_pkt(&pkt);
+    for (int gate = 0; gate < NUM_GATES; gate++)
+    {
+        set_gate_in_edge_offset(&pkt, gate, AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS - 1 - gate);
+    }
+    return pkt;
+}
+
+AudioCtrlPkt gate_pkt = make_gate_pkt();
+GateEdgeDetector detector;
+GateEdgeDetector offset_detector(64);
+GateEdgeEvent events[GateEdgeDetector::MAX_EVENTS];
+
+BENCHMARK_ITEMS("gate_edge/unchanged", NUM_GATES, [] {
+    bench::clobber_memory();
+    bench::do_not_optimize(detector.process(&gate_pkt, events));
+});
+
+BENCHMARK_ITEMS("gate_edge/all_toggle", NUM_GATES, [] {
+    bench::clobber_memory();
+    gate_pkt.gate_in ^= 0xFFFF;
+    bench::do_not_optimize(detector.process(&gate_pkt, events));
+});
+
+BENCHMARK_ITEMS("gate_edge/all_toggle_offsets", NUM_GATES, [] {
+    bench::clobber_memory();
+    gate_pkt.gate_in ^= 0xFFFF;
+    bench::do_not_optimize(offset_detector.process(&gate_pkt, events));
+});
+
+} // anonymous namespace
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the gpio blob scheduler, submitting blobs and packing
+ *        them with 64 blob ids of mixed priorities.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/gpio_blob_scheduler.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_BLOB_IDS = 64;
+
+GpioBlobScheduler<NUM_BLOB_IDS> scheduler(4);
+AudioCtrlPkt gpio_pkt;
+GpioDataBlob blob = {};
+
+BENCHMARK_ITEMS("gpio_scheduler/submit", 1, [] {
+    bench::clobber_memory();
+    blob.data[0]++;
+    bench::do_not_optimize(scheduler.submit(blob.data[0] % NUM_BLOB_IDS, blob));
+});
+
+BENCHMARK_ITEMS("gpio_scheduler/pack/empty", 1, [] {
+    bench::clobber_memory();
+    bench::do_not_optimize(scheduler.pack(&gpio_pkt));
+});
+
+BENCHMARK_ITEMS("gpio_scheduler/pack/16_pending", AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS, [] {
+    bench::clobber_memory();
+    scheduler.clear();
+    for (int id = 0; id < NUM_BLOB_IDS; id += 4)
+    {
+        scheduler.submit(id, blob, static_cast<GpioBlobPriority>(id % 3));
+    }
+    bench::do_not_optimize(scheduler.pack(&gpio_pkt));
+});
+
+} // anonymous namespace
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the gpio change detector on packets with 3 blobs,
+ *        unchanged and with a changed byte, against memcmp of each blob.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cstring>
+
+#include "audio_control_protocol/gpio_change_detector.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_BLOBS = AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS;
+
+AudioCtrlPkt make_gpio_pkt()
+{
+    AudioCtrlPkt pkt;
+    create_default_audio_ctrl_pkt(&pkt);
+    prepare_gpio_cmd_pkt(&pkt, NUM_BLOBS);
+    return pkt;
+}
+
+AudioCtrlPkt gpio_pkt = make_gpio_pkt();
+GpioDataBlob last_blobs[NUM_BLOBS] = {};
+GpioChangeDetector byte_detector(GpioChangeGranularity::BYTE);
+GpioChangeDetector bit_detector(GpioChangeGranularity::BIT);
+GpioChangeEvent events[NUM_BLOBS * AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE * 8];
+
+BENCHMARK_ITEMS("gpio_change/memcmp/unchanged", NUM_BLOBS, [] {
+    bench::clobber_memory();
+    int num_changed = 0;
+    for (int blob = 0; blob < check_for_gpio_data(&gpio_pkt); blob++)
+    {
+        num_changed += std::memcmp(&gpio_pkt.payload.gpio_data_blob[blob], &last_blobs[blob], sizeof(GpioDataBlob)) != 0;
+    }
+    bench::do_not_optimize(num_changed);
+});
+
+BENCHMARK_ITEMS("gpio_change/detector/unchanged", NUM_BLOBS, [] {
+    bench::clobber_memory();
+    int num_events = byte_detector.process(&gpio_pkt, events, NUM_BLOBS * AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE);
+    bench::do_not_optimize(num_events);
+});
+
+BENCHMARK_ITEMS("gpio_change/detector/byte_changed", NUM_BLOBS, [] {
+    bench::clobber_memory();
+    gpio_pkt.payload.gpio_data_blob[1].data[7]++;
+    int num_events = byte_detector.process(&gpio_pkt, events, NUM_BLOBS * AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE);
+    bench::do_not_optimize(num_events);
+});
+
+BENCHMARK_ITEMS("gpio_change/detector/bit_changed", NUM_BLOBS, [] {
+    bench::clobber_memory();
+    gpio_pkt.payload.gpio_data_blob[2].data[30] ^= 0x10;
+    int num_events = bit_detector.process(&gpio_pkt, events, NUM_BLOBS * AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE * 8);
+    bench::do_not_optimize(num_events);
+});
+
+} // anonymous namespace
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the midi aggregator, pushing messages and draining
+ *        heavy controller traffic into a packet.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/midi_aggregator.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_CC_MSGS = 64;
+
+MidiAggregator<1024> aggregator;
+AudioCtrlPkt midi_pkt;
+
+BENCHMARK_ITEMS("midi_aggregator/push_drain/note", 1, [] {
+    bench::clobber_memory();
+    aggregator.push(0x90, 60, 100);
+    bench::do_not_optimize(aggregator.drain(&midi_pkt));
+});
+
+// 2 values for each of 16 controllers on 2 channels, half of them superseded
+BENCHMARK_ITEMS("midi_aggregator/push_drain/64_cc", NUM_CC_MSGS, [] {
+    bench::clobber_memory();
+    for (int i = 0; i < NUM_CC_MSGS; i++)
+    {
+        aggregator.push(0xB0 | (i & 1), (i >> 1) & 0x0F, i);
+    }
+    bench::do_not_optimize(aggregator.drain(&midi_pkt));
+});
+
+} // anonymous namespace
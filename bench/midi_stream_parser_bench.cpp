@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the midi stream parser on full midi packets of
+ *        notes, running status notes and SysEx with interleaved realtime bytes.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/audio_packet_helper.h"
+#include "audio_control_protocol/midi_stream_parser.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_NOTES = AUDIO_CTRL_PKT_PAYLOAD_SIZE / 3;
+constexpr int NUM_RUNNING_STATUS_NOTES = (AUDIO_CTRL_PKT_PAYLOAD_SIZE - 1) / 2;
+
+MidiStreamParser parser;
+MidiMessage msgs[MIDI_STREAM_PARSER_MAX_MSGS];
+
+AudioCtrlPkt make_notes_pkt()
+{
+    AudioCtrlPkt pkt;
+    uint8_t data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    for (int i = 0; i < NUM_NOTES; i++)
+    {
+        data[3 * i] = 0x90;
+        data[3 * i + 1] = i & 0x7F;
+        data[3 * i + 2] = 100;
+    }
+    prepare_midi_data_pkt(&pkt, data, NUM_NOTES * 3);
+    return pkt;
+}
+
+AudioCtrlPkt make_running_status_pkt()
+{
+    AudioCtrlPkt pkt;
+    uint8_t data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    data[0] = 0x90;
+    for (int i = 0; i < NUM_RUNNING_STATUS_NOTES; i++)
+    {
+        data[2 * i + 1] = i & 0x7F;
+        data[2 * i + 2] = 100;
+    }
+    prepare_midi_data_pkt(&pkt, data, NUM_RUNNING_STATUS_NOTES * 2 + 1);
+    return pkt;
+}
+
+// A SysEx filling the packet, with a timing clock every 16 bytes
+AudioCtrlPkt make_sysex_pkt()
+{
+    AudioCtrlPkt pkt;
+    uint8_t data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    for (int i = 0; i < AUDIO_CTRL_PKT_PAYLOAD_SIZE; i++)
+    {
+        data[i] = (i % 16 == 15) ? 0xF8 : (i & 0x7F);
+    }
+    data[0] = 0xF0;
+    data[AUDIO_CTRL_PKT_PAYLOAD_SIZE - 1] = 0xF7;
+    prepare_midi_data_pkt(&pkt, data, AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+    return pkt;
+}
+
+AudioCtrlPkt notes_pkt = make_notes_pkt();
+AudioCtrlPkt running_status_pkt = make_running_status_pkt();
+AudioCtrlPkt sysex_pkt = make_sysex_pkt();
+
+BENCHMARK_ITEMS("midi_stream_parser/parse/notes", NUM_NOTES, [] {
+    bench::clobber_memory();
+    bench::do_not_optimize(parser.parse(&notes_pkt, msgs, MIDI_STREAM_PARSER_MAX_MSGS));
+});
+
+BENCHMARK_ITEMS("midi_stream_parser/parse/running_status", NUM_RUNNING_STATUS_NOTES, [] {
+    bench::clobber_memory();
+    bench::do_not_optimize(parser.parse(&running_status_pkt, msgs, MIDI_STREAM_PARSER_MAX_MSGS));
+});
+
+BENCHMARK_ITEMS("midi_stream_parser/parse/sysex", AUDIO_CTRL_PKT_PAYLOAD_SIZE, [] {
+    bench::clobber_memory();
+    bench::do_not_optimize(parser.parse(&sysex_pkt, msgs, MIDI_STREAM_PARSER_MAX_MSGS));
+});
+
+} // anonymous namespace
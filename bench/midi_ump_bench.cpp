@@ -0,0 +1,80 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Benchmarks of the UMP helpers, walking a full MIDI_UMP_DATA packet
+ *        and translating controllers between MIDI 1.0 and MIDI 2.0.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/midi_ump_helper.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+constexpr int NUM_CC_MSGS = AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS / 2;
+
+// MIDI 2.0 control changes filling the packet
+AudioCtrlPkt make_ump_pkt()
+{
+    AudioCtrlPkt pkt;
+    prepare_midi_ump_data_pkt(&pkt, nullptr, 0);
+    for (int i = 0; i < NUM_CC_MSGS; i++)
+    {
+        uint8_t cc[3] = {0xB0, static_cast<uint8_t>(i), static_cast<uint8_t>(4 * i)};
+        uint32_t words[2];
+        midi1_to_ump_midi2(0, cc, 3, words);
+        add_ump_message(&pkt, words);
+    }
+    return pkt;
+}
+
+AudioCtrlPkt ump_pkt = make_ump_pkt();
+uint8_t midi_data[UMP_MIDI1_MAX_SIZE];
+
+BENCHMARK_ITEMS("midi_ump/walk/14_cc", NUM_CC_MSGS, [] {
+    bench::clobber_memory();
+    int offset = 0;
+    int num_words;
+    uint32_t sum = 0;
+    while (const uint32_t* message = next_ump_message(&ump_pkt, &offset, &num_words))
+    {
+        sum += message[num_words - 1];
+    }
+    bench::do_not_optimize(sum);
+});
+
+BENCHMARK_ITEMS("midi_ump/to_midi1/14_cc", NUM_CC_MSGS, [] {
+    bench::clobber_memory();
+    int offset = 0;
+    int num_words;
+    int num_bytes = 0;
+    while (const uint32_t* message = next_ump_message(&ump_pkt, &offset, &num_words))
+    {
+        num_bytes += ump_to_midi1(message, midi_data);
+    }
+    bench::do_not_optimize(num_bytes);
+});
+
+BENCHMARK_ITEMS("midi_ump/from_midi1/14_cc", NUM_CC_MSGS, [] {
+    bench::clobber_memory();
+    ump_pkt = make_ump_pkt();
+    bench::do_not_optimize(ump_pkt);
+});
+
+} // anonymous namespace
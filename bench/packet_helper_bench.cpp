@@ -0,0 +1,263 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Hot and cold cache benchmarks of every prepare_, check_ and get_
+ *        helper of the audio and device control packets and of the audio
+ *        channel status.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/audio_ch_status_helper.h"
+#include "audio_control_protocol/audio_packet_helper.h"
+#include "audio_control_protocol/device_packet_helper.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+using namespace device_ctrl;
+
+uint8_t midi_bytes[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+uint32_t ump_words[AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS];
+uint8_t raw_bytes[DEVICE_CTRL_PKT_PAYLOAD_SIZE];
+system_info_data system_info = {};
+audio_channel_info_data channel_info = {};
+device_rgb_led_val led_val = {255, 1, 2, 3};
+
+// A cache line of channel status entries
+struct ChStatusLine
+{
+    AudioChStatus ch_status[16];
+};
+
+// Packets of a given kind, to run the check_ and get_ helpers on
+void init_midi_pkt(AudioCtrlPkt* pkt) { prepare_midi_data_pkt(pkt, midi_bytes, AUDIO_CTRL_PKT_PAYLOAD_SIZE); }
+void init_ump_pkt(AudioCtrlPkt* pkt) { prepare_midi_ump_data_pkt(pkt, ump_words, AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS); }
+void init_gate_edge_pkt(AudioCtrlPkt* pkt)
+{
+    create_default_audio_ctrl_pkt(pkt);
+    pkt->gate_in = 0xFF;
+    for (int gate = 0; gate < AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES; gate++)
+    {
+        set_gate_in_edge_offset(pkt, gate, gate % AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS);
+    }
+}
+void init_mute_pkt(AudioCtrlPkt* pkt) { prepare_audio_mute_pkt(pkt, 1); }
+void init_gpio_pkt(AudioCtrlPkt* pkt) { prepare_gpio_cmd_pkt(pkt, AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS); }
+void init_audio_pkt(AudioCtrlPkt* pkt) { create_default_audio_ctrl_pkt(pkt); }
+void init_ch_status(ChStatusLine* line) { init_audio_ch_status(line->ch_status, 0, 16); }
+void init_ping_pkt(device_ctrl_pkt* pkt) { prepare_ping_cmd_query_pkt(pkt, 1234); }
+void init_version_pkt(device_ctrl_pkt* pkt) { prepare_version_check_reply_pkt(pkt, 1, 2, 3); }
+void init_system_info_pkt(device_ctrl_pkt* pkt) { prepare_system_info_cmd_reply_pkt(pkt, &system_info); }
+void init_channel_info_pkt(device_ctrl_pkt* pkt) { prepare_audio_channel_info_cmd_reply_pkt(pkt, &channel_info); }
+void init_start_pkt(device_ctrl_pkt* pkt) { prepare_start_cmd_pkt(pkt, 64); }
+void init_gain_pkt(device_ctrl_pkt* pkt) { prepare_change_input_gain_cmd_pkt(pkt, 10, 1); }
+void init_hp_vol_pkt(device_ctrl_pkt* pkt) { prepare_change_hp_vol_cmd_pkt(pkt, 10); }
+void init_led_pkt(device_ctrl_pkt* pkt) { prepare_set_rgb_led_val_cmd(pkt, 1, &led_val); }
+void init_midi_mode_pkt(device_ctrl_pkt* pkt) { prepare_midi_mode_cmd_query_pkt(pkt, DEVICE_MIDI_MODE_UMP); }
+void init_raw_pkt(device_ctrl_pkt* pkt) { prepare_raw_data_cmd_pkt(pkt, 0, raw_bytes, DEVICE_CTRL_PKT_PAYLOAD_SIZE); }
+void init_device_pkt(device_ctrl_pkt* pkt) { create_default_device_ctrl_pkt(pkt); }
+
+// Cost of the benchmark loop itself, e.g. the fence of the cold cache version
+PACKET_BENCHMARK("baseline", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt*) { return 0; });
+
+// Audio control packets
+PACKET_BENCHMARK("audio/clear_audio_ctrl_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    clear_audio_ctrl_pkt(pkt);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("audio/create_default_audio_ctrl_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    create_default_audio_ctrl_pkt(pkt);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("audio/check_audio_pkt_for_magic_words", AudioCtrlPkt, init_audio_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_audio_pkt_for_magic_words(pkt); });
+PACKET_BENCHMARK("audio/prepare_audio_mute_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    prepare_audio_mute_pkt(pkt, 1);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("audio/check_for_audio_mute_cmd", AudioCtrlPkt, init_mute_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_for_audio_mute_cmd(pkt); });
+PACKET_BENCHMARK("audio/prepare_audio_unmute_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    prepare_audio_unmute_pkt(pkt, 1);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("audio/check_for_audio_unmute_cmd", AudioCtrlPkt, init_mute_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_for_audio_unmute_cmd(pkt); });
+PACKET_BENCHMARK("audio/prepare_audio_cease_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    prepare_audio_cease_pkt(pkt, 1);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("audio/check_for_audio_cease_cmd", AudioCtrlPkt, init_mute_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_for_audio_cease_cmd(pkt); });
+PACKET_BENCHMARK("audio/prepare_gpio_cmd_pkt", AudioCtrlPkt, init_audio_pkt,
+                 [](AudioCtrlPkt* pkt) { return prepare_gpio_cmd_pkt(pkt, AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS); });
+PACKET_BENCHMARK("audio/check_for_gpio_data", AudioCtrlPkt, init_gpio_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_for_gpio_data(pkt); });
+PACKET_BENCHMARK("audio/prepare_midi_data_pkt", AudioCtrlPkt, init_audio_pkt,
+                 [](AudioCtrlPkt* pkt) { return prepare_midi_data_pkt(pkt, midi_bytes, AUDIO_CTRL_PKT_PAYLOAD_SIZE); });
+PACKET_BENCHMARK("audio/check_for_midi_data", AudioCtrlPkt, init_midi_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_for_midi_data(pkt); });
+PACKET_BENCHMARK("audio/get_midi_data", AudioCtrlPkt, init_midi_pkt, [](AudioCtrlPkt* pkt) {
+    static uint8_t dest[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    return get_midi_data(pkt, dest, 0, AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+});
+PACKET_BENCHMARK("audio/prepare_midi_ump_data_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    return prepare_midi_ump_data_pkt(pkt, ump_words, AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS);
+});
+PACKET_BENCHMARK("audio/check_for_midi_ump_data", AudioCtrlPkt, init_ump_pkt,
+                 [](AudioCtrlPkt* pkt) { return check_for_midi_ump_data(pkt); });
+PACKET_BENCHMARK("audio/get_midi_ump_data", AudioCtrlPkt, init_ump_pkt, [](AudioCtrlPkt* pkt) {
+    static uint32_t dest[AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS];
+    return get_midi_ump_data(pkt, dest, 0, AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS);
+});
+PACKET_BENCHMARK("audio/get_timing_error", AudioCtrlPkt, init_midi_pkt,
+                 [](AudioCtrlPkt* pkt) { return get_timing_error(pkt); });
+PACKET_BENCHMARK("audio/get_gate_out_val", AudioCtrlPkt, init_midi_pkt,
+                 [](AudioCtrlPkt* pkt) { return get_gate_out_val(pkt); });
+PACKET_BENCHMARK("audio/get_gate_in_val", AudioCtrlPkt, init_midi_pkt,
+                 [](AudioCtrlPkt* pkt) { return get_gate_in_val(pkt); });
+PACKET_BENCHMARK("audio/get_gate_in_edge_offset", AudioCtrlPkt, init_gate_edge_pkt,
+                 [](AudioCtrlPkt* pkt) { return get_gate_in_edge_offset(pkt, AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES - 1); });
+
+// Audio channel status
+PACKET_BENCHMARK("ch_status/get_audio_ch_mute", ChStatusLine, init_ch_status,
+                 [](ChStatusLine* line) { return get_audio_ch_mute(line->ch_status, 7); });
+
+// Device control packets
+PACKET_BENCHMARK("device/clear_device_ctrl_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    clear_device_ctrl_pkt(pkt);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/create_default_device_ctrl_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    create_default_device_ctrl_pkt(pkt);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_device_pkt_for_magic_words", device_ctrl_pkt, init_device_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_device_pkt_for_magic_words(pkt); });
+PACKET_BENCHMARK("device/check_device_pkt_for_null_cmd", device_ctrl_pkt, init_device_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_device_pkt_for_null_cmd(pkt); });
+PACKET_BENCHMARK("device/prepare_version_check_query_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_version_check_query_pkt(pkt);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/prepare_version_check_reply_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_version_check_reply_pkt(pkt, 1, 2, 3);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_version_check_cmd", device_ctrl_pkt, init_version_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_version_check_cmd(pkt); });
+PACKET_BENCHMARK("device/check_if_fw_vers_matches", device_ctrl_pkt, init_version_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_if_fw_vers_matches(pkt, 1, 2); });
+PACKET_BENCHMARK("device/get_board_vers", device_ctrl_pkt, init_version_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_board_vers(pkt); });
+PACKET_BENCHMARK("device/prepare_ping_cmd_query_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_ping_cmd_query_pkt(pkt, 1234);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/prepare_ping_cmd_reply_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_ping_cmd_reply_pkt(pkt, 1234);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_ping_cmd_pkt", device_ctrl_pkt, init_ping_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_ping_cmd_pkt(pkt); });
+PACKET_BENCHMARK("device/get_ping_code", device_ctrl_pkt, init_ping_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_ping_code(pkt); });
+PACKET_BENCHMARK("device/prepare_system_info_cmd_query_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_system_info_cmd_query_pkt(pkt);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/prepare_system_info_cmd_reply_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_system_info_cmd_reply_pkt(pkt, &system_info);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_system_info_cmd_pkt", device_ctrl_pkt, init_system_info_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_system_info_cmd_pkt(pkt); });
+PACKET_BENCHMARK("device/get_system_info_data", device_ctrl_pkt, init_system_info_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_system_info_data(pkt)->sampling_rate; });
+PACKET_BENCHMARK("device/prepare_audio_channel_info_cmd_query_pkt", device_ctrl_pkt, init_device_pkt,
+                 [](device_ctrl_pkt* pkt) {
+                     prepare_audio_channel_info_cmd_query_pkt(pkt, 64, 1, INPUT_DIRECTION);
+                     return pkt->device_cmd;
+                 });
+PACKET_BENCHMARK("device/prepare_audio_channel_info_cmd_reply_pkt", device_ctrl_pkt, init_device_pkt,
+                 [](device_ctrl_pkt* pkt) {
+                     prepare_audio_channel_info_cmd_reply_pkt(pkt, &channel_info);
+                     return pkt->device_cmd;
+                 });
+PACKET_BENCHMARK("device/check_for_audio_channel_info_cmd", device_ctrl_pkt, init_channel_info_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_audio_channel_info_cmd(pkt); });
+PACKET_BENCHMARK("device/get_audio_channel_info_req", device_ctrl_pkt, init_channel_info_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_audio_channel_info_req(pkt)->sw_ch_id; });
+PACKET_BENCHMARK("device/get_audio_channel_info_data", device_ctrl_pkt, init_channel_info_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_audio_channel_info_data(pkt)->stride_in_words; });
+PACKET_BENCHMARK("device/prepare_start_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_start_cmd_pkt(pkt, 64);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_start_cmd", device_ctrl_pkt, init_start_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_start_cmd(pkt); });
+PACKET_BENCHMARK("device/prepare_stop_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_stop_cmd_pkt(pkt);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_stop_cmd", device_ctrl_pkt, init_start_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_stop_cmd(pkt); });
+PACKET_BENCHMARK("device/prepare_change_input_gain_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_change_input_gain_cmd_pkt(pkt, 10, 1);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_change_input_gain_cmd_pkt", device_ctrl_pkt, init_gain_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_change_input_gain_cmd_pkt(pkt); });
+PACKET_BENCHMARK("device/get_change_input_gain_data", device_ctrl_pkt, init_gain_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_change_input_gain_data(pkt)->gain_val; });
+PACKET_BENCHMARK("device/prepare_change_hp_vol_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_change_hp_vol_cmd_pkt(pkt, 10);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_change_hp_vol_cmd_pkt", device_ctrl_pkt, init_hp_vol_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_change_hp_vol_cmd_pkt(pkt); });
+PACKET_BENCHMARK("device/get_change_hp_vol_data", device_ctrl_pkt, init_hp_vol_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_change_hp_vol_data(pkt); });
+PACKET_BENCHMARK("device/prepare_set_rgb_led_val_cmd", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_set_rgb_led_val_cmd(pkt, 1, &led_val);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_rgb_led_val_cmd_pkt", device_ctrl_pkt, init_led_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_rgb_led_val_cmd_pkt(pkt); });
+PACKET_BENCHMARK("device/get_rgb_led_data", device_ctrl_pkt, init_led_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_rgb_led_data(pkt)->rgb_led_id; });
+PACKET_BENCHMARK("device/prepare_midi_mode_cmd_query_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_midi_mode_cmd_query_pkt(pkt, DEVICE_MIDI_MODE_UMP);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/prepare_midi_mode_cmd_reply_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_midi_mode_cmd_reply_pkt(pkt, DEVICE_MIDI_MODE_UMP);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_midi_mode_cmd_pkt", device_ctrl_pkt, init_midi_mode_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_midi_mode_cmd_pkt(pkt); });
+PACKET_BENCHMARK("device/get_midi_mode_data", device_ctrl_pkt, init_midi_mode_pkt,
+                 [](device_ctrl_pkt* pkt) { return get_midi_mode_data(pkt); });
+PACKET_BENCHMARK("device/prepare_raw_data_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    prepare_raw_data_cmd_pkt(pkt, 0, raw_bytes, DEVICE_CTRL_PKT_PAYLOAD_SIZE);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("device/check_for_raw_data_cmd", device_ctrl_pkt, init_raw_pkt,
+                 [](device_ctrl_pkt* pkt) { return check_for_raw_data_cmd(pkt); });
+
+} // anonymous namespace
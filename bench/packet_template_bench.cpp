@@ -0,0 +1,103 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+
+/**
+ * @brief Benchmarks of the template patch builders, to be compared with the
+ *        prepare_ helpers in packet_helper_bench.cpp.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/audio_packet_templates.h"
+#include "audio_control_protocol/device_packet_templates.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+using namespace device_ctrl;
+
+uint8_t midi_bytes[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+uint32_t ump_words[AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS];
+GpioDataBlob gpio_blobs[AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS] = {};
+AudioPktFields fields = {1, 2, 3, 4, 0};
+
+const AudioPktTemplateCache& audio_templates()
+{
+    static const AudioPktTemplateCache cache = [] {
+        AudioPktTemplateCache c;
+        init_audio_pkt_template_cache(&c);
+        return c;
+    }();
+    return cache;
+}
+
+const device_pkt_template_cache& device_templates()
+{
+    static const device_pkt_template_cache cache = [] {
+        device_pkt_template_cache c;
+        init_device_pkt_template_cache(&c);
+        return c;
+    }();
+    return cache;
+}
+
+void init_audio_pkt(AudioCtrlPkt* pkt) { create_default_audio_ctrl_pkt(pkt); }
+void init_device_pkt(device_ctrl_pkt* pkt) { create_default_device_ctrl_pkt(pkt); }
+
+PACKET_BENCHMARK("template/patch_audio_null_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    patch_audio_null_pkt(&audio_templates(), pkt, 1, 2);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("template/patch_audio_mute_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    patch_audio_mute_pkt(&audio_templates(), pkt, 1);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("template/patch_audio_unmute_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    patch_audio_unmute_pkt(&audio_templates(), pkt, 1);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("template/patch_audio_cease_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    patch_audio_cease_pkt(&audio_templates(), pkt, 1);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("template/patch_gpio_cmd_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    return patch_gpio_cmd_pkt(&audio_templates(), pkt, gpio_blobs, AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS);
+});
+PACKET_BENCHMARK("template/patch_midi_data_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    return patch_midi_data_pkt(&audio_templates(), pkt, midi_bytes, AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+});
+PACKET_BENCHMARK("template/patch_midi_ump_data_pkt", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    return patch_midi_ump_data_pkt(&audio_templates(), pkt, ump_words, AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS);
+});
+PACKET_BENCHMARK("template/update_audio_pkt_fields", AudioCtrlPkt, init_audio_pkt, [](AudioCtrlPkt* pkt) {
+    update_audio_pkt_fields(pkt, &fields, AUDIO_PKT_FIELD_SEQ | AUDIO_PKT_FIELD_GATE_OUT);
+    return pkt->seq;
+});
+PACKET_BENCHMARK("template/patch_ping_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    patch_ping_cmd_pkt(&device_templates(), pkt, 1234);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("template/patch_start_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    patch_start_cmd_pkt(&device_templates(), pkt, 64);
+    return pkt->device_cmd;
+});
+PACKET_BENCHMARK("template/patch_stop_cmd_pkt", device_ctrl_pkt, init_device_pkt, [](device_ctrl_pkt* pkt) {
+    patch_stop_cmd_pkt(&device_templates(), pkt);
+    return pkt->device_cmd;
+});
+
+} // anonymous namespace
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Throughput of the sample format conversion kernels, reported in
+ *        samples/ns for every audio_sample_format.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include "audio_control_protocol/sample_format_conversion.h"
+
+#include "bench_common.h"
+
+namespace {
+
+using namespace device_ctrl;
+
+constexpr int NUM_SAMPLES = 1024;
+
+int32_t hw_buffer[NUM_SAMPLES];
+float float_buffer[NUM_SAMPLES];
+TpdfDither dither;
+
+bool init_buffers()
+{
+    for (int i = 0; i < NUM_SAMPLES; i++)
+    {
+        hw_buffer[i] = static_cast<int32_t>(i * 2654435761u);
+        float_buffer[i] = static_cast<float>(i - NUM_SAMPLES / 2) / NUM_SAMPLES;
+    }
+    init_tpdf_dither(dither, 1);
+    return true;
+}
+
+bool buffers_initialized = init_buffers();
+
+template <audio_sample_format FORMAT>
+void to_float_bench()
+{
+    bench::clobber_memory();
+    convert_to_float(FORMAT, hw_buffer, float_buffer, NUM_SAMPLES);
+    bench::do_not_optimize(float_buffer[0]);
+}
+
+template <audio_sample_format FORMAT, bool DITHER>
+void from_float_bench()
+{
+    bench::clobber_memory();
+    convert_from_float(FORMAT, float_buffer, hw_buffer, NUM_SAMPLES, DITHER ? &dither : nullptr);
+    bench::do_not_optimize(hw_buffer[0]);
+}
+
+#define SAMPLE_FORMAT_BENCHMARKS(format) \
+    BENCHMARK_ITEMS("sample_format/to_float/" #format, NUM_SAMPLES, to_float_bench<format>); \
+    BENCHMARK_ITEMS("sample_format/from_float/" #format, NUM_SAMPLES, (from_float_bench<format, false>)); \
+    BENCHMARK_ITEMS("sample_format/from_float_dither/" #format, NUM_SAMPLES, (from_float_bench<format, true>))
+
+SAMPLE_FORMAT_BENCHMARKS(INT24_LJ);
+SAMPLE_FORMAT_BENCHMARKS(INT24_I2S);
+SAMPLE_FORMAT_BENCHMARKS(INT24_RJ);
+SAMPLE_FORMAT_BENCHMARKS(INT24_32RJ);
+SAMPLE_FORMAT_BENCHMARKS(INT32);
+SAMPLE_FORMAT_BENCHMARKS(BINARY);
+
+} // anonymous namespace
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Bulk access to the audio channel status array. AudioChStatusMirror
+ *        keeps a bitset of the unmuted channels in sync with the status
+ *        array, so the mute state of all channels can be read with a few
+ *        loads, and mutes or unmutes arbitrary sets of channels with SIMD,
+ *        reporting exactly which channels changed state.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef AUDIO_CH_STATUS_MIRROR_H_
+#define AUDIO_CH_STATUS_MIRROR_H_
+
+#include <algorithm>
+
+#include "audio_ch_status_helper.h"
+#include "simd_helpers.h"
+
+namespace audio_ctrl {
+
+constexpr int AUDIO_CH_STATUS_MAX_CHANNELS = 256;
+constexpr int AUDIO_CH_MASK_NUM_WORDS = AUDIO_CH_STATUS_MAX_CHANNELS / 64;
+
+/**
+ * @brief Set of audio channels, bit n of word n / 64 represents channel n.
+ */
+struct AudioChMask
+{
+    uint64_t words[AUDIO_CH_MASK_NUM_WORDS];
+};
+
+/**
+ * @brief Get a mask of a range of channels.
+ *
+ * @param first_ch_idx The index of the first channel
+ * @param num_ch The number of channels in the range
+ * @return The mask, channels outside [0, AUDIO_CH_STATUS_MAX_CHANNELS) are ignored
+ */
+inline AudioChMask make_audio_ch_mask(int first_ch_idx, int num_ch)
+{
+    AudioChMask mask = {};
+    for (int word = 0; word < AUDIO_CH_MASK_NUM_WORDS; word++)
+    {
+        int lo = std::max(first_ch_idx - word * 64, 0);
+        int hi = std::min(first_ch_idx + num_ch - word * 64, 64);
+        if (lo < hi)
+        {
+            uint64_t upper = hi == 64 ? ~uint64_t(0) : (uint64_t(1) << hi) - 1;
+            mask.words[word] = upper & ~((uint64_t(1) << lo) - 1);
+        }
+    }
+    return mask;
+}
+
+inline bool audio_ch_mask_test(const AudioChMask& mask, int ch_idx)
+{
+    return (mask.words[ch_idx >> 6] >> (ch_idx & 63)) & 1u;
+}
+
+inline bool audio_ch_mask_any(const AudioChMask& mask)
+{
+    uint64_t any = 0;
+    for (auto word : mask.words)
+    {
+        any |= word;
+    }
+    return any != 0;
+}
+
+class AudioChStatusMirror
+{
+public:
+    /**
+     * @brief Constructs a mirror of a status array and syncs it.
+     *
+     * @param base The base address of the audio channel status array
+     * @param num_ch The number of channels, at most AUDIO_CH_STATUS_MAX_CHANNELS
+     */
+    AudioChStatusMirror(AudioChStatus* base, int num_ch) : _base(base),
+                                                           _num_ch(std::min(num_ch, AUDIO_CH_STATUS_MAX_CHANNELS))
+    {
+        resync();
+    }
+
+    /**
+     * @brief Rebuild the mirror from the status array, to be called when the
+     *        array has been written by someone else, e.g. the microcontroller.
+     *
+     * @return The set of unmuted channels
+     */
+    const AudioChMask& resync()
+    {
+        constexpr int W = simd::WIDTH;
+        _unmuted = {};
+        const int32_t* words = reinterpret_cast<const int32_t*>(_base);
+        int ch = 0;
+        for (; ch + W <= _num_ch; ch += W)
+        {
+            int bits = simd::sign_mask(simd::sll_i(simd::load_i(words + ch), 31));
+            _unmuted.words[ch >> 6] |= uint64_t(bits) << (ch & 63);
+        }
+        for (int lane = 0; lane < W && ch < _num_ch; lane++, ch++)
+        {
+            _unmuted.words[ch >> 6] |= uint64_t(_base[ch].flags & AUDIO_CH_STATUS_FLAGS_UNMUTE) << (ch & 63);
+        }
+        return _unmuted;
+    }
+
+    /**
+     * @brief Mute or unmute a set of channels. Only the parts of the status
+     *        array holding channels which change state are written.
+     *
+     * @param channels The channels to mute or unmute
+     * @param muted The mute state to be set (true to enable muting)
+     * @return The set of channels whose state was changed by the call
+     */
+    AudioChMask set_mute(const AudioChMask& channels, bool muted)
+    {
+        constexpr int W = simd::WIDTH;
+        constexpr int LANE_BITS = (1 << W) - 1;
+        AudioChMask changed = {};
+        int32_t* words = reinterpret_cast<int32_t*>(_base);
+        const simd::VecI unmute_flag = simd::set1_i(AUDIO_CH_STATUS_FLAGS_UNMUTE);
+        int ch = 0;
+        for (; ch + W <= _num_ch; ch += W)
+        {
+            int selected = static_cast<int>(channels.words[ch >> 6] >> (ch & 63)) & LANE_BITS;
+            if (selected == 0)
+            {
+                continue;
+            }
+            simd::VecI status = simd::load_i(words + ch);
+            int old_bits = simd::sign_mask(simd::sll_i(status, 31));
+            int new_bits = muted ? old_bits & ~selected : old_bits | selected;
+            if (new_bits == old_bits)
+            {
+                continue;
+            }
+            simd::VecI flip = simd::and_i(simd::lane_mask(new_bits ^ old_bits), unmute_flag);
+            simd::store_i(words + ch, simd::xor_i(status, flip));
+            changed.words[ch >> 6] |= uint64_t(new_bits ^ old_bits) << (ch & 63);
+            _unmuted.words[ch >> 6] = (_unmuted.words[ch >> 6] & ~(uint64_t(LANE_BITS) << (ch & 63))) |
+                                      (uint64_t(new_bits) << (ch & 63));
+        }
+        for (int lane = 0; lane < W && ch < _num_ch; lane++, ch++)
+        {
+            if (audio_ch_mask_test(channels, ch) == false)
+            {
+                continue;
+            }
+            uint64_t bit = uint64_t(1) << (ch & 63);
+            if (set_audio_ch_mute(_base, ch, 1, muted))
+            {
+                changed.words[ch >> 6] |= bit;
+            }
+            _unmuted.words[ch >> 6] = muted ? _unmuted.words[ch >> 6] & ~bit : _unmuted.words[ch >> 6] | bit;
+        }
+        return changed;
+    }
+
+    /**
+     * @brief Mute or unmute a range of channels, see set_mute() above.
+     */
+    AudioChMask set_mute(int first_ch_idx, int num_ch, bool muted)
+    {
+        return set_mute(make_audio_ch_mask(first_ch_idx, num_ch), muted);
+    }
+
+    /**
+     * @return The set of unmuted channels as of the last resync() or set_mute()
+     */
+    const AudioChMask& unmuted() const
+    {
+        return _unmuted;
+    }
+
+    bool is_muted(int ch_idx) const
+    {
+        return audio_ch_mask_test(_unmuted, ch_idx) == false;
+    }
+
+    int num_channels() const
+    {
+        return _num_ch;
+    }
+
+private:
+    AudioChStatus* _base;
+    int _num_ch;
+    AudioChMask _unmuted;
+};
+
+} // namespace audio_ctrl
+
+#endif // AUDIO_CH_STATUS_MIRROR_H_
@@ -32,10 +32,25 @@ namespace audio_ctrl {
 // The max number of bytes which the protocol can carry as payload. 16 byte aligned
 #define AUDIO_CTRL_PKT_PAYLOAD_SIZE 112
 
+// Flag set in cmd_lsb of MIDI_DATA packets carrying timestamped midi events,
+// see midi_timestamp_helper.h. The other bits hold the payload size in bytes.
+#define AUDIO_CTRL_MIDI_TIMESTAMPED_FLAG 0x80
+#define AUDIO_CTRL_MIDI_SIZE_MASK 0x7F
+
+// Max number of 32 bit Universal MIDI Packet words of a MIDI_UMP_DATA packet
+#define AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS (AUDIO_CTRL_PKT_PAYLOAD_SIZE / 4)
+
 // Max number of input and output cv gates that this protocol supports
 #define AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES 16
 #define AUDIO_CTRL_PKT_MAX_NUM_CV_OUT_GATES 16
 
+// Gate in edge offsets, 4 bits per gate in the reserved words, giving the
+// position of the last edge of each gate in sixteenths of the period. The
+// resolution is buffer size / 16 frames, e.g. 16 frames at 256 frame buffers
+#define AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS 4
+#define AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS (1 << AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS)
+#define AUDIO_CTRL_PKT_GATE_EDGE_OFFSETS_PER_WORD (32 / AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS)
+
 // Gpio Data Payload size.
 #define AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE 32
 #define AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE_WORDS (AUDIO_CTRL_PKT_GPIO_DATA_SIZE / 4)
@@ -45,6 +60,9 @@ namespace audio_ctrl {
 #define AUDIO_CTRL_PKT_SIZE 144
 #define AUDIO_CTRL_PKT_SIZE_WORDS 36
 
+// Offset of the crc field, the crc covers all the bytes preceding it
+#define AUDIO_CTRL_PKT_CRC_OFFSET 142
+
 // stucture to represent gpio data
 struct GpioDataBlob
 {
@@ -55,6 +73,7 @@ struct GpioDataBlob
 union AudioPacketPayload
 {
     uint8_t midi_data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    uint32_t ump_words[AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS];
     struct GpioDataBlob gpio_data_blob[AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS];
 };
 
@@ -68,7 +87,8 @@ typedef enum
     AUDIO_CMD_UNMUTE = 101,
     AUDIO_CMD_CEASE = 102,
     GPIO_DATA = 179,
-    MIDI_DATA = 186
+    MIDI_DATA = 186,
+    MIDI_UMP_DATA = 187
 } AudioCtrlCmds;
 
 /**
@@ -86,7 +106,8 @@ typedef struct
     // command payload - 16 byte aligned
     union       AudioPacketPayload payload;
 
-    //Reserved data for 16 byte alignment
+    //Reserved data for 16 byte alignment. Carries the gate in edge offsets
+    // of devices with DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_GATE_EDGE_OFFSETS
     uint32_t    reserved[2];
 
     // Sequential packet number
@@ -107,14 +128,17 @@ typedef struct
     // magic stop char 'z'
     uint8_t     magic_stop;
 
-    // Poor's man CRC
+    // CRC of the preceding bytes, see compute_audio_pkt_crc()
     uint16_t    crc;
 } AudioCtrlPkt;
 
 // statically verify the hardcoded size definitions
 COMPILER_VERIFY(sizeof(AudioCtrlPkt) == AUDIO_CTRL_PKT_SIZE);
 COMPILER_VERIFY(sizeof(AudioCtrlPkt)/4 == AUDIO_CTRL_PKT_SIZE_WORDS);
+COMPILER_VERIFY(offsetof(AudioCtrlPkt, crc) == AUDIO_CTRL_PKT_CRC_OFFSET);
+COMPILER_VERIFY(AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES <= 2 * AUDIO_CTRL_PKT_GATE_EDGE_OFFSETS_PER_WORD);
 COMPILER_VERIFY(sizeof(union AudioPacketPayload) == AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+COMPILER_VERIFY(offsetof(AudioCtrlPkt, payload) % 4 == 0);
 COMPILER_VERIFY((sizeof(struct GpioDataBlob) * AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS) <= sizeof(union AudioPacketPayload));
 
 #ifdef __cplusplus
@@ -23,6 +23,7 @@
 #define AUDIO_PACKET_HELPER_
 
 #include "audio_control_protocol.h"
+#include "packet_crc.h"
 
 #ifdef __cplusplus
 namespace audio_ctrl {
@@ -77,6 +78,40 @@ inline int check_audio_pkt_for_magic_words(const AudioCtrlPkt* const pkt)
     return 1;
 }
 
+/**
+ * @brief Computes the crc of the packet. The crc covers all the bytes
+ *        preceding the crc field, see packet_crc.h for the algorithm.
+ *
+ * @param pkt the audio control packet
+ * @return The 16 bit crc of the packet
+ */
+inline uint16_t compute_audio_pkt_crc(const AudioCtrlPkt* const pkt)
+{
+    return compute_pkt_crc((const uint8_t*) pkt, AUDIO_CTRL_PKT_CRC_OFFSET);
+}
+
+/**
+ * @brief Computes the crc of the packet and stores it in the crc field. This
+ *        should be the last operation done on a packet before sending it.
+ *
+ * @param pkt the audio control packet
+ */
+inline void set_audio_pkt_crc(AudioCtrlPkt* const pkt)
+{
+    pkt->crc = compute_audio_pkt_crc(pkt);
+}
+
+/**
+ * @brief Verifies the crc of the packet.
+ *
+ * @param pkt the audio control packet
+ * @return 1 if the crc field matches the packet content, 0 if not
+ */
+inline int check_audio_pkt_crc(const AudioCtrlPkt* const pkt)
+{
+    return compute_audio_pkt_crc(pkt) == pkt->crc;
+}
+
 /**
  * @brief Checks if packet has audio mute command
  *
@@ -248,13 +283,14 @@ inline int prepare_midi_data_pkt(AudioCtrlPkt* const pkt,
 /**
  * @brief Check for midi data in the packet.
  * @param pkt The audio control packet
- * @return The number of midi bytes if the packet contains midi data, 0 if not
+ * @return The number of midi bytes if the packet contains midi data, 0 if not.
+ *         For timestamped midi packets this is the size of the encoded events.
  */
 inline int check_for_midi_data(const AudioCtrlPkt* const pkt)
 {
     if (pkt->cmd_msb == MIDI_DATA)
     {
-        return pkt->cmd_lsb;
+        return pkt->cmd_lsb & AUDIO_CTRL_MIDI_SIZE_MASK;
     }
 
     return 0;
@@ -293,6 +329,91 @@ inline int get_midi_data(const AudioCtrlPkt* const pkt,
     return 1;
 }
 
+/**
+ * @brief Prepare a packet with Universal MIDI Packet words as payload, see
+ *        midi_ump_helper.h. The words are stored in host byte order.
+ *
+ * @param pkt The audio control packet
+ * @param ump_words The UMP words, holding complete messages
+ * @param num_ump_words The number of words. It should be lesser than or equal
+ *        to AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS.
+ * @return 0 indicates an error ie num_ump_words is bigger than
+ *         AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS, 1 if successful
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline int prepare_midi_ump_data_pkt(AudioCtrlPkt* const pkt,
+                                     const uint32_t* const ump_words,
+                                     uint8_t num_ump_words)
+{
+    #ifdef DEBUG
+    if (num_ump_words > AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+    {
+        return 0;
+    }
+    #endif
+
+    create_default_audio_ctrl_pkt(pkt);
+    pkt->cmd_msb = MIDI_UMP_DATA;
+    pkt->cmd_lsb = num_ump_words;
+    for (int i = 0; i < (int) num_ump_words; i++)
+    {
+        pkt->payload.ump_words[i] = ump_words[i];
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Check for Universal MIDI Packet words in the packet.
+ * @param pkt The audio control packet
+ * @return The number of UMP words if the packet contains UMP data, 0 if not.
+ */
+inline int check_for_midi_ump_data(const AudioCtrlPkt* const pkt)
+{
+    if (pkt->cmd_msb == MIDI_UMP_DATA)
+    {
+        return pkt->cmd_lsb;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get Universal MIDI Packet words from packet and store into a dest
+ *        buffer
+ * @param pkt The audio control packet
+ * @param dest_ump_words The destination buffer to store the words
+ * @param offset An offset in words in the payload from which a section of
+ *               the words can be retrieved.
+ * @param num_ump_words The number of words to be retrieved.
+ * @return 1 if successful, 0 if the section is out of the payload (DEBUG only)
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline int get_midi_ump_data(const AudioCtrlPkt* const pkt,
+                             uint32_t* const dest_ump_words,
+                             int offset,
+                             int num_ump_words)
+{
+    #ifdef DEBUG
+    if (offset + num_ump_words > AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+    {
+        return 0;
+    }
+    #endif
+
+    const uint32_t* ump_words = &pkt->payload.ump_words[offset];
+    for (int i = 0; i < num_ump_words; i++)
+    {
+        dest_ump_words[i] = ump_words[i];
+    }
+
+    return 1;
+}
+
 /**
  * @brief Gets the timing error info from the audio control packet.
  *
@@ -364,6 +485,42 @@ inline uint32_t get_gate_in_val(AudioCtrlPkt* const pkt)
     return pkt->gate_in;
 }
 
+/**
+ * @brief Set the position in the period of the last edge of a cv gate in, for
+ *        devices advertising DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_GATE_EDGE_OFFSETS.
+ *        Gates without an edge in the period should keep an offset of 0.
+ *
+ * @param pkt The audio control packet
+ * @param gate The index of the gate, less than AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES
+ * @param edge_offset The position of the edge in sixteenths of the period,
+ *        from 0 to AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS - 1
+ */
+inline void set_gate_in_edge_offset(AudioCtrlPkt* const pkt,
+                                    int gate,
+                                    uint32_t edge_offset)
+{
+    int word = gate / AUDIO_CTRL_PKT_GATE_EDGE_OFFSETS_PER_WORD;
+    int shift = (gate % AUDIO_CTRL_PKT_GATE_EDGE_OFFSETS_PER_WORD) * AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS;
+    uint32_t mask = (uint32_t) (AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS - 1) << shift;
+    pkt->reserved[word] = (pkt->reserved[word] & ~mask) | ((edge_offset << shift) & mask);
+}
+
+/**
+ * @brief Get the position in the period of the last edge of a cv gate in.
+ *
+ * @param pkt The audio control packet
+ * @param gate The index of the gate, less than AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES
+ * @return The position of the edge in sixteenths of the period, 0 if the
+ *         device does not send edge offsets
+ */
+inline uint32_t get_gate_in_edge_offset(const AudioCtrlPkt* const pkt,
+                                        int gate)
+{
+    int word = gate / AUDIO_CTRL_PKT_GATE_EDGE_OFFSETS_PER_WORD;
+    int shift = (gate % AUDIO_CTRL_PKT_GATE_EDGE_OFFSETS_PER_WORD) * AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS;
+    return (pkt->reserved[word] >> shift) & (AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS - 1);
+}
+
 #ifdef __cplusplus
 } // namespace audio_ctrl
 #endif
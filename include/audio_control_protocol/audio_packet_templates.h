@@ -0,0 +1,282 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Prebuilt audio control packets. Instead of clearing and rebuilding a
+ *        whole packet every period, the patch_ functions copy a packet from a
+ *        template cache, built once with the prepare_ helpers, and only write
+ *        the fields which vary. update_audio_pkt_fields() goes one step
+ *        further and only rewrites the dirty fields of a packet which is
+ *        already valid, e.g. one sent in the previous period.
+ *
+ *        The packets produced are identical to the ones of the prepare_
+ *        helpers. Like with those, the crc has to be set afterwards if used.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef AUDIO_PACKET_TEMPLATES_H_
+#define AUDIO_PACKET_TEMPLATES_H_
+
+#include "audio_packet_helper.h"
+
+#ifdef __cplusplus
+namespace audio_ctrl {
+#endif
+
+/**
+ * @brief Identifiers of the packet templates
+ */
+typedef enum
+{
+    AUDIO_PKT_TEMPLATE_NULL = 0,
+    AUDIO_PKT_TEMPLATE_MUTE,
+    AUDIO_PKT_TEMPLATE_UNMUTE,
+    AUDIO_PKT_TEMPLATE_CEASE,
+    AUDIO_PKT_TEMPLATE_GPIO_DATA,
+    AUDIO_PKT_TEMPLATE_MIDI_DATA,
+    AUDIO_PKT_TEMPLATE_MIDI_UMP_DATA,
+    AUDIO_PKT_NUM_TEMPLATES
+} AudioPktTemplateId;
+
+typedef struct
+{
+    AudioCtrlPkt pkts[AUDIO_PKT_NUM_TEMPLATES];
+} AudioPktTemplateCache;
+
+// Fields which can be updated in place with update_audio_pkt_fields()
+#define AUDIO_PKT_FIELD_SEQ             0x01u
+#define AUDIO_PKT_FIELD_TIMING_ERROR    0x02u
+#define AUDIO_PKT_FIELD_GATE_IN         0x04u
+#define AUDIO_PKT_FIELD_GATE_OUT        0x08u
+#define AUDIO_PKT_FIELD_CONTINUATION    0x10u
+
+// Values of the fields which vary from period to period
+typedef struct
+{
+    uint32_t seq;
+    int32_t timing_error;
+    uint32_t gate_in;
+    uint32_t gate_out;
+    uint8_t continuation;
+} AudioPktFields;
+
+/**
+ * @brief Build all the templates of the cache. Should be called once, before
+ *        any of the other functions.
+ *
+ * @param cache The template cache
+ */
+inline void init_audio_pkt_template_cache(AudioPktTemplateCache* const cache)
+{
+    create_default_audio_ctrl_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_NULL]);
+    prepare_audio_mute_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_MUTE], 0);
+    prepare_audio_unmute_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_UNMUTE], 0);
+    prepare_audio_cease_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_CEASE], 0);
+    create_default_audio_ctrl_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_GPIO_DATA]);
+    prepare_gpio_cmd_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_GPIO_DATA], 0);
+    prepare_midi_data_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_MIDI_DATA], 0, 0);
+    prepare_midi_ump_data_pkt(&cache->pkts[AUDIO_PKT_TEMPLATE_MIDI_UMP_DATA], 0, 0);
+}
+
+/**
+ * @brief Copy a template into a packet. The copy is done as a struct
+ *        assignment, which compilers turn into the widest stores available.
+ *
+ * @param cache The template cache
+ * @param template_id The template to copy
+ * @param pkt The audio control packet
+ */
+inline void copy_audio_pkt_template(const AudioPktTemplateCache* const cache,
+                                    AudioPktTemplateId template_id,
+                                    AudioCtrlPkt* const pkt)
+{
+    *pkt = cache->pkts[template_id];
+}
+
+/**
+ * @brief Patch builder of an audio packet without command, carrying only the
+ *        sequence number and the gate outputs.
+ *
+ * @param cache The template cache
+ * @param pkt The audio control packet
+ * @param seq_number The sequence number
+ * @param gate_out_val The gate out value
+ */
+inline void patch_audio_null_pkt(const AudioPktTemplateCache* const cache,
+                                 AudioCtrlPkt* const pkt,
+                                 uint32_t seq_number,
+                                 uint32_t gate_out_val)
+{
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_NULL];
+    pkt->seq = seq_number;
+    pkt->gate_out = gate_out_val;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_audio_mute_pkt()
+ */
+inline void patch_audio_mute_pkt(const AudioPktTemplateCache* const cache,
+                                 AudioCtrlPkt* const pkt,
+                                 uint32_t seq_number)
+{
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_MUTE];
+    pkt->seq = seq_number;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_audio_unmute_pkt()
+ */
+inline void patch_audio_unmute_pkt(const AudioPktTemplateCache* const cache,
+                                   AudioCtrlPkt* const pkt,
+                                   uint32_t seq_number)
+{
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_UNMUTE];
+    pkt->seq = seq_number;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_audio_cease_pkt()
+ */
+inline void patch_audio_cease_pkt(const AudioPktTemplateCache* const cache,
+                                  AudioCtrlPkt* const pkt,
+                                  uint32_t seq_number)
+{
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_CEASE];
+    pkt->seq = seq_number;
+}
+
+/**
+ * @brief Patch builder of a gpio packet, copying the gpio data blobs into the
+ *        payload as well, unlike prepare_gpio_cmd_pkt().
+ *
+ * @param cache The template cache
+ * @param pkt The audio control packet
+ * @param gpio_data_blobs The gpio data blobs
+ * @param num_gpio_data_blobs The number of gpio data blobs
+ * @return -1 if num_gpio_data_blobs is greater than what the payload can hold,
+ *          0 otherwise.
+ */
+inline int patch_gpio_cmd_pkt(const AudioPktTemplateCache* const cache,
+                              AudioCtrlPkt* const pkt,
+                              const struct GpioDataBlob* const gpio_data_blobs,
+                              uint8_t num_gpio_data_blobs)
+{
+    if (num_gpio_data_blobs > AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS)
+    {
+        return -1;
+    }
+
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_GPIO_DATA];
+    pkt->cmd_lsb = num_gpio_data_blobs;
+    for (int i = 0; i < (int) num_gpio_data_blobs; i++)
+    {
+        pkt->payload.gpio_data_blob[i] = gpio_data_blobs[i];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_midi_data_pkt()
+ *
+ * @return 0 if num_midi_bytes is bigger than AUDIO_CTRL_PKT_PAYLOAD_SIZE,
+ *         1 if successful
+ */
+inline int patch_midi_data_pkt(const AudioPktTemplateCache* const cache,
+                               AudioCtrlPkt* const pkt,
+                               const uint8_t* const midi_data,
+                               uint8_t num_midi_bytes)
+{
+    if (num_midi_bytes > AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+    {
+        return 0;
+    }
+
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_MIDI_DATA];
+    pkt->cmd_lsb = num_midi_bytes;
+    for (int i = 0; i < (int) num_midi_bytes; i++)
+    {
+        pkt->payload.midi_data[i] = midi_data[i];
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_midi_ump_data_pkt()
+ *
+ * @return 0 if num_ump_words is bigger than AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS,
+ *         1 if successful
+ */
+inline int patch_midi_ump_data_pkt(const AudioPktTemplateCache* const cache,
+                                   AudioCtrlPkt* const pkt,
+                                   const uint32_t* const ump_words,
+                                   uint8_t num_ump_words)
+{
+    if (num_ump_words > AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+    {
+        return 0;
+    }
+
+    *pkt = cache->pkts[AUDIO_PKT_TEMPLATE_MIDI_UMP_DATA];
+    pkt->cmd_lsb = num_ump_words;
+    for (int i = 0; i < (int) num_ump_words; i++)
+    {
+        pkt->payload.ump_words[i] = ump_words[i];
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Reuse mode: update the dirty fields of an already valid packet,
+ *        leaving everything else untouched.
+ *
+ * @param pkt The audio control packet
+ * @param fields The new field values
+ * @param dirty_fields Bit mask of AUDIO_PKT_FIELD_xxx flags, only the fields
+ *        set in the mask are written
+ */
+inline void update_audio_pkt_fields(AudioCtrlPkt* const pkt,
+                                    const AudioPktFields* const fields,
+                                    uint32_t dirty_fields)
+{
+    if (dirty_fields & AUDIO_PKT_FIELD_SEQ)
+    {
+        pkt->seq = fields->seq;
+    }
+    if (dirty_fields & AUDIO_PKT_FIELD_TIMING_ERROR)
+    {
+        pkt->timing_error = fields->timing_error;
+    }
+    if (dirty_fields & AUDIO_PKT_FIELD_GATE_IN)
+    {
+        pkt->gate_in = fields->gate_in;
+    }
+    if (dirty_fields & AUDIO_PKT_FIELD_GATE_OUT)
+    {
+        pkt->gate_out = fields->gate_out;
+    }
+    if (dirty_fields & AUDIO_PKT_FIELD_CONTINUATION)
+    {
+        pkt->continuation = fields->continuation;
+    }
+}
+
+#ifdef __cplusplus
+} // namespace audio_ctrl
+#endif
+
+#endif // AUDIO_PACKET_TEMPLATES_H_
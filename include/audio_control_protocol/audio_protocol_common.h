@@ -28,7 +28,7 @@
 #define AUDIO_PROTOCOL_COMMON_H_
 
 #define AUDIO_PROTOCOL_VERSION_MAJ 0
-#define AUDIO_PROTOCOL_VERSION_MIN 5
+#define AUDIO_PROTOCOL_VERSION_MIN 9
 #define AUDIO_PROTOCOL_VERSION_REV 0
 
 // static assert implementation for xmos platform
@@ -43,11 +43,14 @@
 // generic c++ static assert for platforms using C++
 #elif defined (__cplusplus)
 #include <cstdint>
+#include <cstddef>
 #include <assert.h>
 #define COMPILER_VERIFY(exp) static_assert(exp)
 
 // empty macro otherwise
 #else
+#include <stdint.h>
+#include <stddef.h>
 #define COMPILER_VERIFY(exp)
 
 #endif
@@ -0,0 +1,497 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Conversion between the hardware audio buffers described by the
+ *        audio_channel_info_data of the device and planar float buffers, one
+ *        per software channel.
+ *
+ *        The channel infos are compiled once into a ChannelLayoutPlan. When
+ *        all channels share the same stride and their start offsets form a
+ *        contiguous frame, the buffer is treated as frame interleaved and
+ *        converted with transposing SIMD kernels, specialized for the common
+ *        2, 8 and 16 channel layouts. Any other layout falls back to a
+ *        per-channel loop, vectorized for planar (stride 1) channels.
+ *        Channels can have different sample formats.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef CHANNEL_LAYOUT_PLAN_H_
+#define CHANNEL_LAYOUT_PLAN_H_
+
+#include <cstddef>
+
+#include "sample_format_conversion.h"
+
+namespace device_ctrl {
+
+constexpr int CHANNEL_LAYOUT_MAX_CHANNELS = 64;
+
+enum class ChannelLayoutKind
+{
+    EMPTY,          // No channel in the requested direction
+    INTERLEAVED,    // Frame interleaved, converted with the SIMD kernels
+    STRIDED         // Generic layout, converted channel by channel
+};
+
+class ChannelLayoutPlan
+{
+public:
+    ChannelLayoutPlan()
+    {
+        _clear();
+    }
+
+    /**
+     * @brief Compile the plan from the channel infos reported by the device.
+     *        Channels with another direction or with an invalid sw or hw
+     *        channel id are ignored. Should not be called from the real-time
+     *        thread while converting.
+     *
+     * @param infos The channel infos as received with DEVICE_AUDIO_CHANNEL_INFO
+     * @param num_infos The number of channel infos
+     * @param direction The direction of the buffers converted with this plan
+     * @return true on success, false if a channel has an unknown sample format,
+     *         a zero stride or if there are more than CHANNEL_LAYOUT_MAX_CHANNELS
+     *         channels. The plan is left empty on failure.
+     */
+    bool compile(const audio_channel_info_data* infos, int num_infos, audio_channel_direction direction)
+    {
+        _clear();
+        for (int i = 0; i < num_infos; i++)
+        {
+            const auto& info = infos[i];
+            if (info.direction != direction ||
+                info.sw_ch_id == DEVICE_CTRL_AUDIO_CHANNEL_NOT_VALID ||
+                info.hw_ch_id == DEVICE_CTRL_AUDIO_CHANNEL_NOT_VALID)
+            {
+                continue;
+            }
+
+            Route route;
+            if (_num_routes == CHANNEL_LAYOUT_MAX_CHANNELS || info.stride_in_words == 0 ||
+                get_sample_format_params(info.sample_format, route.format) == false)
+            {
+                _clear();
+                return false;
+            }
+            route.buffer_index = info.sw_ch_id;
+            route.start_offset = info.start_offset_in_words;
+            route.stride = info.stride_in_words;
+            _routes[_num_routes++] = route;
+            if (route.buffer_index >= _num_buffers)
+            {
+                _num_buffers = route.buffer_index + 1;
+            }
+        }
+
+        if (_num_routes == 0)
+        {
+            return true;
+        }
+        if (_compile_interleaved() == false)
+        {
+            _kind = ChannelLayoutKind::STRIDED;
+            _deinterleave_fn = _deinterleave_strided;
+            _interleave_fn = _interleave_strided;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Convert a hardware buffer into planar float buffers.
+     *
+     * @param hw_buffer The hardware buffer, as pointed to by the channel
+     *        start offsets
+     * @param channels Array of num_buffers() float buffers indexed by software
+     *        channel id, each holding num_frames samples. Entries of ids not
+     *        covered by the plan are not accessed and can be nullptr.
+     * @param num_frames The number of frames to convert
+     */
+    void deinterleave(const int32_t* hw_buffer, float* const* channels, int num_frames) const
+    {
+        _deinterleave_fn(*this, hw_buffer, channels, num_frames);
+    }
+
+    /**
+     * @brief Convert planar float buffers into a hardware buffer. In
+     *        interleaved layouts, the words of frame slots not used by any
+     *        channel are set to 0.
+     *
+     * @param channels Array of num_buffers() float buffers indexed by software
+     *        channel id
+     * @param hw_buffer The hardware buffer
+     * @param num_frames The number of frames to convert
+     */
+    void interleave(const float* const* channels, int32_t* hw_buffer, int num_frames) const
+    {
+        _interleave_fn(*this, channels, hw_buffer, num_frames);
+    }
+
+    ChannelLayoutKind kind() const
+    {
+        return _kind;
+    }
+
+    /**
+     * @return The number of channels routed by the plan
+     */
+    int num_channels() const
+    {
+        return _num_routes;
+    }
+
+    /**
+     * @return The size of the channels array, i.e. the highest software
+     *         channel id + 1
+     */
+    int num_buffers() const
+    {
+        return _num_buffers;
+    }
+
+    /**
+     * @return The frame size in words of an interleaved layout, 0 otherwise
+     */
+    int frame_size() const
+    {
+        return _kind == ChannelLayoutKind::INTERLEAVED ? _stride : 0;
+    }
+
+private:
+    struct Route
+    {
+        int buffer_index;
+        SampleFormatParams format;
+        uint32_t start_offset;
+        uint32_t stride;
+    };
+
+    struct Slot
+    {
+        int buffer_index;   // -1 if the word is not used by any channel
+        SampleFormatParams format;
+    };
+
+    using DeinterleaveFn = void (*)(const ChannelLayoutPlan&, const int32_t*, float* const*, int);
+    using InterleaveFn = void (*)(const ChannelLayoutPlan&, const float* const*, int32_t*, int);
+
+    void _clear()
+    {
+        _kind = ChannelLayoutKind::EMPTY;
+        _num_routes = 0;
+        _num_buffers = 0;
+        _stride = 0;
+        _base_offset = 0;
+        _deinterleave_fn = _deinterleave_empty;
+        _interleave_fn = _interleave_empty;
+    }
+
+    bool _compile_interleaved()
+    {
+        uint32_t stride = _routes[0].stride;
+        uint32_t base_offset = _routes[0].start_offset;
+        for (int i = 0; i < _num_routes; i++)
+        {
+            if (_routes[i].stride != stride)
+            {
+                return false;
+            }
+            if (_routes[i].start_offset < base_offset)
+            {
+                base_offset = _routes[i].start_offset;
+            }
+        }
+        if (stride > static_cast<uint32_t>(CHANNEL_LAYOUT_MAX_CHANNELS))
+        {
+            return false;
+        }
+
+        for (uint32_t s = 0; s < stride; s++)
+        {
+            _slots[s].buffer_index = -1;
+        }
+        for (int i = 0; i < _num_routes; i++)
+        {
+            uint32_t slot = _routes[i].start_offset - base_offset;
+            if (slot >= stride || _slots[slot].buffer_index >= 0)
+            {
+                return false;
+            }
+            _slots[slot] = {_routes[i].buffer_index, _routes[i].format};
+        }
+
+        _kind = ChannelLayoutKind::INTERLEAVED;
+        _stride = static_cast<int>(stride);
+        _base_offset = base_offset;
+        constexpr int W = audio_ctrl::simd::WIDTH;
+        if (_stride == 2 && W > 1)
+        {
+            _deinterleave_fn = _deinterleave_stereo;
+            _interleave_fn = _interleave_stereo;
+        }
+        else if (_stride == 8 && 8 % W == 0)
+        {
+            _deinterleave_fn = _deinterleave_blocks<8>;
+            _interleave_fn = _interleave_blocks<8>;
+        }
+        else if (_stride == 16 && 16 % W == 0)
+        {
+            _deinterleave_fn = _deinterleave_blocks<16>;
+            _interleave_fn = _interleave_blocks<16>;
+        }
+        else if (_stride % W == 0)
+        {
+            _deinterleave_fn = _deinterleave_blocks<0>;
+            _interleave_fn = _interleave_blocks<0>;
+        }
+        else
+        {
+            _deinterleave_fn = _deinterleave_blocks<0, 1>;
+            _interleave_fn = _interleave_blocks<0, 1>;
+        }
+        return true;
+    }
+
+    static void _deinterleave_empty(const ChannelLayoutPlan&, const int32_t*, float* const*, int) {}
+
+    static void _interleave_empty(const ChannelLayoutPlan&, const float* const*, int32_t*, int) {}
+
+    static void _deinterleave_strided(const ChannelLayoutPlan& plan, const int32_t* hw_buffer,
+                                      float* const* channels, int num_frames)
+    {
+        namespace simd = audio_ctrl::simd;
+        for (int i = 0; i < plan._num_routes; i++)
+        {
+            const auto& route = plan._routes[i];
+            const int32_t* src = hw_buffer + route.start_offset;
+            float* dst = channels[route.buffer_index];
+            int frame = 0;
+            if (route.stride == 1)
+            {
+                for (; frame + simd::WIDTH <= num_frames; frame += simd::WIDTH)
+                {
+                    simd::store_f(dst + frame, decode_samples(simd::load_i(src + frame), route.format));
+                }
+            }
+            for (; frame < num_frames; frame++)
+            {
+                dst[frame] = decode_sample(src[static_cast<size_t>(frame) * route.stride], route.format);
+            }
+        }
+    }
+
+    static void _interleave_strided(const ChannelLayoutPlan& plan, const float* const* channels,
+                                    int32_t* hw_buffer, int num_frames)
+    {
+        namespace simd = audio_ctrl::simd;
+        for (int i = 0; i < plan._num_routes; i++)
+        {
+            const auto& route = plan._routes[i];
+            const float* src = channels[route.buffer_index];
+            int32_t* dst = hw_buffer + route.start_offset;
+            int frame = 0;
+            if (route.stride == 1)
+            {
+                for (; frame + simd::WIDTH <= num_frames; frame += simd::WIDTH)
+                {
+                    simd::store_i(dst + frame, encode_samples(simd::load_f(src + frame), route.format));
+                }
+            }
+            for (; frame < num_frames; frame++)
+            {
+                dst[static_cast<size_t>(frame) * route.stride] = encode_sample(src[frame], route.format);
+            }
+        }
+    }
+
+    /**
+     * @brief Scalar conversion of the frames [first_frame, num_frames) of an
+     *        interleaved layout, used for the frames left over by the kernels.
+     */
+    static void _deinterleave_tail(const ChannelLayoutPlan& plan, const int32_t* frames,
+                                   float* const* channels, int first_frame, int num_frames)
+    {
+        for (int frame = first_frame; frame < num_frames; frame++)
+        {
+            const int32_t* src = frames + static_cast<size_t>(frame) * plan._stride;
+            for (int s = 0; s < plan._stride; s++)
+            {
+                if (plan._slots[s].buffer_index >= 0)
+                {
+                    channels[plan._slots[s].buffer_index][frame] = decode_sample(src[s], plan._slots[s].format);
+                }
+            }
+        }
+    }
+
+    static void _interleave_tail(const ChannelLayoutPlan& plan, const float* const* channels,
+                                 int32_t* frames, int first_frame, int num_frames)
+    {
+        for (int frame = first_frame; frame < num_frames; frame++)
+        {
+            int32_t* dst = frames + static_cast<size_t>(frame) * plan._stride;
+            for (int s = 0; s < plan._stride; s++)
+            {
+                const auto& slot = plan._slots[s];
+                dst[s] = slot.buffer_index >= 0 ? encode_sample(channels[slot.buffer_index][frame], slot.format) : 0;
+            }
+        }
+    }
+
+    /**
+     * @brief Stereo kernel, splitting pairs of vectors into even and odd words.
+     */
+    static void _deinterleave_stereo(const ChannelLayoutPlan& plan, const int32_t* hw_buffer,
+                                     float* const* channels, int num_frames)
+    {
+        namespace simd = audio_ctrl::simd;
+        constexpr int W = simd::WIDTH;
+        const int32_t* frames = hw_buffer + plan._base_offset;
+        const Slot& left = plan._slots[0];
+        const Slot& right = plan._slots[1];
+        int frame = 0;
+        for (; frame + W <= num_frames; frame += W)
+        {
+            const int32_t* src = frames + static_cast<size_t>(frame) * 2;
+            simd::VecI even;
+            simd::VecI odd;
+            simd::deinterleave2(simd::load_i(src), simd::load_i(src + W), even, odd);
+            if (left.buffer_index >= 0)
+            {
+                simd::store_f(channels[left.buffer_index] + frame, decode_samples(even, left.format));
+            }
+            if (right.buffer_index >= 0)
+            {
+                simd::store_f(channels[right.buffer_index] + frame, decode_samples(odd, right.format));
+            }
+        }
+        _deinterleave_tail(plan, frames, channels, frame, num_frames);
+    }
+
+    static void _interleave_stereo(const ChannelLayoutPlan& plan, const float* const* channels,
+                                   int32_t* hw_buffer, int num_frames)
+    {
+        namespace simd = audio_ctrl::simd;
+        constexpr int W = simd::WIDTH;
+        int32_t* frames = hw_buffer + plan._base_offset;
+        const Slot& left = plan._slots[0];
+        const Slot& right = plan._slots[1];
+        int frame = 0;
+        for (; frame + W <= num_frames; frame += W)
+        {
+            simd::VecI even = left.buffer_index >= 0 ?
+                    encode_samples(simd::load_f(channels[left.buffer_index] + frame), left.format) : simd::set1_i(0);
+            simd::VecI odd = right.buffer_index >= 0 ?
+                    encode_samples(simd::load_f(channels[right.buffer_index] + frame), right.format) : simd::set1_i(0);
+            simd::VecI a;
+            simd::VecI b;
+            simd::interleave2(even, odd, a, b);
+            int32_t* dst = frames + static_cast<size_t>(frame) * 2;
+            simd::store_i(dst, a);
+            simd::store_i(dst + W, b);
+        }
+        _interleave_tail(plan, channels, frames, frame, num_frames);
+    }
+
+    /**
+     * @brief Block kernel for strides which are a multiple of the vector width.
+     *        Each group of W channels of W consecutive frames is loaded as a
+     *        W x W matrix and transposed, giving W samples per channel. STRIDE
+     *        is the compile time frame size, or 0 to use the one of the plan.
+     */
+    template <int STRIDE, int W = audio_ctrl::simd::WIDTH>
+    static void _deinterleave_blocks(const ChannelLayoutPlan& plan, const int32_t* hw_buffer,
+                                     float* const* channels, int num_frames)
+    {
+        namespace simd = audio_ctrl::simd;
+        const int stride = STRIDE > 0 ? STRIDE : plan._stride;
+        const int32_t* frames = hw_buffer + plan._base_offset;
+        int frame = 0;
+        if constexpr (W == simd::WIDTH)
+        {
+            for (; frame + W <= num_frames; frame += W)
+            {
+                const int32_t* src = frames + static_cast<size_t>(frame) * stride;
+                for (int group = 0; group < stride; group += W)
+                {
+                    simd::VecI rows[W];
+                    for (int r = 0; r < W; r++)
+                    {
+                        rows[r] = simd::load_i(src + r * stride + group);
+                    }
+                    simd::transpose(rows);
+                    for (int c = 0; c < W; c++)
+                    {
+                        const Slot& slot = plan._slots[group + c];
+                        if (slot.buffer_index >= 0)
+                        {
+                            simd::store_f(channels[slot.buffer_index] + frame, decode_samples(rows[c], slot.format));
+                        }
+                    }
+                }
+            }
+        }
+        _deinterleave_tail(plan, frames, channels, frame, num_frames);
+    }
+
+    template <int STRIDE, int W = audio_ctrl::simd::WIDTH>
+    static void _interleave_blocks(const ChannelLayoutPlan& plan, const float* const* channels,
+                                   int32_t* hw_buffer, int num_frames)
+    {
+        namespace simd = audio_ctrl::simd;
+        const int stride = STRIDE > 0 ? STRIDE : plan._stride;
+        int32_t* frames = hw_buffer + plan._base_offset;
+        int frame = 0;
+        if constexpr (W == simd::WIDTH)
+        {
+            for (; frame + W <= num_frames; frame += W)
+            {
+                int32_t* dst = frames + static_cast<size_t>(frame) * stride;
+                for (int group = 0; group < stride; group += W)
+                {
+                    simd::VecI rows[W];
+                    for (int c = 0; c < W; c++)
+                    {
+                        const Slot& slot = plan._slots[group + c];
+                        rows[c] = slot.buffer_index >= 0 ?
+                                encode_samples(simd::load_f(channels[slot.buffer_index] + frame), slot.format) :
+                                simd::set1_i(0);
+                    }
+                    simd::transpose(rows);
+                    for (int r = 0; r < W; r++)
+                    {
+                        simd::store_i(dst + r * stride + group, rows[r]);
+                    }
+                }
+            }
+        }
+        _interleave_tail(plan, channels, frames, frame, num_frames);
+    }
+
+    ChannelLayoutKind _kind;
+    int _num_routes;
+    int _num_buffers;
+    int _stride;
+    uint32_t _base_offset;
+    DeinterleaveFn _deinterleave_fn;
+    InterleaveFn _interleave_fn;
+    Route _routes[CHANNEL_LAYOUT_MAX_CHANNELS];
+    Slot _slots[CHANNEL_LAYOUT_MAX_CHANNELS];
+};
+
+} // namespace device_ctrl
+
+#endif // CHANNEL_LAYOUT_PLAN_H_
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Streaming estimator of the clock drift between the host and the
+ *        microcontroller, based on the timing_error field of the audio control
+ *        packets. A second order delay locked loop filters the per-packet
+ *        timing error into a clock ratio, a phase offset and a jitter
+ *        estimate. Updating is O(1), allocation free and meant to be done
+ *        from the real-time thread; the latest estimate is published as a
+ *        lock free snapshot which can be read from any thread.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef CLOCK_DRIFT_ESTIMATOR_H_
+#define CLOCK_DRIFT_ESTIMATOR_H_
+
+#include <atomic>
+#include <cmath>
+
+#include "audio_packet_helper.h"
+
+namespace audio_ctrl {
+
+/**
+ * @brief Filtered clock estimate. Phase offset and jitter are expressed in the
+ *        same unit as the timing_error field.
+ */
+struct ClockDriftSnapshot
+{
+    double clock_ratio;     // Ratio between the actual and the nominal period length
+    double phase_offset;    // Filtered timing error
+    double jitter;          // Rms of the timing error around the filtered value
+    uint64_t num_updates;   // Number of packets processed since the last reset
+};
+
+class ClockDriftEstimator
+{
+public:
+    static constexpr double DEFAULT_BANDWIDTH_HZ = 0.5;
+
+    /**
+     * @brief Constructs an estimator.
+     *
+     * @param period_length The nominal length of an audio period, expressed in
+     *        the unit of the timing_error field
+     * @param packets_per_second The packet rate, i.e. sample rate / buffer size
+     * @param bandwidth_hz The loop bandwidth, lower values filter more jitter
+     *        but react slower to clock changes
+     */
+    ClockDriftEstimator(double period_length,
+                        double packets_per_second,
+                        double bandwidth_hz = DEFAULT_BANDWIDTH_HZ) : _period_length(period_length),
+                                                                      _packets_per_second(packets_per_second)
+    {
+        set_bandwidth(bandwidth_hz);
+        reset();
+    }
+
+    /**
+     * @brief Set the loop bandwidth. Should be called from the same thread
+     *        calling update().
+     *
+     * @param bandwidth_hz The loop bandwidth
+     */
+    void set_bandwidth(double bandwidth_hz)
+    {
+        double omega = 2.0 * M_PI * bandwidth_hz / _packets_per_second;
+        _b = std::sqrt(2.0) * omega;
+        _c = omega * omega;
+        _jitter_coeff = std::fmin(omega, 1.0);
+    }
+
+    /**
+     * @brief Reset the loop, the next packet restarts the estimation.
+     */
+    void reset()
+    {
+        _phase = 0.0;
+        _rate = 0.0;
+        _error_variance = 0.0;
+        _num_updates = 0;
+        _publish();
+    }
+
+    /**
+     * @brief Update the estimate with a new timing error measurement.
+     *
+     * @param timing_error The timing error of the last packet
+     */
+    void update(int32_t timing_error)
+    {
+        double measured = static_cast<double>(timing_error);
+        if (_num_updates == 0)
+        {
+            _phase = measured;
+            _rate = 0.0;
+        }
+        else
+        {
+            double predicted = _phase + _rate;
+            double error = measured - predicted;
+            _phase = predicted + _b * error;
+            _rate += _c * error;
+            _error_variance += _jitter_coeff * (error * error - _error_variance);
+        }
+        _num_updates++;
+        _publish();
+    }
+
+    /**
+     * @brief Update the estimate with the timing error of a packet.
+     *
+     * @param pkt The audio control packet
+     */
+    void update(const AudioCtrlPkt* const pkt)
+    {
+        update(get_timing_error(pkt));
+    }
+
+    /**
+     * @brief Get the latest estimate. Lock free, can be called from any thread.
+     *
+     * @return A consistent snapshot of the estimate
+     */
+    ClockDriftSnapshot snapshot() const
+    {
+        ClockDriftSnapshot snapshot;
+        uint32_t seq;
+        do
+        {
+            seq = _seq.load(std::memory_order_acquire);
+            snapshot.clock_ratio = _published_ratio.load(std::memory_order_relaxed);
+            snapshot.phase_offset = _published_phase.load(std::memory_order_relaxed);
+            snapshot.jitter = _published_jitter.load(std::memory_order_relaxed);
+            snapshot.num_updates = _published_updates.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1u) || seq != _seq.load(std::memory_order_relaxed));
+
+        return snapshot;
+    }
+
+private:
+    void _publish()
+    {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _published_ratio.store(1.0 + _rate / _period_length, std::memory_order_relaxed);
+        _published_phase.store(_phase, std::memory_order_relaxed);
+        _published_jitter.store(std::sqrt(_error_variance), std::memory_order_relaxed);
+        _published_updates.store(_num_updates, std::memory_order_relaxed);
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    double _period_length;
+    double _packets_per_second;
+
+    // loop coefficients
+    double _b;
+    double _c;
+    double _jitter_coeff;
+
+    // loop state, only touched by the updating thread
+    double _phase;
+    double _rate;
+    double _error_variance;
+    uint64_t _num_updates;
+
+    // published snapshot, protected by a sequence lock
+    std::atomic<uint32_t> _seq{0};
+    std::atomic<double> _published_ratio{1.0};
+    std::atomic<double> _published_phase{0.0};
+    std::atomic<double> _published_jitter{0.0};
+    std::atomic<uint64_t> _published_updates{0};
+};
+
+} // namespace audio_ctrl
+
+#endif // CLOCK_DRIFT_ESTIMATOR_H_
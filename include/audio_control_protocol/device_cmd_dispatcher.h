@@ -0,0 +1,157 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Table driven dispatcher of device control packets. Handlers are
+ *        stored in a 256 entry table indexed by device_cmd, so the dispatch
+ *        cost does not depend on the number of commands. Every dispatched
+ *        packet is counted per command, packets without a registered handler
+ *        are also counted as unknown. Can be used either by the host system
+ *        or, from C translation units, by the secondary microcontroller (XC
+ *        has no function pointers).
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef DEVICE_CMD_DISPATCHER_H_
+#define DEVICE_CMD_DISPATCHER_H_
+
+#include "device_packet_helper.h"
+
+#ifdef __cplusplus
+namespace device_ctrl {
+#endif
+
+// Size of the handler table, one entry for each possible device_cmd value
+#define DEVICE_CMD_DISPATCHER_TABLE_SIZE 256
+
+/**
+ * @brief Handler of a device control command.
+ *
+ * @param pkt The device control packet.
+ * @param user_data The user data given to init_device_cmd_dispatcher().
+ */
+typedef void (*device_cmd_handler_fn)(const struct device_ctrl_pkt* const pkt,
+					void* user_data);
+
+struct device_cmd_dispatcher {
+	device_cmd_handler_fn handlers[DEVICE_CMD_DISPATCHER_TABLE_SIZE];
+	device_cmd_handler_fn unknown_handler;	// Called for commands without a handler, can be null
+	void* user_data;
+	uint32_t hit_count[DEVICE_CMD_DISPATCHER_TABLE_SIZE];
+	uint32_t unknown_count;
+};
+
+/**
+ * @brief Initializes the dispatcher with no handlers and cleared counters.
+ *
+ * @param dispatcher The dispatcher.
+ * @param user_data Passed to all the handlers.
+ */
+inline void init_device_cmd_dispatcher(struct device_cmd_dispatcher* const dispatcher,
+					void* user_data)
+{
+	int i;
+
+	for (i = 0; i < DEVICE_CMD_DISPATCHER_TABLE_SIZE; i++) {
+		dispatcher->handlers[i] = 0;
+		dispatcher->hit_count[i] = 0;
+	}
+	dispatcher->unknown_handler = 0;
+	dispatcher->user_data = user_data;
+	dispatcher->unknown_count = 0;
+}
+
+/**
+ * @brief Registers the handler of a command, replacing any previous one.
+ *
+ * @param dispatcher The dispatcher.
+ * @param cmd The command, as of device_commands.
+ * @param handler The handler, null to remove it.
+ */
+inline void set_device_cmd_handler(struct device_cmd_dispatcher* const dispatcher,
+					uint8_t cmd,
+					device_cmd_handler_fn handler)
+{
+	dispatcher->handlers[cmd] = handler;
+}
+
+/**
+ * @brief Registers the handler called for commands without a handler.
+ *
+ * @param dispatcher The dispatcher.
+ * @param handler The handler, null to remove it.
+ */
+inline void set_device_unknown_cmd_handler(struct device_cmd_dispatcher* const dispatcher,
+					device_cmd_handler_fn handler)
+{
+	dispatcher->unknown_handler = handler;
+}
+
+/**
+ * @brief Calls the handler of the packet's command and updates the counters.
+ *
+ * @param dispatcher The dispatcher.
+ * @param pkt The device control packet.
+ * @return 1 if a handler for the command was registered, 0 if not.
+ */
+inline int dispatch_device_cmd(struct device_cmd_dispatcher* const dispatcher,
+				const struct device_ctrl_pkt* const pkt)
+{
+	uint8_t cmd = pkt->device_cmd;
+	device_cmd_handler_fn handler = dispatcher->handlers[cmd];
+
+	dispatcher->hit_count[cmd]++;
+	if (handler) {
+		handler(pkt, dispatcher->user_data);
+		return 1;
+	}
+
+	dispatcher->unknown_count++;
+	if (dispatcher->unknown_handler) {
+		dispatcher->unknown_handler(pkt, dispatcher->user_data);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the number of dispatched packets with a given command.
+ *
+ * @param dispatcher The dispatcher.
+ * @param cmd The command.
+ * @return The number of packets.
+ */
+inline uint32_t get_device_cmd_hit_count(const struct device_cmd_dispatcher* const dispatcher,
+					uint8_t cmd)
+{
+	return dispatcher->hit_count[cmd];
+}
+
+/**
+ * @brief Get the number of dispatched packets without a registered handler.
+ *
+ * @param dispatcher The dispatcher.
+ * @return The number of packets.
+ */
+inline uint32_t get_device_unknown_cmd_count(const struct device_cmd_dispatcher* const dispatcher)
+{
+	return dispatcher->unknown_count;
+}
+
+#ifdef __cplusplus
+} // namespace device_ctrl
+#endif
+
+#endif // DEVICE_CMD_DISPATCHER_H_
@@ -56,6 +56,7 @@ enum device_commands {
 	DEVICE_CHANGE_INPUT_GAIN = 124,
 	DEVICE_CHANGE_HP_VOL = 125,
 	DEVICE_SET_RGB_LED_VAL = 126,
+	DEVICE_MIDI_MODE = 127,
 	DEVICE_STOP = 234,
 	DEVICE_RAW_DATA = 254,
 };
@@ -84,6 +85,19 @@ struct system_info_data {
 
 // System info flags definition
 #define DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_MICROCONTROLLER_USB	0x00000001u
+#define DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_TIMESTAMPED_MIDI	0x00000002u	// DEVICE_MIDI_MODE is supported
+#define DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_UMP_MIDI		0x00000004u	// DEVICE_MIDI_MODE_UMP is supported
+#define DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_GATE_EDGE_OFFSETS	0x00000008u	// Audio packets carry gate in edge offsets
+
+/**
+ * @brief Encoding of the midi data in the audio control packets, set with a
+ *        DEVICE_MIDI_MODE query. The device replies with the mode in use.
+ */
+enum device_midi_mode {
+	DEVICE_MIDI_MODE_RAW = 0,		// Plain midi byte stream, the default
+	DEVICE_MIDI_MODE_TIMESTAMPED = 1,	// Events with a frame offset, see midi_timestamp_helper.h
+	DEVICE_MIDI_MODE_UMP = 2,		// Universal MIDI Packets in MIDI_UMP_DATA packets, see midi_ump_helper.h
+};
 
 /**
  * @brief Represents the audio channel direction.
@@ -175,6 +189,7 @@ union device_pkt_payload {
 	struct device_input_gain_data input_gain_data;
 	uint32_t hp_vol_data;
 	struct device_rgb_led_data rgb_led_data;
+	uint32_t midi_mode;
 };
 
 /**
@@ -193,8 +208,11 @@ struct device_ctrl_pkt {
 	// command payload
 	union device_pkt_payload payload;
 
+	// CRC of the preceding bytes, see compute_device_pkt_crc()
+	uint16_t crc;
+
 	// reserved data for padding
-	uint8_t reserved[3];
+	uint8_t reserved;
 
 	// magic stop char 'd'
 	uint8_t magic_stop;
@@ -204,8 +222,12 @@ struct device_ctrl_pkt {
 #define DEVICE_CTRL_PKT_SIZE 128
 #define DEVICE_CTRL_PKT_SIZE_WORDS 32
 
+// Offset of the crc field, the crc covers all the bytes preceding it
+#define DEVICE_CTRL_PKT_CRC_OFFSET 124
+
 COMPILER_VERIFY(sizeof(struct device_ctrl_pkt) == DEVICE_CTRL_PKT_SIZE);
 COMPILER_VERIFY(sizeof(struct device_ctrl_pkt)/4 == DEVICE_CTRL_PKT_SIZE_WORDS);
+COMPILER_VERIFY(offsetof(struct device_ctrl_pkt, crc) == DEVICE_CTRL_PKT_CRC_OFFSET);
 COMPILER_VERIFY(sizeof(union device_pkt_payload) == DEVICE_CTRL_PKT_PAYLOAD_SIZE);
 COMPILER_VERIFY(sizeof(struct system_info_data)%4 == 0);
 COMPILER_VERIFY(sizeof(struct audio_channel_info_data)%4 == 0);
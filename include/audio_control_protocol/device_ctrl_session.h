@@ -0,0 +1,362 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Host side session layer for device control commands. Several
+ *        queries can be in flight at the same time, replies are matched to
+ *        their query by command and, where available, by ping code or
+ *        software channel id and direction. Each query has its own timeout
+ *        and number of retries. Completion is reported through a callback
+ *        or, with C++20 coroutines, by co_await-ing async_query().
+ *
+ *        A typical bring-up sends the ping, system info and all the channel
+ *        info queries back to back and then feeds every received packet to
+ *        process_reply() while calling poll() periodically.
+ *
+ *        The session is not thread safe and is not meant to be used from the
+ *        real-time thread.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef DEVICE_CTRL_SESSION_H_
+#define DEVICE_CTRL_SESSION_H_
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define DEVICE_CTRL_SESSION_HAS_COROUTINES 1
+#endif
+
+#include "device_packet_helper.h"
+
+namespace device_ctrl {
+
+enum class QueryStatus
+{
+    OK,         // A matching reply was received
+    TIMEOUT,    // No reply received after all the retries
+    CANCELLED   // The query was cancelled by cancel_all()
+};
+
+/**
+ * @brief Called once when a query completes. reply is only valid for the
+ *        duration of the call and is nullptr unless status is OK.
+ */
+using QueryCallback = std::function<void(QueryStatus status, const struct device_ctrl_pkt* reply)>;
+
+/**
+ * @brief Sends a packet to the device, returns false if it could not be sent.
+ */
+using SendFunction = std::function<bool(const struct device_ctrl_pkt& pkt)>;
+
+struct QueryOptions
+{
+    std::chrono::milliseconds timeout{100};  // Time to wait for a reply to each attempt
+    int max_retries{2};                      // Times the query is resent after a timeout
+};
+
+/**
+ * @brief Key used to match a query to its reply.
+ *
+ * @param pkt The device control packet
+ * @param is_reply true if pkt is a reply sent by the device
+ * @return The match key
+ */
+inline uint64_t get_query_match_key(const struct device_ctrl_pkt& pkt, bool is_reply)
+{
+    uint64_t key = static_cast<uint64_t>(pkt.device_cmd) << 32;
+
+    switch (pkt.device_cmd)
+    {
+    case DEVICE_PING:
+        return key | get_ping_code(&pkt);
+
+    case DEVICE_AUDIO_CHANNEL_INFO:
+        if (is_reply)
+        {
+            const auto* data = get_audio_channel_info_data(&pkt);
+            return key | (data->direction << 8) | data->sw_ch_id;
+        }
+        else
+        {
+            const auto* req = get_audio_channel_info_req(&pkt);
+            return key | (req->direction << 8) | req->sw_ch_id;
+        }
+
+    default:
+        return key;
+    }
+}
+
+class DeviceCtrlSession
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int DEFAULT_MAX_IN_FLIGHT = 8;
+
+    /**
+     * @brief Constructs a session.
+     *
+     * @param send Function used to send packets to the device
+     * @param max_in_flight Max number of queries waiting for a reply at the
+     *        same time, further queries are queued
+     */
+    explicit DeviceCtrlSession(SendFunction send, int max_in_flight = DEFAULT_MAX_IN_FLIGHT) :
+                                                       _send(std::move(send)),
+                                                       _max_in_flight(max_in_flight)
+    {
+        _in_flight.reserve(max_in_flight);
+    }
+
+    /**
+     * @brief Sends a query, or queues it if too many queries are in flight or
+     *        if a query with the same match key is already waiting for a reply.
+     *
+     * @param query The query packet, e.g. built with prepare_ping_cmd_query_pkt()
+     * @param callback Called when the query completes
+     * @param options Timeout and retries of the query
+     * @param now The current time
+     */
+    void send_query(const struct device_ctrl_pkt& query,
+                    QueryCallback callback,
+                    QueryOptions options = QueryOptions(),
+                    Clock::time_point now = Clock::now())
+    {
+        _pending.push_back({query, get_query_match_key(query, false), std::move(callback),
+                            options, options.max_retries, now});
+        _send_pending(now);
+    }
+
+    /**
+     * @brief Matches a packet received from the device against the queries in
+     *        flight and completes the matching query. A channel info reply
+     *        for a non valid channel is matched to the oldest channel info
+     *        query in flight.
+     *
+     * @param reply The received packet
+     * @param now The current time
+     * @return true if the packet completed a query, false otherwise
+     */
+    bool process_reply(const struct device_ctrl_pkt& reply, Clock::time_point now = Clock::now())
+    {
+        if (check_device_pkt_for_magic_words(&reply) == 0)
+        {
+            return false;
+        }
+
+        uint64_t key = get_query_match_key(reply, true);
+        bool wildcard = check_for_audio_channel_info_cmd(&reply) &&
+                        get_audio_channel_info_data(&reply)->sw_ch_id == DEVICE_CTRL_AUDIO_CHANNEL_NOT_VALID;
+
+        for (auto i = _in_flight.begin(); i != _in_flight.end(); ++i)
+        {
+            if (i->key == key || (wildcard && (i->key >> 32) == (key >> 32)))
+            {
+                auto callback = std::move(i->callback);
+                _in_flight.erase(i);
+                _send_pending(now);
+                callback(QueryStatus::OK, &reply);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Handles timeouts and retries, should be called periodically.
+     *
+     * @param now The current time
+     */
+    void poll(Clock::time_point now = Clock::now())
+    {
+        std::vector<QueryCallback> timed_out;
+
+        for (auto i = _in_flight.begin(); i != _in_flight.end();)
+        {
+            if (now < i->deadline)
+            {
+                ++i;
+            }
+            else if (i->retries_left > 0)
+            {
+                i->retries_left--;
+                i->deadline = now + i->options.timeout;
+                _send(i->query);
+                ++i;
+            }
+            else
+            {
+                timed_out.push_back(std::move(i->callback));
+                i = _in_flight.erase(i);
+            }
+        }
+
+        _send_pending(now);
+
+        for (auto& callback : timed_out)
+        {
+            callback(QueryStatus::TIMEOUT, nullptr);
+        }
+    }
+
+    /**
+     * @brief Cancels all the queries in flight or queued.
+     */
+    void cancel_all()
+    {
+        std::vector<QueryCallback> cancelled;
+        for (auto& query : _in_flight)
+        {
+            cancelled.push_back(std::move(query.callback));
+        }
+        for (auto& query : _pending)
+        {
+            cancelled.push_back(std::move(query.callback));
+        }
+        _in_flight.clear();
+        _pending.clear();
+
+        for (auto& callback : cancelled)
+        {
+            callback(QueryStatus::CANCELLED, nullptr);
+        }
+    }
+
+    int num_in_flight() const
+    {
+        return static_cast<int>(_in_flight.size());
+    }
+
+    int num_pending() const
+    {
+        return static_cast<int>(_pending.size());
+    }
+
+#ifdef DEVICE_CTRL_SESSION_HAS_COROUTINES
+    struct QueryResult
+    {
+        QueryStatus status;
+        struct device_ctrl_pkt reply;
+    };
+
+    /**
+     * @brief Awaitable returned by async_query(). The awaiting coroutine is
+     *        resumed from within process_reply(), poll() or cancel_all().
+     */
+    class QueryAwaitable
+    {
+    public:
+        QueryAwaitable(DeviceCtrlSession& session,
+                       const struct device_ctrl_pkt& query,
+                       QueryOptions options) : _session(session),
+                                               _query(query),
+                                               _options(options) {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            _session.send_query(_query, [this, handle](QueryStatus status, const struct device_ctrl_pkt* reply)
+            {
+                _result.status = status;
+                if (reply)
+                {
+                    _result.reply = *reply;
+                }
+                handle.resume();
+            }, _options);
+        }
+
+        QueryResult await_resume() const noexcept
+        {
+            return _result;
+        }
+
+    private:
+        DeviceCtrlSession& _session;
+        struct device_ctrl_pkt _query;
+        QueryOptions _options;
+        QueryResult _result{};
+    };
+
+    /**
+     * @brief Sends a query and suspends the calling coroutine until it
+     *        completes, e.g. auto result = co_await session.async_query(pkt);
+     */
+    QueryAwaitable async_query(const struct device_ctrl_pkt& query, QueryOptions options = QueryOptions())
+    {
+        return QueryAwaitable(*this, query, options);
+    }
+#endif
+
+private:
+    struct Query
+    {
+        struct device_ctrl_pkt query;
+        uint64_t key;
+        QueryCallback callback;
+        QueryOptions options;
+        int retries_left;
+        Clock::time_point deadline;
+    };
+
+    bool _key_in_flight(uint64_t key) const
+    {
+        for (const auto& query : _in_flight)
+        {
+            if (query.key == key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _send_pending(Clock::time_point now)
+    {
+        for (auto i = _pending.begin(); i != _pending.end() &&
+                                        static_cast<int>(_in_flight.size()) < _max_in_flight;)
+        {
+            if (_key_in_flight(i->key))
+            {
+                ++i;
+                continue;
+            }
+            // a failed send is handled as a lost packet and retried on timeout
+            _send(i->query);
+            i->deadline = now + i->options.timeout;
+            _in_flight.push_back(std::move(*i));
+            i = _pending.erase(i);
+        }
+    }
+
+    SendFunction _send;
+    int _max_in_flight;
+    std::vector<Query> _in_flight;
+    std::deque<Query> _pending;
+};
+
+} // namespace device_ctrl
+
+#endif // DEVICE_CTRL_SESSION_H_
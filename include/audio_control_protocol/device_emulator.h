@@ -0,0 +1,630 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Software stand-in for the microcontroller firmware, implementing the
+ *        device side of both protocols over PacketLinks. It answers the
+ *        device control queries with the prepare_xxx_reply_pkt() helpers,
+ *        starts and stops streaming on DEVICE_START / DEVICE_STOP and, while
+ *        streaming, emits one audio control packet per audio period.
+ *
+ *        The emitted stream can be impaired with period jitter, clock drift,
+ *        packet loss and midi and gpio load, to load test the host without
+ *        the hardware. Drift is reported in timing_error as the accumulated
+ *        offset in nanoseconds between the device and the nominal period
+ *        clock.
+ *
+ *        Either run the emulator on its own thread with start()/stop(), or
+ *        drive it manually with process_control() and process_period().
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef DEVICE_EMULATOR_H_
+#define DEVICE_EMULATOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "audio_packet_templates.h"
+#include "device_packet_helper.h"
+#include "midi_timestamp_helper.h"
+#include "midi_ump_helper.h"
+#include "packet_link.h"
+
+namespace device_ctrl {
+
+struct DeviceEmulatorConfig
+{
+    // Identity reported to the host
+    std::string hat_name{"emulator"};
+    uint8_t major_vers{AUDIO_PROTOCOL_VERSION_MAJ};
+    uint8_t minor_vers{AUDIO_PROTOCOL_VERSION_MIN};
+    uint8_t board_vers{0};
+    uint32_t system_info_flags{0};
+    uint32_t sampling_rate{48000};
+    uint8_t num_audio_inputs{8};
+    uint8_t num_audio_outputs{8};
+    uint8_t num_midi_inputs{1};
+    uint8_t num_midi_outputs{1};
+    uint8_t sample_format{INT24_LJ};
+    int buffer_size{64};            // Frames per period, replaced by a non zero buffer size in DEVICE_START
+    bool timestamped_midi{false};   // Support DEVICE_MIDI_MODE, advertised in the system info flags
+    bool ump_midi{false};           // Support DEVICE_MIDI_MODE_UMP, advertised in the system info flags
+
+    // Impairments and load of the audio packet stream
+    double jitter_us{0.0};          // Max deviation of the start of each period, uniformly distributed
+    double drift_ppm{0.0};          // Deviation of the device period from the nominal one
+    double packet_loss{0.0};        // Probability that an audio packet is lost
+    double midi_load{0.0};          // Probability that an audio packet carries midi data
+    int midi_bytes_per_pkt{3};
+    double gpio_load{0.0};          // Probability that an audio packet without midi carries gpio data
+    int gpio_blobs_per_pkt{1};
+    uint32_t seed{1};
+};
+
+struct DeviceEmulatorStats
+{
+    uint64_t control_pkts_received;
+    uint64_t control_replies_sent;
+    uint64_t audio_pkts_sent;
+    uint64_t audio_pkts_lost;       // Dropped on purpose by packet_loss or because the link was full
+    uint64_t audio_pkts_received;
+    uint64_t midi_bytes_sent;
+    uint64_t midi_bytes_received;
+    uint64_t gpio_blobs_sent;
+};
+
+class DeviceEmulator
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructs an emulator, which is initially not streaming.
+     *
+     * @param config The device configuration
+     * @param control_link The device end of the device control packet link
+     * @param audio_link The device end of the audio control packet link
+     */
+    DeviceEmulator(const DeviceEmulatorConfig& config,
+                   audio_ctrl::PacketLink<struct device_ctrl_pkt>& control_link,
+                   audio_ctrl::PacketLink<audio_ctrl::AudioCtrlPkt>& audio_link) : _config(config),
+                                                                        _control_link(control_link),
+                                                                        _audio_link(audio_link),
+                                                                        _buffer_size(std::max(config.buffer_size, 1)),
+                                                                        _random(config.seed)
+    {
+        audio_ctrl::init_audio_pkt_template_cache(&_templates);
+        // Note on messages, so that the midi stream can be parsed
+        const uint8_t note_on[3] = {0x90, 60, 100};
+        for (int i = 0; i < AUDIO_CTRL_PKT_PAYLOAD_SIZE; i++)
+        {
+            _midi_data[i] = note_on[i % 3];
+        }
+        std::memset(_gpio_data, 0, sizeof(_gpio_data));
+    }
+
+    DeviceEmulator(const DeviceEmulator&) = delete;
+    DeviceEmulator& operator=(const DeviceEmulator&) = delete;
+
+    ~DeviceEmulator()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Start a thread running the emulator until stop() is called. Audio
+     *        periods are scheduled on an absolute timeline, so jitter does not
+     *        accumulate.
+     *
+     * @return true if started, false if already running
+     */
+    bool start()
+    {
+        if (_thread.joinable())
+        {
+            return false;
+        }
+        _running.store(true, std::memory_order_release);
+        _thread = std::thread([this] { _run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if (!_thread.joinable())
+        {
+            return;
+        }
+        _running.store(false, std::memory_order_release);
+        _thread.join();
+    }
+
+    /**
+     * @brief Handle all the device control packets received from the host.
+     *
+     * @return The number of packets handled
+     */
+    int process_control()
+    {
+        int num_pkts = 0;
+        struct device_ctrl_pkt pkt;
+        while (_control_link.receive(pkt))
+        {
+            _add(_stats.control_pkts_received, 1);
+            if (check_device_pkt_for_magic_words(&pkt))
+            {
+                _handle_control_pkt(pkt);
+            }
+            num_pkts++;
+        }
+        return num_pkts;
+    }
+
+    /**
+     * @brief Run one audio period, without waiting: consume the audio packets
+     *        from the host and, if streaming, emit the packet of the period.
+     *
+     * @return true if a packet was sent to the host
+     */
+    bool process_period()
+    {
+        _receive_audio_pkts();
+        if (!_streaming.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        uint32_t seq = _seq++;
+        // _run() started this period jitter_ns off its nominal time. The
+        // jitter of the next period is drawn now, so that _run() applies it
+        // to the wakeup of the same period it is reported in
+        double jitter_ns = _next_jitter_ns;
+        _next_jitter_ns = _config.jitter_us * 1000.0 * _uniform(_random);
+        if (_probability(_random) < _config.packet_loss)
+        {
+            _add(_stats.audio_pkts_lost, 1);
+            return false;
+        }
+
+        audio_ctrl::AudioCtrlPkt pkt;
+        if (_probability(_random) < _config.midi_load)
+        {
+            uint8_t num_bytes = static_cast<uint8_t>(std::clamp(_config.midi_bytes_per_pkt, 0, AUDIO_CTRL_PKT_PAYLOAD_SIZE));
+            uint32_t midi_mode = _midi_mode.load(std::memory_order_relaxed);
+            if (midi_mode == DEVICE_MIDI_MODE_TIMESTAMPED)
+            {
+                num_bytes = _prepare_timestamped_midi_pkt(pkt, num_bytes);
+            }
+            else if (midi_mode == DEVICE_MIDI_MODE_UMP)
+            {
+                num_bytes = _prepare_ump_midi_pkt(pkt, num_bytes);
+            }
+            else
+            {
+                _prepare_raw_midi_pkt(pkt, num_bytes);
+            }
+            _add(_stats.midi_bytes_sent, num_bytes);
+        }
+        else if (_probability(_random) < _config.gpio_load)
+        {
+            uint8_t num_blobs = static_cast<uint8_t>(std::clamp(_config.gpio_blobs_per_pkt, 0, AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS));
+            _gpio_data[0].data[0]++;
+            audio_ctrl::patch_gpio_cmd_pkt(&_templates, &pkt, _gpio_data, num_blobs);
+            _add(_stats.gpio_blobs_sent, num_blobs);
+        }
+        else
+        {
+            audio_ctrl::copy_audio_pkt_template(&_templates, audio_ctrl::AUDIO_PKT_TEMPLATE_NULL, &pkt);
+        }
+
+        // The device clock is late by drift_ppm of the elapsed nominal time,
+        // plus the jitter of this period. Saturates once the accumulated
+        // drift no longer fits, e.g. after about 6 hours at 100 ppm
+        double nominal_ns = double(seq) * _period_ns();
+        double timing_error = nominal_ns * _config.drift_ppm * 1e-6 + jitter_ns;
+        pkt.seq = seq;
+        pkt.timing_error = static_cast<int32_t>(std::clamp(timing_error, double(INT32_MIN), double(INT32_MAX)));
+        pkt.gate_in = _gate_in.load(std::memory_order_relaxed);
+        pkt.gate_out = _gate_out;
+        audio_ctrl::set_audio_pkt_crc(&pkt);
+
+        if (!_audio_link.send(pkt))
+        {
+            _add(_stats.audio_pkts_lost, 1);
+            return false;
+        }
+        _add(_stats.audio_pkts_sent, 1);
+        return true;
+    }
+
+    uint32_t midi_mode() const
+    {
+        return _midi_mode.load(std::memory_order_relaxed);
+    }
+
+    bool streaming() const
+    {
+        return _streaming.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief true if the host has muted the audio with AUDIO_CMD_MUTE
+     */
+    bool muted() const
+    {
+        return _muted.load(std::memory_order_relaxed);
+    }
+
+    int buffer_size() const
+    {
+        return _buffer_size.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Set the gate input values reported to the host.
+     */
+    void set_gate_in(uint32_t gate_in)
+    {
+        _gate_in.store(gate_in, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the counters, can be called from any thread.
+     */
+    DeviceEmulatorStats stats() const
+    {
+        return {_stats.control_pkts_received.load(std::memory_order_relaxed),
+                _stats.control_replies_sent.load(std::memory_order_relaxed),
+                _stats.audio_pkts_sent.load(std::memory_order_relaxed),
+                _stats.audio_pkts_lost.load(std::memory_order_relaxed),
+                _stats.audio_pkts_received.load(std::memory_order_relaxed),
+                _stats.midi_bytes_sent.load(std::memory_order_relaxed),
+                _stats.midi_bytes_received.load(std::memory_order_relaxed),
+                _stats.gpio_blobs_sent.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> control_pkts_received{0};
+        std::atomic<uint64_t> control_replies_sent{0};
+        std::atomic<uint64_t> audio_pkts_sent{0};
+        std::atomic<uint64_t> audio_pkts_lost{0};
+        std::atomic<uint64_t> audio_pkts_received{0};
+        std::atomic<uint64_t> midi_bytes_sent{0};
+        std::atomic<uint64_t> midi_bytes_received{0};
+        std::atomic<uint64_t> gpio_blobs_sent{0};
+    };
+
+    // Only the emulator thread writes the counters
+    static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    double _period_ns() const
+    {
+        return 1e9 * double(_buffer_size.load(std::memory_order_relaxed)) / double(std::max(_config.sampling_rate, 1u));
+    }
+
+    void _send_reply(struct device_ctrl_pkt& reply)
+    {
+        set_device_pkt_crc(&reply);
+        if (_control_link.send(reply))
+        {
+            _add(_stats.control_replies_sent, 1);
+        }
+    }
+
+    void _handle_control_pkt(const struct device_ctrl_pkt& pkt)
+    {
+        struct device_ctrl_pkt reply;
+        switch (pkt.device_cmd)
+        {
+        case DEVICE_PING:
+            prepare_ping_cmd_reply_pkt(&reply, get_ping_code(&pkt));
+            _send_reply(reply);
+            break;
+
+        case DEVICE_FIRMWARE_VERSION_CHECK:
+            prepare_version_check_reply_pkt(&reply, _config.major_vers, _config.minor_vers, _config.board_vers);
+            _send_reply(reply);
+            break;
+
+        case DEVICE_SYSTEM_INFO:
+        {
+            struct system_info_data info = {};
+            std::strncpy(reinterpret_cast<char*>(info.hat_name), _config.hat_name.c_str(), DEVICE_CTRL_PKT_HAT_NAME_SIZE - 1);
+            info.flags = _config.system_info_flags;
+            if (_config.timestamped_midi)
+            {
+                info.flags |= DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_TIMESTAMPED_MIDI;
+            }
+            if (_config.ump_midi)
+            {
+                info.flags |= DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_UMP_MIDI;
+            }
+            info.sampling_rate = _config.sampling_rate;
+            info.num_audio_inputs = _config.num_audio_inputs;
+            info.num_audio_outputs = _config.num_audio_outputs;
+            info.num_midi_inputs = _config.num_midi_inputs;
+            info.num_midi_outputs = _config.num_midi_outputs;
+            prepare_system_info_cmd_reply_pkt(&reply, &info);
+            _send_reply(reply);
+            break;
+        }
+
+        case DEVICE_AUDIO_CHANNEL_INFO:
+        {
+            struct audio_channel_info_data info = {};
+            _fill_channel_info(*get_audio_channel_info_req(&pkt), info);
+            prepare_audio_channel_info_cmd_reply_pkt(&reply, &info);
+            _send_reply(reply);
+            break;
+        }
+
+        case DEVICE_START:
+        {
+            int buffer_size = check_for_start_cmd(&pkt);
+            if (buffer_size > 0)
+            {
+                _buffer_size.store(buffer_size, std::memory_order_relaxed);
+            }
+            _seq = 0;
+            _streaming.store(true, std::memory_order_relaxed);
+            break;
+        }
+
+        case DEVICE_STOP:
+            _streaming.store(false, std::memory_order_relaxed);
+            break;
+
+        case DEVICE_MIDI_MODE:
+        {
+            uint32_t midi_mode = get_midi_mode_data(&pkt);
+            bool supported = (midi_mode == DEVICE_MIDI_MODE_TIMESTAMPED && _config.timestamped_midi) ||
+                             (midi_mode == DEVICE_MIDI_MODE_UMP && _config.ump_midi);
+            _midi_mode.store(supported ? midi_mode : static_cast<uint32_t>(DEVICE_MIDI_MODE_RAW), std::memory_order_relaxed);
+            prepare_midi_mode_cmd_reply_pkt(&reply, _midi_mode.load(std::memory_order_relaxed));
+            _send_reply(reply);
+            break;
+        }
+
+        default:
+            // Gain, volume, led and raw data commands have no effect
+            break;
+        }
+    }
+
+    /**
+     * @brief Channels are interleaved, with the inputs and the outputs in
+     *        separate buffers.
+     */
+    void _fill_channel_info(const struct audio_channel_info_req& req, struct audio_channel_info_data& info) const
+    {
+        int num_channels = req.direction == INPUT_DIRECTION ? _config.num_audio_inputs : _config.num_audio_outputs;
+        info.direction = req.direction;
+        if (req.sw_ch_id >= num_channels || req.direction > OUTPUT_DIRECTION)
+        {
+            info.sw_ch_id = DEVICE_CTRL_AUDIO_CHANNEL_NOT_VALID;
+            info.hw_ch_id = DEVICE_CTRL_AUDIO_CHANNEL_NOT_VALID;
+            return;
+        }
+        info.sw_ch_id = req.sw_ch_id;
+        info.hw_ch_id = req.sw_ch_id;
+        info.sample_format = _config.sample_format;
+        std::snprintf(reinterpret_cast<char*>(info.channel_name), DEVICE_CTRL_PKT_AUDIO_CHANNEL_NAME_SIZE, "%s %d",
+                      req.direction == INPUT_DIRECTION ? "in" : "out", req.sw_ch_id);
+        info.start_offset_in_words = req.sw_ch_id;
+        info.stride_in_words = num_channels;
+    }
+
+    /**
+     * @brief A complete midi message of 1 or 2 bytes, to carry the bytes left
+     *        over by the 3 byte note on messages.
+     */
+    static const uint8_t* _tail_midi_message(int size)
+    {
+        static const uint8_t PROGRAM_CHANGE[2] = {0xC0, 0};
+        static const uint8_t TIMING_CLOCK[1] = {0xF8};
+        return size == 2 ? PROGRAM_CHANGE : TIMING_CLOCK;
+    }
+
+    /**
+     * @brief Note on messages, the last 1 or 2 bytes are a program change or
+     *        a timing clock message, so that only complete messages are sent.
+     */
+    void _prepare_raw_midi_pkt(audio_ctrl::AudioCtrlPkt& pkt, int num_bytes)
+    {
+        audio_ctrl::patch_midi_data_pkt(&_templates, &pkt, _midi_data, static_cast<uint8_t>(num_bytes));
+        int remainder = num_bytes % 3;
+        if (remainder > 0)
+        {
+            std::memcpy(&pkt.payload.midi_data[num_bytes - remainder], _tail_midi_message(remainder), remainder);
+        }
+    }
+
+    /**
+     * @brief Note on events of 3 bytes spread evenly over the period, the last
+     *        1 or 2 bytes as with _prepare_raw_midi_pkt().
+     *
+     * @return The number of midi bytes in the packet, less than num_bytes
+     *         only if the events do not fit in the payload
+     */
+    uint8_t _prepare_timestamped_midi_pkt(audio_ctrl::AudioCtrlPkt& pkt, int num_bytes)
+    {
+        audio_ctrl::prepare_timestamped_midi_data_pkt(&pkt);
+        int num_events = (num_bytes + 2) / 3;
+        int buffer_size = _buffer_size.load(std::memory_order_relaxed);
+        int num_sent = 0;
+        for (int i = 0; i < num_events; i++)
+        {
+            int size = std::min(3, num_bytes - i * 3);
+            const uint8_t* message = size == 3 ? _midi_data : _tail_midi_message(size);
+            auto frame_offset = static_cast<uint16_t>(i * buffer_size / num_events);
+            if (!audio_ctrl::add_timestamped_midi_event(&pkt, frame_offset, message, static_cast<uint8_t>(size)))
+            {
+                break;
+            }
+            num_sent += size;
+        }
+        return static_cast<uint8_t>(num_sent);
+    }
+
+    /**
+     * @brief Note on messages as MIDI 1.0 channel voice UMP messages, 1 word
+     *        for every 3 midi bytes. The last 1 or 2 bytes are sent as a
+     *        timing clock or a program change message.
+     *
+     * @return The number of midi bytes carried by the packet, less than
+     *         num_bytes only if the words do not fit in the payload
+     */
+    uint8_t _prepare_ump_midi_pkt(audio_ctrl::AudioCtrlPkt& pkt, int num_bytes)
+    {
+        audio_ctrl::patch_midi_ump_data_pkt(&_templates, &pkt, nullptr, 0);
+        uint32_t note_on;
+        audio_ctrl::midi1_to_ump(0, _midi_data, 3, &note_on);
+        int num_messages = std::min(num_bytes / 3, AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS);
+        for (int i = 0; i < num_messages; i++)
+        {
+            audio_ctrl::add_ump_message(&pkt, &note_on);
+        }
+        int num_sent = num_messages * 3;
+        int remainder = num_bytes - num_sent;
+        if (remainder > 0 && remainder < 3 && num_messages < AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+        {
+            uint32_t word;
+            audio_ctrl::midi1_to_ump(0, _tail_midi_message(remainder), remainder, &word);
+            audio_ctrl::add_ump_message(&pkt, &word);
+            num_sent += remainder;
+        }
+        return static_cast<uint8_t>(num_sent);
+    }
+
+    static int _count_ump_midi_bytes(const audio_ctrl::AudioCtrlPkt& pkt)
+    {
+        uint8_t midi_data[UMP_MIDI1_MAX_SIZE];
+        int offset = 0;
+        int num_words;
+        int total = 0;
+        while (const uint32_t* message = audio_ctrl::next_ump_message(&pkt, &offset, &num_words))
+        {
+            total += audio_ctrl::ump_to_midi1(message, midi_data);
+        }
+        return total;
+    }
+
+    static int _count_midi_bytes(const audio_ctrl::AudioCtrlPkt& pkt)
+    {
+        audio_ctrl::MidiEventIterator events;
+        audio_ctrl::init_midi_event_iterator(&events, &pkt);
+        uint32_t frame_offset;
+        int num_bytes;
+        int total = 0;
+        while (audio_ctrl::next_midi_event(&events, &frame_offset, &num_bytes))
+        {
+            total += num_bytes;
+        }
+        return total;
+    }
+
+    void _receive_audio_pkts()
+    {
+        audio_ctrl::AudioCtrlPkt pkt;
+        while (_audio_link.receive(pkt))
+        {
+            _add(_stats.audio_pkts_received, 1);
+            if (audio_ctrl::check_audio_pkt_for_magic_words(&pkt) == 0)
+            {
+                continue;
+            }
+            if (audio_ctrl::check_for_audio_mute_cmd(&pkt))
+            {
+                _muted.store(true, std::memory_order_relaxed);
+            }
+            else if (audio_ctrl::check_for_audio_unmute_cmd(&pkt))
+            {
+                _muted.store(false, std::memory_order_relaxed);
+            }
+            else if (audio_ctrl::check_for_midi_data(&pkt))
+            {
+                _add(_stats.midi_bytes_received, _count_midi_bytes(pkt));
+            }
+            else if (audio_ctrl::check_for_midi_ump_data(&pkt))
+            {
+                _add(_stats.midi_bytes_received, _count_ump_midi_bytes(pkt));
+            }
+            _gate_out = pkt.gate_out;
+        }
+    }
+
+    void _run()
+    {
+        auto next_period = Clock::now();
+        while (_running.load(std::memory_order_acquire))
+        {
+            process_control();
+            if (!_streaming.load(std::memory_order_relaxed))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                next_period = Clock::now();
+                _next_jitter_ns = 0.0;
+                continue;
+            }
+            process_period();
+
+            double period_ns = _period_ns() * (1.0 + _config.drift_ppm * 1e-6);
+            next_period += std::chrono::nanoseconds(static_cast<int64_t>(period_ns));
+            auto jitter = std::chrono::nanoseconds(static_cast<int64_t>(_next_jitter_ns));
+            std::this_thread::sleep_until(next_period + jitter);
+        }
+    }
+
+    DeviceEmulatorConfig _config;
+    audio_ctrl::PacketLink<struct device_ctrl_pkt>& _control_link;
+    audio_ctrl::PacketLink<audio_ctrl::AudioCtrlPkt>& _audio_link;
+
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _streaming{false};
+    std::atomic<bool> _muted{true};
+    std::atomic<int> _buffer_size;
+    std::atomic<uint32_t> _gate_in{0};
+    std::atomic<uint32_t> _midi_mode{DEVICE_MIDI_MODE_RAW};
+    std::thread _thread;
+
+    // emulator thread owned
+    audio_ctrl::AudioPktTemplateCache _templates;
+    uint32_t _seq{0};
+    uint32_t _gate_out{0};
+    double _next_jitter_ns{0.0};
+    uint8_t _midi_data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+    struct audio_ctrl::GpioDataBlob _gpio_data[AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS];
+    std::mt19937 _random;
+    std::uniform_real_distribution<double> _uniform{-1.0, 1.0};
+    std::uniform_real_distribution<double> _probability{0.0, 1.0};
+
+    AtomicStats _stats;
+};
+
+} // namespace device_ctrl
+
+#endif // DEVICE_EMULATOR_H_
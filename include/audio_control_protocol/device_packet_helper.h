@@ -30,6 +30,7 @@
 #define DEVICE_PACKET_HELPER_H_
 
 #include "device_control_protocol.h"
+#include "packet_crc.h"
 
 #ifdef __cplusplus
 namespace device_ctrl {
@@ -87,6 +88,40 @@ inline int check_device_pkt_for_magic_words(const struct
 	return 1;
 }
 
+/**
+ * @brief Computes the crc of the packet. The crc covers all the bytes
+ *        preceding the crc field, see packet_crc.h for the algorithm.
+ *
+ * @param pkt The device control packet.
+ * @return The 16 bit crc of the packet.
+ */
+inline uint16_t compute_device_pkt_crc(const struct device_ctrl_pkt* const pkt)
+{
+	return compute_pkt_crc((const uint8_t*) pkt, DEVICE_CTRL_PKT_CRC_OFFSET);
+}
+
+/**
+ * @brief Computes the crc of the packet and stores it in the crc field. This
+ *        should be the last operation done on a packet before sending it.
+ *
+ * @param pkt The device control packet.
+ */
+inline void set_device_pkt_crc(struct device_ctrl_pkt* const pkt)
+{
+	pkt->crc = compute_device_pkt_crc(pkt);
+}
+
+/**
+ * @brief Verifies the crc of the packet.
+ *
+ * @param pkt The device control packet.
+ * @return 1 if the crc field matches the packet content, 0 if not.
+ */
+inline int check_device_pkt_crc(const struct device_ctrl_pkt* const pkt)
+{
+	return compute_device_pkt_crc(pkt) == pkt->crc;
+}
+
 /**
  * @brief Check if a device packet has a null command.
  *
@@ -534,6 +569,65 @@ inline struct device_rgb_led_data* get_rgb_led_data(struct device_ctrl_pkt* pkt)
 	return &pkt->payload.rgb_led_data;
 }
 
+/**
+ * @brief Check if packet has a midi mode command.
+ *
+ * @param pkt The device control packet.
+ * @return 1 if packet has midi mode command, 0 otherwise.
+ */
+inline int check_for_midi_mode_cmd_pkt(const struct device_ctrl_pkt* const pkt)
+{
+	if (pkt->device_cmd == DEVICE_MIDI_MODE)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Get the midi mode from the packet (assuming it is a midi mode command).
+ *
+ * @param pkt The device control packet.
+ * @return The midi mode as of device_midi_mode enum.
+ */
+inline uint32_t get_midi_mode_data(const struct device_ctrl_pkt* const pkt)
+{
+	return pkt->payload.midi_mode;
+}
+
+/**
+ * @brief Prepares a midi mode command query, requesting the encoding of the
+ *        midi data in both directions. Should only be sent to devices with
+ *        the DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_TIMESTAMPED_MIDI flag, or
+ *        DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_UMP_MIDI for DEVICE_MIDI_MODE_UMP.
+ *
+ * @param pkt The device control packet.
+ * @param midi_mode The requested midi mode as of device_midi_mode enum.
+ */
+inline void prepare_midi_mode_cmd_query_pkt(struct device_ctrl_pkt* const pkt,
+					uint32_t midi_mode)
+{
+	create_default_device_ctrl_pkt(pkt);
+	pkt->device_cmd = DEVICE_MIDI_MODE;
+	pkt->payload.midi_mode = midi_mode;
+}
+
+/**
+ * @brief Prepares a midi mode command reply.
+ *
+ * @param pkt The device control packet.
+ * @param midi_mode The midi mode in use from now on, DEVICE_MIDI_MODE_RAW
+ *        if the requested mode is not supported.
+ */
+inline void prepare_midi_mode_cmd_reply_pkt(struct device_ctrl_pkt* const pkt,
+					uint32_t midi_mode)
+{
+	create_default_device_ctrl_pkt(pkt);
+	pkt->device_cmd = DEVICE_MIDI_MODE;
+	pkt->payload.midi_mode = midi_mode;
+}
+
 /**
  * @brief Check if packet has a raw data command.
  *
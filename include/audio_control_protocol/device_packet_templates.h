@@ -0,0 +1,111 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Prebuilt device control packets, see audio_packet_templates.h. The
+ *        patch_ functions copy a template built once with the prepare_
+ *        helpers and only write the fields which vary.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef DEVICE_PACKET_TEMPLATES_H_
+#define DEVICE_PACKET_TEMPLATES_H_
+
+#include "device_packet_helper.h"
+
+#ifdef __cplusplus
+namespace device_ctrl {
+#endif
+
+/**
+ * @brief Identifiers of the packet templates
+ */
+enum device_pkt_template_id {
+	DEVICE_PKT_TEMPLATE_NULL = 0,
+	DEVICE_PKT_TEMPLATE_PING,
+	DEVICE_PKT_TEMPLATE_START,
+	DEVICE_PKT_TEMPLATE_STOP,
+	DEVICE_PKT_NUM_TEMPLATES
+};
+
+struct device_pkt_template_cache {
+	struct device_ctrl_pkt pkts[DEVICE_PKT_NUM_TEMPLATES];
+};
+
+/**
+ * @brief Build all the templates of the cache. Should be called once, before
+ *        any of the other functions.
+ *
+ * @param cache The template cache.
+ */
+inline void init_device_pkt_template_cache(struct device_pkt_template_cache* const cache)
+{
+	create_default_device_ctrl_pkt(&cache->pkts[DEVICE_PKT_TEMPLATE_NULL]);
+	prepare_ping_cmd_query_pkt(&cache->pkts[DEVICE_PKT_TEMPLATE_PING], 0);
+	prepare_start_cmd_pkt(&cache->pkts[DEVICE_PKT_TEMPLATE_START], 0);
+	prepare_stop_cmd_pkt(&cache->pkts[DEVICE_PKT_TEMPLATE_STOP]);
+}
+
+/**
+ * @brief Copy a template into a packet.
+ *
+ * @param cache The template cache.
+ * @param template_id The template to copy.
+ * @param pkt The device control packet.
+ */
+inline void copy_device_pkt_template(const struct device_pkt_template_cache* const cache,
+					enum device_pkt_template_id template_id,
+					struct device_ctrl_pkt* const pkt)
+{
+	*pkt = cache->pkts[template_id];
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_ping_cmd_query_pkt() and
+ *        prepare_ping_cmd_reply_pkt().
+ */
+inline void patch_ping_cmd_pkt(const struct device_pkt_template_cache* const cache,
+				struct device_ctrl_pkt* const pkt,
+				uint32_t ping_code)
+{
+	*pkt = cache->pkts[DEVICE_PKT_TEMPLATE_PING];
+	pkt->payload.ping_code = ping_code;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_start_cmd_pkt().
+ */
+inline void patch_start_cmd_pkt(const struct device_pkt_template_cache* const cache,
+				struct device_ctrl_pkt* const pkt,
+				int buffer_size)
+{
+	*pkt = cache->pkts[DEVICE_PKT_TEMPLATE_START];
+	pkt->payload.buffer_size = buffer_size;
+}
+
+/**
+ * @brief Patch builder equivalent to prepare_stop_cmd_pkt().
+ */
+inline void patch_stop_cmd_pkt(const struct device_pkt_template_cache* const cache,
+				struct device_ctrl_pkt* const pkt)
+{
+	*pkt = cache->pkts[DEVICE_PKT_TEMPLATE_STOP];
+}
+
+#ifdef __cplusplus
+} // namespace device_ctrl
+#endif
+
+#endif // DEVICE_PACKET_TEMPLATES_H_
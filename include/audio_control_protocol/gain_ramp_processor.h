@@ -0,0 +1,311 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Click free muting of the audio channels. GainRampProcessor follows
+ *        the mute state of each channel, taken from the channel status array
+ *        and from the AUDIO_CMD_MUTE / AUDIO_CMD_UNMUTE commands, and applies
+ *        a linear or equal power gain ramp whenever the state of a channel
+ *        changes. Ramps can start at any frame of a period.
+ *
+ *        Only ramping channels are processed sample by sample. Channels which
+ *        are stably muted are cleared and stably unmuted channels are not
+ *        touched at all.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef GAIN_RAMP_PROCESSOR_H_
+#define GAIN_RAMP_PROCESSOR_H_
+
+#include <cstring>
+
+#include "audio_packet_helper.h"
+#include "audio_ch_status_mirror.h"
+#include "simd_helpers.h"
+
+namespace audio_ctrl {
+
+enum class GainRampShape
+{
+    LINEAR,
+    EQUAL_POWER     // Sine shaped, keeps the power constant in crossfades
+};
+
+class GainRampProcessor
+{
+public:
+    /**
+     * @brief Constructs a processor, all the channels start muted.
+     *
+     * @param num_ch The number of channels, at most AUDIO_CH_STATUS_MAX_CHANNELS
+     * @param ramp_length The length of a full ramp in samples, at least 1
+     * @param shape The shape of the ramps
+     */
+    GainRampProcessor(int num_ch,
+                      int ramp_length,
+                      GainRampShape shape = GainRampShape::LINEAR) : _num_ch(std::min(num_ch, AUDIO_CH_STATUS_MAX_CHANNELS)),
+                                                                     _ramp_length(std::max(ramp_length, 1)),
+                                                                     _inv_ramp_length(1.0f / static_cast<float>(_ramp_length)),
+                                                                     _shape(shape)
+    {
+        reset();
+    }
+
+    /**
+     * @brief Mute all the channels immediately, without ramps.
+     */
+    void reset()
+    {
+        _channels_unmuted = {};
+        _global_unmuted = true;
+        _targets = {};
+        _ramping = {};
+        for (int ch = 0; ch < AUDIO_CH_STATUS_MAX_CHANNELS; ch++)
+        {
+            _ramp_pos[ch] = 0;
+            _start_offset[ch] = 0;
+        }
+    }
+
+    /**
+     * @brief Set the mute state of the channels.
+     *
+     * @param unmuted The set of unmuted channels, typically
+     *        AudioChStatusMirror::unmuted()
+     * @param frame_offset The frame of the next period at which ramps start
+     */
+    void set_unmuted_channels(const AudioChMask& unmuted, int frame_offset = 0)
+    {
+        _channels_unmuted = unmuted;
+        _update_targets(frame_offset);
+    }
+
+    /**
+     * @brief Handle an AUDIO_CMD_MUTE or AUDIO_CMD_UNMUTE command, which mute
+     *        or unmute all the channels on top of their individual state.
+     *
+     * @param pkt The audio control packet
+     * @param frame_offset The frame of the next period at which ramps start
+     * @return true if the packet was a mute or unmute command, false otherwise
+     */
+    bool process_cmd(const AudioCtrlPkt* const pkt, int frame_offset = 0)
+    {
+        if (check_for_audio_mute_cmd(pkt))
+        {
+            _global_unmuted = false;
+        }
+        else if (check_for_audio_unmute_cmd(pkt))
+        {
+            _global_unmuted = true;
+        }
+        else
+        {
+            return false;
+        }
+        _update_targets(frame_offset);
+        return true;
+    }
+
+    /**
+     * @brief Apply the gains to one period of audio, in place.
+     *
+     * @param channels Array of num_ch planar buffers of num_frames samples
+     * @param num_frames The number of frames in the period
+     */
+    void process(float* const* channels, int num_frames)
+    {
+        for (int word = 0; word < AUDIO_CH_MASK_NUM_WORDS; word++)
+        {
+            uint64_t ramping = _ramping.words[word];
+            uint64_t muted = ~(_targets.words[word] | ramping) & _channel_mask(word);
+            while (ramping)
+            {
+                int ch = word * 64 + __builtin_ctzll(ramping);
+                ramping &= ramping - 1;
+                _process_ramp(ch, channels[ch], num_frames);
+            }
+            while (muted)
+            {
+                int ch = word * 64 + __builtin_ctzll(muted);
+                muted &= muted - 1;
+                std::memset(channels[ch], 0, static_cast<size_t>(num_frames) * sizeof(float));
+            }
+        }
+    }
+
+    /**
+     * @return true if the channel is in the middle of a ramp
+     */
+    bool is_ramping(int ch_idx) const
+    {
+        return audio_ch_mask_test(_ramping, ch_idx);
+    }
+
+    /**
+     * @return The gain which will be applied to the next sample of a channel
+     */
+    float current_gain(int ch_idx) const
+    {
+        return _gain_at(_ramp_pos[ch_idx]);
+    }
+
+private:
+    /**
+     * @brief The bits of the channels handled by the processor in a mask word
+     */
+    uint64_t _channel_mask(int word) const
+    {
+        int num_bits = std::min(std::max(_num_ch - word * 64, 0), 64);
+        return num_bits == 64 ? ~uint64_t(0) : (uint64_t(1) << num_bits) - 1;
+    }
+
+    void _update_targets(int frame_offset)
+    {
+        for (int word = 0; word < AUDIO_CH_MASK_NUM_WORDS; word++)
+        {
+            uint64_t targets = _global_unmuted ? _channels_unmuted.words[word] & _channel_mask(word) : 0;
+            uint64_t changed = targets ^ _targets.words[word];
+            _targets.words[word] = targets;
+            _ramping.words[word] |= changed;
+            while (changed)
+            {
+                int ch = word * 64 + __builtin_ctzll(changed);
+                changed &= changed - 1;
+                _start_offset[ch] = frame_offset;
+            }
+        }
+    }
+
+    float _gain_at(int ramp_pos) const
+    {
+        return _gain(static_cast<float>(ramp_pos) * _inv_ramp_length);
+    }
+
+    float _gain(float position) const
+    {
+        if (_shape == GainRampShape::LINEAR)
+        {
+            return position;
+        }
+        simd::VecF gain = _equal_power_gain(simd::set1_f(position));
+        float gains[simd::WIDTH];
+        simd::store_f(gains, gain);
+        return gains[0];
+    }
+
+    /**
+     * @brief sin(x * pi / 2) for x in [0, 1], as an odd polynomial (error < 4e-6).
+     */
+    static simd::VecF _equal_power_gain(simd::VecF x)
+    {
+        simd::VecF x2 = simd::mul_f(x, x);
+        simd::VecF poly = simd::set1_f(1.6044118e-4f);
+        poly = simd::add_f(simd::mul_f(poly, x2), simd::set1_f(-4.6817541e-3f));
+        poly = simd::add_f(simd::mul_f(poly, x2), simd::set1_f(7.9692626e-2f));
+        poly = simd::add_f(simd::mul_f(poly, x2), simd::set1_f(-6.4596409e-1f));
+        poly = simd::add_f(simd::mul_f(poly, x2), simd::set1_f(1.5707963f));
+        return simd::min_f(simd::mul_f(poly, x), simd::set1_f(1.0f));
+    }
+
+    /**
+     * @brief Apply a constant gain to a block of samples.
+     */
+    void _apply_constant(float* buffer, int num_frames, int ramp_pos) const
+    {
+        if (ramp_pos == 0)
+        {
+            std::memset(buffer, 0, static_cast<size_t>(num_frames) * sizeof(float));
+        }
+        else if (ramp_pos < _ramp_length)
+        {
+            float gain = _gain_at(ramp_pos);
+            for (int i = 0; i < num_frames; i++)
+            {
+                buffer[i] *= gain;
+            }
+        }
+    }
+
+    /**
+     * @brief Apply num_frames steps of a ramp starting from ramp_pos, sample i
+     *        gets the gain of position ramp_pos + direction * (i + 1).
+     */
+    void _apply_ramp(float* buffer, int num_frames, int ramp_pos, int direction) const
+    {
+        constexpr int W = simd::WIDTH;
+        float steps[W];
+        for (int lane = 0; lane < W; lane++)
+        {
+            steps[lane] = static_cast<float>(direction * (lane + 1));
+        }
+        const simd::VecF step_offsets = simd::load_f(steps);
+        const simd::VecF inv_length = simd::set1_f(_inv_ramp_length);
+        int i = 0;
+        for (; i + W <= num_frames; i += W)
+        {
+            simd::VecF start = simd::set1_f(static_cast<float>(ramp_pos + direction * i));
+            simd::VecF position = simd::mul_f(simd::add_f(start, step_offsets), inv_length);
+            simd::VecF gain = _shape == GainRampShape::LINEAR ? position : _equal_power_gain(position);
+            simd::store_f(buffer + i, simd::mul_f(simd::load_f(buffer + i), gain));
+        }
+        for (; i < num_frames; i++)
+        {
+            buffer[i] *= _gain_at(ramp_pos + direction * (i + 1));
+        }
+    }
+
+    void _process_ramp(int ch, float* buffer, int num_frames)
+    {
+        int start = std::min(_start_offset[ch], num_frames);
+        _start_offset[ch] -= start;
+        _apply_constant(buffer, start, _ramp_pos[ch]);
+        if (start == num_frames)
+        {
+            return;
+        }
+
+        bool unmuting = audio_ch_mask_test(_targets, ch);
+        int direction = unmuting ? 1 : -1;
+        int remaining = unmuting ? _ramp_length - _ramp_pos[ch] : _ramp_pos[ch];
+        int ramp_frames = std::min(remaining, num_frames - start);
+        _apply_ramp(buffer + start, ramp_frames, _ramp_pos[ch], direction);
+        _ramp_pos[ch] += direction * ramp_frames;
+
+        if (ramp_frames == remaining)
+        {
+            _ramping.words[ch >> 6] &= ~(uint64_t(1) << (ch & 63));
+            if (unmuting == false)
+            {
+                int done = start + ramp_frames;
+                std::memset(buffer + done, 0, static_cast<size_t>(num_frames - done) * sizeof(float));
+            }
+        }
+    }
+
+    int _num_ch;
+    int _ramp_length;
+    float _inv_ramp_length;
+    GainRampShape _shape;
+    bool _global_unmuted;
+    AudioChMask _channels_unmuted;
+    AudioChMask _targets;               // Channels which are or will be unmuted
+    AudioChMask _ramping;               // Channels in a ramp or with a pending one
+    int _ramp_pos[AUDIO_CH_STATUS_MAX_CHANNELS];    // 0 is muted, _ramp_length unmuted
+    int _start_offset[AUDIO_CH_STATUS_MAX_CHANNELS];
+};
+
+} // namespace audio_ctrl
+
+#endif // GAIN_RAMP_PROCESSOR_H_
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Stateful decoder of the cv gate inputs of audio control packets.
+ *        Successive gate_in values are xor-ed and the changed bits expanded
+ *        with ctz loops into rising and falling edge events, in a buffer owned
+ *        by the caller. Devices advertising
+ *        DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_GATE_EDGE_OFFSETS also report the
+ *        position of the edges in sixteenths of the period, which are then
+ *        converted to frame offsets so that edges don't snap to the start of
+ *        the period.
+ *
+ *        The offsets are 4 bits per gate, so their resolution is
+ *        buffer_size / 16 frames: 4 frames at 64 frame buffers, 16 frames at
+ *        256 frame buffers. Edges are placed at the start of their
+ *        sixteenth, and only the last edge of a gate in a period is reported.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef GATE_EDGE_DETECTOR_H_
+#define GATE_EDGE_DETECTOR_H_
+
+#include "audio_packet_helper.h"
+
+namespace audio_ctrl {
+
+struct GateEdgeEvent
+{
+    uint8_t gate;           // Index of the gate, less than AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES
+    uint8_t rising;         // 1 for a rising edge, 0 for a falling edge
+    uint16_t frame_offset;  // Position of the edge in the period, 0 without edge offsets
+};
+
+class GateEdgeDetector
+{
+public:
+    // Max number of events of a packet, one per gate
+    static constexpr int MAX_EVENTS = AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES;
+
+    /**
+     * @brief Constructor
+     *
+     * @param buffer_size Frames per period, to convert the edge offsets to
+     *        frame offsets. Must be 0 unless the device advertises
+     *        DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_GATE_EDGE_OFFSETS, the reserved
+     *        words of other devices would be read as offsets.
+     */
+    explicit GateEdgeDetector(int buffer_size = 0) : _buffer_size(buffer_size) {}
+
+    /**
+     * @brief Set the last seen gate values, no events are reported for them.
+     */
+    void reset(uint32_t gate_in = 0)
+    {
+        _last = gate_in & GATE_MASK;
+    }
+
+    /**
+     * @brief Set the frames per period, 0 to ignore the edge offsets. Same
+     *        rules as for the constructor.
+     */
+    void set_buffer_size(int buffer_size)
+    {
+        _buffer_size = buffer_size;
+    }
+
+    /**
+     * @brief Compare the gate in values of a packet with the last seen ones.
+     *
+     * @param pkt The audio control packet
+     * @param events Filled with the edge events, room for MAX_EVENTS events.
+     *        Ordered by frame offset, then by gate.
+     * @return The number of events written
+     */
+    int process(const AudioCtrlPkt* const pkt, GateEdgeEvent* events)
+    {
+        uint64_t edge_offsets = 0;
+        if (_buffer_size > 0)
+        {
+            edge_offsets = pkt->reserved[0] | (static_cast<uint64_t>(pkt->reserved[1]) << 32);
+        }
+        return process_gates(pkt->gate_in, edge_offsets, events);
+    }
+
+    /**
+     * @brief Same as process(), for gate values outside of a packet.
+     *
+     * @param gate_in The gate values, one bit per gate
+     * @param edge_offsets The edge offsets, AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS
+     *        per gate as in the reserved words of the packet, 0 if none
+     */
+    int process_gates(uint32_t gate_in, uint64_t edge_offsets, GateEdgeEvent* events)
+    {
+        gate_in &= GATE_MASK;
+        uint32_t changed = gate_in ^ _last;
+        _last = gate_in;
+        int num_events = __builtin_popcount(changed);
+        if (_buffer_size <= 0 || edge_offsets == 0)
+        {
+            for (int i = 0; changed != 0; i++)
+            {
+                int gate = __builtin_ctz(changed);
+                changed &= changed - 1;
+                events[i] = {static_cast<uint8_t>(gate), static_cast<uint8_t>((gate_in >> gate) & 1u), 0};
+            }
+            return num_events;
+        }
+
+        // Counting sort on the offset steps, stable so that edges at the same
+        // step stay in gate order
+        uint8_t steps[MAX_EVENTS];
+        int step_start[AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS + 1] = {};
+        for (uint32_t bits = changed; bits != 0; bits &= bits - 1)
+        {
+            int gate = __builtin_ctz(bits);
+            int step = static_cast<int>(edge_offsets >> (gate * AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS)) &
+                       (AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS - 1);
+            steps[gate] = static_cast<uint8_t>(step);
+            step_start[step + 1]++;
+        }
+        for (int step = 1; step < AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_STEPS; step++)
+        {
+            step_start[step] += step_start[step - 1];
+        }
+        while (changed != 0)
+        {
+            int gate = __builtin_ctz(changed);
+            changed &= changed - 1;
+            int step = steps[gate];
+            auto frame_offset = static_cast<uint16_t>((step * _buffer_size) >> AUDIO_CTRL_PKT_GATE_EDGE_OFFSET_BITS);
+            events[step_start[step]++] = {static_cast<uint8_t>(gate), static_cast<uint8_t>((gate_in >> gate) & 1u),
+                                          frame_offset};
+        }
+        return num_events;
+    }
+
+    /**
+     * @brief Get the last seen gate values.
+     */
+    uint32_t gate_in() const
+    {
+        return _last;
+    }
+
+private:
+    static constexpr uint32_t GATE_MASK = (1ull << AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES) - 1;
+
+    int _buffer_size;
+    uint32_t _last{0};
+};
+
+} // namespace audio_ctrl
+
+#endif // GATE_EDGE_DETECTOR_H_
@@ -0,0 +1,336 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Scheduler of gpio data blobs shared by several producers. Producers
+ *        submit blobs under a blob id of their choice with a priority, a new
+ *        blob replaces a pending blob with the same id (latest value wins)
+ *        but keeps its age, so that frequent updates do not starve it.
+ *        Once per period the real-time thread packs the highest priority
+ *        pending blobs, up to AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS, into the
+ *        outgoing packet. The blob id is not sent, the blob content has to
+ *        identify itself to the device as before.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef GPIO_BLOB_SCHEDULER_H_
+#define GPIO_BLOB_SCHEDULER_H_
+
+#include <atomic>
+#include <cstring>
+
+#include "audio_packet_helper.h"
+
+namespace audio_ctrl {
+
+enum class GpioBlobPriority : uint8_t
+{
+    LOW,
+    NORMAL,
+    HIGH,
+    URGENT  // Sent in the next packet, see GpioBlobScheduler::pack()
+};
+
+struct GpioSchedulerStats
+{
+    uint64_t submitted;
+    uint64_t coalesced;         // Pending blobs replaced by a newer one, approximate
+    uint64_t sent;
+    uint64_t urgent_deferred;   // Urgent blobs which did not fit in a packet
+};
+
+/**
+ * @brief submit() can be called from any number of threads and never waits
+ *        for pack(). Producers of the same blob id wait for each other for the
+ *        duration of a blob copy. pack() is lock free and should only be
+ *        called from one thread, once per period.
+ *
+ * @tparam NUM_BLOB_IDS The number of blob ids, valid ids are 0 to NUM_BLOB_IDS - 1
+ */
+template <int NUM_BLOB_IDS = 64>
+class GpioBlobScheduler
+{
+public:
+    static_assert(NUM_BLOB_IDS > 0, "At least one blob id is needed");
+
+    /**
+     * @brief Constructs a scheduler.
+     *
+     * @param aging_periods Non urgent blobs are raised one priority level, up to
+     *        HIGH, every aging_periods periods they wait, so that low priority
+     *        blobs are not starved. 0 disables aging.
+     */
+    explicit GpioBlobScheduler(uint32_t aging_periods = 0) : _aging_periods(aging_periods) {}
+
+    GpioBlobScheduler(const GpioBlobScheduler&) = delete;
+    GpioBlobScheduler& operator=(const GpioBlobScheduler&) = delete;
+
+    /**
+     * @brief Queue a blob, replacing any pending blob with the same id. The
+     *        data and priority are replaced, the age is the one of the blob
+     *        first queued since the id was last sent.
+     *
+     * @param blob_id The id of the blob
+     * @param blob The blob data
+     * @param priority The priority of the blob
+     * @return false if blob_id is out of range, true otherwise
+     */
+    bool submit(int blob_id, const struct GpioDataBlob& blob, GpioBlobPriority priority = GpioBlobPriority::NORMAL)
+    {
+        if (blob_id < 0 || blob_id >= NUM_BLOB_IDS)
+        {
+            return false;
+        }
+
+        uint32_t words[BLOB_WORDS];
+        std::memcpy(words, blob.data, sizeof(words));
+        uint64_t bit = 1ull << (blob_id % 64);
+
+        // Seqlock write, the version is odd while the slot is written
+        Slot& slot = _slots[blob_id];
+        uint32_t version = slot.version.load(std::memory_order_relaxed);
+        while ((version & 1u) || !slot.version.compare_exchange_weak(version, version + 1, std::memory_order_acquire,
+                                                                      std::memory_order_relaxed))
+        {
+            version = slot.version.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        uint64_t enqueue_period = _period.load(std::memory_order_relaxed);
+        if (_pending[blob_id / 64].load(std::memory_order_relaxed) & bit)
+        {
+            // Still pending, keep the period the blob was first queued in
+            enqueue_period = slot.meta.load(std::memory_order_relaxed) >> 8;
+        }
+        slot.meta.store((enqueue_period << 8) | static_cast<uint8_t>(priority), std::memory_order_relaxed);
+        for (int i = 0; i < BLOB_WORDS; i++)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.version.store(version + 2, std::memory_order_release);
+
+        uint64_t prev = _pending[blob_id / 64].fetch_or(bit, std::memory_order_release);
+        _stats.submitted.fetch_add(1, std::memory_order_relaxed);
+        if (prev & bit)
+        {
+            _stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Pack the highest priority pending blobs into a gpio data packet.
+     *        Blobs are ordered by priority, then by age. If pack() is called
+     *        every period, urgent blobs submitted before the call are always
+     *        sent by it, as long as no more than
+     *        AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS urgent blobs are pending.
+     *        Other fields, like seq and crc, are left to the caller. Real-time
+     *        safe.
+     *
+     * @param pkt The audio control packet, only modified if blobs are packed
+     * @return The number of blobs packed
+     */
+    int pack(AudioCtrlPkt* const pkt)
+    {
+        uint64_t period = _period.load(std::memory_order_relaxed);
+        Candidate best[AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS];
+        int num_best = 0;
+        uint64_t keep[NUM_WORDS] = {};
+        uint64_t urgent_seen = 0;
+
+        for (int word = 0; word < NUM_WORDS; word++)
+        {
+            uint64_t mask = _pending[word].exchange(0, std::memory_order_acquire);
+            while (mask)
+            {
+                int blob_id = word * 64 + __builtin_ctzll(mask);
+                mask &= mask - 1;
+
+                Candidate candidate;
+                if (!_read_slot(blob_id, period, candidate))
+                {
+                    // Written right now, leave it for the next period
+                    keep[word] |= 1ull << (blob_id % 64);
+                    continue;
+                }
+                urgent_seen += candidate.urgent;
+
+                int displaced = _insert(best, num_best, candidate);
+                if (displaced >= 0)
+                {
+                    keep[displaced / 64] |= 1ull << (displaced % 64);
+                }
+            }
+        }
+
+        for (int word = 0; word < NUM_WORDS; word++)
+        {
+            if (keep[word])
+            {
+                _pending[word].fetch_or(keep[word], std::memory_order_relaxed);
+            }
+        }
+        _period.store(period + 1, std::memory_order_relaxed);
+
+        if (num_best == 0)
+        {
+            return 0;
+        }
+
+        uint64_t urgent_sent = 0;
+        for (int i = 0; i < num_best; i++)
+        {
+            pkt->payload.gpio_data_blob[i] = best[i].blob;
+            urgent_sent += best[i].urgent;
+        }
+        std::memset(&pkt->payload.gpio_data_blob[num_best], 0,
+                    (AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS - num_best) * sizeof(struct GpioDataBlob));
+        prepare_gpio_cmd_pkt(pkt, static_cast<uint8_t>(num_best));
+
+        _add(_stats.sent, num_best);
+        _add(_stats.urgent_deferred, urgent_seen - urgent_sent);
+        return num_best;
+    }
+
+    /**
+     * @brief Drop all pending blobs. Blobs submitted concurrently may be kept.
+     */
+    void clear()
+    {
+        for (auto& pending : _pending)
+        {
+            pending.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Get the counters since construction. Can be called from any thread.
+     */
+    GpioSchedulerStats stats() const
+    {
+        return {_stats.submitted.load(std::memory_order_relaxed),
+                _stats.coalesced.load(std::memory_order_relaxed),
+                _stats.sent.load(std::memory_order_relaxed),
+                _stats.urgent_deferred.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr int BLOB_WORDS = AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE / 4;
+    static constexpr int NUM_WORDS = (NUM_BLOB_IDS + 63) / 64;
+    static constexpr int MAX_AGE_BITS = 48;
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t> version{0};
+        std::atomic<uint64_t> meta{0};  // Enqueue period << 8 | priority
+        std::atomic<uint32_t> words[BLOB_WORDS] = {};
+    };
+
+    struct Candidate
+    {
+        int blob_id;
+        bool urgent;
+        uint64_t rank;  // Effective priority << MAX_AGE_BITS | age
+        struct GpioDataBlob blob;
+    };
+
+    bool _read_slot(int blob_id, uint64_t period, Candidate& candidate) const
+    {
+        const Slot& slot = _slots[blob_id];
+        uint32_t version = slot.version.load(std::memory_order_acquire);
+        if (version & 1u)
+        {
+            return false;
+        }
+        uint64_t meta = slot.meta.load(std::memory_order_relaxed);
+        uint32_t words[BLOB_WORDS];
+        for (int i = 0; i < BLOB_WORDS; i++)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.load(std::memory_order_relaxed) != version)
+        {
+            return false;
+        }
+
+        auto priority = static_cast<uint64_t>(meta & 0xFF);
+        uint64_t age = period - (meta >> 8);
+        candidate.blob_id = blob_id;
+        candidate.urgent = priority == static_cast<uint64_t>(GpioBlobPriority::URGENT);
+        if (!candidate.urgent && _aging_periods > 0)
+        {
+            priority += age / _aging_periods;
+            if (priority > static_cast<uint64_t>(GpioBlobPriority::HIGH))
+            {
+                priority = static_cast<uint64_t>(GpioBlobPriority::HIGH);
+            }
+        }
+        uint64_t max_age = (1ull << MAX_AGE_BITS) - 1;
+        candidate.rank = (priority << MAX_AGE_BITS) | (age < max_age ? age : max_age);
+        std::memcpy(candidate.blob.data, words, sizeof(words));
+        return true;
+    }
+
+    // Insert into the best candidates, sorted by decreasing rank. Returns the
+    // id of the candidate left out, or -1 if none.
+    static int _insert(Candidate* best, int& num_best, const Candidate& candidate)
+    {
+        int left_out = -1;
+        int pos = num_best;
+        if (num_best == AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS)
+        {
+            if (candidate.rank <= best[num_best - 1].rank)
+            {
+                return candidate.blob_id;
+            }
+            left_out = best[num_best - 1].blob_id;
+            pos--;
+        }
+        else
+        {
+            num_best++;
+        }
+        for (; pos > 0 && best[pos - 1].rank < candidate.rank; pos--)
+        {
+            best[pos] = best[pos - 1];
+        }
+        best[pos] = candidate;
+        return left_out;
+    }
+
+    // single writer, so a plain load and store is enough
+    static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> urgent_deferred{0};
+    };
+
+    Slot _slots[NUM_BLOB_IDS];
+    std::atomic<uint64_t> _pending[NUM_WORDS] = {};
+    std::atomic<uint64_t> _period{0};
+    AtomicStats _stats;
+    uint32_t _aging_periods;
+};
+
+} // namespace audio_ctrl
+
+#endif // GPIO_BLOB_SCHEDULER_H_
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Stateful decoder of the gpio data blobs of audio control packets.
+ *        The last seen content of each blob position in the payload is kept
+ *        and every new blob is compared with it using full width vector
+ *        compares, one per blob with AVX2, so that unchanged blobs cost a
+ *        single compare. Changed bytes, or bits, are reported as compact
+ *        change events in a buffer owned by the caller.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef GPIO_CHANGE_DETECTOR_H_
+#define GPIO_CHANGE_DETECTOR_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "audio_packet_helper.h"
+#include "simd_helpers.h"
+
+namespace audio_ctrl {
+
+enum class GpioChangeGranularity
+{
+    BYTE,   // One event per changed byte
+    BIT     // One event per changed bit
+};
+
+struct GpioChangeEvent
+{
+    uint8_t blob_idx;   // Position of the blob in the payload
+    uint8_t index;      // Index of the byte (0 to 31) or of the bit (0 to 255) in the blob
+    uint8_t old_val;    // Previous value, 0 or 1 for bit events
+    uint8_t new_val;    // New value, 0 or 1 for bit events
+};
+
+class GpioChangeDetector
+{
+public:
+    explicit GpioChangeDetector(GpioChangeGranularity granularity = GpioChangeGranularity::BYTE) : _granularity(granularity)
+    {
+        reset();
+    }
+
+    /**
+     * @brief Forget the last seen blobs, all their bytes are considered 0.
+     */
+    void reset()
+    {
+        std::memset(_last, 0, sizeof(_last));
+    }
+
+    /**
+     * @brief Compare the gpio data blobs of a packet with the last seen ones.
+     *        Packets without gpio data produce no events.
+     *
+     * @param pkt The audio control packet
+     * @param events Filled with the change events, ordered by blob and index
+     * @param max_events The size of events. If it is too small, the changes
+     *        not reported are kept and reported by the next call.
+     * @return The number of events written
+     */
+    int process(const AudioCtrlPkt* const pkt, GpioChangeEvent* events, int max_events)
+    {
+        int num_blobs = std::min(check_for_gpio_data(pkt), AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS);
+        return process_blobs(pkt->payload.gpio_data_blob, num_blobs, events, max_events);
+    }
+
+    /**
+     * @brief Same as process(), for blobs outside of a packet.
+     *
+     * @param blobs The blobs, blob i is compared with the last seen blob i
+     * @param num_blobs The number of blobs, at most AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS
+     */
+    int process_blobs(const struct GpioDataBlob* blobs, int num_blobs, GpioChangeEvent* events, int max_events)
+    {
+        int num_events = 0;
+        for (int blob = 0; blob < num_blobs; blob++)
+        {
+            uint32_t diff = _diff_mask(blobs[blob].data, _last[blob].data);
+            if (diff == 0)
+            {
+                continue;
+            }
+            num_events = _granularity == GpioChangeGranularity::BYTE
+                       ? _emit_bytes(blob, blobs[blob].data, diff, events, num_events, max_events)
+                       : _emit_bits(blob, blobs[blob].data, diff, events, num_events, max_events);
+            if (num_events == max_events)
+            {
+                break;
+            }
+        }
+        return num_events;
+    }
+
+    /**
+     * @brief Get the last seen content of a blob position, including only
+     *        the changes already reported.
+     */
+    const struct GpioDataBlob& last_blob(int blob_idx) const
+    {
+        return _last[blob_idx];
+    }
+
+private:
+    static constexpr int VEC_BYTES = simd::WIDTH * 4;
+
+    static_assert(AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE == 32, "Diff masks are 32 bits");
+    static_assert(AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE % VEC_BYTES == 0);
+
+    // Bit i is set if byte i of the blobs differs
+    static uint32_t _diff_mask(const uint8_t* a, const uint8_t* b)
+    {
+        uint32_t diff = 0;
+        for (int offset = 0; offset < AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE; offset += VEC_BYTES)
+        {
+            simd::VecI va = simd::load_i(reinterpret_cast<const int32_t*>(a + offset));
+            simd::VecI vb = simd::load_i(reinterpret_cast<const int32_t*>(b + offset));
+            diff |= simd::byte_diff_mask(va, vb) << offset;
+        }
+        return diff;
+    }
+
+    int _emit_bytes(int blob, const uint8_t* data, uint32_t diff, GpioChangeEvent* events, int num_events, int max_events)
+    {
+        uint8_t* last = _last[blob].data;
+        while (diff != 0 && num_events < max_events)
+        {
+            int i = __builtin_ctz(diff);
+            diff &= diff - 1;
+            events[num_events++] = {static_cast<uint8_t>(blob), static_cast<uint8_t>(i), last[i], data[i]};
+            last[i] = data[i];
+        }
+        return num_events;
+    }
+
+    int _emit_bits(int blob, const uint8_t* data, uint32_t diff, GpioChangeEvent* events, int num_events, int max_events)
+    {
+        uint8_t* last = _last[blob].data;
+        while (diff != 0)
+        {
+            int i = __builtin_ctz(diff);
+            diff &= diff - 1;
+            unsigned bits = last[i] ^ data[i];
+            while (bits != 0)
+            {
+                if (num_events == max_events)
+                {
+                    return num_events;
+                }
+                int bit = __builtin_ctz(bits);
+                bits &= bits - 1;
+                events[num_events++] = {static_cast<uint8_t>(blob), static_cast<uint8_t>(i * 8 + bit),
+                                        static_cast<uint8_t>((last[i] >> bit) & 1u),
+                                        static_cast<uint8_t>((data[i] >> bit) & 1u)};
+                last[i] ^= static_cast<uint8_t>(1u << bit);
+            }
+        }
+        return num_events;
+    }
+
+    GpioChangeGranularity _granularity;
+    struct GpioDataBlob _last[AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS];
+};
+
+} // namespace audio_ctrl
+
+#endif // GPIO_CHANGE_DETECTOR_H_
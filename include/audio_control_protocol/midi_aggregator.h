@@ -0,0 +1,384 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Aggregator of outgoing midi messages from several producers, e.g. a
+ *        sequencer, a gui and network midi, into one midi data packet per
+ *        period. Producers push complete messages into a lock free queue from
+ *        any thread. Once per period the real-time thread drains the queue and
+ *        packs as many messages as fit into the payload, in order:
+ *          - Control changes superseded by a later value of the same
+ *            controller, with no other message of that channel in between,
+ *            are dropped. Data increment/decrement (CC 96/97) and channel
+ *            mode messages (CC 120-127) are commands rather than values and
+ *            are always kept.
+ *          - Running status is used for consecutive channel messages with
+ *            the same status byte.
+ *          - Messages are never split, messages which do not fit are kept
+ *            for the next period. Messages bigger than
+ *            MIDI_AGGREGATOR_MAX_MSG_SIZE, like long SysEx dumps, should be
+ *            sent in fragments with midi_fragment_helper.h instead.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef MIDI_AGGREGATOR_H_
+#define MIDI_AGGREGATOR_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#include "audio_packet_helper.h"
+
+// Max size of a message passed through the aggregator, SysEx included
+#define MIDI_AGGREGATOR_MAX_MSG_SIZE 15
+
+namespace audio_ctrl {
+
+/**
+ * @brief Get the size of a midi message from its status byte.
+ *
+ * @param status The status byte
+ * @return The size of the message in bytes, 0 for SysEx, which has a
+ *         variable size, and for bytes which are not status bytes.
+ */
+inline int midi_msg_size(uint8_t status)
+{
+    if (status < 0x80 || status == 0xF0 || status == 0xF7 || status == 0xF4 || status == 0xF5)
+    {
+        return 0;
+    }
+    if (status < 0xF0)
+    {
+        uint8_t type = status & 0xF0;
+        return (type == 0xC0 || type == 0xD0) ? 2 : 3;
+    }
+    switch (status)
+    {
+    case 0xF1:
+    case 0xF3:
+        return 2;
+    case 0xF2:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief Check if a control change only sets a value, so that a later control
+ *        change of the same controller supersedes it.
+ *
+ * @param controller The controller number, the first data byte
+ * @return true if the control change can be coalesced
+ */
+inline bool midi_cc_is_coalescable(uint8_t controller)
+{
+    // Data increment/decrement are cumulative, channel mode messages are
+    // commands, e.g. all notes off
+    return controller != 96 && controller != 97 && controller < 120;
+}
+
+struct MidiAggregatorStats
+{
+    uint64_t queued;
+    uint64_t rejected;              // Invalid messages or queue full
+    uint64_t coalesced;             // Control changes dropped as superseded
+    uint64_t sent;                  // Messages packed into packets
+    uint64_t running_status_saved;  // Status bytes omitted
+};
+
+/**
+ * @brief push() can be called from any number of threads, drain() from one
+ *        thread only, once per period. Neither of them blocks or allocates.
+ *
+ * @tparam CAPACITY The number of messages in the queue, must be a power of 2.
+ *         Messages carried over to the next period are held separately.
+ */
+template <size_t CAPACITY = 1024>
+class MidiAggregator
+{
+public:
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of 2");
+
+    /**
+     * @brief Constructs an aggregator.
+     *
+     * @param running_status Use running status when packing, the receiver must
+     *        then handle running status like a midi din input does
+     */
+    explicit MidiAggregator(bool running_status = true) : _running_status(running_status)
+    {
+        for (size_t i = 0; i < CAPACITY; i++)
+        {
+            _cells[i].seq.store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+        }
+    }
+
+    MidiAggregator(const MidiAggregator&) = delete;
+    MidiAggregator& operator=(const MidiAggregator&) = delete;
+
+    /**
+     * @brief Queue a complete midi message. Running status is not accepted,
+     *        each message must start with its status byte.
+     *
+     * @param data The midi message
+     * @param size The size of the message in bytes
+     * @return false if the message is invalid, bigger than
+     *         MIDI_AGGREGATOR_MAX_MSG_SIZE or the queue is full
+     */
+    bool push(const uint8_t* data, int size)
+    {
+        if (!_valid_msg(data, size))
+        {
+            _stats.rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Bounded multi producer queue, every cell has a sequence number which
+        // tells whether it is free for the producer at a given position.
+        uint32_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &_cells[pos & MASK];
+            uint32_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<int32_t>(seq - pos);
+            if (diff == 0)
+            {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                _stats.rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->msg.size = static_cast<uint8_t>(size);
+        std::memcpy(cell->msg.data, data, size);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        _stats.queued.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Convenience overload for channel messages.
+     */
+    bool push(uint8_t status, uint8_t data_1, uint8_t data_2 = 0)
+    {
+        uint8_t data[3] = {status, data_1, data_2};
+        return push(data, midi_msg_size(status));
+    }
+
+    /**
+     * @brief Drain the queue and pack the pending messages into a midi data
+     *        packet. Other fields, like seq and crc, are left to the caller.
+     *        Real-time safe.
+     *
+     * @param pkt The audio control packet, only modified if messages are packed
+     * @return The number of midi bytes packed, 0 if no message is pending
+     */
+    int drain(AudioCtrlPkt* const pkt)
+    {
+        _pop_all();
+        _coalesce();
+
+        uint8_t payload[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+        int num_bytes = 0;
+        int num_msgs = 0;
+        uint8_t running_status = 0;
+        uint64_t saved = 0;
+        for (; num_msgs < _num_pending; num_msgs++)
+        {
+            const Msg& msg = _pending[num_msgs];
+            uint8_t status = msg.data[0];
+            bool skip_status = _running_status && status == running_status;
+            int size = msg.size - skip_status;
+            if (num_bytes + size > AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+            {
+                break;
+            }
+            std::memcpy(&payload[num_bytes], &msg.data[skip_status], size);
+            num_bytes += size;
+            saved += skip_status;
+
+            // System common messages cancel running status, real-time ones don't
+            if (status < 0xF0)
+            {
+                running_status = status;
+            }
+            else if (status < 0xF8)
+            {
+                running_status = 0;
+            }
+        }
+
+        _num_pending -= num_msgs;
+        std::memmove(&_pending[0], &_pending[num_msgs], _num_pending * sizeof(Msg));
+
+        if (num_bytes == 0)
+        {
+            return 0;
+        }
+        prepare_midi_data_pkt(pkt, payload, static_cast<uint8_t>(num_bytes));
+        _add(_stats.sent, num_msgs);
+        _add(_stats.running_status_saved, saved);
+        return num_bytes;
+    }
+
+    /**
+     * @brief Get the number of messages carried over by the last drain().
+     *        Should be called from the draining thread.
+     */
+    int num_pending() const
+    {
+        return _num_pending;
+    }
+
+    /**
+     * @brief Get the counters since construction. Can be called from any thread.
+     */
+    MidiAggregatorStats stats() const
+    {
+        return {_stats.queued.load(std::memory_order_relaxed),
+                _stats.rejected.load(std::memory_order_relaxed),
+                _stats.coalesced.load(std::memory_order_relaxed),
+                _stats.sent.load(std::memory_order_relaxed),
+                _stats.running_status_saved.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr uint32_t MASK = CAPACITY - 1;
+
+    struct Msg
+    {
+        uint8_t size;
+        uint8_t data[MIDI_AGGREGATOR_MAX_MSG_SIZE];
+    };
+
+    struct Cell
+    {
+        std::atomic<uint32_t> seq;
+        Msg msg;
+    };
+
+    static bool _valid_msg(const uint8_t* data, int size)
+    {
+        if (size <= 0 || size > MIDI_AGGREGATOR_MAX_MSG_SIZE || data[0] < 0x80)
+        {
+            return false;
+        }
+        if (data[0] == 0xF0)
+        {
+            return size >= 2 && data[size - 1] == 0xF7;
+        }
+        return size == midi_msg_size(data[0]);
+    }
+
+    void _pop_all()
+    {
+        while (_num_pending < static_cast<int>(CAPACITY))
+        {
+            Cell& cell = _cells[_dequeue_pos & MASK];
+            uint32_t seq = cell.seq.load(std::memory_order_acquire);
+            if (static_cast<int32_t>(seq - (_dequeue_pos + 1)) < 0)
+            {
+                return;
+            }
+            _pending[_num_pending++] = cell.msg;
+            cell.seq.store(_dequeue_pos + static_cast<uint32_t>(CAPACITY), std::memory_order_release);
+            _dequeue_pos++;
+        }
+    }
+
+    // Walk the pending messages backwards, remembering for every channel
+    // whether its next message is a coalescable control change and of which
+    // controller.
+    void _coalesce()
+    {
+        int next_cc[16];
+        for (auto& cc : next_cc)
+        {
+            cc = -1;
+        }
+
+        int num_dropped = 0;
+        for (int i = _num_pending - 1; i >= 0; i--)
+        {
+            const Msg& msg = _pending[i];
+            uint8_t status = msg.data[0];
+            bool drop = false;
+            if (status < 0xF0)
+            {
+                int channel = status & 0x0F;
+                bool value_cc = (status & 0xF0) == 0xB0 && midi_cc_is_coalescable(msg.data[1]);
+                int cc = value_cc ? msg.data[1] : -1;
+                drop = cc >= 0 && next_cc[channel] == cc;
+                next_cc[channel] = cc;
+            }
+
+            if (drop)
+            {
+                num_dropped++;
+            }
+            else if (num_dropped > 0)
+            {
+                _pending[i + num_dropped] = msg;
+            }
+        }
+
+        if (num_dropped > 0)
+        {
+            _num_pending -= num_dropped;
+            std::memmove(&_pending[0], &_pending[num_dropped], _num_pending * sizeof(Msg));
+            _add(_stats.coalesced, num_dropped);
+        }
+    }
+
+    // single writer, so a plain load and store is enough
+    static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> queued{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> running_status_saved{0};
+    };
+
+    Cell _cells[CAPACITY];
+    alignas(64) std::atomic<uint32_t> _enqueue_pos{0};
+    alignas(64) uint32_t _dequeue_pos{0};
+    Msg _pending[CAPACITY];
+    int _num_pending{0};
+    AtomicStats _stats;
+    bool _running_status;
+};
+
+} // namespace audio_ctrl
+
+#endif // MIDI_AGGREGATOR_H_
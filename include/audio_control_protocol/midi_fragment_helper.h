@@ -0,0 +1,324 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Helper functions to split midi messages bigger than the packet
+ *        payload (e.g. long SysEx dumps) across consecutive audio control
+ *        packets and to reassemble them on the receiving side. The number of
+ *        packets still to come for a message is carried in the continuation
+ *        field, so a message can span up to AUDIO_CTRL_MIDI_MAX_FRAGMENTS
+ *        packets. Fragments must be sent in packets with consecutive
+ *        sequence numbers. Can be used either by the host system or the
+ *        secondary microcontroller.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef MIDI_FRAGMENT_HELPER_H_
+#define MIDI_FRAGMENT_HELPER_H_
+
+#include "audio_packet_helper.h"
+
+#ifdef __cplusplus
+namespace audio_ctrl {
+#endif
+
+// Max number of packets a single midi message can be split into
+#define AUDIO_CTRL_MIDI_MAX_FRAGMENTS 256
+
+// Max size in bytes of a fragmented midi message
+#define AUDIO_CTRL_MIDI_MAX_MESSAGE_SIZE \
+    (AUDIO_CTRL_MIDI_MAX_FRAGMENTS * AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+
+// Flags returned by midi_reassembler_push()
+#define MIDI_REASSEMBLY_FLAG_COMPLETE   0x01u   // a complete message is available
+#define MIDI_REASSEMBLY_FLAG_TRUNCATED  0x02u   // a partial message was dropped due to missing packets
+#define MIDI_REASSEMBLY_FLAG_OVERFLOW   0x04u   // a message was dropped since it does not fit in the arena
+
+/**
+ * @brief State of a fragmented midi message being sent
+ */
+typedef struct
+{
+    const uint8_t* data;    // The midi message
+    uint32_t size;          // Size of the message in bytes
+    uint32_t offset;        // Offset of the next fragment
+} MidiFragmentEncoder;
+
+/**
+ * @brief State of a fragmented midi message being received. Fragments are
+ *        copied once, straight from the packet payload into a caller provided
+ *        arena. Messages fitting a single packet are not copied at all.
+ */
+typedef struct
+{
+    uint8_t* arena;                 // Caller provided buffer for the message
+    uint32_t arena_size;            // Size of the arena in bytes
+    uint32_t size;                  // Bytes of the current message received so far
+    uint32_t expected_seq;          // Sequence number of the next fragment
+    uint8_t expected_continuation;  // Continuation value of the next fragment
+    uint8_t in_progress;            // 1 if a message is being received
+    uint8_t discarding;             // 1 if the current message is being dropped
+    uint8_t at_boundary;            // 1 if the packet before boundary_seq ended a message
+    uint32_t boundary_seq;          // Sequence number following the last message end
+    const uint8_t* msg_data;        // Last complete message
+    uint32_t msg_size;              // Size of the last complete message
+} MidiReassembler;
+
+/**
+ * @brief Initializes a fragment encoder for a midi message.
+ *
+ * @param enc The fragment encoder
+ * @param midi_data The midi message, must stay valid until all the
+ *        fragments have been sent
+ * @param num_midi_bytes The size of the midi message
+ * @return 1 if successful, 0 if the message is bigger than
+ *         AUDIO_CTRL_MIDI_MAX_MESSAGE_SIZE
+ */
+inline int init_midi_fragment_encoder(MidiFragmentEncoder* const enc,
+                                      const uint8_t* const midi_data,
+                                      uint32_t num_midi_bytes)
+{
+    enc->data = midi_data;
+    enc->size = num_midi_bytes;
+    enc->offset = 0;
+
+    if (num_midi_bytes > AUDIO_CTRL_MIDI_MAX_MESSAGE_SIZE)
+    {
+        enc->size = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Get the number of packets needed to send the rest of the message.
+ *
+ * @param enc The fragment encoder
+ * @return The number of fragments not sent yet
+ */
+inline int get_midi_fragments_remaining(const MidiFragmentEncoder* const enc)
+{
+    uint32_t bytes_left = enc->size - enc->offset;
+    return (int) ((bytes_left + AUDIO_CTRL_PKT_PAYLOAD_SIZE - 1) / AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+}
+
+/**
+ * @brief Prepares a midi data packet with the next fragment of the message.
+ *        The continuation field is set to the number of packets remaining
+ *        after this one.
+ *
+ * @param enc The fragment encoder
+ * @param pkt The audio control packet
+ * @param seq_number the packet's sequence number, must be consecutive for
+ *        all the fragments of a message
+ * @return The number of midi bytes in the packet, 0 if the whole message has
+ *         already been sent
+ */
+inline int prepare_next_midi_fragment_pkt(MidiFragmentEncoder* const enc,
+                                          AudioCtrlPkt* const pkt,
+                                          uint32_t seq_number)
+{
+    int remaining = get_midi_fragments_remaining(enc);
+    if (remaining == 0)
+    {
+        return 0;
+    }
+
+    uint32_t num_bytes = enc->size - enc->offset;
+    if (num_bytes > AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+    {
+        num_bytes = AUDIO_CTRL_PKT_PAYLOAD_SIZE;
+    }
+
+    prepare_midi_data_pkt(pkt, &enc->data[enc->offset], (uint8_t) num_bytes);
+    pkt->seq = seq_number;
+    pkt->continuation = (uint8_t) (remaining - 1);
+    enc->offset += num_bytes;
+
+    return (int) num_bytes;
+}
+
+/**
+ * @brief Initializes a midi reassembler.
+ *
+ * @param r The midi reassembler
+ * @param arena Buffer where fragmented messages are reassembled
+ * @param arena_size The size of the arena in bytes. Messages bigger than this
+ *        are dropped, AUDIO_CTRL_MIDI_MAX_MESSAGE_SIZE fits any message.
+ */
+inline void init_midi_reassembler(MidiReassembler* const r,
+                                  uint8_t* const arena,
+                                  uint32_t arena_size)
+{
+    r->arena = arena;
+    r->arena_size = arena_size;
+    r->size = 0;
+    r->expected_seq = 0;
+    r->expected_continuation = 0;
+    r->in_progress = 0;
+    r->discarding = 0;
+    r->at_boundary = 0;
+    r->boundary_seq = 0;
+    r->msg_data = 0;
+    r->msg_size = 0;
+}
+
+/**
+ * @brief Feeds a received packet to the reassembler. Should be called for
+ *        every received packet, so that a non midi packet in the middle of a
+ *        fragmented message is detected as a truncation as early as possible.
+ *        A fragmented message is only started by a fragment beginning with a
+ *        status byte or following a packet which ended a message, other
+ *        fragments are dropped until the end of their message so that a
+ *        message missing its first fragment is never reported as complete.
+ *
+ * @param r The midi reassembler
+ * @param pkt The audio control packet
+ * @return Bit mask of MIDI_REASSEMBLY_FLAG_xxx flags, 0 if no message was
+ *         completed or dropped by this packet. When the COMPLETE flag is set,
+ *         the message can be retrieved with get_reassembled_midi_data().
+ */
+inline int midi_reassembler_push(MidiReassembler* const r,
+                                 const AudioCtrlPkt* const pkt)
+{
+    int flags = 0;
+    int num_midi_bytes = check_for_midi_data(pkt);
+
+    r->msg_data = 0;
+    r->msg_size = 0;
+
+    if (r->in_progress)
+    {
+        if (pkt->seq != r->expected_seq ||
+            num_midi_bytes == 0 ||
+            pkt->continuation != r->expected_continuation)
+        {
+            // lost or out of order fragment, drop the partial message
+            if (!r->discarding)
+            {
+                flags |= MIDI_REASSEMBLY_FLAG_TRUNCATED;
+            }
+
+            // if this is a later fragment of the same message, drop the
+            // rest of it too instead of taking it for a new message
+            uint32_t lost_pkts = pkt->seq - r->expected_seq;
+            if (num_midi_bytes != 0 &&
+                lost_pkts <= r->expected_continuation &&
+                pkt->continuation == r->expected_continuation - lost_pkts)
+            {
+                r->discarding = 1;
+            }
+            else
+            {
+                r->in_progress = 0;
+                r->discarding = 0;
+                r->size = 0;
+            }
+        }
+    }
+
+    if (num_midi_bytes == 0)
+    {
+        r->at_boundary = 1;
+        r->boundary_seq = pkt->seq + 1;
+        return flags;
+    }
+
+    if (!r->in_progress && pkt->continuation == 0)
+    {
+        // message fits a single packet, no need to copy it
+        r->msg_data = pkt->payload.midi_data;
+        r->msg_size = (uint32_t) num_midi_bytes;
+        r->at_boundary = 1;
+        r->boundary_seq = pkt->seq + 1;
+        return flags | MIDI_REASSEMBLY_FLAG_COMPLETE;
+    }
+
+    if (!r->in_progress)
+    {
+        r->in_progress = 1;
+        r->size = 0;
+        r->discarding = 0;
+        if (pkt->payload.midi_data[0] < 0x80 &&
+            !(r->at_boundary && pkt->seq == r->boundary_seq))
+        {
+            // first fragment of the message lost, or a repeated fragment
+            flags |= MIDI_REASSEMBLY_FLAG_TRUNCATED;
+            r->discarding = 1;
+        }
+    }
+
+    if (!r->discarding)
+    {
+        if (r->size + (uint32_t) num_midi_bytes > r->arena_size)
+        {
+            flags |= MIDI_REASSEMBLY_FLAG_OVERFLOW;
+            r->discarding = 1;
+        }
+        else
+        {
+            get_midi_data(pkt, &r->arena[r->size], 0, num_midi_bytes);
+            r->size += (uint32_t) num_midi_bytes;
+        }
+    }
+
+    if (pkt->continuation == 0)
+    {
+        if (!r->discarding)
+        {
+            r->msg_data = r->arena;
+            r->msg_size = r->size;
+            flags |= MIDI_REASSEMBLY_FLAG_COMPLETE;
+        }
+        r->in_progress = 0;
+        r->discarding = 0;
+        r->size = 0;
+        r->at_boundary = 1;
+        r->boundary_seq = pkt->seq + 1;
+    }
+    else
+    {
+        r->at_boundary = 0;
+        r->expected_seq = pkt->seq + 1;
+        r->expected_continuation = (uint8_t) (pkt->continuation - 1);
+    }
+
+    return flags;
+}
+
+/**
+ * @brief Get the last message completed by midi_reassembler_push(). The data
+ *        points either into the arena or, for messages fitting a single
+ *        packet, into the payload of the last pushed packet; it is valid
+ *        until the next call to midi_reassembler_push() or until that packet
+ *        is overwritten.
+ *
+ * @param r The midi reassembler
+ * @param num_midi_bytes Filled with the size of the message
+ * @return Pointer to the message data, null if no message is available
+ */
+inline const uint8_t* get_reassembled_midi_data(const MidiReassembler* const r,
+                                                uint32_t* const num_midi_bytes)
+{
+    *num_midi_bytes = r->msg_size;
+    return r->msg_data;
+}
+
+#ifdef __cplusplus
+} // namespace audio_ctrl
+#endif
+
+#endif // MIDI_FRAGMENT_HELPER_H_
@@ -0,0 +1,593 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Parser of the midi byte stream carried by midi data packets into
+ *        fixed size message records. The positions of all the status bytes
+ *        of the payload are found up front with vector compares, so that
+ *        data bytes are never looked at one by one: running status messages
+ *        are cut at fixed strides and SysEx data is returned as chunks
+ *        pointing into the payload. Realtime bytes are reported where they
+ *        appear, also inside SysEx and channel messages. The parser state is
+ *        kept between packets, so messages and SysEx can span several
+ *        packets, e.g. with the continuation field (midi_fragment_helper.h).
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef MIDI_STREAM_PARSER_H_
+#define MIDI_STREAM_PARSER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "midi_aggregator.h"
+#include "midi_timestamp_helper.h"
+#include "simd_helpers.h"
+
+// Max number of records produced by a packet. Every byte produces at most two
+// records (a status byte ending a SysEx), plus one for a SysEx truncated by a
+// lost packet.
+#define MIDI_STREAM_PARSER_MAX_MSGS (2 * AUDIO_CTRL_PKT_PAYLOAD_SIZE + 1)
+
+namespace audio_ctrl {
+
+enum class MidiMessageType : uint8_t
+{
+    CHANNEL,        // Channel voice and mode messages
+    SYSTEM_COMMON,  // 0xF1 to 0xF6
+    REALTIME,       // 0xF8 to 0xFF
+    SYSEX           // A chunk of a SysEx message, see MIDI_MSG_FLAG_xxx
+};
+
+// Flags of SysEx chunks
+#define MIDI_MSG_FLAG_SYSEX_START   0x01u   // The chunk starts with 0xF0
+#define MIDI_MSG_FLAG_SYSEX_END     0x02u   // Last chunk of the message, which ends with 0xF7 unless truncated
+#define MIDI_MSG_FLAG_TRUNCATED     0x04u   // The message was cut by a status byte or a lost packet
+
+struct MidiMessage
+{
+    uint16_t frame_offset;  // Frame in the period for timestamped packets, 0 otherwise
+    uint16_t offset;        // SysEx chunks: offset of the chunk in the parsed bytes
+    MidiMessageType type;
+    uint8_t flags;          // SysEx chunks: bit mask of MIDI_MSG_FLAG_xxx flags
+    uint8_t size;           // Number of bytes in data, or in the SysEx chunk
+    uint8_t data[3];        // Status and data bytes, running status is expanded
+};
+
+static_assert(sizeof(MidiMessage) == 10 && offsetof(MidiMessage, data) == 7);
+
+struct MidiParserStats
+{
+    uint64_t messages;
+    uint64_t stray_bytes;       // Data bytes without a status and stray 0xF7 bytes
+    uint64_t truncated;         // Messages cut by a status byte or a lost packet
+    uint64_t overflows;         // Records dropped since the record buffer was full
+};
+
+class MidiStreamParser
+{
+public:
+    MidiStreamParser()
+    {
+        reset();
+    }
+
+    /**
+     * @brief Forget the running status and any partial message, e.g. after
+     *        packets were lost.
+     */
+    void reset()
+    {
+        _running_status = 0;
+        _msg_size = 0;
+        _msg_needed = 0;
+        _in_sysex = false;
+        _sysex_start = false;
+        _expect_fragment = false;
+    }
+
+    /**
+     * @brief Parse the midi data of a packet, either raw or timestamped.
+     *        SysEx chunk offsets are relative to payload.midi_data. Should be
+     *        called for every received packet, so that a packet lost in the
+     *        middle of a fragmented message is detected.
+     *
+     * @param pkt The audio control packet
+     * @param msgs Buffer for the records, MIDI_STREAM_PARSER_MAX_MSGS records
+     *        always fit the messages of a packet
+     * @param max_msgs The size of the buffer
+     * @return The number of records written
+     */
+    int parse(const AudioCtrlPkt* const pkt, MidiMessage* msgs, int max_msgs)
+    {
+        int num_msgs = 0;
+        int num_bytes = check_for_midi_data(pkt);
+        if (_expect_fragment && (num_bytes == 0 || pkt->seq != _expected_seq))
+        {
+            num_msgs = _truncate(msgs, num_msgs, max_msgs);
+            reset();
+        }
+        _expect_fragment = num_bytes > 0 && pkt->continuation > 0;
+        _expected_seq = pkt->seq + 1;
+
+        if (!check_for_timestamped_midi_data(pkt))
+        {
+            return _parse(pkt->payload.midi_data, 0, std::min(num_bytes, AUDIO_CTRL_PKT_PAYLOAD_SIZE), 0,
+                          msgs, num_msgs, max_msgs);
+        }
+
+        MidiEventIterator events;
+        init_midi_event_iterator(&events, pkt);
+        uint32_t frame_offset;
+        int event_size;
+        while (const uint8_t* event = next_midi_event(&events, &frame_offset, &event_size))
+        {
+            int begin = static_cast<int>(event - pkt->payload.midi_data);
+            num_msgs = _parse(pkt->payload.midi_data, begin, begin + event_size, static_cast<uint16_t>(frame_offset),
+                              msgs, num_msgs, max_msgs);
+        }
+        return num_msgs;
+    }
+
+    /**
+     * @brief Parse a block of the midi byte stream. SysEx chunk offsets are
+     *        relative to data.
+     *
+     * @param data The midi bytes
+     * @param size The number of bytes, at most 65535
+     * @param msgs Buffer for the records, 2 * size + 1 records always fit
+     * @param max_msgs The size of the buffer
+     * @return The number of records written
+     */
+    int parse(const uint8_t* data, int size, MidiMessage* msgs, int max_msgs)
+    {
+        return _parse(data, 0, size, 0, msgs, 0, max_msgs);
+    }
+
+    /**
+     * @brief Get the counters since construction.
+     */
+    MidiParserStats stats() const
+    {
+        return _stats;
+    }
+
+private:
+    static constexpr int VEC_BYTES = simd::WIDTH * 4;
+    static constexpr int WINDOW_SIZE = 128;
+    static_assert(WINDOW_SIZE % VEC_BYTES == 0);
+
+    /**
+     * @brief Bit mask of the status bytes of a window of up to WINDOW_SIZE
+     *        bytes. Bytes past size are taken as status bytes, so that runs
+     *        of data bytes always end within the window. The vectors are
+     *        loaded from data directly, a partial last vector overlaps the
+     *        previous one.
+     */
+    static void _status_mask(const uint8_t* data, int size, uint64_t (&mask)[2])
+    {
+        mask[0] = 0;
+        mask[1] = 0;
+        int offset = 0;
+        for (; offset + VEC_BYTES <= size; offset += VEC_BYTES)
+        {
+            simd::VecI v = simd::load_i(reinterpret_cast<const int32_t*>(data + offset));
+            mask[offset / 64] |= static_cast<uint64_t>(simd::byte_msb_mask(v)) << (offset % 64);
+        }
+        if (offset < size)
+        {
+            uint32_t bits = 0;
+            if (size >= VEC_BYTES)
+            {
+                int last = size - VEC_BYTES;
+                simd::VecI v = simd::load_i(reinterpret_cast<const int32_t*>(data + last));
+                bits = simd::byte_msb_mask(v) >> (offset - last);
+            }
+            else
+            {
+                for (int i = offset; i < size; i++)
+                {
+                    bits |= static_cast<uint32_t>(data[i] >> 7) << (i - offset);
+                }
+            }
+            mask[offset / 64] |= static_cast<uint64_t>(bits) << (offset % 64);
+        }
+        for (int word = 0; word < 2; word++)
+        {
+            int end = size - 64 * word;
+            if (end <= 0)
+            {
+                mask[word] = ~uint64_t(0);
+            }
+            else if (end < 64)
+            {
+                mask[word] |= ~uint64_t(0) << end;
+            }
+        }
+    }
+
+    // Position of the first status byte at or after pos, WINDOW_SIZE if none
+    static int _next_status(const uint64_t (&mask)[2], int pos)
+    {
+        if (pos < 64)
+        {
+            uint64_t bits = mask[0] >> pos;
+            if (bits)
+            {
+                return pos + __builtin_ctzll(bits);
+            }
+            pos = 64;
+        }
+        uint64_t bits = mask[1] >> (pos - 64);
+        return bits ? pos + __builtin_ctzll(bits) : WINDOW_SIZE;
+    }
+
+    // Records are filled in place, building them on the stack defeats store forwarding
+    MidiMessage* _next_record(MidiMessage* msgs, int& num_msgs, int max_msgs)
+    {
+        if (num_msgs >= max_msgs)
+        {
+            _stats.overflows++;
+            return nullptr;
+        }
+        _stats.messages++;
+        return &msgs[num_msgs++];
+    }
+
+    // Writes a record with two stores rather than one per field, assuming a
+    // little endian host as the rest of the protocol does
+    static void _fill(MidiMessage* msg, uint16_t frame_offset, uint16_t offset, MidiMessageType type,
+                      uint8_t flags, uint8_t size, uint8_t d0, uint8_t d1, uint8_t d2)
+    {
+        uint64_t head = frame_offset | (uint64_t(offset) << 16) | (uint64_t(type) << 32) |
+                        (uint64_t(flags) << 40) | (uint64_t(size) << 48) | (uint64_t(d0) << 56);
+        uint16_t tail = static_cast<uint16_t>(d1 | (d2 << 8));
+        std::memcpy(msg, &head, sizeof(head));
+        std::memcpy(&msg->data[1], &tail, sizeof(tail));
+    }
+
+    void _emit_short(MidiMessage* msgs, int& num_msgs, int max_msgs, MidiMessageType type, const uint8_t* bytes, int size)
+    {
+        if (MidiMessage* msg = _next_record(msgs, num_msgs, max_msgs))
+        {
+            _fill(msg, _frame_offset, 0, type, 0, static_cast<uint8_t>(size),
+                  bytes[0], size > 1 ? bytes[1] : 0, size > 2 ? bytes[2] : 0);
+        }
+    }
+
+    void _emit_sysex(MidiMessage* msgs, int& num_msgs, int max_msgs, int offset, int size, uint8_t flags)
+    {
+        if (_sysex_start)
+        {
+            flags |= MIDI_MSG_FLAG_SYSEX_START;
+            _sysex_start = false;
+        }
+        if (MidiMessage* msg = _next_record(msgs, num_msgs, max_msgs))
+        {
+            _fill(msg, _frame_offset, static_cast<uint16_t>(offset), MidiMessageType::SYSEX, flags,
+                  static_cast<uint8_t>(size), 0, 0, 0);
+        }
+    }
+
+    // Ends a SysEx or partial message cut by a lost packet
+    int _truncate(MidiMessage* msgs, int num_msgs, int max_msgs)
+    {
+        if (_in_sysex)
+        {
+            _emit_sysex(msgs, num_msgs, max_msgs, 0, 0, MIDI_MSG_FLAG_SYSEX_END | MIDI_MSG_FLAG_TRUNCATED);
+        }
+        if (_in_sysex || _msg_needed > 0)
+        {
+            _stats.truncated++;
+        }
+        return num_msgs;
+    }
+
+    int _parse(const uint8_t* data, int begin, int end, uint16_t frame_offset,
+               MidiMessage* msgs, int num_msgs, int max_msgs)
+    {
+        _frame_offset = frame_offset;
+        for (int base = begin; base < end; base += WINDOW_SIZE)
+        {
+            int size = std::min(end - base, WINDOW_SIZE);
+            uint64_t mask[2];
+            _status_mask(data + base, size, mask);
+            _parse_window(data + base, size, base, mask, msgs, num_msgs, max_msgs);
+        }
+        return num_msgs;
+    }
+
+    void _parse_window(const uint8_t* bytes, int size, int base, const uint64_t (&mask)[2],
+                       MidiMessage* msgs, int& num_msgs, int max_msgs)
+    {
+        int pos = 0;
+        int sysex_begin = 0;
+        while (pos < size)
+        {
+            if (_in_sysex)
+            {
+                // Skip to the next status byte, everything before it is SysEx data
+                pos = _next_status(mask, pos);
+                if (pos >= size)
+                {
+                    break;
+                }
+                uint8_t status = bytes[pos];
+                if (status >= 0xF8)
+                {
+                    if (pos > sysex_begin)
+                    {
+                        _emit_sysex(msgs, num_msgs, max_msgs, base + sysex_begin, pos - sysex_begin, 0);
+                    }
+                    _emit_short(msgs, num_msgs, max_msgs, MidiMessageType::REALTIME, &bytes[pos], 1);
+                    sysex_begin = ++pos;
+                }
+                else if (status == 0xF7)
+                {
+                    pos++;
+                    _emit_sysex(msgs, num_msgs, max_msgs, base + sysex_begin, pos - sysex_begin, MIDI_MSG_FLAG_SYSEX_END);
+                    _in_sysex = false;
+                }
+                else
+                {
+                    // Any other status byte ends the SysEx, and is parsed below
+                    _emit_sysex(msgs, num_msgs, max_msgs, base + sysex_begin, pos - sysex_begin,
+                                MIDI_MSG_FLAG_SYSEX_END | MIDI_MSG_FLAG_TRUNCATED);
+                    _stats.truncated++;
+                    _in_sysex = false;
+                }
+                continue;
+            }
+
+            uint8_t status = bytes[pos];
+            if (status < 0x80)
+            {
+                pos = _parse_data(bytes, size, pos, mask, msgs, num_msgs, max_msgs);
+                continue;
+            }
+            pos++;
+            if (status >= 0xF8)
+            {
+                _emit_short(msgs, num_msgs, max_msgs, MidiMessageType::REALTIME, &bytes[pos - 1], 1);
+                continue;
+            }
+            if (_msg_needed > 0)
+            {
+                _stats.truncated++;
+                _msg_needed = 0;
+            }
+            if (status == 0xF0)
+            {
+                _in_sysex = true;
+                _sysex_start = true;
+                _running_status = 0;
+                sysex_begin = pos - 1;
+            }
+            else if (status == 0xF7)
+            {
+                _stats.stray_bytes++;
+            }
+            else if (status > 0xF0)
+            {
+                _running_status = 0;
+                _start_msg(status, msgs, num_msgs, max_msgs);
+            }
+            else
+            {
+                _running_status = status;
+                int end = _parse_channel_msgs(bytes, size, pos - 1, mask, msgs, num_msgs, max_msgs);
+                if (end > pos - 1)
+                {
+                    pos = end;
+                }
+                else
+                {
+                    _start_msg(status, msgs, num_msgs, max_msgs);
+                }
+            }
+        }
+
+        // The rest of the SysEx comes with the next bytes
+        if (_in_sysex && size > sysex_begin)
+        {
+            _emit_sysex(msgs, num_msgs, max_msgs, base + sysex_begin, size - sysex_begin, 0);
+        }
+    }
+
+    /**
+     * @brief Cut the run of whole channel messages, each with its status byte,
+     *        starting at the status byte at pos. This is the common case of a
+     *        packet of notes or controllers. The messages are cut at the set
+     *        bits of the status mask rather than at the sizes given by the
+     *        status bytes, so that finding the next message only depends on
+     *        clearing the lowest bit of the mask, not on the load of the
+     *        current one. The records are written with a local index, not
+     *        through num_msgs and the counters in memory.
+     *
+     * @return The position after the last message cut, pos if none
+     */
+    int _parse_channel_msgs(const uint8_t* bytes, int size, int pos, const uint64_t (&mask)[2],
+                            MidiMessage* msgs, int& num_msgs, int max_msgs)
+    {
+        // The status bytes after pos, kept in registers
+        int first = pos + 1;
+        uint64_t bits_lo = 0;
+        uint64_t bits_hi = 0;
+        if (first < 64)
+        {
+            bits_lo = mask[0] & (~uint64_t(0) << first);
+            bits_hi = mask[1];
+        }
+        else if (first < WINDOW_SIZE)
+        {
+            bits_hi = mask[1] & (~uint64_t(0) << (first - 64));
+        }
+
+        uint16_t frame_offset = _frame_offset;
+        MidiMessage* msg = &msgs[num_msgs];
+        int num_records = 0;
+        int max_records = max_msgs - num_msgs;
+        uint8_t status = 0;
+        int next = _pop_status(bits_lo, bits_hi);
+        while (num_records < max_records)
+        {
+            uint8_t msg_status = bytes[pos];
+            // Program change and channel pressure have 1 data byte, the rest 2
+            int num_data = (msg_status & 0xE0) == 0xC0 ? 1 : 2;
+            // The mask is set past size, so a message running past the window
+            // is cut short as well
+            if (msg_status >= 0xF0 || next - pos - 1 < num_data)
+            {
+                break;
+            }
+            status = msg_status;
+            _fill(&msg[num_records++], frame_offset, 0, MidiMessageType::CHANNEL, 0,
+                  static_cast<uint8_t>(num_data + 1), status, bytes[pos + 1], num_data > 1 ? bytes[pos + 2] : 0);
+            if (next - pos - 1 > num_data || next >= size)
+            {
+                // Followed by running status data or the end of the window
+                pos += num_data + 1;
+                break;
+            }
+            pos = next;
+            next = _pop_status(bits_lo, bits_hi);
+        }
+        if (num_records > 0)
+        {
+            _running_status = status;
+            num_msgs += num_records;
+            _stats.messages += num_records;
+        }
+        return pos;
+    }
+
+    // Position of the lowest set bit of a window mask, which is then cleared,
+    // WINDOW_SIZE if none
+    static int _pop_status(uint64_t& bits_lo, uint64_t& bits_hi)
+    {
+        if (bits_lo)
+        {
+            int pos = __builtin_ctzll(bits_lo);
+            bits_lo &= bits_lo - 1;
+            return pos;
+        }
+        if (bits_hi)
+        {
+            int pos = 64 + __builtin_ctzll(bits_hi);
+            bits_hi &= bits_hi - 1;
+            return pos;
+        }
+        return WINDOW_SIZE;
+    }
+
+    // Channel messages are emitted at once if they have no data bytes
+    void _start_msg(uint8_t status, MidiMessage* msgs, int& num_msgs, int max_msgs)
+    {
+        int msg_size = midi_msg_size(status);
+        _msg[0] = status;
+        _msg_size = 1;
+        _msg_needed = msg_size > 0 ? msg_size - 1 : 0;
+        if (msg_size == 1)
+        {
+            _emit_short(msgs, num_msgs, max_msgs, MidiMessageType::SYSTEM_COMMON, _msg, 1);
+        }
+    }
+
+    /**
+     * @brief Consume the run of data bytes starting at pos, completing the
+     *        partial message and then cutting running status messages at a
+     *        fixed stride.
+     *
+     * @return The position of the status byte ending the run
+     */
+    int _parse_data(const uint8_t* bytes, int size, int pos, const uint64_t (&mask)[2],
+                    MidiMessage* msgs, int& num_msgs, int max_msgs)
+    {
+        int run_end = std::min(_next_status(mask, pos), size);
+        if (_msg_size == 1 && _msg_needed > 0 && _msg[0] == _running_status)
+        {
+            // A channel status was just seen, its data is cut as running status
+            _msg_needed = 0;
+        }
+        if (_msg_needed > 0)
+        {
+            while (_msg_needed > 0 && pos < run_end)
+            {
+                _msg[_msg_size++] = bytes[pos++];
+                _msg_needed--;
+            }
+            if (_msg_needed > 0)
+            {
+                return run_end;
+            }
+            auto type = _msg[0] < 0xF0 ? MidiMessageType::CHANNEL : MidiMessageType::SYSTEM_COMMON;
+            _emit_short(msgs, num_msgs, max_msgs, type, _msg, _msg_size);
+        }
+        if (pos == run_end)
+        {
+            return run_end;
+        }
+        if (_running_status == 0)
+        {
+            _stats.stray_bytes += run_end - pos;
+            return run_end;
+        }
+
+        // Running status is only kept for channel messages, with 1 or 2 data
+        // bytes. The records are written with a local index, not through
+        // num_msgs and the counters in memory.
+        uint8_t status = _running_status;
+        int num_data = midi_msg_size(status) - 1;
+        int num_complete = (run_end - pos) / num_data;
+        int num_records = std::min(num_complete, max_msgs - num_msgs);
+        MidiMessage* msg = &msgs[num_msgs];
+        uint16_t frame_offset = _frame_offset;
+        for (int i = 0; i < num_records; i++)
+        {
+            const uint8_t* data = &bytes[pos + i * num_data];
+            _fill(&msg[i], frame_offset, 0, MidiMessageType::CHANNEL, 0, static_cast<uint8_t>(num_data + 1),
+                  status, data[0], num_data > 1 ? data[1] : 0);
+        }
+        num_msgs += num_records;
+        _stats.messages += num_records;
+        _stats.overflows += num_complete - num_records;
+        pos += num_complete * num_data;
+
+        if (pos < run_end)
+        {
+            _msg[0] = status;
+            _msg[1] = bytes[pos];
+            _msg_size = 2;
+            _msg_needed = num_data - 1;
+        }
+        return run_end;
+    }
+
+    uint8_t _running_status;
+    uint8_t _msg[3];
+    int _msg_size;
+    int _msg_needed;
+    bool _in_sysex;
+    bool _sysex_start;
+    bool _expect_fragment;
+    uint32_t _expected_seq{0};
+    uint16_t _frame_offset{0};
+    MidiParserStats _stats{};
+};
+
+} // namespace audio_ctrl
+
+#endif // MIDI_STREAM_PARSER_H_
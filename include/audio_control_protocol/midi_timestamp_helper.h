@@ -0,0 +1,203 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Helper functions for timestamped midi data packets, carrying the
+ *        frame offset within the period of every midi event so that the
+ *        receiver can render them sample accurately. Timestamped packets are
+ *        MIDI_DATA packets with AUDIO_CTRL_MIDI_TIMESTAMPED_FLAG set in cmd_lsb,
+ *        the payload holds a sequence of events, each encoded as:
+ *
+ *            frame offset (16 bit little endian) | size (8 bit) | midi bytes
+ *
+ *        Events should be in increasing frame offset order and hold complete
+ *        midi messages. Host and device agree on the encoding with a
+ *        DEVICE_MIDI_MODE query, supported by devices advertising
+ *        DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_TIMESTAMPED_MIDI. Fragmented
+ *        messages (midi_fragment_helper.h) are only supported in raw mode.
+ *        Can be used either by the host system or the secondary
+ *        microcontroller.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef MIDI_TIMESTAMP_HELPER_H_
+#define MIDI_TIMESTAMP_HELPER_H_
+
+#include "audio_packet_helper.h"
+
+#ifdef __cplusplus
+namespace audio_ctrl {
+#endif
+
+// Size of the frame offset and size fields preceding every event
+#define AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE 3
+
+// Max size of the midi bytes of a single timestamped event
+#define AUDIO_CTRL_MIDI_EVENT_MAX_SIZE \
+    (AUDIO_CTRL_PKT_PAYLOAD_SIZE - AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE)
+
+/**
+ * @brief State of the parsing of the midi events of a packet. Raw midi
+ *        packets are returned as a single event at frame offset 0.
+ */
+typedef struct
+{
+    const uint8_t* data;    // The midi payload of the packet
+    int size;               // Size of the midi payload in bytes
+    int offset;             // Offset of the next event
+    uint8_t timestamped;    // 1 if the packet is timestamped
+    uint8_t malformed;      // 1 if an event overran the payload
+} MidiEventIterator;
+
+/**
+ * @brief Check if a packet holds timestamped midi events.
+ *
+ * @param pkt The audio control packet
+ * @return 1 if the packet is a timestamped midi data packet, 0 if not
+ */
+inline int check_for_timestamped_midi_data(const AudioCtrlPkt* const pkt)
+{
+    if (pkt->cmd_msb == MIDI_DATA && (pkt->cmd_lsb & AUDIO_CTRL_MIDI_TIMESTAMPED_FLAG))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Prepare a timestamped midi data packet with no events.
+ *
+ * @param pkt The audio control packet
+ */
+inline void prepare_timestamped_midi_data_pkt(AudioCtrlPkt* const pkt)
+{
+    create_default_audio_ctrl_pkt(pkt);
+    pkt->cmd_msb = MIDI_DATA;
+    pkt->cmd_lsb = AUDIO_CTRL_MIDI_TIMESTAMPED_FLAG;
+}
+
+/**
+ * @brief Append a midi event to a packet prepared with
+ *        prepare_timestamped_midi_data_pkt().
+ *
+ * @param pkt The audio control packet
+ * @param frame_offset The frame of the period the event belongs to
+ * @param midi_data The midi bytes of the event
+ * @param num_midi_bytes The number of midi bytes, at least 1
+ * @return 1 if successful, 0 if the event does not fit in the packet
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline int add_timestamped_midi_event(AudioCtrlPkt* const pkt,
+                                      uint16_t frame_offset,
+                                      const uint8_t* const midi_data,
+                                      uint8_t num_midi_bytes)
+{
+    int offset = pkt->cmd_lsb & AUDIO_CTRL_MIDI_SIZE_MASK;
+    if (num_midi_bytes == 0 ||
+        offset + AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE + num_midi_bytes > AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+    {
+        return 0;
+    }
+
+    uint8_t* event = &pkt->payload.midi_data[offset];
+    event[0] = (uint8_t) (frame_offset & 0xFF);
+    event[1] = (uint8_t) (frame_offset >> 8);
+    event[2] = num_midi_bytes;
+    for (int i = 0; i < (int) num_midi_bytes; i++)
+    {
+        event[AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE + i] = midi_data[i];
+    }
+    pkt->cmd_lsb = (uint8_t) (AUDIO_CTRL_MIDI_TIMESTAMPED_FLAG |
+                              (offset + AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE + num_midi_bytes));
+
+    return 1;
+}
+
+/**
+ * @brief Start parsing the midi events of a packet, either raw or timestamped.
+ *        Nothing is copied, events point into the packet payload.
+ *
+ * @param it The event iterator
+ * @param pkt The audio control packet, must not change during the parsing
+ * @return The number of midi payload bytes, 0 if the packet has no midi data
+ */
+inline int init_midi_event_iterator(MidiEventIterator* const it,
+                                    const AudioCtrlPkt* const pkt)
+{
+    int num_midi_bytes = check_for_midi_data(pkt);
+    if (num_midi_bytes > AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+    {
+        num_midi_bytes = 0;
+    }
+
+    it->data = pkt->payload.midi_data;
+    it->size = num_midi_bytes;
+    it->offset = 0;
+    it->timestamped = (uint8_t) check_for_timestamped_midi_data(pkt);
+    it->malformed = 0;
+
+    return num_midi_bytes;
+}
+
+/**
+ * @brief Get the next midi event of the packet.
+ *
+ * @param it The event iterator
+ * @param frame_offset Filled with the frame offset of the event
+ * @param num_midi_bytes Filled with the number of midi bytes of the event
+ * @return Pointer to the midi bytes of the event, null if there are no more
+ *         events or if the rest of the payload is malformed, in which case
+ *         the malformed field is set
+ */
+inline const uint8_t* next_midi_event(MidiEventIterator* const it,
+                                      uint32_t* const frame_offset,
+                                      int* const num_midi_bytes)
+{
+    if (it->offset >= it->size)
+    {
+        return 0;
+    }
+
+    if (!it->timestamped)
+    {
+        *frame_offset = 0;
+        *num_midi_bytes = it->size;
+        it->offset = it->size;
+        return it->data;
+    }
+
+    const uint8_t* event = &it->data[it->offset];
+    int size = it->offset + AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE <= it->size ? event[2] : 0;
+    if (size == 0 || it->offset + AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE + size > it->size)
+    {
+        it->malformed = 1;
+        it->offset = it->size;
+        return 0;
+    }
+
+    *frame_offset = (uint32_t) event[0] | ((uint32_t) event[1] << 8);
+    *num_midi_bytes = size;
+    it->offset += AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE + size;
+    return &event[AUDIO_CTRL_MIDI_EVENT_HEADER_SIZE];
+}
+
+#ifdef __cplusplus
+} // namespace audio_ctrl
+#endif
+
+#endif // MIDI_TIMESTAMP_HELPER_H_
@@ -0,0 +1,581 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Helper functions for MIDI_UMP_DATA packets, carrying MIDI 2.0
+ *        Universal MIDI Packets (UMP) instead of a midi byte stream. The
+ *        payload holds up to AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS 32 bit words in
+ *        host byte order and cmd_lsb the number of words. Packets hold
+ *        complete UMP messages, whose size in words follows from the message
+ *        type in the 4 msbs of their first word, so that they are parsed a
+ *        word at a time without looking at the individual bytes. Long SysEx
+ *        are split in 7 bit SysEx messages of up to 6 bytes each.
+ *
+ *        Host and device agree on the encoding with a DEVICE_MIDI_MODE query
+ *        for DEVICE_MIDI_MODE_UMP, supported by devices advertising
+ *        DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_UMP_MIDI. Translation helpers to
+ *        and from MIDI 1.0 messages are provided for the ports and
+ *        applications still using the byte stream, MIDI 2.0 channel voice
+ *        messages carry 16 bit velocities and 32 bit controllers.
+ *        Can be used either by the host system or the secondary
+ *        microcontroller.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef MIDI_UMP_HELPER_H_
+#define MIDI_UMP_HELPER_H_
+
+#include "audio_packet_helper.h"
+
+#ifdef __cplusplus
+namespace audio_ctrl {
+#endif
+
+// UMP message types, in the 4 msbs of the first word of a message
+#define UMP_MT_UTILITY              0x0
+#define UMP_MT_SYSTEM               0x1
+#define UMP_MT_MIDI1_CHANNEL_VOICE  0x2
+#define UMP_MT_SYSEX7               0x3
+#define UMP_MT_MIDI2_CHANNEL_VOICE  0x4
+#define UMP_MT_DATA128              0x5
+
+// Number of words minus one of each message type, 2 bits per message type
+#define UMP_NUM_WORDS_TABLE 0xFE950D40u
+
+// Max number of words of a UMP message
+#define UMP_MAX_NUM_WORDS 4
+
+// Status of 7 bit SysEx messages, in bits 20 to 23 of the first word
+#define UMP_SYSEX7_COMPLETE 0x0
+#define UMP_SYSEX7_START    0x1
+#define UMP_SYSEX7_CONTINUE 0x2
+#define UMP_SYSEX7_END      0x3
+
+// Max number of SysEx data bytes of a 7 bit SysEx message
+#define UMP_SYSEX7_MAX_SIZE 6
+
+// Max number of midi bytes produced by ump_to_midi1(), a MIDI 2.0
+// registered controller is translated to 4 control changes
+#define UMP_MIDI1_MAX_SIZE 12
+
+/**
+ * @brief Get the message type of a UMP message.
+ *
+ * @param word The first word of the message
+ * @return The message type, as of UMP_MT_xxx
+ */
+inline int ump_message_type(uint32_t word)
+{
+    return (int) (word >> 28);
+}
+
+/**
+ * @brief Get the group of a UMP message.
+ *
+ * @param word The first word of the message
+ * @return The group, from 0 to 15
+ */
+inline int ump_group(uint32_t word)
+{
+    return (int) ((word >> 24) & 0xF);
+}
+
+/**
+ * @brief Get the size of a UMP message from its message type, without
+ *        branches.
+ *
+ * @param word The first word of the message
+ * @return The number of words of the message, from 1 to UMP_MAX_NUM_WORDS
+ */
+inline int ump_num_words(uint32_t word)
+{
+    return 1 + (int) ((UMP_NUM_WORDS_TABLE >> ((word >> 28) * 2)) & 3u);
+}
+
+/**
+ * @brief Scale a value to a higher resolution with the MIDI 2.0 min-center-max
+ *        algorithm: 0, the center value and the max value are preserved.
+ *
+ * @param value The value to scale
+ * @param src_bits The resolution of value, from 1 to 31
+ * @param dst_bits The resolution of the result, from src_bits to 32
+ * @return The scaled value
+ */
+inline uint32_t ump_scale_up(uint32_t value, int src_bits, int dst_bits)
+{
+    int scale_bits = dst_bits - src_bits;
+    if (src_bits == 1)
+    {
+        return value ? (0xFFFFFFFFu >> (32 - dst_bits)) : 0;
+    }
+
+    uint32_t scaled = value << scale_bits;
+    if (value <= (1u << (src_bits - 1)))
+    {
+        return scaled;
+    }
+
+    // Above the center the bits below the msb are repeated in the lsbs
+    int repeat_bits = src_bits - 1;
+    uint32_t repeat = value & ((1u << repeat_bits) - 1);
+    repeat = scale_bits > repeat_bits ? repeat << (scale_bits - repeat_bits) : repeat >> (repeat_bits - scale_bits);
+    while (repeat != 0)
+    {
+        scaled |= repeat;
+        repeat >>= repeat_bits;
+    }
+
+    return scaled;
+}
+
+/**
+ * @brief Scale a value to a lower resolution.
+ *
+ * @param value The value to scale
+ * @param src_bits The resolution of value, up to 32
+ * @param dst_bits The resolution of the result, up to src_bits
+ * @return The scaled value
+ */
+inline uint32_t ump_scale_down(uint32_t value, int src_bits, int dst_bits)
+{
+    return value >> (src_bits - dst_bits);
+}
+
+/**
+ * @brief Append a UMP message to a packet prepared with
+ *        prepare_midi_ump_data_pkt().
+ *
+ * @param pkt The audio control packet
+ * @param ump_words The words of the message, ump_num_words() of them
+ * @return 1 if successful, 0 if the message does not fit in the packet
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline int add_ump_message(AudioCtrlPkt* const pkt, const uint32_t* const ump_words)
+{
+    int offset = pkt->cmd_lsb;
+    int num_words = ump_num_words(ump_words[0]);
+    if (offset + num_words > AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < num_words; i++)
+    {
+        pkt->payload.ump_words[offset + i] = ump_words[i];
+    }
+    pkt->cmd_lsb = (uint8_t) (offset + num_words);
+
+    return 1;
+}
+
+/**
+ * @brief Get the next UMP message of a packet. Nothing is copied, messages
+ *        point into the packet payload.
+ *
+ * @param pkt The audio control packet
+ * @param offset The offset in words of the message, 0 for the first message.
+ *        Advanced past the message.
+ * @param num_words Set to the number of words of the message
+ * @return The first word of the message, null at the end of the packet or
+ *         if a message overruns the payload, in which case offset is left
+ *         before the end of the packet
+ */
+inline const uint32_t* next_ump_message(const AudioCtrlPkt* const pkt,
+                                        int* const offset,
+                                        int* const num_words)
+{
+    int num_pkt_words = check_for_midi_ump_data(pkt);
+    if (num_pkt_words > AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+    {
+        num_pkt_words = AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS;
+    }
+    if (*offset >= num_pkt_words)
+    {
+        return 0;
+    }
+
+    const uint32_t* message = &pkt->payload.ump_words[*offset];
+    int size = ump_num_words(message[0]);
+    if (*offset + size > num_pkt_words)
+    {
+        return 0;
+    }
+    *num_words = size;
+    *offset += size;
+
+    return message;
+}
+
+/**
+ * @brief Size of a MIDI 1.0 message which has a UMP equivalent.
+ *
+ * @param status The status byte
+ * @return The size in bytes, 0 for SysEx and undefined status bytes
+ */
+inline int ump_midi1_msg_size(uint8_t status)
+{
+    if (status < 0x80)
+    {
+        return 0;
+    }
+    if (status < 0xF0)
+    {
+        return (status & 0xE0) == 0xC0 ? 2 : 3;
+    }
+    switch (status)
+    {
+    case 0xF1:
+    case 0xF3:
+        return 2;
+    case 0xF2:
+        return 3;
+    case 0xF6:
+    case 0xF8:
+    case 0xFA:
+    case 0xFB:
+    case 0xFC:
+    case 0xFE:
+    case 0xFF:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Translate a MIDI 1.0 message into a MIDI 1.0 channel voice or a
+ *        system UMP message, without loss.
+ *
+ * @param group The UMP group, from 0 to 15
+ * @param midi_data The midi bytes of a complete message, without running status
+ * @param num_midi_bytes The number of midi bytes
+ * @param ump_words Set to the message, 1 word
+ * @return The number of words written, 0 if the message has no UMP equivalent
+ *         or is incomplete
+ */
+inline int midi1_to_ump(uint8_t group,
+                        const uint8_t* const midi_data,
+                        int num_midi_bytes,
+                        uint32_t* const ump_words)
+{
+    int size = num_midi_bytes > 0 ? ump_midi1_msg_size(midi_data[0]) : 0;
+    if (size == 0 || size > num_midi_bytes)
+    {
+        return 0;
+    }
+
+    uint32_t message_type = midi_data[0] < 0xF0 ? UMP_MT_MIDI1_CHANNEL_VOICE : UMP_MT_SYSTEM;
+    uint32_t word = (message_type << 28) | ((uint32_t) (group & 0xF) << 24) | ((uint32_t) midi_data[0] << 16);
+    if (size > 1)
+    {
+        word |= (uint32_t) midi_data[1] << 8;
+    }
+    if (size > 2)
+    {
+        word |= midi_data[2];
+    }
+    ump_words[0] = word;
+
+    return 1;
+}
+
+/**
+ * @brief Translate a MIDI 1.0 message into a MIDI 2.0 channel voice UMP
+ *        message, scaling the values to the MIDI 2.0 resolution. A note on
+ *        with velocity 0 becomes a note off with velocity 64. Control
+ *        changes are translated one by one, so bank select and registered
+ *        parameter sequences stay control changes. System messages are
+ *        translated as with midi1_to_ump().
+ *
+ * @param group The UMP group, from 0 to 15
+ * @param midi_data The midi bytes of a complete message, without running status
+ * @param num_midi_bytes The number of midi bytes
+ * @param ump_words Set to the message, up to 2 words
+ * @return The number of words written, 0 if the message has no UMP equivalent
+ *         or is incomplete
+ */
+inline int midi1_to_ump_midi2(uint8_t group,
+                              const uint8_t* const midi_data,
+                              int num_midi_bytes,
+                              uint32_t* const ump_words)
+{
+    int size = num_midi_bytes > 0 ? ump_midi1_msg_size(midi_data[0]) : 0;
+    if (size == 0 || size > num_midi_bytes)
+    {
+        return 0;
+    }
+    if (midi_data[0] >= 0xF0)
+    {
+        return midi1_to_ump(group, midi_data, num_midi_bytes, ump_words);
+    }
+
+    uint32_t status = midi_data[0];
+    uint32_t data1 = midi_data[1] & 0x7Fu;
+    uint32_t data2 = size > 2 ? midi_data[2] & 0x7Fu : 0;
+    uint32_t index = 0;
+    uint32_t value = 0;
+    switch (status & 0xF0)
+    {
+    case 0x90:
+        if (data2 == 0)
+        {
+            status = 0x80 | (status & 0x0F);
+            data2 = 64;
+        }
+        index = data1 << 8;
+        value = ump_scale_up(data2, 7, 16) << 16;
+        break;
+    case 0x80:
+        index = data1 << 8;
+        value = ump_scale_up(data2, 7, 16) << 16;
+        break;
+    case 0xA0:
+    case 0xB0:
+        index = data1 << 8;
+        value = ump_scale_up(data2, 7, 32);
+        break;
+    case 0xC0:
+        value = data1 << 24;
+        break;
+    case 0xD0:
+        value = ump_scale_up(data1, 7, 32);
+        break;
+    default:
+        value = ump_scale_up(data1 | (data2 << 7), 14, 32);
+        break;
+    }
+    ump_words[0] = ((uint32_t) UMP_MT_MIDI2_CHANNEL_VOICE << 28) | ((uint32_t) (group & 0xF) << 24) |
+                   (status << 16) | index;
+    ump_words[1] = value;
+
+    return 2;
+}
+
+/**
+ * @brief Translate a MIDI 1.0 SysEx message into 7 bit SysEx UMP messages.
+ *
+ * @param group The UMP group, from 0 to 15
+ * @param sysex_data The SysEx data bytes, without the 0xF0 and 0xF7 bytes
+ * @param num_sysex_bytes The number of SysEx data bytes
+ * @param ump_words Set to the messages, 2 words for every UMP_SYSEX7_MAX_SIZE
+ *        data bytes
+ * @param max_words The size of ump_words
+ * @return The number of words written, 0 if they do not fit in max_words
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline int midi1_sysex_to_ump(uint8_t group,
+                              const uint8_t* const sysex_data,
+                              int num_sysex_bytes,
+                              uint32_t* const ump_words,
+                              int max_words)
+{
+    int num_msgs = num_sysex_bytes > 0 ? (num_sysex_bytes + UMP_SYSEX7_MAX_SIZE - 1) / UMP_SYSEX7_MAX_SIZE : 1;
+    if (2 * num_msgs > max_words)
+    {
+        return 0;
+    }
+
+    for (int msg = 0; msg < num_msgs; msg++)
+    {
+        int offset = msg * UMP_SYSEX7_MAX_SIZE;
+        int size = num_sysex_bytes - offset;
+        if (size > UMP_SYSEX7_MAX_SIZE)
+        {
+            size = UMP_SYSEX7_MAX_SIZE;
+        }
+        uint32_t status = UMP_SYSEX7_CONTINUE;
+        if (num_msgs == 1)
+        {
+            status = UMP_SYSEX7_COMPLETE;
+        }
+        else if (msg == 0)
+        {
+            status = UMP_SYSEX7_START;
+        }
+        else if (msg == num_msgs - 1)
+        {
+            status = UMP_SYSEX7_END;
+        }
+
+        uint8_t bytes[UMP_SYSEX7_MAX_SIZE] = {0, 0, 0, 0, 0, 0};
+        for (int i = 0; i < size; i++)
+        {
+            bytes[i] = sysex_data[offset + i] & 0x7F;
+        }
+        ump_words[2 * msg] = ((uint32_t) UMP_MT_SYSEX7 << 28) | ((uint32_t) (group & 0xF) << 24) |
+                             (status << 20) | ((uint32_t) size << 16) | ((uint32_t) bytes[0] << 8) | bytes[1];
+        ump_words[2 * msg + 1] = ((uint32_t) bytes[2] << 24) | ((uint32_t) bytes[3] << 16) |
+                                 ((uint32_t) bytes[4] << 8) | bytes[5];
+    }
+
+    return 2 * num_msgs;
+}
+
+/**
+ * @brief Translate a UMP message into MIDI 1.0 bytes. MIDI 2.0 channel voice
+ *        values are scaled down, note on velocities are kept above 0, a
+ *        program change with a valid bank is preceded by the bank select
+ *        control changes and registered and assignable controllers become
+ *        control change sequences. 7 bit SysEx messages are returned with
+ *        the 0xF0 and 0xF7 bytes of the messages they start and end.
+ *
+ * @param ump_words The words of the message
+ * @param midi_data Set to the midi bytes, room for UMP_MIDI1_MAX_SIZE bytes
+ * @return The number of midi bytes, 0 if the message has no MIDI 1.0
+ *         equivalent (utility, per note and relative controllers, 8 bit
+ *         data and stream messages)
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline int ump_to_midi1(const uint32_t* const ump_words, uint8_t* const midi_data)
+{
+    uint32_t word = ump_words[0];
+    uint8_t status = (uint8_t) (word >> 16);
+    uint8_t byte2 = (uint8_t) ((word >> 8) & 0x7F);
+    uint8_t byte3 = (uint8_t) (word & 0x7F);
+
+    switch (ump_message_type(word))
+    {
+    case UMP_MT_SYSTEM:
+    case UMP_MT_MIDI1_CHANNEL_VOICE:
+    {
+        int size = ump_midi1_msg_size(status);
+        midi_data[0] = status;
+        midi_data[1] = byte2;
+        midi_data[2] = byte3;
+        return size;
+    }
+
+    case UMP_MT_SYSEX7:
+    {
+        int sysex_status = (int) ((word >> 20) & 0xF);
+        int size = (int) ((word >> 16) & 0xF);
+        int num_bytes = 0;
+        if (size > UMP_SYSEX7_MAX_SIZE)
+        {
+            size = UMP_SYSEX7_MAX_SIZE;
+        }
+        if (sysex_status == UMP_SYSEX7_COMPLETE || sysex_status == UMP_SYSEX7_START)
+        {
+            midi_data[num_bytes++] = 0xF0;
+        }
+        for (int i = 0; i < size; i++)
+        {
+            uint32_t data_word = i < 2 ? word : ump_words[1];
+            int shift = i < 2 ? 8 * (1 - i) : 8 * (5 - i);
+            midi_data[num_bytes++] = (uint8_t) ((data_word >> shift) & 0x7F);
+        }
+        if (sysex_status == UMP_SYSEX7_COMPLETE || sysex_status == UMP_SYSEX7_END)
+        {
+            midi_data[num_bytes++] = 0xF7;
+        }
+        return num_bytes;
+    }
+
+    case UMP_MT_MIDI2_CHANNEL_VOICE:
+    {
+        uint8_t channel = status & 0x0F;
+        uint32_t value = ump_words[1];
+        switch (status & 0xF0)
+        {
+        case 0x80:
+        case 0x90:
+        {
+            uint8_t velocity = (uint8_t) ump_scale_down(value >> 16, 16, 7);
+            if ((status & 0xF0) == 0x90 && velocity == 0)
+            {
+                velocity = 1;
+            }
+            midi_data[0] = status;
+            midi_data[1] = byte2;
+            midi_data[2] = velocity;
+            return 3;
+        }
+        case 0xA0:
+        case 0xB0:
+            midi_data[0] = status;
+            midi_data[1] = byte2;
+            midi_data[2] = (uint8_t) ump_scale_down(value, 32, 7);
+            return 3;
+        case 0xC0:
+        {
+            int num_bytes = 0;
+            if (word & 0x1)
+            {
+                midi_data[0] = 0xB0 | channel;
+                midi_data[1] = 0;
+                midi_data[2] = (uint8_t) ((value >> 8) & 0x7F);
+                midi_data[3] = 0xB0 | channel;
+                midi_data[4] = 32;
+                midi_data[5] = (uint8_t) (value & 0x7F);
+                num_bytes = 6;
+            }
+            midi_data[num_bytes] = status;
+            midi_data[num_bytes + 1] = (uint8_t) ((value >> 24) & 0x7F);
+            return num_bytes + 2;
+        }
+        case 0xD0:
+            midi_data[0] = status;
+            midi_data[1] = (uint8_t) ump_scale_down(value, 32, 7);
+            return 2;
+        case 0xE0:
+        {
+            uint32_t bend = ump_scale_down(value, 32, 14);
+            midi_data[0] = status;
+            midi_data[1] = (uint8_t) (bend & 0x7F);
+            midi_data[2] = (uint8_t) (bend >> 7);
+            return 3;
+        }
+        case 0x20:
+        case 0x30:
+        {
+            // Registered (0x2) and assignable (0x3) controllers, value msbs
+            // and lsbs through data entry
+            uint8_t registered = (status & 0xF0) == 0x20;
+            uint32_t data = ump_scale_down(value, 32, 14);
+            midi_data[0] = 0xB0 | channel;
+            midi_data[1] = registered ? 101 : 99;
+            midi_data[2] = (uint8_t) ((word >> 8) & 0x7F);
+            midi_data[3] = 0xB0 | channel;
+            midi_data[4] = registered ? 100 : 98;
+            midi_data[5] = byte3;
+            midi_data[6] = 0xB0 | channel;
+            midi_data[7] = 6;
+            midi_data[8] = (uint8_t) (data >> 7);
+            midi_data[9] = 0xB0 | channel;
+            midi_data[10] = 38;
+            midi_data[11] = (uint8_t) (data & 0x7F);
+            return 12;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    default:
+        return 0;
+    }
+}
+
+#ifdef __cplusplus
+} // namespace audio_ctrl
+#endif
+
+#endif // MIDI_UMP_HELPER_H_
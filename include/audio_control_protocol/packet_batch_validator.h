@@ -0,0 +1,338 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Batch validation of contiguous arrays of audio or device control
+ *        packets. Magic words, command codes and optionally the crc of up to
+ *        PKT_BATCH_MAX_NUM_PKTS packets are checked without per-packet
+ *        branches. The header and trailer words of 8 (AVX2) or 4 (NEON)
+ *        packets are checked at a time, a scalar fallback handles the
+ *        remaining packets and other platforms. Meant to be used by the host
+ *        when draining several packets at once.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef PACKET_BATCH_VALIDATOR_H_
+#define PACKET_BATCH_VALIDATOR_H_
+
+#include <cstring>
+
+#include "audio_packet_helper.h"
+#include "device_packet_helper.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Maximum number of packets which can be validated in a single call
+#define PKT_BATCH_MAX_NUM_PKTS 64
+
+// Validation flags
+#define PKT_BATCH_CHECK_CRC     0x01u
+
+// Error classes reported in PktBatchSummary::error_classes
+#define PKT_BATCH_ERROR_MAGIC   0x01u
+#define PKT_BATCH_ERROR_CMD     0x02u
+#define PKT_BATCH_ERROR_CRC     0x04u
+
+namespace audio_ctrl {
+
+/**
+ * @brief Summary of the errors found in a batch of packets. Bit n of each
+ *        mask refers to the n-th packet of the batch, the number of packets
+ *        with a given error can be obtained with a popcount of the mask.
+ */
+struct PktBatchSummary
+{
+    uint64_t magic_error_mask;  // Packets with invalid magic words
+    uint64_t cmd_error_mask;    // Packets with an unknown command
+    uint64_t crc_error_mask;    // Packets with a crc mismatch
+    uint32_t error_classes;     // Bit mask of PKT_BATCH_ERROR_xxx found in the batch
+    int num_validated;          // Number of packets checked, packets past PKT_BATCH_MAX_NUM_PKTS are not
+};
+
+/**
+ * @brief Bitset of the valid command codes, bit n is set if command n is valid.
+ */
+struct PktCmdTable
+{
+    uint32_t bits[8];
+};
+
+template <size_t N>
+constexpr PktCmdTable make_pkt_cmd_table(const int (&cmds)[N])
+{
+    PktCmdTable table = {};
+    for (size_t i = 0; i < N; i++)
+    {
+        table.bits[cmds[i] >> 5] |= 1u << (cmds[i] & 31);
+    }
+    return table;
+}
+
+/**
+ * @brief Generic batch validation kernel, see validate_audio_pkt_batch() and
+ *        validate_device_pkt_batch() for the packet specific versions.
+ *
+ * @tparam Layout Describes the position of the magic words, command and crc
+ *         in the packet.
+ */
+template <class Layout>
+inline uint64_t validate_pkt_batch(const uint8_t* const pkts,
+                                   int num_pkts,
+                                   uint32_t flags,
+                                   const PktCmdTable& cmd_table,
+                                   PktBatchSummary* const summary)
+{
+    constexpr int SIZE_WORDS = Layout::SIZE / 4;
+    constexpr int TAIL_WORD = SIZE_WORDS - 1;
+
+    #ifdef DEBUG
+    if (num_pkts < 0 || num_pkts > PKT_BATCH_MAX_NUM_PKTS)
+    {
+        if (summary)
+        {
+            *summary = {};
+        }
+        return 0;
+    }
+    #endif
+    num_pkts = num_pkts < 0 ? 0 : num_pkts;
+    num_pkts = num_pkts > PKT_BATCH_MAX_NUM_PKTS ? PKT_BATCH_MAX_NUM_PKTS : num_pkts;
+
+    uint64_t magic_ok = 0;
+    uint64_t cmd_ok = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i head_idx = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(SIZE_WORDS));
+    const __m256i tail_idx = _mm256_add_epi32(head_idx, _mm256_set1_epi32(TAIL_WORD));
+    const __m256i magic_start = _mm256_set1_epi32(Layout::MAGIC_START);
+    const __m256i magic_stop = _mm256_set1_epi32(Layout::MAGIC_STOP);
+    const __m256i mask_16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i mask_8 = _mm256_set1_epi32(0xFF);
+    const __m256i mask_5 = _mm256_set1_epi32(31);
+
+    for (; i + 8 <= num_pkts; i += 8)
+    {
+        const int* base = reinterpret_cast<const int*>(&pkts[static_cast<size_t>(i) * Layout::SIZE]);
+        __m256i head = _mm256_i32gather_epi32(base, head_idx, 4);
+        __m256i tail = _mm256_i32gather_epi32(base, tail_idx, 4);
+
+        __m256i start_ok = _mm256_cmpeq_epi32(_mm256_and_si256(head, mask_16), magic_start);
+        __m256i stop = _mm256_and_si256(_mm256_srli_epi32(tail, Layout::MAGIC_STOP_SHIFT), mask_8);
+        __m256i stop_ok = _mm256_cmpeq_epi32(stop, magic_stop);
+        uint32_t magic_mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(start_ok, stop_ok)));
+
+        __m256i cmd = _mm256_and_si256(_mm256_srli_epi32(head, 16), mask_8);
+        __m256i cmd_bits = _mm256_i32gather_epi32(reinterpret_cast<const int*>(cmd_table.bits),
+                                                  _mm256_srli_epi32(cmd, 5), 4);
+        cmd_bits = _mm256_srlv_epi32(cmd_bits, _mm256_and_si256(cmd, mask_5));
+        uint32_t cmd_mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(cmd_bits, 31)));
+
+        magic_ok |= static_cast<uint64_t>(magic_mask) << i;
+        cmd_ok |= static_cast<uint64_t>(cmd_mask) << i;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint32x4_t lane_bits = {1, 2, 4, 8};
+    const uint32x4_t magic_start = vdupq_n_u32(Layout::MAGIC_START);
+    const uint32x4_t magic_stop = vdupq_n_u32(Layout::MAGIC_STOP);
+    const uint32x4_t mask_16 = vdupq_n_u32(0xFFFF);
+    const uint32x4_t mask_8 = vdupq_n_u32(0xFF);
+
+    for (; i + 4 <= num_pkts; i += 4)
+    {
+        uint32_t heads[4];
+        uint32_t tails[4];
+        uint32_t table_words[4];
+        for (int lane = 0; lane < 4; lane++)
+        {
+            const uint8_t* pkt = &pkts[static_cast<size_t>(i + lane) * Layout::SIZE];
+            std::memcpy(&heads[lane], pkt, 4);
+            std::memcpy(&tails[lane], &pkt[TAIL_WORD * 4], 4);
+            table_words[lane] = cmd_table.bits[pkt[2] >> 5];
+        }
+        uint32x4_t head = vld1q_u32(heads);
+        uint32x4_t tail = vld1q_u32(tails);
+
+        uint32x4_t start_ok = vceqq_u32(vandq_u32(head, mask_16), magic_start);
+        uint32x4_t stop = vandq_u32(vshrq_n_u32(tail, Layout::MAGIC_STOP_SHIFT), mask_8);
+        uint32x4_t stop_ok = vceqq_u32(stop, magic_stop);
+        uint32_t magic_mask = vaddvq_u32(vandq_u32(vandq_u32(start_ok, stop_ok), lane_bits));
+
+        uint32x4_t cmd = vandq_u32(vshrq_n_u32(head, 16), vdupq_n_u32(31));
+        uint32x4_t cmd_bits = vshlq_u32(vld1q_u32(table_words), vnegq_s32(vreinterpretq_s32_u32(cmd)));
+        uint32_t cmd_mask = vaddvq_u32(vandq_u32(vtstq_u32(cmd_bits, vdupq_n_u32(1)), lane_bits));
+
+        magic_ok |= static_cast<uint64_t>(magic_mask) << i;
+        cmd_ok |= static_cast<uint64_t>(cmd_mask) << i;
+    }
+#endif
+
+    for (; i < num_pkts; i++)
+    {
+        const uint8_t* pkt = &pkts[static_cast<size_t>(i) * Layout::SIZE];
+        uint32_t head;
+        uint32_t tail;
+        std::memcpy(&head, pkt, 4);
+        std::memcpy(&tail, &pkt[TAIL_WORD * 4], 4);
+        uint32_t cmd = (head >> 16) & 0xFF;
+
+        uint64_t valid_magic = ((head & 0xFFFF) == Layout::MAGIC_START) &
+                               (((tail >> Layout::MAGIC_STOP_SHIFT) & 0xFF) == Layout::MAGIC_STOP);
+        uint64_t valid_cmd = (cmd_table.bits[cmd >> 5] >> (cmd & 31)) & 1;
+
+        magic_ok |= valid_magic << i;
+        cmd_ok |= valid_cmd << i;
+    }
+
+    uint64_t crc_ok = ~0ull;
+    if (flags & PKT_BATCH_CHECK_CRC)
+    {
+        crc_ok = 0;
+        for (i = 0; i < num_pkts; i++)
+        {
+            const uint8_t* pkt = &pkts[static_cast<size_t>(i) * Layout::SIZE];
+            uint16_t stored_crc;
+            std::memcpy(&stored_crc, &pkt[Layout::CRC_OFFSET], 2);
+            uint64_t valid_crc = compute_pkt_crc(pkt, Layout::CRC_OFFSET) == stored_crc;
+            crc_ok |= valid_crc << i;
+        }
+    }
+
+    uint64_t all = num_pkts >= PKT_BATCH_MAX_NUM_PKTS ? ~0ull : (1ull << num_pkts) - 1;
+    uint64_t magic_errors = ~magic_ok & all;
+    uint64_t cmd_errors = ~cmd_ok & all;
+    uint64_t crc_errors = ~crc_ok & all;
+
+    if (summary)
+    {
+        summary->magic_error_mask = magic_errors;
+        summary->cmd_error_mask = cmd_errors;
+        summary->crc_error_mask = crc_errors;
+        summary->error_classes = (magic_errors ? PKT_BATCH_ERROR_MAGIC : 0) |
+                                 (cmd_errors ? PKT_BATCH_ERROR_CMD : 0) |
+                                 (crc_errors ? PKT_BATCH_ERROR_CRC : 0);
+        summary->num_validated = num_pkts;
+    }
+
+    return all & ~(magic_errors | cmd_errors | crc_errors);
+}
+
+// Commands accepted by validate_audio_pkt_batch()
+inline constexpr int AUDIO_CTRL_VALID_CMDS[] =
+{
+    AUDIO_CMD_NULL,
+    AUDIO_CMD_MUTE,
+    AUDIO_CMD_UNMUTE,
+    AUDIO_CMD_CEASE,
+    GPIO_DATA,
+    MIDI_DATA,
+    MIDI_UMP_DATA
+};
+
+inline constexpr PktCmdTable AUDIO_CTRL_CMD_TABLE = make_pkt_cmd_table(AUDIO_CTRL_VALID_CMDS);
+
+struct AudioPktLayout
+{
+    static constexpr int SIZE = AUDIO_CTRL_PKT_SIZE;
+    static constexpr int CRC_OFFSET = AUDIO_CTRL_PKT_CRC_OFFSET;
+    static constexpr uint32_t MAGIC_START = 'm' | ('d' << 8);
+    static constexpr uint32_t MAGIC_STOP = 'z';
+    static constexpr int MAGIC_STOP_SHIFT = 8;  // position of magic_stop in the last word
+};
+
+/**
+ * @brief Validates a contiguous array of audio control packets.
+ *
+ * @param pkts The audio control packets
+ * @param num_pkts The number of packets, at most PKT_BATCH_MAX_NUM_PKTS.
+ *        Only the first PKT_BATCH_MAX_NUM_PKTS packets are checked, see
+ *        PktBatchSummary::num_validated. Rejected in DEBUG builds.
+ * @param flags Bit mask of PKT_BATCH_CHECK_xxx flags
+ * @param summary If not null, filled with the errors found in the batch
+ * @return Bit mask where bit n is set if the n-th packet is valid
+ */
+inline uint64_t validate_audio_pkt_batch(const AudioCtrlPkt* const pkts,
+                                         int num_pkts,
+                                         uint32_t flags,
+                                         PktBatchSummary* const summary)
+{
+    return validate_pkt_batch<AudioPktLayout>(reinterpret_cast<const uint8_t*>(pkts),
+                                              num_pkts, flags, AUDIO_CTRL_CMD_TABLE, summary);
+}
+
+} // namespace audio_ctrl
+
+namespace device_ctrl {
+
+using audio_ctrl::PktBatchSummary;
+using audio_ctrl::PktCmdTable;
+using audio_ctrl::make_pkt_cmd_table;
+using audio_ctrl::validate_pkt_batch;
+
+// Commands accepted by validate_device_pkt_batch()
+inline constexpr int DEVICE_CTRL_VALID_CMDS[] =
+{
+    DEVICE_CMD_NULL,
+    DEVICE_PING,
+    DEVICE_FIRMWARE_VERSION_CHECK,
+    DEVICE_SYSTEM_INFO,
+    DEVICE_AUDIO_CHANNEL_INFO,
+    DEVICE_START,
+    DEVICE_CHANGE_INPUT_GAIN,
+    DEVICE_CHANGE_HP_VOL,
+    DEVICE_SET_RGB_LED_VAL,
+    DEVICE_MIDI_MODE,
+    DEVICE_STOP,
+    DEVICE_RAW_DATA
+};
+
+inline constexpr PktCmdTable DEVICE_CTRL_CMD_TABLE = make_pkt_cmd_table(DEVICE_CTRL_VALID_CMDS);
+
+struct DevicePktLayout
+{
+    static constexpr int SIZE = DEVICE_CTRL_PKT_SIZE;
+    static constexpr int CRC_OFFSET = DEVICE_CTRL_PKT_CRC_OFFSET;
+    static constexpr uint32_t MAGIC_START = 'x' | ('i' << 8);
+    static constexpr uint32_t MAGIC_STOP = 'd';
+    static constexpr int MAGIC_STOP_SHIFT = 24; // position of magic_stop in the last word
+};
+
+/**
+ * @brief Validates a contiguous array of device control packets.
+ *
+ * @param pkts The device control packets.
+ * @param num_pkts The number of packets, at most PKT_BATCH_MAX_NUM_PKTS, see
+ *        validate_audio_pkt_batch().
+ * @param flags Bit mask of PKT_BATCH_CHECK_xxx flags.
+ * @param summary If not null, filled with the errors found in the batch.
+ * @return Bit mask where bit n is set if the n-th packet is valid.
+ */
+inline uint64_t validate_device_pkt_batch(const struct device_ctrl_pkt* const pkts,
+                                          int num_pkts,
+                                          uint32_t flags,
+                                          PktBatchSummary* const summary)
+{
+    return validate_pkt_batch<DevicePktLayout>(reinterpret_cast<const uint8_t*>(pkts),
+                                               num_pkts, flags, DEVICE_CTRL_CMD_TABLE, summary);
+}
+
+} // namespace device_ctrl
+
+#endif // PACKET_BATCH_VALIDATOR_H_
@@ -0,0 +1,386 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief CRC engine shared by the audio and device control packets. The
+ *        packets carry a 16 bit CRC which is the CRC-32C (Castagnoli) of the
+ *        bytes preceding the crc field, folded to 16 bits by xor-ing its two
+ *        halves. CRC-32C is used since it is natively supported by the xcore
+ *        crc32 instruction, by SSE 4.2 and by the ARMv8 CRC extension.
+ *
+ *        The kernel used by pkt_crc32c_update() is selected at compile time:
+ *          - xcore (XC) : crc32 instruction, one word at a time.
+ *          - SSE 4.2    : crc32 instruction, 8 bytes at a time.
+ *          - ARMv8 CRC  : crc32c instructions, 8 bytes at a time.
+ *          - C++ host   : table driven slice-by-8.
+ *          - C          : portable bitwise implementation.
+ *        On x86 builds without SSE 4.2 enabled (e.g. the default x86-64
+ *        target) with gcc or clang, the SSE 4.2 kernel is compiled for that
+ *        target only and selected at run time if the cpu supports it, else
+ *        the C++ or C kernel is used. Building with -msse4.2 or -march set
+ *        to a cpu with SSE 4.2 saves that check.
+ *        Define PKT_CRC_FORCE_PORTABLE to always use the portable kernel.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef PACKET_CRC_H_
+#define PACKET_CRC_H_
+
+#include "audio_protocol_common.h"
+
+#ifdef __XC__
+#include <xs1.h>
+#elif !defined(PKT_CRC_FORCE_PORTABLE) && defined(__SSE4_2__)
+#include <nmmintrin.h>
+#include <string.h>
+#define PKT_CRC_HAS_HW_KERNEL 1
+#define PKT_CRC_SSE42 1
+#elif !defined(PKT_CRC_FORCE_PORTABLE) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#include <string.h>
+#define PKT_CRC_HAS_HW_KERNEL 1
+#elif !defined(PKT_CRC_FORCE_PORTABLE) && (defined(__x86_64__) || defined(__i386__)) && \
+      (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#include <string.h>
+#define PKT_CRC_HAS_HW_KERNEL 1
+#define PKT_CRC_SSE42 1
+// The SSE 4.2 kernel is selected at run time, see pkt_crc_cpu_has_hw()
+#define PKT_CRC_HW_DISPATCH 1
+#endif
+
+#ifdef PKT_CRC_HW_DISPATCH
+#define PKT_CRC_HW_TARGET __attribute__((target("sse4.2")))
+#else
+#define PKT_CRC_HW_TARGET
+#endif
+
+#ifdef __cplusplus
+namespace audio_ctrl {
+#endif
+
+// Reflected CRC-32C (Castagnoli) polynomial
+#define PKT_CRC32C_POLY 0x82F63B78u
+
+// Initial value and final xor value of the CRC-32C
+#define PKT_CRC32C_INIT 0xFFFFFFFFu
+
+/**
+ * @brief Portable CRC-32C update, processing one 32 bit little endian word at
+ *        a time. Data size should be a multiple of 4 bytes.
+ *
+ * @param crc The running crc value
+ * @param data Pointer to word aligned data
+ * @param num_words The number of words to process
+ * @return The updated crc value
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline uint32_t pkt_crc32c_update_words(uint32_t crc,
+                                        const uint32_t* const data,
+                                        uint32_t num_words)
+{
+    for (uint32_t i = 0; i < num_words; i++)
+    {
+#ifdef __XC__
+        crc32(crc, data[i], PKT_CRC32C_POLY);
+#else
+        crc ^= data[i];
+        for (int bit = 0; bit < 32; bit++)
+        {
+            crc = (crc >> 1) ^ (PKT_CRC32C_POLY & (0u - (crc & 1u)));
+        }
+#endif
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Portable CRC-32C update, processing one byte at a time.
+ *
+ * @param crc The running crc value
+ * @param data Pointer to the data
+ * @param size The number of bytes to process
+ * @return The updated crc value
+ */
+#ifdef __XC__
+#pragma unsafe arrays
+#endif
+inline uint32_t pkt_crc32c_update_bytes(uint32_t crc,
+                                        const uint8_t* const data,
+                                        uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (PKT_CRC32C_POLY & (0u - (crc & 1u)));
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * @brief Portable CRC-32C update over word aligned data of any size.
+ *
+ * @param crc The running crc value
+ * @param data Pointer to word aligned data
+ * @param size The number of bytes to process
+ * @return The updated crc value
+ */
+inline uint32_t pkt_crc32c_update_portable(uint32_t crc,
+                                           const uint8_t* const data,
+                                           uint32_t size)
+{
+    crc = pkt_crc32c_update_words(crc, (const uint32_t*) data, size / 4);
+    return pkt_crc32c_update_bytes(crc, &data[size & ~3u], size & 3u);
+}
+
+#if defined(__cplusplus) && !defined(__XC__)
+
+/**
+ * @brief Lookup tables for the slice-by-8 kernel, generated at compile time.
+ */
+struct PktCrcTables
+{
+    uint32_t table[8][256];
+};
+
+constexpr PktCrcTables make_pkt_crc_tables()
+{
+    PktCrcTables tables = {};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (PKT_CRC32C_POLY & (0u - (crc & 1u)));
+        }
+        tables.table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int slice = 1; slice < 8; slice++)
+        {
+            uint32_t prev = tables.table[slice - 1][i];
+            tables.table[slice][i] = (prev >> 8) ^ tables.table[0][prev & 0xFF];
+        }
+    }
+    return tables;
+}
+
+inline constexpr PktCrcTables PKT_CRC_TABLES = make_pkt_crc_tables();
+
+/**
+ * @brief Table driven slice-by-8 CRC-32C update. Assumes a little endian host.
+ *
+ * @param crc The running crc value
+ * @param data Pointer to the data
+ * @param size The number of bytes to process
+ * @return The updated crc value
+ */
+inline uint32_t pkt_crc32c_update_slice8(uint32_t crc,
+                                         const uint8_t* const data,
+                                         uint32_t size)
+{
+    const auto& t = PKT_CRC_TABLES.table;
+    uint32_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint32_t lo = crc ^ (data[i] | (data[i + 1] << 8) |
+                             (data[i + 2] << 16) | (uint32_t(data[i + 3]) << 24));
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+              t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][data[i + 4]] ^ t[2][data[i + 5]] ^
+              t[1][data[i + 6]] ^ t[0][data[i + 7]];
+    }
+    for (; i < size; i++)
+    {
+        crc = (crc >> 8) ^ t[0][(crc ^ data[i]) & 0xFF];
+    }
+
+    return crc;
+}
+
+#endif // __cplusplus && !__XC__
+
+#ifdef PKT_CRC_HAS_HW_KERNEL
+
+/**
+ * @brief CRC-32C update using the crc instructions of the host cpu
+ *        (SSE 4.2 or ARMv8 CRC extension). With PKT_CRC_HW_DISPATCH it must
+ *        only be called if pkt_crc_cpu_has_hw() returns 1.
+ *
+ * @param crc The running crc value
+ * @param data Pointer to the data
+ * @param size The number of bytes to process
+ * @return The updated crc value
+ */
+PKT_CRC_HW_TARGET
+inline uint32_t pkt_crc32c_update_hw(uint32_t crc,
+                                     const uint8_t* const data,
+                                     uint32_t size)
+{
+    uint32_t i = 0;
+#if defined(PKT_CRC_SSE42) && defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+#elif defined(PKT_CRC_SSE42)
+    for (; i + 4 <= size; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+#else
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+#endif
+    // The tail in at most 3 steps rather than one per byte
+    if (i + 4 <= size)
+    {
+        uint32_t word;
+        memcpy(&word, &data[i], sizeof(word));
+#ifdef PKT_CRC_SSE42
+        crc = _mm_crc32_u32(crc, word);
+#else
+        crc = __crc32cw(crc, word);
+#endif
+        i += 4;
+    }
+    if (i + 2 <= size)
+    {
+        uint16_t half;
+        memcpy(&half, &data[i], sizeof(half));
+#ifdef PKT_CRC_SSE42
+        crc = _mm_crc32_u16(crc, half);
+#else
+        crc = __crc32ch(crc, half);
+#endif
+        i += 2;
+    }
+    if (i < size)
+    {
+#ifdef PKT_CRC_SSE42
+        crc = _mm_crc32_u8(crc, data[i]);
+#else
+        crc = __crc32cb(crc, data[i]);
+#endif
+    }
+
+    return crc;
+}
+
+#endif // PKT_CRC_HAS_HW_KERNEL
+
+#ifdef PKT_CRC_HW_DISPATCH
+
+/**
+ * @brief Check if the cpu supports the SSE 4.2 crc32 instruction. The cpu is
+ *        only queried on the first call in C++.
+ *
+ * @return 1 if pkt_crc32c_update_hw() can be used, 0 if not
+ */
+inline int pkt_crc_cpu_has_hw(void)
+{
+#ifdef __cplusplus
+    // __builtin_cpu_init() is needed if called from a static initializer
+    static const int has_hw = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2") != 0);
+    return has_hw;
+#else
+    return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+#endif // PKT_CRC_HW_DISPATCH
+
+/**
+ * @brief CRC-32C update using the fastest kernel available on the platform.
+ *
+ * @param crc The running crc value
+ * @param data Pointer to word aligned data
+ * @param size The number of bytes to process
+ * @return The updated crc value
+ */
+inline uint32_t pkt_crc32c_update(uint32_t crc,
+                                  const uint8_t* const data,
+                                  uint32_t size)
+{
+#if defined(PKT_CRC_HAS_HW_KERNEL) && !defined(PKT_CRC_HW_DISPATCH)
+    return pkt_crc32c_update_hw(crc, data, size);
+#else
+#ifdef PKT_CRC_HW_DISPATCH
+    if (pkt_crc_cpu_has_hw())
+    {
+        return pkt_crc32c_update_hw(crc, data, size);
+    }
+#endif
+#if defined(__cplusplus) && !defined(__XC__) && !defined(PKT_CRC_FORCE_PORTABLE)
+    return pkt_crc32c_update_slice8(crc, data, size);
+#else
+    return pkt_crc32c_update_portable(crc, data, size);
+#endif
+#endif
+}
+
+/**
+ * @brief Folds a 32 bit crc into the 16 bit value stored in the packets.
+ *
+ * @param crc32 The final CRC-32C value
+ * @return The folded 16 bit crc
+ */
+inline uint16_t pkt_crc_fold(uint32_t crc32)
+{
+    return (uint16_t) ((crc32 ^ (crc32 >> 16)) & 0xFFFFu);
+}
+
+/**
+ * @brief Computes the 16 bit packet crc of a block of word aligned data.
+ *
+ * @param data Pointer to word aligned data
+ * @param size The number of bytes covered by the crc
+ * @return The 16 bit crc
+ */
+inline uint16_t compute_pkt_crc(const uint8_t* const data, uint32_t size)
+{
+    return pkt_crc_fold(~pkt_crc32c_update(PKT_CRC32C_INIT, data, size));
+}
+
+#ifdef __cplusplus
+} // namespace audio_ctrl
+
+// The device packet helpers share the same crc engine
+namespace device_ctrl {
+using audio_ctrl::pkt_crc32c_update;
+using audio_ctrl::pkt_crc_fold;
+using audio_ctrl::compute_pkt_crc;
+} // namespace device_ctrl
+#endif
+
+#endif // PACKET_CRC_H_
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Bidirectional, non blocking packet transports between two processes
+ *        or threads on a POSIX host, used to connect a host to a software
+ *        device such as DeviceEmulator. Each link carries a single packet
+ *        type, one link is needed for the device control packets and one for
+ *        the audio control packets.
+ *
+ *          - FdPacketLink over a socketpair or over two pipes.
+ *          - ShmPacketLink over a named shared memory area holding two
+ *            PacketRings, the fastest option, the two ends can be in
+ *            different processes.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef PACKET_LINK_H_
+#define PACKET_LINK_H_
+
+#include <memory>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "packet_ring.h"
+
+namespace audio_ctrl {
+
+/**
+ * @brief One end of a packet link.
+ *
+ * @tparam PacketType The packet type
+ */
+template <typename PacketType>
+class PacketLink
+{
+public:
+    virtual ~PacketLink() = default;
+
+    /**
+     * @brief Send a packet to the other end, without blocking.
+     *
+     * @return true if the packet was sent, false if the link is full or closed
+     */
+    virtual bool send(const PacketType& pkt) = 0;
+
+    /**
+     * @brief Receive a packet from the other end, without blocking.
+     *
+     * @param pkt Filled with the packet
+     * @return true if a packet was received, false if none is available
+     */
+    virtual bool receive(PacketType& pkt) = 0;
+};
+
+/**
+ * @brief Link over file descriptors, either the two ends of a socketpair or
+ *        a pipe in each direction. The descriptors must be non blocking and
+ *        are closed by the destructor. Packets are written in single calls,
+ *        which are atomic for both SOCK_SEQPACKET sockets and pipes since
+ *        packets are smaller than PIPE_BUF.
+ */
+template <typename PacketType>
+class FdPacketLink : public PacketLink<PacketType>
+{
+public:
+    static_assert(sizeof(PacketType) <= 512, "Packets must be written atomically");
+
+    FdPacketLink(int read_fd, int write_fd) : _read_fd(read_fd), _write_fd(write_fd) {}
+
+    FdPacketLink(const FdPacketLink&) = delete;
+    FdPacketLink& operator=(const FdPacketLink&) = delete;
+
+    ~FdPacketLink() override
+    {
+        ::close(_read_fd);
+        if (_write_fd != _read_fd)
+        {
+            ::close(_write_fd);
+        }
+    }
+
+    bool send(const PacketType& pkt) override
+    {
+        return ::write(_write_fd, &pkt, sizeof(pkt)) == static_cast<ssize_t>(sizeof(pkt));
+    }
+
+    bool receive(PacketType& pkt) override
+    {
+        return ::read(_read_fd, &pkt, sizeof(pkt)) == static_cast<ssize_t>(sizeof(pkt));
+    }
+
+private:
+    int _read_fd;
+    int _write_fd;
+};
+
+/**
+ * @brief Create both ends of a link over a SOCK_SEQPACKET socketpair.
+ *
+ * @return true if successful, false if the sockets could not be created
+ */
+template <typename PacketType>
+bool make_socketpair_link(std::unique_ptr<PacketLink<PacketType>>& host_end,
+                          std::unique_ptr<PacketLink<PacketType>>& device_end)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        return false;
+    }
+    host_end = std::make_unique<FdPacketLink<PacketType>>(fds[0], fds[0]);
+    device_end = std::make_unique<FdPacketLink<PacketType>>(fds[1], fds[1]);
+    return true;
+}
+
+/**
+ * @brief Create both ends of a link over two pipes.
+ *
+ * @return true if successful, false if the pipes could not be created
+ */
+template <typename PacketType>
+bool make_pipe_link(std::unique_ptr<PacketLink<PacketType>>& host_end,
+                    std::unique_ptr<PacketLink<PacketType>>& device_end)
+{
+    int to_device[2];
+    int to_host[2];
+    if (::pipe2(to_device, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        return false;
+    }
+    if (::pipe2(to_host, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        ::close(to_device[0]);
+        ::close(to_device[1]);
+        return false;
+    }
+    host_end = std::make_unique<FdPacketLink<PacketType>>(to_host[0], to_device[1]);
+    device_end = std::make_unique<FdPacketLink<PacketType>>(to_device[0], to_host[1]);
+    return true;
+}
+
+enum class PacketLinkSide
+{
+    HOST,
+    DEVICE
+};
+
+/**
+ * @brief Link over a named POSIX shared memory area holding a PacketRing in
+ *        each direction. One end creates the area, the other opens it.
+ *
+ * @tparam PacketType The packet type
+ * @tparam CAPACITY The capacity of each ring, must be a power of 2
+ */
+template <typename PacketType, size_t CAPACITY = 256>
+class ShmPacketLink : public PacketLink<PacketType>
+{
+public:
+    ShmPacketLink() = default;
+
+    ShmPacketLink(const ShmPacketLink&) = delete;
+    ShmPacketLink& operator=(const ShmPacketLink&) = delete;
+
+    ~ShmPacketLink() override
+    {
+        close();
+    }
+
+    /**
+     * @brief Create the shared memory area, replacing any existing area with
+     *        the same name. The area is removed when this end is closed.
+     *
+     * @param name The name of the area, starting with '/'
+     * @param side The side of this end
+     * @return true if successful, false if the area could not be created
+     */
+    bool create(const std::string& name, PacketLinkSide side)
+    {
+        close();
+        ::shm_unlink(name.c_str());
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (::ftruncate(fd, sizeof(Area)) != 0 || !_map(fd))
+        {
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            return false;
+        }
+        ::close(fd);
+        new (_area) Area();
+        _area->packet_size = sizeof(PacketType);
+        _area->magic.store(AREA_MAGIC, std::memory_order_release);
+        _name = name;
+        _owner = true;
+        _side = side;
+        return true;
+    }
+
+    /**
+     * @brief Open an area created by the other end.
+     *
+     * @param name The name of the area
+     * @param side The side of this end
+     * @return true if successful, false if the area does not exist or does
+     *         not carry packets of this type
+     */
+    bool open(const std::string& name, PacketLinkSide side)
+    {
+        close();
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool mapped = _map(fd);
+        ::close(fd);
+        if (!mapped)
+        {
+            return false;
+        }
+        if (_area->magic.load(std::memory_order_acquire) != AREA_MAGIC ||
+            _area->packet_size != sizeof(PacketType))
+        {
+            close();
+            return false;
+        }
+        _side = side;
+        return true;
+    }
+
+    void close()
+    {
+        if (_area == nullptr)
+        {
+            return;
+        }
+        ::munmap(_area, sizeof(Area));
+        _area = nullptr;
+        if (_owner)
+        {
+            ::shm_unlink(_name.c_str());
+            _owner = false;
+        }
+    }
+
+    bool send(const PacketType& pkt) override
+    {
+        return _area != nullptr && _area->rings[_side == PacketLinkSide::HOST ? 0 : 1].push(pkt);
+    }
+
+    bool receive(PacketType& pkt) override
+    {
+        return _area != nullptr && _area->rings[_side == PacketLinkSide::HOST ? 1 : 0].pop(pkt);
+    }
+
+private:
+    static constexpr uint32_t AREA_MAGIC = 0x4b4e4c50; // "PLNK"
+
+    // Lock free atomics are address free and can be shared between processes
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    struct Area
+    {
+        std::atomic<uint32_t> magic{0};
+        uint32_t packet_size{0};
+        PacketRing<PacketType, CAPACITY> rings[2];  // host to device, device to host
+    };
+
+    bool _map(int fd)
+    {
+        void* map = ::mmap(nullptr, sizeof(Area), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            return false;
+        }
+        _area = static_cast<Area*>(map);
+        return true;
+    }
+
+    Area* _area{nullptr};
+    std::string _name;
+    bool _owner{false};
+    PacketLinkSide _side{PacketLinkSide::HOST};
+};
+
+} // namespace audio_ctrl
+
+#endif // PACKET_LINK_H_
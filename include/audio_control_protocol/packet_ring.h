@@ -0,0 +1,216 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Wait-free single producer, single consumer ring buffer of packets,
+ *        meant to pass audio or device control packets between the real-time
+ *        audio thread and non real-time threads on the host. All slots are
+ *        preallocated and aligned to a cache line, the producer and consumer
+ *        indices live on separate cache lines. Packets can be built directly
+ *        in the ring with reserve_write()/commit_write() or emplace(), e.g.
+ *
+ *            ring.emplace([&](AudioCtrlPkt* pkt) { prepare_audio_mute_pkt(pkt, seq); });
+ *
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef PACKET_RING_H_
+#define PACKET_RING_H_
+
+#include <atomic>
+#include <cstddef>
+
+#include "audio_control_protocol.h"
+#include "device_control_protocol.h"
+
+#define PKT_RING_CACHE_LINE_SIZE 64
+
+namespace audio_ctrl {
+
+/**
+ * @brief Ring buffer of packets for a single producer and a single consumer.
+ *
+ * @tparam PacketType The packet type
+ * @tparam CAPACITY The number of slots, must be a power of 2
+ */
+template <typename PacketType, size_t CAPACITY>
+class PacketRing
+{
+public:
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of 2");
+
+    PacketRing() = default;
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    /**
+     * @brief Producer side. Get the next free slot to build a packet in place.
+     *        The packet is not visible to the consumer until commit_write().
+     *
+     * @return Pointer to the free slot, nullptr if the ring is full
+     */
+    PacketType* reserve_write()
+    {
+        uint32_t write_idx = _write_idx.load(std::memory_order_relaxed);
+        if (write_idx - _cached_read_idx == CAPACITY)
+        {
+            _cached_read_idx = _read_idx.load(std::memory_order_acquire);
+            if (write_idx - _cached_read_idx == CAPACITY)
+            {
+                return nullptr;
+            }
+        }
+        return &_slots[write_idx & MASK].pkt;
+    }
+
+    /**
+     * @brief Producer side. Publish the packet in the slot returned by the
+     *        last successful call to reserve_write().
+     */
+    void commit_write()
+    {
+        _write_idx.store(_write_idx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Producer side. Build a packet in place and publish it.
+     *
+     * @param prepare Callable taking a PacketType* which fills the packet,
+     *        typically wrapping one of the prepare_xxx() helpers
+     * @return true if the packet was queued, false if the ring is full
+     */
+    template <typename PrepareFunction>
+    bool emplace(PrepareFunction&& prepare)
+    {
+        PacketType* pkt = reserve_write();
+        if (pkt == nullptr)
+        {
+            return false;
+        }
+        prepare(pkt);
+        commit_write();
+        return true;
+    }
+
+    /**
+     * @brief Producer side. Copy a packet into the ring.
+     *
+     * @param pkt The packet
+     * @return true if the packet was queued, false if the ring is full
+     */
+    bool push(const PacketType& pkt)
+    {
+        return emplace([&](PacketType* slot) { *slot = pkt; });
+    }
+
+    /**
+     * @brief Consumer side. Get the oldest packet without removing it.
+     *
+     * @return Pointer to the packet, valid until release_read(). nullptr if
+     *         the ring is empty.
+     */
+    const PacketType* peek_read()
+    {
+        uint32_t read_idx = _read_idx.load(std::memory_order_relaxed);
+        if (read_idx == _cached_write_idx)
+        {
+            _cached_write_idx = _write_idx.load(std::memory_order_acquire);
+            if (read_idx == _cached_write_idx)
+            {
+                return nullptr;
+            }
+        }
+        return &_slots[read_idx & MASK].pkt;
+    }
+
+    /**
+     * @brief Consumer side. Free the slot returned by the last successful
+     *        call to peek_read().
+     */
+    void release_read()
+    {
+        _read_idx.store(_read_idx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Consumer side. Copy out and remove the oldest packet.
+     *
+     * @param pkt Filled with the packet
+     * @return true if a packet was read, false if the ring is empty
+     */
+    bool pop(PacketType& pkt)
+    {
+        const PacketType* slot = peek_read();
+        if (slot == nullptr)
+        {
+            return false;
+        }
+        pkt = *slot;
+        release_read();
+        return true;
+    }
+
+    /**
+     * @brief Approximate number of packets in the ring, exact when called
+     *        from either the producer or the consumer with the other idle.
+     */
+    size_t size() const
+    {
+        return _write_idx.load(std::memory_order_acquire) - _read_idx.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return CAPACITY;
+    }
+
+private:
+    static constexpr uint32_t MASK = CAPACITY - 1;
+
+    struct alignas(PKT_RING_CACHE_LINE_SIZE) Slot
+    {
+        PacketType pkt;
+    };
+
+    // producer owned
+    alignas(PKT_RING_CACHE_LINE_SIZE) std::atomic<uint32_t> _write_idx{0};
+    uint32_t _cached_read_idx{0};
+
+    // consumer owned
+    alignas(PKT_RING_CACHE_LINE_SIZE) std::atomic<uint32_t> _read_idx{0};
+    uint32_t _cached_write_idx{0};
+
+    Slot _slots[CAPACITY];
+};
+
+template <size_t CAPACITY>
+using AudioCtrlPktRing = PacketRing<AudioCtrlPkt, CAPACITY>;
+
+} // namespace audio_ctrl
+
+namespace device_ctrl {
+
+template <size_t CAPACITY>
+using DeviceCtrlPktRing = audio_ctrl::PacketRing<struct device_ctrl_pkt, CAPACITY>;
+
+} // namespace device_ctrl
+
+#endif // PACKET_RING_H_
@@ -0,0 +1,605 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Binary capture of the control traffic between the host and the
+ *        device. The real-time thread calls PacketTraceRecorder::record()
+ *        right after a packet is built or received, which copies it together
+ *        with a monotonic timestamp and a direction tag into a wait-free
+ *        PacketRing. A background thread drains the rings into memory mapped
+ *        trace files, rotating to a new file when the current one is full and
+ *        deleting the oldest ones. File I/O never happens on the real-time
+ *        thread, if the ring is full the record is dropped and counted.
+ *
+ *        PacketRing is single producer, so audio and device packets have a
+ *        ring each and can be recorded from two different threads, e.g. the
+ *        audio thread and the device control thread. All the packets of one
+ *        type must be recorded from the same thread.
+ *
+ *        Trace files are read back with PacketTraceReader, see also the
+ *        decoder in tools/.
+ *
+ *        Requires a POSIX host.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef PACKET_TRACE_H_
+#define PACKET_TRACE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "audio_control_protocol.h"
+#include "device_control_protocol.h"
+#include "packet_ring.h"
+
+#define PKT_TRACE_FILE_MAGIC "ACPTRACE"
+// Version 1 counted record_seq across both packet types
+#define PKT_TRACE_FILE_VERSION 2
+
+namespace audio_ctrl {
+
+enum PacketTraceType : uint8_t
+{
+    PKT_TRACE_AUDIO_PKT = 0,
+    PKT_TRACE_DEVICE_PKT = 1,
+    PKT_TRACE_NUM_PKT_TYPES
+};
+
+enum PacketTraceDirection : uint8_t
+{
+    PKT_TRACE_HOST_TO_DEVICE = 0,
+    PKT_TRACE_DEVICE_TO_HOST = 1
+};
+
+/**
+ * @brief A captured packet. The packet is stored verbatim, pkt_size tells how
+ *        many bytes of data are used.
+ */
+struct PacketTraceRecord
+{
+    uint64_t timestamp_ns;  // steady clock time of the call to record()
+    uint32_t record_seq;    // incremented on every call to record() for the pkt_type, gaps show dropped records
+    uint8_t pkt_type;       // PacketTraceType
+    uint8_t direction;      // PacketTraceDirection
+    uint16_t pkt_size;      // size of the packet in bytes
+    union
+    {
+        uint8_t raw[AUDIO_CTRL_PKT_SIZE];
+        AudioCtrlPkt audio_pkt;
+        struct device_ctrl::device_ctrl_pkt device_pkt;
+    } data;
+};
+
+/**
+ * @brief Header at the start of every trace file, followed by num_records
+ *        PacketTraceRecords.
+ */
+struct PacketTraceFileHeader
+{
+    char magic[8];              // PKT_TRACE_FILE_MAGIC, without null terminator
+    uint16_t version;           // PKT_TRACE_FILE_VERSION
+    uint16_t record_size;       // sizeof(PacketTraceRecord)
+    uint32_t file_index;        // index of the file in the rotation
+    uint32_t num_records;       // number of valid records, updated after each record written
+    uint32_t protocol_version;  // AUDIO_PROTOCOL_VERSION_xxx as 0x00MMmmrr
+    uint64_t create_time_ns;    // steady clock time of the creation of the file
+    uint8_t reserved[32];
+};
+
+static_assert(sizeof(PacketTraceRecord) == 16 + AUDIO_CTRL_PKT_SIZE);
+static_assert(sizeof(PacketTraceFileHeader) == 64);
+
+/**
+ * @brief Timestamp used for the trace records. steady_clock is served from
+ *        the vDSO on Linux and is safe to call from the real-time thread.
+ */
+inline uint64_t packet_trace_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Name of a file in the rotation, i.e. <base_path>.<file_index>.trace
+ */
+inline std::string packet_trace_file_name(const std::string& base_path, uint32_t file_index)
+{
+    return base_path + "." + std::to_string(file_index) + ".trace";
+}
+
+/**
+ * @brief Writes records to a rotating set of memory mapped files. Every file
+ *        is allocated to its full size when created and truncated to the
+ *        records written when closed. Not thread safe, owned by the thread
+ *        draining the ring.
+ */
+class PacketTraceFileWriter
+{
+public:
+    PacketTraceFileWriter() = default;
+
+    PacketTraceFileWriter(const PacketTraceFileWriter&) = delete;
+    PacketTraceFileWriter& operator=(const PacketTraceFileWriter&) = delete;
+
+    ~PacketTraceFileWriter()
+    {
+        close();
+    }
+
+    /**
+     * @brief Open the first file of the rotation.
+     *
+     * @param base_path Path of the files without the .<index>.trace suffix
+     * @param max_file_size The max size of each file in bytes
+     * @param max_files Number of files kept, the oldest ones are deleted.
+     *        0 keeps all the files.
+     * @return true if successful, false if the file could not be created
+     */
+    bool open(const std::string& base_path, size_t max_file_size, uint32_t max_files)
+    {
+        close();
+        if (max_file_size < sizeof(PacketTraceFileHeader) + sizeof(PacketTraceRecord))
+        {
+            return false;
+        }
+        _base_path = base_path;
+        _records_per_file = (max_file_size - sizeof(PacketTraceFileHeader)) / sizeof(PacketTraceRecord);
+        _max_files = max_files;
+        _file_index = 0;
+        return _open_file();
+    }
+
+    /**
+     * @brief Append a record, rotating to a new file if the current one is full.
+     *
+     * @return true if successful, false if there is no open file
+     */
+    bool write(const PacketTraceRecord& record)
+    {
+        if (_header == nullptr)
+        {
+            return false;
+        }
+        if (_header->num_records == _records_per_file)
+        {
+            _close_file();
+            _file_index++;
+            if (_max_files > 0 && _file_index >= _max_files)
+            {
+                ::unlink(packet_trace_file_name(_base_path, _file_index - _max_files).c_str());
+            }
+            if (!_open_file())
+            {
+                return false;
+            }
+        }
+        std::memcpy(&_records[_header->num_records], &record, sizeof(record));
+        _header->num_records++;
+        return true;
+    }
+
+    void close()
+    {
+        _close_file();
+    }
+
+    bool is_open() const
+    {
+        return _header != nullptr;
+    }
+
+    uint32_t file_index() const
+    {
+        return _file_index;
+    }
+
+private:
+    bool _open_file()
+    {
+        std::string name = packet_trace_file_name(_base_path, _file_index);
+        int fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        // Reserve the blocks up front, writing to a sparse mapping on a full
+        // disk would raise SIGBUS instead of failing here
+        _map_size = sizeof(PacketTraceFileHeader) + size_t(_records_per_file) * sizeof(PacketTraceRecord);
+        if (::posix_fallocate(fd, 0, _map_size) != 0)
+        {
+            ::close(fd);
+            ::unlink(name.c_str());
+            return false;
+        }
+        void* map = ::mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            ::close(fd);
+            ::unlink(name.c_str());
+            return false;
+        }
+        _fd = fd;
+        _header = static_cast<PacketTraceFileHeader*>(map);
+        _records = reinterpret_cast<PacketTraceRecord*>(_header + 1);
+
+        std::memset(_header, 0, sizeof(PacketTraceFileHeader));
+        std::memcpy(_header->magic, PKT_TRACE_FILE_MAGIC, sizeof(_header->magic));
+        _header->version = PKT_TRACE_FILE_VERSION;
+        _header->record_size = sizeof(PacketTraceRecord);
+        _header->file_index = _file_index;
+        _header->protocol_version = (AUDIO_PROTOCOL_VERSION_MAJ << 16) |
+                                    (AUDIO_PROTOCOL_VERSION_MIN << 8) |
+                                    AUDIO_PROTOCOL_VERSION_REV;
+        _header->create_time_ns = packet_trace_now_ns();
+        return true;
+    }
+
+    void _close_file()
+    {
+        if (_header == nullptr)
+        {
+            return;
+        }
+        size_t used_size = sizeof(PacketTraceFileHeader) + size_t(_header->num_records) * sizeof(PacketTraceRecord);
+        ::munmap(_header, _map_size);
+        if (::ftruncate(_fd, used_size) != 0)
+        {
+            // The file is still valid, num_records in the header is correct
+        }
+        ::close(_fd);
+        _fd = -1;
+        _header = nullptr;
+        _records = nullptr;
+    }
+
+    std::string _base_path;
+    uint32_t _records_per_file{0};
+    uint32_t _max_files{0};
+    uint32_t _file_index{0};
+
+    int _fd{-1};
+    size_t _map_size{0};
+    PacketTraceFileHeader* _header{nullptr};
+    PacketTraceRecord* _records{nullptr};
+};
+
+struct PacketTraceOptions
+{
+    std::string base_path;                          // Path of the files without the .<index>.trace suffix
+    size_t max_file_size{16 * 1024 * 1024};         // Max size of each file in bytes
+    uint32_t max_files{4};                          // Number of files kept, 0 to keep all of them
+    std::chrono::milliseconds poll_interval{10};    // Sleep time of the writer thread when the ring is empty
+};
+
+/**
+ * @brief Records packets from the real-time threads and writes them to trace
+ *        files from a background thread. Audio and device packets are queued
+ *        in separate rings, each with a single producer: all the audio
+ *        packets must be recorded from one thread and all the device packets
+ *        from one thread, possibly a different one. With DEBUG defined,
+ *        records from a second thread are rejected and counted as dropped.
+ *        The writer thread merges the two rings in timestamp order.
+ *
+ * @tparam CAPACITY The number of records each ring can hold, must be a power
+ *         of 2. Should cover the packets of a few poll intervals.
+ */
+template <size_t CAPACITY = 4096>
+class PacketTraceRecorder
+{
+public:
+    PacketTraceRecorder() = default;
+
+    PacketTraceRecorder(const PacketTraceRecorder&) = delete;
+    PacketTraceRecorder& operator=(const PacketTraceRecorder&) = delete;
+
+    ~PacketTraceRecorder()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Open the first trace file and start the writer thread. Not
+     *        real-time safe.
+     *
+     * @return true if successful, false if already started or if the file
+     *         could not be created
+     */
+    bool start(const PacketTraceOptions& options)
+    {
+        if (_writer_thread.joinable())
+        {
+            return false;
+        }
+        if (!_writer.open(options.base_path, options.max_file_size, options.max_files))
+        {
+            return false;
+        }
+        _poll_interval = options.poll_interval;
+    #ifdef DEBUG
+        for (auto& producer : _producers)
+        {
+            producer.store(std::thread::id(), std::memory_order_relaxed);
+        }
+    #endif
+        _running.store(true, std::memory_order_release);
+        _writer_thread = std::thread([this] { _writer_loop(); });
+        return true;
+    }
+
+    /**
+     * @brief Stop the writer thread after writing all the queued records and
+     *        close the trace file. Not real-time safe, record() must not be
+     *        called concurrently.
+     */
+    void stop()
+    {
+        if (!_writer_thread.joinable())
+        {
+            return;
+        }
+        _running.store(false, std::memory_order_release);
+        _writer_thread.join();
+        _writer.close();
+    }
+
+    /**
+     * @brief Record an audio control packet. Real-time safe. Must always be
+     *        called from the same thread.
+     *
+     * @return true if the packet was queued, false if the recorder is not
+     *         running or if the ring is full
+     */
+    bool record(const AudioCtrlPkt& pkt, PacketTraceDirection direction)
+    {
+        return _record(PKT_TRACE_AUDIO_PKT, direction, &pkt, sizeof(pkt));
+    }
+
+    /**
+     * @brief Record a device control packet. Real-time safe. Must always be
+     *        called from the same thread.
+     *
+     * @return true if the packet was queued, false if the recorder is not
+     *         running or if the ring is full
+     */
+    bool record(const struct device_ctrl::device_ctrl_pkt& pkt, PacketTraceDirection direction)
+    {
+        return _record(PKT_TRACE_DEVICE_PKT, direction, &pkt, sizeof(pkt));
+    }
+
+    bool running() const
+    {
+        return _running.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The number of records lost because a ring was full or the
+     *        trace file could not be written.
+     */
+    uint32_t num_dropped() const
+    {
+        return _num_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    bool _record(PacketTraceType type, PacketTraceDirection direction, const void* pkt, size_t size)
+    {
+        if (!_running.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+    #ifdef DEBUG
+        if (!_check_producer(type))
+        {
+            _num_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    #endif
+        auto& ring = _rings[type];
+        uint32_t record_seq = _record_seqs[type]++;
+        PacketTraceRecord* record = ring.reserve_write();
+        if (record == nullptr)
+        {
+            _num_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        record->timestamp_ns = packet_trace_now_ns();
+        record->record_seq = record_seq;
+        record->pkt_type = type;
+        record->direction = direction;
+        record->pkt_size = static_cast<uint16_t>(size);
+        std::memcpy(record->data.raw, pkt, size);
+        ring.commit_write();
+        return true;
+    }
+
+#ifdef DEBUG
+    /**
+     * @brief The first thread recording a packet type since start() becomes
+     *        the only producer allowed for it.
+     */
+    bool _check_producer(PacketTraceType type)
+    {
+        std::thread::id expected;
+        std::thread::id current = std::this_thread::get_id();
+        if (_producers[type].compare_exchange_strong(expected, current, std::memory_order_relaxed))
+        {
+            return true;
+        }
+        return expected == current;
+    }
+#endif
+
+    void _writer_loop()
+    {
+        while (_running.load(std::memory_order_acquire))
+        {
+            if (_drain() == 0)
+            {
+                std::this_thread::sleep_for(_poll_interval);
+            }
+        }
+        _drain();
+    }
+
+    /**
+     * @brief Write the queued records of both rings, oldest first.
+     */
+    size_t _drain()
+    {
+        size_t num_records = 0;
+        while (true)
+        {
+            auto& audio_ring = _rings[PKT_TRACE_AUDIO_PKT];
+            auto& device_ring = _rings[PKT_TRACE_DEVICE_PKT];
+            const PacketTraceRecord* audio_record = audio_ring.peek_read();
+            const PacketTraceRecord* device_record = device_ring.peek_read();
+            if (audio_record == nullptr && device_record == nullptr)
+            {
+                break;
+            }
+            bool take_audio = device_record == nullptr ||
+                              (audio_record != nullptr && audio_record->timestamp_ns <= device_record->timestamp_ns);
+            if (!_writer.write(take_audio ? *audio_record : *device_record))
+            {
+                _num_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            (take_audio ? audio_ring : device_ring).release_read();
+            num_records++;
+        }
+        return num_records;
+    }
+
+    // Owned by the producer thread of each packet type
+    uint32_t _record_seqs[PKT_TRACE_NUM_PKT_TYPES]{};
+
+    std::atomic<bool> _running{false};
+    std::atomic<uint32_t> _num_dropped{0};
+
+    PacketRing<PacketTraceRecord, CAPACITY> _rings[PKT_TRACE_NUM_PKT_TYPES];
+#ifdef DEBUG
+    std::atomic<std::thread::id> _producers[PKT_TRACE_NUM_PKT_TYPES];
+#endif
+
+    // writer thread owned
+    PacketTraceFileWriter _writer;
+    std::chrono::milliseconds _poll_interval{10};
+    std::thread _writer_thread;
+};
+
+/**
+ * @brief Read only access to a trace file, which is memory mapped. Files
+ *        still being written can be opened, records written after open()
+ *        are not visible.
+ */
+class PacketTraceReader
+{
+public:
+    PacketTraceReader() = default;
+
+    PacketTraceReader(const PacketTraceReader&) = delete;
+    PacketTraceReader& operator=(const PacketTraceReader&) = delete;
+
+    ~PacketTraceReader()
+    {
+        close();
+    }
+
+    /**
+     * @brief Open and validate a trace file.
+     *
+     * @return true if successful, false if the file can not be read or is not
+     *         a trace file of a compatible version
+     */
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(PacketTraceFileHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+        {
+            return false;
+        }
+        _map_size = st.st_size;
+        _header = static_cast<const PacketTraceFileHeader*>(map);
+        if (std::memcmp(_header->magic, PKT_TRACE_FILE_MAGIC, sizeof(_header->magic)) != 0 ||
+            _header->version < 1 || _header->version > PKT_TRACE_FILE_VERSION ||
+            _header->record_size != sizeof(PacketTraceRecord))
+        {
+            close();
+            return false;
+        }
+        _records = reinterpret_cast<const PacketTraceRecord*>(_header + 1);
+        size_t records_in_file = (_map_size - sizeof(PacketTraceFileHeader)) / sizeof(PacketTraceRecord);
+        _num_records = std::min<size_t>(_header->num_records, records_in_file);
+        return true;
+    }
+
+    void close()
+    {
+        if (_header != nullptr)
+        {
+            ::munmap(const_cast<PacketTraceFileHeader*>(_header), _map_size);
+        }
+        _header = nullptr;
+        _records = nullptr;
+        _num_records = 0;
+    }
+
+    const PacketTraceFileHeader& header() const
+    {
+        return *_header;
+    }
+
+    uint32_t num_records() const
+    {
+        return _num_records;
+    }
+
+    const PacketTraceRecord& record(uint32_t index) const
+    {
+        return _records[index];
+    }
+
+private:
+    size_t _map_size{0};
+    const PacketTraceFileHeader* _header{nullptr};
+    const PacketTraceRecord* _records{nullptr};
+    uint32_t _num_records{0};
+};
+
+} // namespace audio_ctrl
+
+#endif // PACKET_TRACE_H_
@@ -0,0 +1,545 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Replays packets captured with PacketTraceRecorder through the host
+ *        side parsing helpers, to compare library versions on identical
+ *        inputs. Every packet goes through a fixed pipeline of stages:
+ *        validation, sequence tracking, midi and gpio extraction, channel
+ *        status updates and device command dispatch. The time spent in each
+ *        stage is collected in a histogram.
+ *
+ *        In REALTIME mode packets are fed at their original cadence and the
+ *        lateness of each packet relative to its original schedule is
+ *        recorded too. In FAST mode packets are fed back to back, to measure
+ *        throughput.
+ *
+ *        Stage timings are taken with the cpu timestamp counter where
+ *        available and include the overhead of reading it, which is reported
+ *        separately.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef PACKET_TRACE_REPLAY_H_
+#define PACKET_TRACE_REPLAY_H_
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "audio_ch_status_mirror.h"
+#include "audio_packet_helper.h"
+#include "device_cmd_dispatcher.h"
+#include "device_packet_helper.h"
+#include "gain_ramp_processor.h"
+#include "midi_timestamp_helper.h"
+#include "midi_ump_helper.h"
+#include "packet_trace.h"
+#include "seq_tracker.h"
+
+namespace audio_ctrl {
+
+enum class ReplayMode
+{
+    REALTIME,   // Feed packets at their original cadence
+    FAST        // Feed packets back to back
+};
+
+enum ReplayStage
+{
+    REPLAY_STAGE_VALIDATE = 0,  // magic words and crc check
+    REPLAY_STAGE_SEQ,           // sequence tracking of audio packets from the device
+    REPLAY_STAGE_MIDI,          // get_midi_data() for raw midi, parsing of timestamped or ump midi
+    REPLAY_STAGE_GPIO,          // check_for_gpio_data() and copy of the gpio blobs
+    REPLAY_STAGE_CH_STATUS,     // mute/unmute commands applied to the channel status and gain ramps
+    REPLAY_STAGE_DEVICE,        // dispatch of device commands to the get_ helpers
+    REPLAY_STAGE_TOTAL,         // all the stages of a packet
+    REPLAY_NUM_STAGES
+};
+
+inline const char* replay_stage_name(int stage)
+{
+    switch (stage)
+    {
+    case REPLAY_STAGE_VALIDATE:     return "validate";
+    case REPLAY_STAGE_SEQ:          return "seq";
+    case REPLAY_STAGE_MIDI:         return "midi";
+    case REPLAY_STAGE_GPIO:         return "gpio";
+    case REPLAY_STAGE_CH_STATUS:    return "ch_status";
+    case REPLAY_STAGE_DEVICE:       return "device";
+    case REPLAY_STAGE_TOTAL:        return "total";
+    default:                        return "unknown";
+    }
+}
+
+/**
+ * @brief Histogram of durations in nanoseconds. Buckets are log-linear, with
+ *        8 buckets per power of 2, i.e. values are kept within 12.5%.
+ */
+class ReplayHistogram
+{
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void add(uint64_t value_ns)
+    {
+        _buckets[_bucket(value_ns)]++;
+        _count++;
+        _sum += value_ns;
+        _min = std::min(_min, value_ns);
+        _max = std::max(_max, value_ns);
+    }
+
+    void merge(const ReplayHistogram& other)
+    {
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            _buckets[i] += other._buckets[i];
+        }
+        _count += other._count;
+        _sum += other._sum;
+        _min = std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+    }
+
+    uint64_t count() const
+    {
+        return _count;
+    }
+
+    uint64_t min() const
+    {
+        return _count > 0 ? _min : 0;
+    }
+
+    uint64_t max() const
+    {
+        return _max;
+    }
+
+    double mean() const
+    {
+        return _count > 0 ? double(_sum) / double(_count) : 0.0;
+    }
+
+    /**
+     * @brief Get a percentile.
+     *
+     * @param percent The percentile, 0 to 100
+     * @return The upper bound of the bucket containing the percentile,
+     *         clamped to the max value
+     */
+    uint64_t percentile(double percent) const
+    {
+        if (_count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(percent / 100.0 * double(_count) + 0.5));
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            seen += _buckets[i];
+            if (seen >= rank)
+            {
+                return std::min(_upper_bound(i), _max);
+            }
+        }
+        return _max;
+    }
+
+private:
+    static int _bucket(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int sub_bucket = static_cast<int>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    static uint64_t _upper_bound(int bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return bucket;
+        }
+        int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        uint64_t sub_bucket = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub_bucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+    }
+
+    uint64_t _buckets[NUM_BUCKETS] = {};
+    uint64_t _count{0};
+    uint64_t _sum{0};
+    uint64_t _min{UINT64_MAX};
+    uint64_t _max{0};
+};
+
+struct ReplayOptions
+{
+    ReplayMode mode{ReplayMode::FAST};
+    int repeat{1};                  // Number of times the trace is replayed, FAST mode only
+    int num_channels{8};            // Number of channels of the channel status and gain ramps
+    bool device_to_host_only{false};// Skip the packets sent by the host
+};
+
+struct ReplayReport
+{
+    ReplayHistogram stages[REPLAY_NUM_STAGES];
+    ReplayHistogram lateness;       // Delay of each packet relative to its original schedule, REALTIME mode only
+    uint64_t num_packets{0};
+    uint64_t num_invalid{0};        // Packets with bad magic words or crc
+    uint64_t num_midi_bytes{0};
+    uint64_t num_gpio_blobs{0};
+    uint64_t num_ch_status_changes{0};
+    uint64_t num_seq_gaps{0};
+    double elapsed_s{0.0};
+    double packets_per_s{0.0};
+    double timer_overhead_ns{0.0};  // Included in every stage timing
+};
+
+/**
+ * @brief Replays a set of trace records. Not real-time safe, meant to run
+ *        in a benchmark process.
+ */
+class PacketTraceReplay
+{
+public:
+    /**
+     * @brief Append all the records of a trace file.
+     *
+     * @return true if successful, false if the file could not be read
+     */
+    bool load(const std::string& path)
+    {
+        PacketTraceReader reader;
+        if (!reader.open(path))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < reader.num_records(); i++)
+        {
+            _records.push_back(reader.record(i));
+        }
+        return true;
+    }
+
+    void add_record(const PacketTraceRecord& record)
+    {
+        _records.push_back(record);
+    }
+
+    void clear()
+    {
+        _records.clear();
+    }
+
+    size_t num_records() const
+    {
+        return _records.size();
+    }
+
+    /**
+     * @brief Replay all the records.
+     */
+    ReplayReport run(const ReplayOptions& options)
+    {
+        ReplayReport report;
+        _calibrate_timer(report);
+        _state.reset(options.num_channels);
+
+        int repeat = options.mode == ReplayMode::FAST ? std::max(options.repeat, 1) : 1;
+        uint64_t start_ns = packet_trace_now_ns();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            if (_records.empty())
+            {
+                break;
+            }
+            // Sequence numbers start over on every pass
+            _state.seq_tracker->reset();
+            uint64_t first_timestamp_ns = _records.front().timestamp_ns;
+            uint64_t pass_start_ns = packet_trace_now_ns();
+            for (const PacketTraceRecord& record : _records)
+            {
+                if (options.device_to_host_only && record.direction != PKT_TRACE_DEVICE_TO_HOST)
+                {
+                    continue;
+                }
+                if (options.mode == ReplayMode::REALTIME)
+                {
+                    uint64_t target_ns = pass_start_ns + (record.timestamp_ns - first_timestamp_ns);
+                    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(target_ns)));
+                    uint64_t now_ns = packet_trace_now_ns();
+                    report.lateness.add(now_ns > target_ns ? now_ns - target_ns : 0);
+                }
+                _replay_record(record, report);
+            }
+        }
+        report.elapsed_s = double(packet_trace_now_ns() - start_ns) * 1e-9;
+        report.packets_per_s = report.elapsed_s > 0.0 ? double(report.num_packets) / report.elapsed_s : 0.0;
+        return report;
+    }
+
+private:
+    /**
+     * @brief Host state the packets are applied to, rebuilt on every run so
+     *        that runs are reproducible.
+     */
+    struct HostState
+    {
+        void reset(int num_ch)
+        {
+            num_channels = std::clamp(num_ch, 1, audio_ctrl::AUDIO_CH_STATUS_MAX_CHANNELS);
+            ch_status.assign(AUDIO_CH_STATUS_ARRAY_SIZE_IN_WORDS(num_channels), audio_ctrl::AudioChStatus{});
+            mirror = std::make_unique<audio_ctrl::AudioChStatusMirror>(ch_status.data(), num_channels);
+            gain_ramps = std::make_unique<audio_ctrl::GainRampProcessor>(num_channels, 64);
+            seq_tracker = std::make_unique<audio_ctrl::SeqTracker>(1000);
+            device_ctrl::init_device_cmd_dispatcher(&device_dispatcher, this);
+            for (int cmd = 0; cmd < DEVICE_CMD_DISPATCHER_TABLE_SIZE; cmd++)
+            {
+                device_ctrl::set_device_cmd_handler(&device_dispatcher, cmd, _device_cmd_handler);
+            }
+        }
+
+        static void _device_cmd_handler(const struct device_ctrl::device_ctrl_pkt* const pkt, void* user_data)
+        {
+            auto state = static_cast<HostState*>(user_data);
+            const union device_ctrl::device_pkt_payload& payload = pkt->payload;
+            switch (pkt->device_cmd)
+            {
+            case device_ctrl::DEVICE_PING:
+                state->device_sink += device_ctrl::get_ping_code(pkt);
+                break;
+            case device_ctrl::DEVICE_FIRMWARE_VERSION_CHECK:
+                state->device_sink += device_ctrl::get_board_vers(pkt);
+                break;
+            case device_ctrl::DEVICE_SYSTEM_INFO:
+                state->device_sink += device_ctrl::get_system_info_data(pkt)->sampling_rate;
+                break;
+            case device_ctrl::DEVICE_AUDIO_CHANNEL_INFO:
+                state->device_sink += device_ctrl::get_audio_channel_info_data(pkt)->stride_in_words;
+                break;
+            case device_ctrl::DEVICE_START:
+                state->device_sink += device_ctrl::check_for_start_cmd(pkt);
+                break;
+            case device_ctrl::DEVICE_CHANGE_INPUT_GAIN:
+                state->device_sink += payload.input_gain_data.gain_val;
+                break;
+            case device_ctrl::DEVICE_CHANGE_HP_VOL:
+                state->device_sink += payload.hp_vol_data;
+                break;
+            case device_ctrl::DEVICE_SET_RGB_LED_VAL:
+                state->device_sink += payload.rgb_led_data.rgb_led_id;
+                break;
+            case device_ctrl::DEVICE_MIDI_MODE:
+                state->device_sink += device_ctrl::get_midi_mode_data(pkt);
+                break;
+            case device_ctrl::DEVICE_RAW_DATA:
+                state->device_sink += payload.raw_data[0];
+                break;
+            default:
+                break;
+            }
+        }
+
+        int num_channels{0};
+        std::vector<audio_ctrl::AudioChStatus> ch_status;
+        std::unique_ptr<audio_ctrl::AudioChStatusMirror> mirror;
+        std::unique_ptr<audio_ctrl::GainRampProcessor> gain_ramps;
+        std::unique_ptr<audio_ctrl::SeqTracker> seq_tracker;
+        struct device_ctrl::device_cmd_dispatcher device_dispatcher;
+        uint8_t midi_data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+        struct audio_ctrl::GpioDataBlob gpio_data[AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS];
+        uint64_t device_sink{0};
+    };
+
+    static uint64_t _timer_ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+#else
+        return packet_trace_now_ns();
+#endif
+    }
+
+    void _calibrate_timer(ReplayReport& report)
+    {
+        uint64_t start_ns = packet_trace_now_ns();
+        uint64_t start_ticks = _timer_ticks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t ticks = _timer_ticks() - start_ticks;
+        uint64_t ns = packet_trace_now_ns() - start_ns;
+        _ns_per_tick = ticks > 0 ? double(ns) / double(ticks) : 1.0;
+
+        uint64_t min_ticks = UINT64_MAX;
+        for (int i = 0; i < 1000; i++)
+        {
+            uint64_t t0 = _timer_ticks();
+            uint64_t t1 = _timer_ticks();
+            min_ticks = std::min(min_ticks, t1 - t0);
+        }
+        report.timer_overhead_ns = double(min_ticks) * _ns_per_tick;
+    }
+
+    uint64_t _elapsed_ns(uint64_t start_ticks, uint64_t end_ticks) const
+    {
+        return static_cast<uint64_t>(double(end_ticks - start_ticks) * _ns_per_tick + 0.5);
+    }
+
+    void _replay_record(const PacketTraceRecord& record, ReplayReport& report)
+    {
+        if (record.pkt_type == PKT_TRACE_AUDIO_PKT && record.pkt_size == AUDIO_CTRL_PKT_SIZE)
+        {
+            _replay_audio_pkt(&record.data.audio_pkt, record.direction == PKT_TRACE_DEVICE_TO_HOST, report);
+        }
+        else if (record.pkt_type == PKT_TRACE_DEVICE_PKT && record.pkt_size == DEVICE_CTRL_PKT_SIZE)
+        {
+            _replay_device_pkt(&record.data.device_pkt, report);
+        }
+        else
+        {
+            return;
+        }
+        report.num_packets++;
+    }
+
+    void _replay_audio_pkt(const audio_ctrl::AudioCtrlPkt* pkt, bool from_device, ReplayReport& report)
+    {
+        uint64_t total_start = _timer_ticks();
+        uint64_t t0 = total_start;
+        bool valid = audio_ctrl::check_audio_pkt_for_magic_words(pkt) &&
+                     (pkt->crc == 0 || audio_ctrl::check_audio_pkt_crc(pkt));
+        uint64_t t1 = _timer_ticks();
+        report.stages[REPLAY_STAGE_VALIDATE].add(_elapsed_ns(t0, t1));
+        if (!valid)
+        {
+            report.num_invalid++;
+            return;
+        }
+
+        if (from_device)
+        {
+            t0 = _timer_ticks();
+            audio_ctrl::SeqEvent event = _state.seq_tracker->process(pkt);
+            t1 = _timer_ticks();
+            report.stages[REPLAY_STAGE_SEQ].add(_elapsed_ns(t0, t1));
+            report.num_seq_gaps += event == audio_ctrl::SeqEvent::GAP;
+        }
+
+        t0 = _timer_ticks();
+        if (audio_ctrl::check_for_timestamped_midi_data(pkt))
+        {
+            audio_ctrl::MidiEventIterator midi_events;
+            audio_ctrl::init_midi_event_iterator(&midi_events, pkt);
+            uint32_t frame_offset;
+            int num_bytes;
+            while (const uint8_t* event = audio_ctrl::next_midi_event(&midi_events, &frame_offset, &num_bytes))
+            {
+                std::memcpy(_state.midi_data, event, num_bytes);
+                report.num_midi_bytes += num_bytes;
+            }
+        }
+        else if (int num_bytes = audio_ctrl::check_for_midi_data(pkt))
+        {
+            // get_midi_data() returns 1 on success, not the number of bytes
+            num_bytes = std::min(num_bytes, AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+            if (audio_ctrl::get_midi_data(pkt, _state.midi_data, 0, num_bytes))
+            {
+                report.num_midi_bytes += num_bytes;
+            }
+        }
+        else
+        {
+            int offset = 0;
+            int num_words;
+            while (const uint32_t* message = audio_ctrl::next_ump_message(pkt, &offset, &num_words))
+            {
+                report.num_midi_bytes += audio_ctrl::ump_to_midi1(message, _state.midi_data);
+            }
+        }
+        t1 = _timer_ticks();
+        report.stages[REPLAY_STAGE_MIDI].add(_elapsed_ns(t0, t1));
+
+        t0 = _timer_ticks();
+        int num_blobs = audio_ctrl::check_for_gpio_data(pkt);
+        num_blobs = std::min(num_blobs, AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS);
+        for (int i = 0; i < num_blobs; i++)
+        {
+            _state.gpio_data[i] = pkt->payload.gpio_data_blob[i];
+        }
+        t1 = _timer_ticks();
+        report.stages[REPLAY_STAGE_GPIO].add(_elapsed_ns(t0, t1));
+        report.num_gpio_blobs += num_blobs;
+
+        t0 = _timer_ticks();
+        if (_state.gain_ramps->process_cmd(pkt))
+        {
+            audio_ctrl::AudioChMask changed = _state.mirror->set_mute(0, _state.num_channels,
+                                                                      audio_ctrl::check_for_audio_mute_cmd(pkt));
+            for (auto word : changed.words)
+            {
+                report.num_ch_status_changes += __builtin_popcountll(word);
+            }
+        }
+        t1 = _timer_ticks();
+        report.stages[REPLAY_STAGE_CH_STATUS].add(_elapsed_ns(t0, t1));
+        report.stages[REPLAY_STAGE_TOTAL].add(_elapsed_ns(total_start, t1));
+    }
+
+    void _replay_device_pkt(const struct device_ctrl::device_ctrl_pkt* pkt, ReplayReport& report)
+    {
+        uint64_t total_start = _timer_ticks();
+        uint64_t t0 = total_start;
+        bool valid = device_ctrl::check_device_pkt_for_magic_words(pkt) &&
+                     (pkt->crc == 0 || device_ctrl::check_device_pkt_crc(pkt));
+        uint64_t t1 = _timer_ticks();
+        report.stages[REPLAY_STAGE_VALIDATE].add(_elapsed_ns(t0, t1));
+        if (!valid)
+        {
+            report.num_invalid++;
+            return;
+        }
+
+        t0 = _timer_ticks();
+        device_ctrl::dispatch_device_cmd(&_state.device_dispatcher, pkt);
+        t1 = _timer_ticks();
+        report.stages[REPLAY_STAGE_DEVICE].add(_elapsed_ns(t0, t1));
+        report.stages[REPLAY_STAGE_TOTAL].add(_elapsed_ns(total_start, t1));
+    }
+
+    std::vector<PacketTraceRecord> _records;
+    HostState _state;
+    double _ns_per_tick{1.0};
+};
+
+} // namespace audio_ctrl
+
+#endif // PACKET_TRACE_REPLAY_H_
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Conversion between the hardware sample formats of the audio channels
+ *        (audio_sample_format) and normalized float samples in [-1, 1).
+ *
+ *        Every 24 bit and 32 bit format is decoded by shifting the sample to
+ *        the top of the word, masking the unused low bits and scaling by
+ *        2^-31. Encoding scales, clamps, rounds to nearest and then places
+ *        the bits according to the format. BINARY channels are not numerical
+ *        data and are passed through bit by bit.
+ *
+ *        The scalar and the vector versions give bit exact results. The
+ *        vector kernels use the instruction set selected at compile time by
+ *        simd_helpers.h (AVX2, SSE2, NEON or scalar).
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef SAMPLE_FORMAT_CONVERSION_H_
+#define SAMPLE_FORMAT_CONVERSION_H_
+
+#include <cmath>
+#include <cstring>
+
+#include "device_control_protocol.h"
+#include "simd_helpers.h"
+
+namespace device_ctrl {
+
+/**
+ * @brief Precomputed per-format constants used by the conversion kernels.
+ */
+struct SampleFormatParams
+{
+    bool binary;           // Bit passthrough, no conversion
+    int decode_shift;      // Left shift placing the sample msb at bit 31
+    int32_t decode_mask;   // Mask applied after the shift
+    float encode_scale;    // Full scale of the quantized sample
+    float encode_min;      // Clamping range of the scaled sample
+    float encode_max;
+    int encode_shift_left; // Placement of the quantized sample in the word
+    int encode_shift_right;
+    int32_t encode_mask;
+};
+
+constexpr float SAMPLE_DECODE_SCALE = 1.0f / 2147483648.0f;   // 2^-31
+
+/**
+ * @brief Get the conversion constants of a sample format.
+ *
+ * @param format One of audio_sample_format
+ * @param params Set to the constants of the format
+ * @return true if the format is known, false otherwise
+ */
+inline bool get_sample_format_params(uint8_t format, SampleFormatParams& params)
+{
+    constexpr float FULL_SCALE_24 = 8388608.0f;           // 2^23
+    constexpr float MAX_24 = 8388607.0f;
+    constexpr float FULL_SCALE_32 = 2147483648.0f;        // 2^31
+    constexpr float MAX_32 = 2147483520.0f;          // Largest float below 2^31
+
+    SampleFormatParams int24 = {false, 0, int32_t(0xFFFFFF00), FULL_SCALE_24, -FULL_SCALE_24, MAX_24, 0, 0, -1};
+    switch (format)
+    {
+    case INT24_LJ:
+        params = int24;
+        params.encode_shift_left = 8;
+        return true;
+
+    case INT24_I2S:
+        params = int24;
+        params.decode_shift = 1;
+        params.encode_shift_left = 8;
+        params.encode_shift_right = 1;
+        return true;
+
+    case INT24_RJ:
+        params = int24;
+        params.decode_shift = 8;
+        params.encode_mask = 0x00FFFFFF;
+        return true;
+
+    case INT24_32RJ:
+        params = int24;
+        params.decode_shift = 8;
+        return true;
+
+    case INT32:
+        params = {false, 0, -1, FULL_SCALE_32, -FULL_SCALE_32, MAX_32, 0, 0, -1};
+        return true;
+
+    case BINARY:
+        params = {true, 0, -1, 1.0f, 0.0f, 0.0f, 0, 0, -1};
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Decode a single hardware word into a float sample.
+ */
+inline float decode_sample(int32_t word, const SampleFormatParams& params)
+{
+    if (params.binary)
+    {
+        float sample;
+        std::memcpy(&sample, &word, sizeof(sample));
+        return sample;
+    }
+    int32_t aligned = static_cast<int32_t>(static_cast<uint32_t>(word) << params.decode_shift) & params.decode_mask;
+    return static_cast<float>(aligned) * SAMPLE_DECODE_SCALE;
+}
+
+/**
+ * @brief Encode a single float sample into a hardware word. Out of range
+ *        samples are clipped.
+ *
+ * @param sample The float sample
+ * @param params The constants of the hardware format
+ * @param dither Noise added before quantization, in lsb of the format
+ * @return The hardware word
+ */
+inline int32_t encode_sample(float sample, const SampleFormatParams& params, float dither = 0.0f)
+{
+    if (params.binary)
+    {
+        int32_t word;
+        std::memcpy(&word, &sample, sizeof(word));
+        return word;
+    }
+    float scaled = sample * params.encode_scale + dither;
+    scaled = std::fmax(std::fmin(scaled, params.encode_max), params.encode_min);
+    auto quantized = static_cast<uint32_t>(static_cast<int32_t>(std::lrint(scaled)));
+    quantized = (quantized << params.encode_shift_left) >> params.encode_shift_right;
+    return static_cast<int32_t>(quantized) & params.encode_mask;
+}
+
+/**
+ * @brief Vector version of decode_sample(), converting simd::WIDTH samples.
+ */
+inline audio_ctrl::simd::VecF decode_samples(audio_ctrl::simd::VecI words, const SampleFormatParams& params)
+{
+    namespace simd = audio_ctrl::simd;
+    if (params.binary)
+    {
+        return simd::bits_i_f(words);
+    }
+    simd::VecI aligned = simd::and_i(simd::sll_i(words, params.decode_shift), simd::set1_i(params.decode_mask));
+    return simd::mul_f(simd::cvt_i_f(aligned), simd::set1_f(SAMPLE_DECODE_SCALE));
+}
+
+/**
+ * @brief Vector version of encode_sample(), converting simd::WIDTH samples.
+ */
+inline audio_ctrl::simd::VecI encode_samples(audio_ctrl::simd::VecF samples,
+                                             const SampleFormatParams& params,
+                                             audio_ctrl::simd::VecF dither)
+{
+    namespace simd = audio_ctrl::simd;
+    if (params.binary)
+    {
+        return simd::bits_f_i(samples);
+    }
+    simd::VecF scaled = simd::add_f(simd::mul_f(samples, simd::set1_f(params.encode_scale)), dither);
+    scaled = simd::max_f(simd::min_f(scaled, simd::set1_f(params.encode_max)), simd::set1_f(params.encode_min));
+    simd::VecI quantized = simd::sll_i(simd::cvt_f_i(scaled), params.encode_shift_left);
+    quantized = simd::srl_i(quantized, params.encode_shift_right);
+    return simd::and_i(quantized, simd::set1_i(params.encode_mask));
+}
+
+inline audio_ctrl::simd::VecI encode_samples(audio_ctrl::simd::VecF samples, const SampleFormatParams& params)
+{
+    return encode_samples(samples, params, audio_ctrl::simd::set1_f(0.0f));
+}
+
+/**
+ * @brief State of the TPDF dither generator, one xorshift32 generator per
+ *        vector lane. The noise is the difference of two uniform variables,
+ *        i.e. triangular in (-1, 1) lsb.
+ */
+struct TpdfDither
+{
+    int32_t state[audio_ctrl::simd::WIDTH];
+};
+
+/**
+ * @brief Initialize a dither generator.
+ *
+ * @param dither The generator
+ * @param seed Any value, different seeds give uncorrelated noise
+ */
+inline void init_tpdf_dither(TpdfDither& dither, uint32_t seed)
+{
+    for (int lane = 0; lane < audio_ctrl::simd::WIDTH; lane++)
+    {
+        // splitmix32 style scrambling, avoiding the all zero xorshift state
+        uint32_t x = seed + 0x9E3779B9u * static_cast<uint32_t>(lane + 1);
+        x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+        x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+        x ^= x >> 16;
+        dither.state[lane] = static_cast<int32_t>(x != 0 ? x : 0x1234567u);
+    }
+}
+
+/**
+ * @brief Advance the dither generators and return the next TPDF noise values.
+ *        The two uniform variables are taken from the upper and lower halves
+ *        of the generator output, with a resolution of 2^-16 lsb.
+ */
+inline audio_ctrl::simd::VecF next_tpdf_dither(audio_ctrl::simd::VecI& state)
+{
+    namespace simd = audio_ctrl::simd;
+    state = simd::xor_i(state, simd::sll_i(state, 13));
+    state = simd::xor_i(state, simd::srl_i(state, 17));
+    state = simd::xor_i(state, simd::sll_i(state, 5));
+    simd::VecF a = simd::cvt_i_f(simd::srl_i(state, 16));
+    simd::VecF b = simd::cvt_i_f(simd::and_i(state, simd::set1_i(0xFFFF)));
+    return simd::mul_f(simd::sub_f(a, b), simd::set1_f(1.0f / 65536.0f));
+}
+
+/**
+ * @brief Decode a contiguous buffer of hardware words into float samples.
+ *        src and dst can point to the same memory.
+ *
+ * @param src The hardware words
+ * @param dst The float samples
+ * @param num_samples The number of samples to convert
+ * @param params The constants of the hardware format
+ */
+inline void decode_buffer(const int32_t* src, float* dst, int num_samples, const SampleFormatParams& params)
+{
+    namespace simd = audio_ctrl::simd;
+    if (params.binary)
+    {
+        std::memmove(dst, src, static_cast<size_t>(num_samples) * sizeof(float));
+        return;
+    }
+    int i = 0;
+    for (; i + simd::WIDTH <= num_samples; i += simd::WIDTH)
+    {
+        simd::store_f(dst + i, decode_samples(simd::load_i(src + i), params));
+    }
+    for (; i < num_samples; i++)
+    {
+        dst[i] = decode_sample(src[i], params);
+    }
+}
+
+/**
+ * @brief Encode a contiguous buffer of float samples into hardware words,
+ *        with optional TPDF dither. src and dst can point to the same memory.
+ *
+ * @param src The float samples
+ * @param dst The hardware words
+ * @param num_samples The number of samples to convert
+ * @param params The constants of the hardware format
+ * @param dither The dither generator, or nullptr for plain rounding
+ */
+inline void encode_buffer(const float* src, int32_t* dst, int num_samples,
+                          const SampleFormatParams& params, TpdfDither* dither = nullptr)
+{
+    namespace simd = audio_ctrl::simd;
+    if (params.binary)
+    {
+        std::memmove(dst, src, static_cast<size_t>(num_samples) * sizeof(int32_t));
+        return;
+    }
+    int i = 0;
+    if (dither == nullptr)
+    {
+        for (; i + simd::WIDTH <= num_samples; i += simd::WIDTH)
+        {
+            simd::store_i(dst + i, encode_samples(simd::load_f(src + i), params));
+        }
+        for (; i < num_samples; i++)
+        {
+            dst[i] = encode_sample(src[i], params);
+        }
+        return;
+    }
+
+    simd::VecI state = simd::load_i(dither->state);
+    for (; i + simd::WIDTH <= num_samples; i += simd::WIDTH)
+    {
+        simd::store_i(dst + i, encode_samples(simd::load_f(src + i), params, next_tpdf_dither(state)));
+    }
+    if (i < num_samples)
+    {
+        float noise[simd::WIDTH];
+        simd::store_f(noise, next_tpdf_dither(state));
+        int remaining = num_samples - i;
+        for (int lane = 0; lane < remaining && lane < simd::WIDTH; lane++)
+        {
+            dst[i + lane] = encode_sample(src[i + lane], params, noise[lane]);
+        }
+    }
+    simd::store_i(dither->state, state);
+}
+
+/**
+ * @brief Convert a contiguous buffer of hardware words into float samples.
+ *
+ * @param format One of audio_sample_format
+ * @return true on success, false if the format is unknown
+ */
+inline bool convert_to_float(uint8_t format, const int32_t* src, float* dst, int num_samples)
+{
+    SampleFormatParams params{};
+    if (get_sample_format_params(format, params) == false)
+    {
+        return false;
+    }
+    decode_buffer(src, dst, num_samples, params);
+    return true;
+}
+
+/**
+ * @brief Convert a contiguous buffer of float samples into hardware words.
+ *
+ * @param format One of audio_sample_format
+ * @param dither The dither generator, or nullptr for plain rounding
+ * @return true on success, false if the format is unknown
+ */
+inline bool convert_from_float(uint8_t format, const float* src, int32_t* dst, int num_samples,
+                               TpdfDither* dither = nullptr)
+{
+    SampleFormatParams params{};
+    if (get_sample_format_params(format, params) == false)
+    {
+        return false;
+    }
+    encode_buffer(src, dst, num_samples, params, dither);
+    return true;
+}
+
+} // namespace device_ctrl
+
+#endif // SAMPLE_FORMAT_CONVERSION_H_
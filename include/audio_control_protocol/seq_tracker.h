@@ -0,0 +1,276 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Receive side tracker of the audio control packets sequence numbers.
+ *        Every incoming sequence number is classified as in order, gap,
+ *        duplicate or late (i.e. reordered), or restarts the tracking when it
+ *        is older than the history or further ahead than a statistics window,
+ *        e.g. after a device restart without reset(). Counters are kept both
+ *        as totals and per window, e.g. per second, in atomics which can be
+ *        read from a monitoring thread. A hook can be registered to react to
+ *        lost or repeated packets from the real-time thread.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef SEQ_TRACKER_H_
+#define SEQ_TRACKER_H_
+
+#include <algorithm>
+#include <atomic>
+
+#include "audio_packet_helper.h"
+
+namespace audio_ctrl {
+
+enum class SeqEvent
+{
+    IN_ORDER,   // Sequence number following the highest one received
+    GAP,        // One or more packets are missing before this one
+    DUPLICATE,  // Already received
+    LATE,       // Missing packet received after newer ones
+    RESYNC      // Too far from the highest one to be a gap or late, e.g. the device restarted
+};
+
+/**
+ * @brief Hook called from process() for every event other than IN_ORDER.
+ *        Called from the thread processing the packets, so it should be
+ *        real-time safe. gap_size is the number of missing packets for GAP
+ *        events and 0 otherwise.
+ */
+using SeqEventHook = void (*)(void* user_data, SeqEvent event, uint32_t seq, uint32_t gap_size);
+
+struct SeqStats
+{
+    uint64_t in_order;
+    uint64_t gaps;          // Number of gap events
+    uint64_t lost_pkts;     // Number of packets skipped by gap events
+    uint64_t duplicates;
+    uint64_t late;
+    uint64_t resyncs;       // Number of discontinuities, tracking restarted from them
+};
+
+class SeqTracker
+{
+public:
+    // Number of sequence numbers before the highest one that are remembered
+    static constexpr uint32_t HISTORY_SIZE = 64;
+
+    /**
+     * @brief Constructs a tracker.
+     *
+     * @param packets_per_window The number of packets in a statistics window,
+     *        use sample rate / buffer size for per second windows. Jumps ahead
+     *        by more than a window, or HISTORY_SIZE if bigger, are counted as
+     *        resyncs instead of gaps.
+     */
+    explicit SeqTracker(uint32_t packets_per_window) : _packets_per_window(packets_per_window),
+                                                       _max_gap(std::max(packets_per_window, HISTORY_SIZE))
+    {
+        reset();
+    }
+
+    /**
+     * @brief Set the event hook, should not be called while packets are processed.
+     *
+     * @param hook The hook, nullptr to disable it
+     * @param user_data Passed back to the hook
+     */
+    void set_event_hook(SeqEventHook hook, void* user_data)
+    {
+        _hook = hook;
+        _hook_user_data = user_data;
+    }
+
+    /**
+     * @brief Restart tracking, e.g. after the device has been restarted and its
+     *        sequence numbers start over. Counters are not cleared.
+     */
+    void reset()
+    {
+        _started = false;
+        _highest_seq = 0;
+        _history = 0;
+    }
+
+    /**
+     * @brief Classify a sequence number and update the counters.
+     *
+     * @param seq The sequence number of the received packet
+     * @return The classification of the packet
+     */
+    SeqEvent process(uint32_t seq)
+    {
+        SeqEvent event = SeqEvent::IN_ORDER;
+        uint32_t gap_size = 0;
+        int32_t distance = static_cast<int32_t>(seq - _highest_seq);
+
+        if (!_started)
+        {
+            _started = true;
+            _highest_seq = seq;
+            _history = 1;
+        }
+        else if (distance > 0 && static_cast<uint32_t>(distance) <= _max_gap)
+        {
+            gap_size = static_cast<uint32_t>(distance) - 1;
+            event = gap_size == 0 ? SeqEvent::IN_ORDER : SeqEvent::GAP;
+            _history = static_cast<uint32_t>(distance) < HISTORY_SIZE ? (_history << distance) | 1 : 1;
+            _highest_seq = seq;
+        }
+        else if (distance > 0 || _highest_seq - seq >= HISTORY_SIZE)
+        {
+            // Too far ahead to be a gap or older than the history, tracking
+            // restarts from this packet
+            event = SeqEvent::RESYNC;
+            _highest_seq = seq;
+            _history = 1;
+        }
+        else
+        {
+            uint64_t bit = 1ull << (_highest_seq - seq);
+            event = (_history & bit) ? SeqEvent::DUPLICATE : SeqEvent::LATE;
+            _history |= bit;
+        }
+
+        _count(event, gap_size);
+
+        if (event != SeqEvent::IN_ORDER && _hook)
+        {
+            _hook(_hook_user_data, event, seq, gap_size);
+        }
+
+        return event;
+    }
+
+    /**
+     * @brief Classify the sequence number of a packet and update the counters.
+     *
+     * @param pkt The received audio control packet
+     * @return The classification of the packet
+     */
+    SeqEvent process(const AudioCtrlPkt* const pkt)
+    {
+        return process(pkt->seq);
+    }
+
+    /**
+     * @brief Get the counters since construction. Can be called from any thread.
+     */
+    SeqStats totals() const
+    {
+        return _load(_totals);
+    }
+
+    /**
+     * @brief Get the counters of the last completed window. Can be called from
+     *        any thread.
+     */
+    SeqStats last_window() const
+    {
+        return _load(_last_window);
+    }
+
+private:
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> in_order{0};
+        std::atomic<uint64_t> gaps{0};
+        std::atomic<uint64_t> lost_pkts{0};
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<uint64_t> late{0};
+        std::atomic<uint64_t> resyncs{0};
+    };
+
+    // single writer, so a plain load and store is enough
+    static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static SeqStats _load(const AtomicStats& stats)
+    {
+        return {stats.in_order.load(std::memory_order_relaxed),
+                stats.gaps.load(std::memory_order_relaxed),
+                stats.lost_pkts.load(std::memory_order_relaxed),
+                stats.duplicates.load(std::memory_order_relaxed),
+                stats.late.load(std::memory_order_relaxed),
+                stats.resyncs.load(std::memory_order_relaxed)};
+    }
+
+    void _count(SeqEvent event, uint32_t gap_size)
+    {
+        switch (event)
+        {
+        case SeqEvent::IN_ORDER:
+            _window.in_order++;
+            _add(_totals.in_order, 1);
+            break;
+
+        case SeqEvent::GAP:
+            _window.gaps++;
+            _window.lost_pkts += gap_size;
+            _add(_totals.gaps, 1);
+            _add(_totals.lost_pkts, gap_size);
+            break;
+
+        case SeqEvent::DUPLICATE:
+            _window.duplicates++;
+            _add(_totals.duplicates, 1);
+            break;
+
+        case SeqEvent::LATE:
+            _window.late++;
+            _add(_totals.late, 1);
+            break;
+
+        case SeqEvent::RESYNC:
+            _window.resyncs++;
+            _add(_totals.resyncs, 1);
+            break;
+        }
+
+        if (++_window_pkts >= _packets_per_window)
+        {
+            _last_window.in_order.store(_window.in_order, std::memory_order_relaxed);
+            _last_window.gaps.store(_window.gaps, std::memory_order_relaxed);
+            _last_window.lost_pkts.store(_window.lost_pkts, std::memory_order_relaxed);
+            _last_window.duplicates.store(_window.duplicates, std::memory_order_relaxed);
+            _last_window.late.store(_window.late, std::memory_order_relaxed);
+            _last_window.resyncs.store(_window.resyncs, std::memory_order_relaxed);
+            _window = SeqStats{};
+            _window_pkts = 0;
+        }
+    }
+
+    uint32_t _packets_per_window;
+    uint32_t _max_gap;
+    SeqEventHook _hook{nullptr};
+    void* _hook_user_data{nullptr};
+
+    // tracking state, only touched by the processing thread
+    bool _started;
+    uint32_t _highest_seq;
+    uint64_t _history;      // bit n set if _highest_seq - n was received
+    SeqStats _window{};
+    uint32_t _window_pkts{0};
+
+    AtomicStats _totals;
+    AtomicStats _last_window;
+};
+
+} // namespace audio_ctrl
+
+#endif // SEQ_TRACKER_H_
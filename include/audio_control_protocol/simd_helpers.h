@@ -0,0 +1,385 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Thin abstraction over the SIMD instruction sets used by the host side
+ *        audio kernels, so that each kernel is written once. The vector width
+ *        is selected at compile time: 8 lanes with AVX2, 4 lanes with SSE2 or
+ *        NEON (aarch64) and 1 lane (plain scalar code) otherwise. Define
+ *        AUDIO_CTRL_SIMD_FORCE_SCALAR to always use the scalar version.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef SIMD_HELPERS_H_
+#define SIMD_HELPERS_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(AUDIO_CTRL_SIMD_FORCE_SCALAR)
+#define AUDIO_CTRL_SIMD_SCALAR 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define AUDIO_CTRL_SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIO_CTRL_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AUDIO_CTRL_SIMD_NEON 1
+#else
+#define AUDIO_CTRL_SIMD_SCALAR 1
+#endif
+
+namespace audio_ctrl {
+namespace simd {
+
+#if defined(AUDIO_CTRL_SIMD_AVX2)
+
+constexpr int WIDTH = 8;
+constexpr const char* NAME = "avx2";
+using VecI = __m256i;
+using VecF = __m256;
+
+inline VecI load_i(const int32_t* src) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)); }
+inline void store_i(int32_t* dst, VecI v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v); }
+inline VecF load_f(const float* src) { return _mm256_loadu_ps(src); }
+inline void store_f(float* dst, VecF v) { _mm256_storeu_ps(dst, v); }
+inline VecI set1_i(int32_t x) { return _mm256_set1_epi32(x); }
+inline VecF set1_f(float x) { return _mm256_set1_ps(x); }
+inline VecI and_i(VecI a, VecI b) { return _mm256_and_si256(a, b); }
+inline VecI or_i(VecI a, VecI b) { return _mm256_or_si256(a, b); }
+inline VecI xor_i(VecI a, VecI b) { return _mm256_xor_si256(a, b); }
+inline VecI add_i(VecI a, VecI b) { return _mm256_add_epi32(a, b); }
+inline VecI sll_i(VecI v, int n) { return _mm256_sll_epi32(v, _mm_cvtsi32_si128(n)); }
+inline VecI srl_i(VecI v, int n) { return _mm256_srl_epi32(v, _mm_cvtsi32_si128(n)); }
+inline VecF add_f(VecF a, VecF b) { return _mm256_add_ps(a, b); }
+inline VecF sub_f(VecF a, VecF b) { return _mm256_sub_ps(a, b); }
+inline VecF mul_f(VecF a, VecF b) { return _mm256_mul_ps(a, b); }
+inline VecF min_f(VecF a, VecF b) { return _mm256_min_ps(a, b); }
+inline VecF max_f(VecF a, VecF b) { return _mm256_max_ps(a, b); }
+inline VecF cvt_i_f(VecI v) { return _mm256_cvtepi32_ps(v); }
+inline VecI cvt_f_i(VecF v) { return _mm256_cvtps_epi32(v); }  // round to nearest even
+inline VecF bits_i_f(VecI v) { return _mm256_castsi256_ps(v); }
+inline VecI bits_f_i(VecF v) { return _mm256_castps_si256(v); }
+
+// Bit i of the result is the msb of lane i
+inline int sign_mask(VecI v) { return _mm256_movemask_ps(_mm256_castsi256_ps(v)); }
+
+// Lane i is set to all ones if bit i of bits is set, to 0 otherwise
+inline VecI lane_mask(int bits)
+{
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lane_bits), lane_bits);
+}
+
+// Bit i of the result is set if byte i of a and b differ
+inline uint32_t byte_diff_mask(VecI a, VecI b)
+{
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+}
+
+// Bit i of the result is the msb of byte i
+inline uint32_t byte_msb_mask(VecI v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+
+inline void transpose(VecI (&r)[WIDTH])
+{
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+inline void deinterleave2(VecI a, VecI b, VecI& even, VecI& odd)
+{
+    __m256 fa = _mm256_castsi256_ps(a);
+    __m256 fb = _mm256_castsi256_ps(b);
+    __m256i e = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256i o = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+    even = _mm256_permute4x64_epi64(e, _MM_SHUFFLE(3, 1, 2, 0));
+    odd = _mm256_permute4x64_epi64(o, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+inline void interleave2(VecI even, VecI odd, VecI& a, VecI& b)
+{
+    __m256i lo = _mm256_unpacklo_epi32(even, odd);
+    __m256i hi = _mm256_unpackhi_epi32(even, odd);
+    a = _mm256_permute2x128_si256(lo, hi, 0x20);
+    b = _mm256_permute2x128_si256(lo, hi, 0x31);
+}
+
+#elif defined(AUDIO_CTRL_SIMD_SSE2)
+
+constexpr int WIDTH = 4;
+constexpr const char* NAME = "sse2";
+using VecI = __m128i;
+using VecF = __m128;
+
+inline VecI load_i(const int32_t* src) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)); }
+inline void store_i(int32_t* dst, VecI v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v); }
+inline VecF load_f(const float* src) { return _mm_loadu_ps(src); }
+inline void store_f(float* dst, VecF v) { _mm_storeu_ps(dst, v); }
+inline VecI set1_i(int32_t x) { return _mm_set1_epi32(x); }
+inline VecF set1_f(float x) { return _mm_set1_ps(x); }
+inline VecI and_i(VecI a, VecI b) { return _mm_and_si128(a, b); }
+inline VecI or_i(VecI a, VecI b) { return _mm_or_si128(a, b); }
+inline VecI xor_i(VecI a, VecI b) { return _mm_xor_si128(a, b); }
+inline VecI add_i(VecI a, VecI b) { return _mm_add_epi32(a, b); }
+inline VecI sll_i(VecI v, int n) { return _mm_sll_epi32(v, _mm_cvtsi32_si128(n)); }
+inline VecI srl_i(VecI v, int n) { return _mm_srl_epi32(v, _mm_cvtsi32_si128(n)); }
+inline VecF add_f(VecF a, VecF b) { return _mm_add_ps(a, b); }
+inline VecF sub_f(VecF a, VecF b) { return _mm_sub_ps(a, b); }
+inline VecF mul_f(VecF a, VecF b) { return _mm_mul_ps(a, b); }
+inline VecF min_f(VecF a, VecF b) { return _mm_min_ps(a, b); }
+inline VecF max_f(VecF a, VecF b) { return _mm_max_ps(a, b); }
+inline VecF cvt_i_f(VecI v) { return _mm_cvtepi32_ps(v); }
+inline VecI cvt_f_i(VecF v) { return _mm_cvtps_epi32(v); }  // round to nearest even
+inline VecF bits_i_f(VecI v) { return _mm_castsi128_ps(v); }
+inline VecI bits_f_i(VecF v) { return _mm_castps_si128(v); }
+
+// Bit i of the result is the msb of lane i
+inline int sign_mask(VecI v) { return _mm_movemask_ps(_mm_castsi128_ps(v)); }
+
+// Lane i is set to all ones if bit i of bits is set, to 0 otherwise
+inline VecI lane_mask(int bits)
+{
+    const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lane_bits), lane_bits);
+}
+
+// Bit i of the result is set if byte i of a and b differ
+inline uint32_t byte_diff_mask(VecI a, VecI b)
+{
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) & 0xFFFFu;
+}
+
+// Bit i of the result is the msb of byte i
+inline uint32_t byte_msb_mask(VecI v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+
+inline void transpose(VecI (&r)[WIDTH])
+{
+    __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+    __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+    __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+    r[0] = _mm_unpacklo_epi64(t0, t1);
+    r[1] = _mm_unpackhi_epi64(t0, t1);
+    r[2] = _mm_unpacklo_epi64(t2, t3);
+    r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+inline void deinterleave2(VecI a, VecI b, VecI& even, VecI& odd)
+{
+    __m128 fa = _mm_castsi128_ps(a);
+    __m128 fb = _mm_castsi128_ps(b);
+    even = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+    odd = _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+inline void interleave2(VecI even, VecI odd, VecI& a, VecI& b)
+{
+    a = _mm_unpacklo_epi32(even, odd);
+    b = _mm_unpackhi_epi32(even, odd);
+}
+
+#elif defined(AUDIO_CTRL_SIMD_NEON)
+
+constexpr int WIDTH = 4;
+constexpr const char* NAME = "neon";
+using VecI = int32x4_t;
+using VecF = float32x4_t;
+
+inline VecI load_i(const int32_t* src) { return vld1q_s32(src); }
+inline void store_i(int32_t* dst, VecI v) { vst1q_s32(dst, v); }
+inline VecF load_f(const float* src) { return vld1q_f32(src); }
+inline void store_f(float* dst, VecF v) { vst1q_f32(dst, v); }
+inline VecI set1_i(int32_t x) { return vdupq_n_s32(x); }
+inline VecF set1_f(float x) { return vdupq_n_f32(x); }
+inline VecI and_i(VecI a, VecI b) { return vandq_s32(a, b); }
+inline VecI or_i(VecI a, VecI b) { return vorrq_s32(a, b); }
+inline VecI xor_i(VecI a, VecI b) { return veorq_s32(a, b); }
+inline VecI add_i(VecI a, VecI b) { return vaddq_s32(a, b); }
+inline VecI sll_i(VecI v, int n) { return vshlq_s32(v, vdupq_n_s32(n)); }
+inline VecI srl_i(VecI v, int n)
+{
+    return vreinterpretq_s32_u32(vshlq_u32(vreinterpretq_u32_s32(v), vdupq_n_s32(-n)));
+}
+inline VecF add_f(VecF a, VecF b) { return vaddq_f32(a, b); }
+inline VecF sub_f(VecF a, VecF b) { return vsubq_f32(a, b); }
+inline VecF mul_f(VecF a, VecF b) { return vmulq_f32(a, b); }
+inline VecF min_f(VecF a, VecF b) { return vminq_f32(a, b); }
+inline VecF max_f(VecF a, VecF b) { return vmaxq_f32(a, b); }
+inline VecF cvt_i_f(VecI v) { return vcvtq_f32_s32(v); }
+inline VecI cvt_f_i(VecF v) { return vcvtnq_s32_f32(v); }  // round to nearest even
+inline VecF bits_i_f(VecI v) { return vreinterpretq_f32_s32(v); }
+inline VecI bits_f_i(VecF v) { return vreinterpretq_s32_f32(v); }
+
+// Bit i of the result is the msb of lane i
+inline int sign_mask(VecI v)
+{
+    const int32_t shifts[4] = {0, 1, 2, 3};
+    uint32x4_t msb = vshrq_n_u32(vreinterpretq_u32_s32(v), 31);
+    return static_cast<int>(vaddvq_u32(vshlq_u32(msb, vld1q_s32(shifts))));
+}
+
+// Lane i is set to all ones if bit i of bits is set, to 0 otherwise
+inline VecI lane_mask(int bits)
+{
+    const int32_t lane_bits[4] = {1, 2, 4, 8};
+    return vreinterpretq_s32_u32(vtstq_s32(vdupq_n_s32(bits), vld1q_s32(lane_bits)));
+}
+
+// Bit i of the result is set if byte i of a and b differ
+inline uint32_t byte_diff_mask(VecI a, VecI b)
+{
+    const uint8_t byte_bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t diff = vmvnq_u8(vceqq_u8(vreinterpretq_u8_s32(a), vreinterpretq_u8_s32(b)));
+    uint8x16_t bits = vandq_u8(diff, vld1q_u8(byte_bits));
+    return vaddv_u8(vget_low_u8(bits)) | (static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8);
+}
+
+// Bit i of the result is the msb of byte i
+inline uint32_t byte_msb_mask(VecI v)
+{
+    const uint8_t byte_bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t msb = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_s32(v), 7));
+    uint8x16_t bits = vandq_u8(msb, vld1q_u8(byte_bits));
+    return vaddv_u8(vget_low_u8(bits)) | (static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8);
+}
+
+inline void transpose(VecI (&r)[WIDTH])
+{
+    int32x4_t t0 = vtrn1q_s32(r[0], r[1]);
+    int32x4_t t1 = vtrn2q_s32(r[0], r[1]);
+    int32x4_t t2 = vtrn1q_s32(r[2], r[3]);
+    int32x4_t t3 = vtrn2q_s32(r[2], r[3]);
+    r[0] = vreinterpretq_s32_s64(vtrn1q_s64(vreinterpretq_s64_s32(t0), vreinterpretq_s64_s32(t2)));
+    r[1] = vreinterpretq_s32_s64(vtrn1q_s64(vreinterpretq_s64_s32(t1), vreinterpretq_s64_s32(t3)));
+    r[2] = vreinterpretq_s32_s64(vtrn2q_s64(vreinterpretq_s64_s32(t0), vreinterpretq_s64_s32(t2)));
+    r[3] = vreinterpretq_s32_s64(vtrn2q_s64(vreinterpretq_s64_s32(t1), vreinterpretq_s64_s32(t3)));
+}
+
+inline void deinterleave2(VecI a, VecI b, VecI& even, VecI& odd)
+{
+    even = vuzp1q_s32(a, b);
+    odd = vuzp2q_s32(a, b);
+}
+
+inline void interleave2(VecI even, VecI odd, VecI& a, VecI& b)
+{
+    a = vzip1q_s32(even, odd);
+    b = vzip2q_s32(even, odd);
+}
+
+#else
+
+constexpr int WIDTH = 1;
+constexpr const char* NAME = "scalar";
+using VecI = int32_t;
+using VecF = float;
+
+inline VecI load_i(const int32_t* src) { VecI v; std::memcpy(&v, src, sizeof(v)); return v; }
+inline void store_i(int32_t* dst, VecI v) { std::memcpy(dst, &v, sizeof(v)); }
+inline VecF load_f(const float* src) { VecF v; std::memcpy(&v, src, sizeof(v)); return v; }
+inline void store_f(float* dst, VecF v) { std::memcpy(dst, &v, sizeof(v)); }
+inline VecI set1_i(int32_t x) { return x; }
+inline VecF set1_f(float x) { return x; }
+inline VecI and_i(VecI a, VecI b) { return a & b; }
+inline VecI or_i(VecI a, VecI b) { return a | b; }
+inline VecI xor_i(VecI a, VecI b) { return a ^ b; }
+inline VecI add_i(VecI a, VecI b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+inline VecI sll_i(VecI v, int n) { return static_cast<int32_t>(static_cast<uint32_t>(v) << n); }
+inline VecI srl_i(VecI v, int n) { return static_cast<int32_t>(static_cast<uint32_t>(v) >> n); }
+inline VecF add_f(VecF a, VecF b) { return a + b; }
+inline VecF sub_f(VecF a, VecF b) { return a - b; }
+inline VecF mul_f(VecF a, VecF b) { return a * b; }
+inline VecF min_f(VecF a, VecF b) { return a < b ? a : b; }
+inline VecF max_f(VecF a, VecF b) { return a > b ? a : b; }
+inline VecF cvt_i_f(VecI v) { return static_cast<float>(v); }
+inline VecI cvt_f_i(VecF v) { return static_cast<int32_t>(std::lrint(v)); }
+inline VecF bits_i_f(VecI v) { float f; std::memcpy(&f, &v, sizeof(f)); return f; }
+inline VecI bits_f_i(VecF v) { int32_t i; std::memcpy(&i, &v, sizeof(i)); return i; }
+
+// Bit i of the result is the msb of lane i
+inline int sign_mask(VecI v) { return static_cast<int>(static_cast<uint32_t>(v) >> 31); }
+
+// Lane i is set to all ones if bit i of bits is set, to 0 otherwise
+inline VecI lane_mask(int bits) { return -(bits & 1); }
+
+// Bit i of the result is set if byte i of a and b differ
+inline uint32_t byte_diff_mask(VecI a, VecI b)
+{
+    uint32_t diff = static_cast<uint32_t>(a ^ b);
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        mask |= ((diff >> (8 * i)) & 0xFFu) != 0 ? 1u << i : 0u;
+    }
+    return mask;
+}
+
+// Bit i of the result is the msb of byte i
+inline uint32_t byte_msb_mask(VecI v)
+{
+    uint32_t bits = static_cast<uint32_t>(v);
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        mask |= ((bits >> (8 * i + 7)) & 1u) << i;
+    }
+    return mask;
+}
+
+inline void transpose(VecI (&)[WIDTH]) {}
+
+inline void deinterleave2(VecI a, VecI b, VecI& even, VecI& odd)
+{
+    even = a;
+    odd = b;
+}
+
+inline void interleave2(VecI even, VecI odd, VecI& a, VecI& b)
+{
+    a = even;
+    b = odd;
+}
+
+#endif
+
+} // namespace simd
+} // namespace audio_ctrl
+
+#endif // SIMD_HELPERS_H_
@@ -0,0 +1,494 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief C++17 typed layer on top of the audio and device control packets.
+ *        TypedAudioPkt<CMD> and TypedDevicePkt<CMD> wrap a packet whose command
+ *        is known at compile time, payload accessors not matching the command
+ *        are rejected at compile time. visit() dispatches a packet to the
+ *        handler accepting its command through a single jump table, e.g.
+ *
+ *            visit(pkt,
+ *                  [](AudioPktView<MIDI_DATA> midi) { ... },
+ *                  [](AudioPktView<GPIO_DATA> gpio) { ... },
+ *                  [](UnknownAudioCmd unknown) { ... });
+ *
+ *        Commands without a matching handler are ignored.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef TYPED_PACKET_H_
+#define TYPED_PACKET_H_
+
+#include <array>
+#include <type_traits>
+
+#include "audio_packet_helper.h"
+#include "device_packet_helper.h"
+
+namespace typed_pkt_detail {
+
+template <typename... Handlers>
+struct Overloaded : Handlers...
+{
+    using Handlers::operator()...;
+};
+
+template <typename... Handlers>
+Overloaded(Handlers...) -> Overloaded<Handlers...>;
+
+template <typename Visitor, typename Arg>
+bool invoke_if_handled(Visitor& visitor, Arg arg)
+{
+    if constexpr (std::is_invocable_v<Visitor&, Arg>)
+    {
+        visitor(arg);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+} // namespace typed_pkt_detail
+
+namespace audio_ctrl {
+
+/**
+ * @brief Payload type carried by each command, void if none.
+ */
+template <AudioCtrlCmds CMD>
+struct AudioCmdPayload
+{
+    using type = void;
+};
+
+template <>
+struct AudioCmdPayload<MIDI_DATA>
+{
+    using type = decltype(AudioPacketPayload::midi_data);
+};
+
+template <>
+struct AudioCmdPayload<MIDI_UMP_DATA>
+{
+    using type = decltype(AudioPacketPayload::ump_words);
+};
+
+template <>
+struct AudioCmdPayload<GPIO_DATA>
+{
+    using type = decltype(AudioPacketPayload::gpio_data_blob);
+};
+
+template <AudioCtrlCmds... CMDS>
+struct AudioCmdList {};
+
+// All the audio commands known to visit()
+using AudioCmds = AudioCmdList<AUDIO_CMD_NULL,
+                               AUDIO_CMD_MUTE,
+                               AUDIO_CMD_UNMUTE,
+                               AUDIO_CMD_CEASE,
+                               GPIO_DATA,
+                               MIDI_DATA,
+                               MIDI_UMP_DATA>;
+
+/**
+ * @brief Audio control packet with a command known at compile time.
+ *
+ * @tparam CMD The command of the packet
+ * @tparam PktType AudioCtrlPkt, or const AudioCtrlPkt for read only access
+ */
+template <AudioCtrlCmds CMD, typename PktType = AudioCtrlPkt>
+class TypedAudioPkt
+{
+public:
+    static_assert(std::is_same_v<std::remove_const_t<PktType>, AudioCtrlPkt>);
+
+    static constexpr AudioCtrlCmds COMMAND = CMD;
+    using Payload = typename AudioCmdPayload<CMD>::type;
+
+    /**
+     * @brief Wraps a packet, which should already contain command CMD.
+     */
+    explicit TypedAudioPkt(PktType& pkt) : _pkt(&pkt) {}
+
+    /**
+     * @brief A read only view can be obtained from a mutable packet.
+     */
+    template <typename OtherPktType,
+              typename = std::enable_if_t<std::is_const_v<PktType> && !std::is_const_v<OtherPktType>>>
+    TypedAudioPkt(const TypedAudioPkt<CMD, OtherPktType>& other) : _pkt(&other.raw()) {}
+
+    /**
+     * @brief Builds a default packet with command CMD.
+     *
+     * @param pkt The audio control packet
+     * @param seq_number the packet's sequence number
+     */
+    static TypedAudioPkt build(AudioCtrlPkt& pkt, uint32_t seq_number)
+    {
+        create_default_audio_ctrl_pkt(&pkt);
+        pkt.cmd_msb = CMD;
+        pkt.seq = seq_number;
+        return TypedAudioPkt(pkt);
+    }
+
+    PktType& raw() const
+    {
+        return *_pkt;
+    }
+
+    uint32_t seq() const
+    {
+        return _pkt->seq;
+    }
+
+    /**
+     * @brief Access to the payload, only available for commands carrying one.
+     */
+    auto& payload() const
+    {
+        static_assert(!std::is_void_v<Payload>, "This command has no payload");
+        if constexpr (std::is_const_v<PktType>)
+        {
+            return static_cast<const Payload&>(_payload());
+        }
+        else
+        {
+            return _payload();
+        }
+    }
+
+    /**
+     * @brief Number of midi bytes in a MIDI_DATA packet.
+     */
+    int num_midi_bytes() const
+    {
+        static_assert(CMD == MIDI_DATA, "Only MIDI_DATA packets carry midi data");
+        return check_for_midi_data(_pkt);
+    }
+
+    /**
+     * @brief Fill the payload of a MIDI_DATA packet.
+     *
+     * @return 1 if successful, see prepare_midi_data_pkt()
+     */
+    int set_midi_data(const uint8_t* midi_data, uint8_t num_midi_bytes) const
+    {
+        static_assert(CMD == MIDI_DATA, "Only MIDI_DATA packets carry midi data");
+        static_assert(!std::is_const_v<PktType>, "Read only packet");
+        uint32_t seq = _pkt->seq;
+        int res = prepare_midi_data_pkt(_pkt, midi_data, num_midi_bytes);
+        _pkt->seq = seq;
+        return res;
+    }
+
+    /**
+     * @brief Number of UMP words in a MIDI_UMP_DATA packet.
+     */
+    int num_ump_words() const
+    {
+        static_assert(CMD == MIDI_UMP_DATA, "Only MIDI_UMP_DATA packets carry ump data");
+        return check_for_midi_ump_data(_pkt);
+    }
+
+    /**
+     * @brief Fill the payload of a MIDI_UMP_DATA packet.
+     *
+     * @return 1 if successful, see prepare_midi_ump_data_pkt()
+     */
+    int set_ump_data(const uint32_t* ump_words, uint8_t num_ump_words) const
+    {
+        static_assert(CMD == MIDI_UMP_DATA, "Only MIDI_UMP_DATA packets carry ump data");
+        static_assert(!std::is_const_v<PktType>, "Read only packet");
+        uint32_t seq = _pkt->seq;
+        int res = prepare_midi_ump_data_pkt(_pkt, ump_words, num_ump_words);
+        _pkt->seq = seq;
+        return res;
+    }
+
+    /**
+     * @brief Number of gpio blobs in a GPIO_DATA packet.
+     */
+    int num_gpio_blobs() const
+    {
+        static_assert(CMD == GPIO_DATA, "Only GPIO_DATA packets carry gpio data");
+        return check_for_gpio_data(_pkt);
+    }
+
+    /**
+     * @brief Set the number of gpio blobs of a GPIO_DATA packet.
+     *
+     * @return 0 if successful, see prepare_gpio_cmd_pkt()
+     */
+    int set_num_gpio_blobs(uint8_t num_gpio_data_blobs) const
+    {
+        static_assert(CMD == GPIO_DATA, "Only GPIO_DATA packets carry gpio data");
+        static_assert(!std::is_const_v<PktType>, "Read only packet");
+        return prepare_gpio_cmd_pkt(_pkt, num_gpio_data_blobs);
+    }
+
+private:
+    auto& _payload() const
+    {
+        if constexpr (CMD == MIDI_DATA)
+        {
+            return _pkt->payload.midi_data;
+        }
+        else if constexpr (CMD == MIDI_UMP_DATA)
+        {
+            return _pkt->payload.ump_words;
+        }
+        else
+        {
+            return _pkt->payload.gpio_data_blob;
+        }
+    }
+
+    PktType* _pkt;
+};
+
+template <AudioCtrlCmds CMD>
+using AudioPktView = TypedAudioPkt<CMD, const AudioCtrlPkt>;
+
+/**
+ * @brief Passed to the handlers for packets with a command not in AudioCmds.
+ */
+struct UnknownAudioCmd
+{
+    const AudioCtrlPkt& pkt;
+};
+
+namespace detail {
+
+template <AudioCtrlCmds CMD, typename PktType, typename Visitor>
+bool visit_audio_cmd(PktType& pkt, Visitor& visitor)
+{
+    return typed_pkt_detail::invoke_if_handled(visitor, TypedAudioPkt<CMD, PktType>(pkt));
+}
+
+template <typename PktType, typename Visitor>
+bool visit_unknown_audio_cmd(PktType& pkt, Visitor& visitor)
+{
+    return typed_pkt_detail::invoke_if_handled(visitor, UnknownAudioCmd{pkt});
+}
+
+template <typename PktType, typename Visitor, AudioCtrlCmds... CMDS>
+constexpr auto make_audio_visit_table(AudioCmdList<CMDS...>)
+{
+    using Handler = bool (*)(PktType&, Visitor&);
+    std::array<Handler, 256> table{};
+    for (auto& handler : table)
+    {
+        handler = &visit_unknown_audio_cmd<PktType, Visitor>;
+    }
+    ((table[CMDS] = &visit_audio_cmd<CMDS, PktType, Visitor>), ...);
+    return table;
+}
+
+} // namespace detail
+
+/**
+ * @brief Dispatches the packet to the handler accepting TypedAudioPkt or
+ *        AudioPktView of its command, through a jump table indexed by cmd_msb.
+ *
+ * @param pkt The audio control packet, if const only AudioPktView handlers
+ *        are considered, otherwise both kinds are
+ * @param handlers Callables taking a TypedAudioPkt, AudioPktView or UnknownAudioCmd
+ * @return true if a handler was called, false if the command has no handler
+ */
+template <typename PktType, typename... Handlers,
+          typename = std::enable_if_t<std::is_same_v<std::remove_const_t<PktType>, AudioCtrlPkt>>>
+bool visit(PktType& pkt, Handlers&&... handlers)
+{
+    using Visitor = typed_pkt_detail::Overloaded<std::decay_t<Handlers>...>;
+    static constexpr auto table = detail::make_audio_visit_table<PktType, Visitor>(AudioCmds{});
+    Visitor visitor{std::forward<Handlers>(handlers)...};
+    return table[pkt.cmd_msb](pkt, visitor);
+}
+
+} // namespace audio_ctrl
+
+namespace device_ctrl {
+
+/**
+ * @brief True if payload type T can be carried by command CMD.
+ */
+template <device_commands CMD, typename T>
+inline constexpr bool device_payload_allowed = std::is_same_v<T, decltype(device_pkt_payload::raw_data)> &&
+                                               CMD == DEVICE_RAW_DATA;
+
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_PING, uint32_t> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_FIRMWARE_VERSION_CHECK, device_version_data> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_SYSTEM_INFO, system_info_data> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_AUDIO_CHANNEL_INFO, audio_channel_info_req> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_AUDIO_CHANNEL_INFO, audio_channel_info_data> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_START, int> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_CHANGE_INPUT_GAIN, device_input_gain_data> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_CHANGE_HP_VOL, uint32_t> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_SET_RGB_LED_VAL, device_rgb_led_data> = true;
+template <>
+inline constexpr bool device_payload_allowed<DEVICE_MIDI_MODE, uint32_t> = true;
+
+template <device_commands... CMDS>
+struct DeviceCmdList {};
+
+// All the device commands known to visit()
+using DeviceCmds = DeviceCmdList<DEVICE_CMD_NULL,
+                                 DEVICE_PING,
+                                 DEVICE_FIRMWARE_VERSION_CHECK,
+                                 DEVICE_SYSTEM_INFO,
+                                 DEVICE_AUDIO_CHANNEL_INFO,
+                                 DEVICE_START,
+                                 DEVICE_CHANGE_INPUT_GAIN,
+                                 DEVICE_CHANGE_HP_VOL,
+                                 DEVICE_SET_RGB_LED_VAL,
+                                 DEVICE_MIDI_MODE,
+                                 DEVICE_STOP,
+                                 DEVICE_RAW_DATA>;
+
+/**
+ * @brief Device control packet with a command known at compile time.
+ *
+ * @tparam CMD The command of the packet
+ * @tparam PktType device_ctrl_pkt, or const device_ctrl_pkt for read only access
+ */
+template <device_commands CMD, typename PktType = device_ctrl_pkt>
+class TypedDevicePkt
+{
+public:
+    static_assert(std::is_same_v<std::remove_const_t<PktType>, device_ctrl_pkt>);
+
+    static constexpr device_commands COMMAND = CMD;
+
+    /**
+     * @brief Wraps a packet, which should already contain command CMD.
+     */
+    explicit TypedDevicePkt(PktType& pkt) : _pkt(&pkt) {}
+
+    /**
+     * @brief A read only view can be obtained from a mutable packet.
+     */
+    template <typename OtherPktType,
+              typename = std::enable_if_t<std::is_const_v<PktType> && !std::is_const_v<OtherPktType>>>
+    TypedDevicePkt(const TypedDevicePkt<CMD, OtherPktType>& other) : _pkt(&other.raw()) {}
+
+    /**
+     * @brief Builds a default packet with command CMD.
+     *
+     * @param pkt The device control packet
+     */
+    static TypedDevicePkt build(device_ctrl_pkt& pkt)
+    {
+        create_default_device_ctrl_pkt(&pkt);
+        pkt.device_cmd = CMD;
+        return TypedDevicePkt(pkt);
+    }
+
+    PktType& raw() const
+    {
+        return *_pkt;
+    }
+
+    /**
+     * @brief Access to the payload as type T, which must be one of the
+     *        payloads carried by CMD, e.g. payload<uint32_t>() for DEVICE_PING.
+     */
+    template <typename T>
+    auto& payload() const
+    {
+        static_assert(device_payload_allowed<CMD, T>, "Payload type not valid for this command");
+        using Ref = std::conditional_t<std::is_const_v<PktType>, const T&, T&>;
+        return reinterpret_cast<Ref>(_pkt->payload);
+    }
+
+private:
+    PktType* _pkt;
+};
+
+template <device_commands CMD>
+using DevicePktView = TypedDevicePkt<CMD, const device_ctrl_pkt>;
+
+/**
+ * @brief Passed to the handlers for packets with a command not in DeviceCmds.
+ */
+struct UnknownDeviceCmd
+{
+    const device_ctrl_pkt& pkt;
+};
+
+namespace detail {
+
+template <device_commands CMD, typename PktType, typename Visitor>
+bool visit_device_cmd(PktType& pkt, Visitor& visitor)
+{
+    return typed_pkt_detail::invoke_if_handled(visitor, TypedDevicePkt<CMD, PktType>(pkt));
+}
+
+template <typename PktType, typename Visitor>
+bool visit_unknown_device_cmd(PktType& pkt, Visitor& visitor)
+{
+    return typed_pkt_detail::invoke_if_handled(visitor, UnknownDeviceCmd{pkt});
+}
+
+template <typename PktType, typename Visitor, device_commands... CMDS>
+constexpr auto make_device_visit_table(DeviceCmdList<CMDS...>)
+{
+    using Handler = bool (*)(PktType&, Visitor&);
+    std::array<Handler, 256> table{};
+    for (auto& handler : table)
+    {
+        handler = &visit_unknown_device_cmd<PktType, Visitor>;
+    }
+    ((table[CMDS] = &visit_device_cmd<CMDS, PktType, Visitor>), ...);
+    return table;
+}
+
+} // namespace detail
+
+/**
+ * @brief Dispatches the packet to the handler accepting TypedDevicePkt or
+ *        DevicePktView of its command, through a jump table indexed by
+ *        device_cmd.
+ *
+ * @param pkt The device control packet, if const only DevicePktView handlers
+ *        are considered, otherwise both kinds are
+ * @param handlers Callables taking a TypedDevicePkt, DevicePktView or UnknownDeviceCmd
+ * @return true if a handler was called, false if the command has no handler
+ */
+template <typename PktType, typename... Handlers,
+          typename = std::enable_if_t<std::is_same_v<std::remove_const_t<PktType>, device_ctrl_pkt>>>
+bool visit(PktType& pkt, Handlers&&... handlers)
+{
+    using Visitor = typed_pkt_detail::Overloaded<std::decay_t<Handlers>...>;
+    static constexpr auto table = detail::make_device_visit_table<PktType, Visitor>(DeviceCmds{});
+    Visitor visitor{std::forward<Handlers>(handlers)...};
+    return table[pkt.device_cmd](pkt, visitor);
+}
+
+} // namespace device_ctrl
+
+#endif // TYPED_PACKET_H_
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Tests of MidiAggregator: coalescing of superseded control changes,
+ *        running status and that drained packets only contain complete
+ *        messages, with nothing lost or reordered across periods.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cstdio>
+#include <vector>
+
+#include "audio_control_protocol/midi_aggregator.h"
+
+#include "test_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+using Bytes = std::vector<uint8_t>;
+
+template <size_t CAPACITY>
+Bytes drain_bytes(MidiAggregator<CAPACITY>& aggregator)
+{
+    AudioCtrlPkt pkt{};
+    int num_bytes = aggregator.drain(&pkt);
+    TEST_CHECK(num_bytes == 0 || check_for_midi_data(&pkt) == num_bytes,
+               "packet size %d, drain returned %d", check_for_midi_data(&pkt), num_bytes);
+    Bytes bytes(num_bytes);
+    get_midi_data(&pkt, bytes.data(), 0, num_bytes);
+    return bytes;
+}
+
+// Expand running status and check that the packet holds only complete
+// messages, which are appended to msgs with their status bytes.
+bool parse_packet(const Bytes& bytes, Bytes& msgs)
+{
+    uint8_t running_status = 0;
+    size_t i = 0;
+    while (i < bytes.size())
+    {
+        uint8_t status = bytes[i];
+        if (status == 0xF0)
+        {
+            size_t end = i;
+            while (end < bytes.size() && bytes[end] != 0xF7)
+            {
+                end++;
+            }
+            if (end == bytes.size())
+            {
+                return false;
+            }
+            msgs.insert(msgs.end(), &bytes[i], &bytes[end] + 1);
+            i = end + 1;
+            running_status = 0;
+            continue;
+        }
+
+        int num_data = 0;
+        if (status < 0x80)
+        {
+            // Running status, status is the first data byte
+            if (running_status == 0)
+            {
+                return false;
+            }
+            status = running_status;
+            num_data = midi_msg_size(status) - 1;
+        }
+        else
+        {
+            num_data = midi_msg_size(status) - 1;
+            i++;
+        }
+        if (num_data < 0 || i + num_data > bytes.size())
+        {
+            return false;
+        }
+
+        msgs.push_back(status);
+        for (int j = 0; j < num_data; j++)
+        {
+            if (bytes[i + j] >= 0x80)
+            {
+                return false;
+            }
+            msgs.push_back(bytes[i + j]);
+        }
+        i += num_data;
+
+        if (status < 0xF0)
+        {
+            running_status = status;
+        }
+        else if (status < 0xF8)
+        {
+            running_status = 0;
+        }
+    }
+    return true;
+}
+
+void test_coalescing()
+{
+    MidiAggregator<64> aggregator;
+    aggregator.push(0xB0, 7, 10);
+    aggregator.push(0xB0, 7, 20);
+    aggregator.push(0xB0, 7, 30);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0xB0, 7, 30}), "repeated cc not coalesced");
+    TEST_CHECK(aggregator.stats().coalesced == 2, "coalesced %d", int(aggregator.stats().coalesced));
+
+    // Messages of other channels don't block coalescing
+    aggregator.push(0xB0, 7, 10);
+    aggregator.push(0xB1, 7, 11);
+    aggregator.push(0xB0, 7, 12);
+    aggregator.push(0xB1, 7, 13);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0xB0, 7, 12, 0xB1, 7, 13}),
+               "cc of other channel blocks coalescing");
+
+    // Other messages of the same channel do, other controllers included
+    aggregator.push(0xB0, 7, 10);
+    aggregator.push(0xB0, 1, 11);
+    aggregator.push(0xB0, 1, 12);
+    aggregator.push(0xB0, 7, 13);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0xB0, 7, 10, 1, 12, 7, 13}),
+               "cc coalesced across another controller");
+    aggregator.push(0xB0, 7, 10);
+    aggregator.push(0x90, 60, 100);
+    aggregator.push(0xB0, 7, 20);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0xB0, 7, 10, 0x90, 60, 100, 0xB0, 7, 20}),
+               "cc coalesced across a note");
+
+    // Data increment/decrement and channel mode messages are commands
+    for (uint8_t controller : {96, 97, 120, 123, 127})
+    {
+        aggregator.push(0xB2, controller, 0);
+        aggregator.push(0xB2, controller, 0);
+        TEST_CHECK((drain_bytes(aggregator) == Bytes{0xB2, controller, 0, controller, 0}),
+                   "cc %d coalesced", controller);
+    }
+
+    // And block coalescing of earlier value controllers
+    aggregator.push(0xB3, 6, 1);
+    aggregator.push(0xB3, 96, 0);
+    aggregator.push(0xB3, 6, 2);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0xB3, 6, 1, 96, 0, 6, 2}),
+               "cc coalesced across data increment");
+}
+
+void test_running_status()
+{
+    MidiAggregator<64> aggregator;
+    aggregator.push(0x90, 60, 100);
+    aggregator.push(0x90, 64, 100);
+    aggregator.push(0xF8, 0);
+    aggregator.push(0x90, 67, 100);
+    aggregator.push(0xF6, 0);
+    aggregator.push(0x90, 72, 100);
+    aggregator.push(0x80, 72, 0);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0x90, 60, 100, 64, 100, 0xF8, 67, 100, 0xF6,
+                                                 0x90, 72, 100, 0x80, 72, 0}),
+               "wrong running status");
+    TEST_CHECK(aggregator.stats().running_status_saved == 2,
+               "saved %d", int(aggregator.stats().running_status_saved));
+
+    // SysEx cancels running status
+    const uint8_t sysex[] = {0xF0, 0x7D, 0x01, 0xF7};
+    aggregator.push(0x90, 60, 100);
+    aggregator.push(sysex, sizeof(sysex));
+    aggregator.push(0x90, 60, 0);
+    TEST_CHECK((drain_bytes(aggregator) == Bytes{0x90, 60, 100, 0xF0, 0x7D, 0x01, 0xF7, 0x90, 60, 0}),
+               "running status across SysEx");
+
+    MidiAggregator<64> no_running_status(false);
+    no_running_status.push(0x90, 60, 100);
+    no_running_status.push(0x90, 64, 100);
+    TEST_CHECK((drain_bytes(no_running_status) == Bytes{0x90, 60, 100, 0x90, 64, 100}),
+               "running status used when disabled");
+    TEST_CHECK(no_running_status.stats().running_status_saved == 0, "running status counted");
+}
+
+void test_no_split()
+{
+    MidiAggregator<1024> aggregator;
+    const uint8_t sysex[] = {0xF0, 0x7D, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0xF7};
+    Bytes expected;
+    for (int i = 0; i < 300; i++)
+    {
+        // A mix of sizes so that packets end at different message boundaries,
+        // without repeated controllers so that nothing is coalesced.
+        uint8_t channel = i % 3;
+        switch (i % 5)
+        {
+        case 0:
+        case 1:
+            aggregator.push(0x90 | channel, i % 128, 100);
+            expected.insert(expected.end(), {uint8_t(0x90 | channel), uint8_t(i % 128), 100});
+            break;
+        case 2:
+            aggregator.push(0xC0 | channel, i % 128);
+            expected.insert(expected.end(), {uint8_t(0xC0 | channel), uint8_t(i % 128)});
+            break;
+        case 3:
+            aggregator.push(0xF8, 0);
+            expected.push_back(0xF8);
+            break;
+        default:
+            aggregator.push(sysex, sizeof(sysex));
+            expected.insert(expected.end(), sysex, sysex + sizeof(sysex));
+            break;
+        }
+    }
+
+    Bytes received;
+    int num_packets = 0;
+    while (true)
+    {
+        Bytes bytes = drain_bytes(aggregator);
+        if (bytes.empty())
+        {
+            break;
+        }
+        num_packets++;
+        TEST_CHECK(parse_packet(bytes, received), "packet %d has split messages", num_packets);
+        TEST_CHECK(bytes.size() > AUDIO_CTRL_PKT_PAYLOAD_SIZE - sizeof(sysex) || aggregator.num_pending() == 0,
+                   "packet %d only %d bytes with messages pending", num_packets, int(bytes.size()));
+    }
+    TEST_CHECK(num_packets > 1, "only %d packets", num_packets);
+    TEST_CHECK(received == expected, "messages lost or reordered");
+    TEST_CHECK(aggregator.stats().sent == 300, "sent %d", int(aggregator.stats().sent));
+    TEST_CHECK(aggregator.stats().coalesced == 0, "coalesced %d", int(aggregator.stats().coalesced));
+}
+
+void test_rejected()
+{
+    MidiAggregator<4> aggregator;
+    const uint8_t data_byte[] = {0x40, 0x40, 0x40};
+    const uint8_t short_note[] = {0x90, 60};
+    const uint8_t open_sysex[] = {0xF0, 0x7D, 0x01};
+    TEST_CHECK(!aggregator.push(data_byte, sizeof(data_byte)), "data byte accepted");
+    TEST_CHECK(!aggregator.push(short_note, sizeof(short_note)), "short message accepted");
+    TEST_CHECK(!aggregator.push(open_sysex, sizeof(open_sysex)), "unterminated SysEx accepted");
+    for (int i = 0; i < 4; i++)
+    {
+        TEST_CHECK(aggregator.push(0x90, 60 + i, 100), "message %d rejected", i);
+    }
+    TEST_CHECK(!aggregator.push(0x90, 70, 100), "message accepted in full queue");
+    TEST_CHECK(aggregator.stats().rejected == 4, "rejected %d", int(aggregator.stats().rejected));
+    TEST_CHECK(aggregator.stats().queued == 4, "queued %d", int(aggregator.stats().queued));
+}
+
+} // anonymous namespace
+
+int main()
+{
+    test_coalescing();
+    test_running_status();
+    test_no_split();
+    test_rejected();
+    return test::test_result("midi_aggregator_test");
+}
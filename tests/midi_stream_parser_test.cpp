@@ -0,0 +1,340 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Tests of MidiStreamParser: SysEx split across continuation packets,
+ *        realtime bytes inside SysEx, truncation on a lost packet, and the
+ *        batched paths for whole and running status messages checked against
+ *        the same stream parsed one byte at a time.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "audio_control_protocol/midi_fragment_helper.h"
+#include "audio_control_protocol/midi_stream_parser.h"
+
+#include "test_common.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+using Records = std::vector<MidiMessage>;
+
+Records parse_pkt(MidiStreamParser& parser, const AudioCtrlPkt& pkt)
+{
+    Records msgs(MIDI_STREAM_PARSER_MAX_MSGS);
+    msgs.resize(parser.parse(&pkt, msgs.data(), MIDI_STREAM_PARSER_MAX_MSGS));
+    return msgs;
+}
+
+bool is_sysex(const MidiMessage& msg, int offset, int size, uint8_t flags)
+{
+    return msg.type == MidiMessageType::SYSEX && msg.offset == offset && msg.size == size && msg.flags == flags;
+}
+
+bool is_short(const MidiMessage& msg, MidiMessageType type, std::vector<uint8_t> data)
+{
+    if (msg.type != type || msg.size != data.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        if (msg.data[i] != data[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A SysEx of 2.5 packets, with a known byte at every position
+std::vector<uint8_t> make_sysex()
+{
+    std::vector<uint8_t> sysex(2 * AUDIO_CTRL_PKT_PAYLOAD_SIZE + AUDIO_CTRL_PKT_PAYLOAD_SIZE / 2);
+    for (size_t i = 0; i < sysex.size(); i++)
+    {
+        sysex[i] = i & 0x7F;
+    }
+    sysex.front() = 0xF0;
+    sysex.back() = 0xF7;
+    return sysex;
+}
+
+std::vector<AudioCtrlPkt> make_fragment_pkts(const std::vector<uint8_t>& data, uint32_t seq)
+{
+    MidiFragmentEncoder enc;
+    init_midi_fragment_encoder(&enc, data.data(), data.size());
+    std::vector<AudioCtrlPkt> pkts;
+    AudioCtrlPkt pkt{};
+    while (prepare_next_midi_fragment_pkt(&enc, &pkt, seq++) > 0)
+    {
+        pkts.push_back(pkt);
+    }
+    return pkts;
+}
+
+void test_sysex_continuation()
+{
+    auto sysex = make_sysex();
+    auto pkts = make_fragment_pkts(sysex, 10);
+    TEST_CHECK(pkts.size() == 3, "%d packets", int(pkts.size()));
+
+    MidiStreamParser parser;
+    Records msgs = parse_pkt(parser, pkts[0]);
+    TEST_CHECK(msgs.size() == 1 && is_sysex(msgs[0], 0, AUDIO_CTRL_PKT_PAYLOAD_SIZE, MIDI_MSG_FLAG_SYSEX_START),
+               "first fragment");
+    msgs = parse_pkt(parser, pkts[1]);
+    TEST_CHECK(msgs.size() == 1 && is_sysex(msgs[0], 0, AUDIO_CTRL_PKT_PAYLOAD_SIZE, 0), "middle fragment");
+    msgs = parse_pkt(parser, pkts[2]);
+    TEST_CHECK(msgs.size() == 1 && is_sysex(msgs[0], 0, AUDIO_CTRL_PKT_PAYLOAD_SIZE / 2, MIDI_MSG_FLAG_SYSEX_END),
+               "last fragment");
+
+    // A message following the SysEx in the next packet is not affected
+    uint8_t note[] = {0x90, 60, 100};
+    AudioCtrlPkt pkt{};
+    prepare_midi_data_pkt(&pkt, note, sizeof(note));
+    pkt.seq = 13;
+    msgs = parse_pkt(parser, pkt);
+    TEST_CHECK(msgs.size() == 1 && is_short(msgs[0], MidiMessageType::CHANNEL, {0x90, 60, 100}), "note after SysEx");
+
+    auto stats = parser.stats();
+    TEST_CHECK(stats.messages == 4 && stats.truncated == 0 && stats.stray_bytes == 0,
+               "stats %d %d %d", int(stats.messages), int(stats.truncated), int(stats.stray_bytes));
+}
+
+void test_realtime_in_sysex()
+{
+    // Timing clocks inside the SysEx, also as its first and last data byte,
+    // and a SysEx continuing into the next packet
+    std::vector<uint8_t> data = {0xF0, 0xF8, 0x7D, 0x01, 0x02, 0xFE, 0x03, 0xF8, 0xF7, 0xF0, 0x7D, 0xF8, 0x04};
+    AudioCtrlPkt pkt{};
+    prepare_midi_data_pkt(&pkt, data.data(), data.size());
+    pkt.seq = 0;
+    pkt.continuation = 1;
+
+    MidiStreamParser parser;
+    Records msgs = parse_pkt(parser, pkt);
+    TEST_CHECK(msgs.size() == 10, "%d records", int(msgs.size()));
+    if (msgs.size() == 10)
+    {
+        TEST_CHECK(is_sysex(msgs[0], 0, 1, MIDI_MSG_FLAG_SYSEX_START), "record 0");
+        TEST_CHECK(is_short(msgs[1], MidiMessageType::REALTIME, {0xF8}), "record 1");
+        TEST_CHECK(is_sysex(msgs[2], 2, 3, 0), "record 2");
+        TEST_CHECK(is_short(msgs[3], MidiMessageType::REALTIME, {0xFE}), "record 3");
+        TEST_CHECK(is_sysex(msgs[4], 6, 1, 0), "record 4");
+        TEST_CHECK(is_short(msgs[5], MidiMessageType::REALTIME, {0xF8}), "record 5");
+        TEST_CHECK(is_sysex(msgs[6], 8, 1, MIDI_MSG_FLAG_SYSEX_END), "record 6");
+        TEST_CHECK(is_sysex(msgs[7], 9, 2, MIDI_MSG_FLAG_SYSEX_START), "record 7");
+        TEST_CHECK(is_short(msgs[8], MidiMessageType::REALTIME, {0xF8}), "record 8");
+        TEST_CHECK(is_sysex(msgs[9], 12, 1, 0), "record 9");
+    }
+
+    std::vector<uint8_t> rest = {0xF8, 0x05, 0xF7};
+    prepare_midi_data_pkt(&pkt, rest.data(), rest.size());
+    pkt.seq = 1;
+    pkt.continuation = 0;
+    msgs = parse_pkt(parser, pkt);
+    TEST_CHECK(msgs.size() == 2, "%d records", int(msgs.size()));
+    if (msgs.size() == 2)
+    {
+        TEST_CHECK(is_short(msgs[0], MidiMessageType::REALTIME, {0xF8}), "realtime at packet start");
+        TEST_CHECK(is_sysex(msgs[1], 1, 2, MIDI_MSG_FLAG_SYSEX_END), "SysEx end");
+    }
+    TEST_CHECK(parser.stats().truncated == 0, "truncated %d", int(parser.stats().truncated));
+}
+
+void test_lost_packet()
+{
+    auto sysex = make_sysex();
+    auto pkts = make_fragment_pkts(sysex, 20);
+
+    // The middle fragment is lost, the SysEx is ended as truncated when the
+    // last one arrives, whose data bytes then have no status
+    MidiStreamParser parser;
+    parse_pkt(parser, pkts[0]);
+    Records msgs = parse_pkt(parser, pkts[2]);
+    TEST_CHECK(msgs.size() == 1 && is_sysex(msgs[0], 0, 0, MIDI_MSG_FLAG_SYSEX_END | MIDI_MSG_FLAG_TRUNCATED),
+               "SysEx not truncated on lost packet");
+    auto stats = parser.stats();
+    TEST_CHECK(stats.truncated == 1, "truncated %d", int(stats.truncated));
+    TEST_CHECK(stats.stray_bytes == uint64_t(AUDIO_CTRL_PKT_PAYLOAD_SIZE / 2),
+               "stray bytes %d", int(stats.stray_bytes));
+
+    // A packet without midi data in place of the next fragment
+    MidiStreamParser parser_2;
+    parse_pkt(parser_2, pkts[0]);
+    AudioCtrlPkt pkt{};
+    pkt.seq = 21;
+    msgs = parse_pkt(parser_2, pkt);
+    TEST_CHECK(msgs.size() == 1 && is_sysex(msgs[0], 0, 0, MIDI_MSG_FLAG_SYSEX_END | MIDI_MSG_FLAG_TRUNCATED),
+               "SysEx not truncated on packet without midi");
+
+    // A channel message split across packets
+    uint8_t first[] = {0x90, 60};
+    uint8_t note[] = {0x90, 62, 100};
+    MidiStreamParser parser_3;
+    prepare_midi_data_pkt(&pkt, first, sizeof(first));
+    pkt.seq = 30;
+    pkt.continuation = 1;
+    msgs = parse_pkt(parser_3, pkt);
+    TEST_CHECK(msgs.empty(), "partial message emitted");
+    prepare_midi_data_pkt(&pkt, note, sizeof(note));
+    pkt.seq = 32;
+    pkt.continuation = 0;
+    msgs = parse_pkt(parser_3, pkt);
+    TEST_CHECK(msgs.size() == 1 && is_short(msgs[0], MidiMessageType::CHANNEL, {0x90, 62, 100}),
+               "message after lost packet");
+    TEST_CHECK(parser_3.stats().truncated == 1, "truncated %d", int(parser_3.stats().truncated));
+}
+
+bool same_record(const MidiMessage& a, const MidiMessage& b)
+{
+    return a.type == b.type && a.size == b.size && a.flags == b.flags && a.frame_offset == b.frame_offset &&
+           a.data[0] == b.data[0] && a.data[1] == b.data[1] && a.data[2] == b.data[2];
+}
+
+// A random stream of channel messages, with and without running status,
+// system common and realtime messages, also in the middle of other messages,
+// and stray data bytes
+std::vector<uint8_t> make_random_stream(std::mt19937& rng, int size)
+{
+    const uint8_t STATUS[] = {0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0};
+    std::vector<uint8_t> stream;
+    while (static_cast<int>(stream.size()) < size)
+    {
+        int kind = rng() % 16;
+        if (kind < 10)
+        {
+            uint8_t status = STATUS[rng() % 7] | (rng() % 16);
+            int repeats = kind < 7 ? 1 : 1 + rng() % 4;
+            stream.push_back(status);
+            for (int i = 0; i < repeats * (midi_msg_size(status) - 1); i++)
+            {
+                stream.push_back(rng() & 0x7F);
+            }
+        }
+        else if (kind < 12)
+        {
+            stream.push_back(0xF8 + rng() % 8);
+        }
+        else if (kind < 14)
+        {
+            // Song position, song select, tune request
+            const uint8_t COMMON[] = {0xF2, 0xF3, 0xF6};
+            uint8_t status = COMMON[rng() % 3];
+            stream.push_back(status);
+            for (int i = 1; i < midi_msg_size(status); i++)
+            {
+                stream.push_back(rng() & 0x7F);
+            }
+        }
+        else if (kind < 15)
+        {
+            // Realtime in the middle of a message
+            uint8_t status = 0x90 | (rng() % 16);
+            stream.insert(stream.end(), {status, uint8_t(rng() & 0x7F), 0xF8, uint8_t(rng() & 0x7F)});
+        }
+        else
+        {
+            stream.push_back(rng() & 0x7F);
+        }
+    }
+    stream.resize(size);
+    return stream;
+}
+
+void test_batched_parsing()
+{
+    std::mt19937 rng(1234);
+    for (int size : {1, 2, 3, 63, 64, 65, 111, 127, 128, 129, 200, 256, 1000})
+    {
+        for (int rep = 0; rep < 20; rep++)
+        {
+            auto stream = make_random_stream(rng, size);
+
+            MidiStreamParser block_parser;
+            Records block(2 * size + 1);
+            block.resize(block_parser.parse(stream.data(), size, block.data(), block.size()));
+
+            MidiStreamParser byte_parser;
+            Records bytes;
+            for (int i = 0; i < size; i++)
+            {
+                MidiMessage msgs[3];
+                int num_msgs = byte_parser.parse(&stream[i], 1, msgs, 3);
+                bytes.insert(bytes.end(), msgs, msgs + num_msgs);
+            }
+
+            bool same = block.size() == bytes.size();
+            for (size_t i = 0; same && i < block.size(); i++)
+            {
+                same = same_record(block[i], bytes[i]);
+            }
+            TEST_CHECK(same, "size %d, rep %d: %d records in a block, %d byte by byte",
+                       size, rep, int(block.size()), int(bytes.size()));
+            auto block_stats = block_parser.stats();
+            auto byte_stats = byte_parser.stats();
+            TEST_CHECK(block_stats.messages == byte_stats.messages && block_stats.truncated == byte_stats.truncated &&
+                       block_stats.stray_bytes == byte_stats.stray_bytes,
+                       "size %d, rep %d: stats differ", size, rep);
+        }
+    }
+
+    // Notes across the 128 byte window boundary of the parser
+    std::vector<uint8_t> notes;
+    for (int i = 0; i < 60; i++)
+    {
+        notes.insert(notes.end(), {0x90, uint8_t(i), 100});
+    }
+    MidiStreamParser parser;
+    Records msgs(2 * notes.size() + 1);
+    msgs.resize(parser.parse(notes.data(), notes.size(), msgs.data(), msgs.size()));
+    TEST_CHECK(msgs.size() == 60, "%d notes", int(msgs.size()));
+    for (size_t i = 0; i < msgs.size(); i++)
+    {
+        TEST_CHECK(is_short(msgs[i], MidiMessageType::CHANNEL, {0x90, uint8_t(i), 100}), "note %d", int(i));
+    }
+
+    // Records not fitting the buffer are counted as overflows
+    MidiStreamParser small_parser;
+    MidiMessage few[10];
+    int num_msgs = small_parser.parse(notes.data(), notes.size(), few, 10);
+    TEST_CHECK(num_msgs == 10 && small_parser.stats().overflows == 50,
+               "%d records, %d overflows", num_msgs, int(small_parser.stats().overflows));
+}
+
+} // anonymous namespace
+
+int main()
+{
+#if defined(AUDIO_CTRL_SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    if (!__builtin_cpu_supports("avx2"))
+    {
+        std::printf("avx2 not supported by the cpu, skipped\n");
+        return 77;
+    }
+#endif
+
+    test_sysex_continuation();
+    test_realtime_in_sysex();
+    test_lost_packet();
+    test_batched_parsing();
+    return test::test_result("midi_stream_parser_test");
+}
@@ -0,0 +1,377 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Bit exactness tests of the sample format conversion kernels. The
+ *        scalar reference functions, decode_sample() and encode_sample(), and
+ *        the buffer kernels are checked against known words of every format
+ *        for sign extension, bit placement and saturation. The buffer kernels
+ *        are then compared with the scalar functions on random data, using
+ *        exact equality. The test is built once for each SIMD backend, the
+ *        one expected is given by TEST_SIMD_BACKEND. Also checks
+ *        that the TPDF dither is deterministic for a given seed.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "audio_control_protocol/sample_format_conversion.h"
+
+#include "test_common.h"
+
+namespace {
+
+using namespace device_ctrl;
+namespace simd = audio_ctrl::simd;
+
+const uint8_t FORMATS[] = {INT24_LJ, INT24_I2S, INT24_RJ, INT24_32RJ, INT32, BINARY};
+
+// Buffer sizes covering empty buffers, vector tails and long buffers
+const int SIZES[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 1027};
+
+const char* backend_name()
+{
+#if defined(AUDIO_CTRL_SIMD_AVX2)
+    return "avx2";
+#elif defined(AUDIO_CTRL_SIMD_SSE2)
+    return "sse2";
+#elif defined(AUDIO_CTRL_SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+bool same_bits(float a, float b)
+{
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+std::vector<int32_t> make_words(int size, std::mt19937& rng)
+{
+    const int32_t special[] = {0, 1, -1, 0x7FFFFFFF, int32_t(0x80000000), 0x00800000, int32_t(0xFF800000),
+                               0x7FFFFF00, int32_t(0x80000100), 0x00FFFFFF, 0x40000000, 0x3FFFFFFF};
+    std::vector<int32_t> words(size);
+    for (int i = 0; i < size; i++)
+    {
+        words[i] = i < int(std::size(special)) && size > 1 ? special[i] : static_cast<int32_t>(rng());
+    }
+    return words;
+}
+
+// Out of range values, signed zeros, denormals and rounding ties of the
+// 24 bit formats are mixed with uniform samples. NaN is not covered, its
+// clamping is backend dependent.
+std::vector<float> make_samples(int size, std::mt19937& rng)
+{
+    const float special[] = {0.0f, -0.0f, 1.0f, -1.0f, 0.99999994f, -0.99999994f, 1.5f, -1.5f, 1e30f, -1e30f,
+                             std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                             std::numeric_limits<float>::denorm_min(), 0.5f / 8388608.0f, 1.5f / 8388608.0f,
+                             -2.5f / 8388608.0f, 0.5f / 2147483648.0f};
+    std::uniform_real_distribution<float> dist(-1.25f, 1.25f);
+    std::vector<float> samples(size);
+    for (int i = 0; i < size; i++)
+    {
+        samples[i] = i < int(std::size(special)) && size > 1 ? special[i] : dist(rng);
+    }
+    return samples;
+}
+
+// Scalar model of the per lane xorshift generators of next_tpdf_dither()
+std::vector<float> reference_dither(uint32_t seed, int num_samples)
+{
+    TpdfDither dither;
+    init_tpdf_dither(dither, seed);
+    std::vector<float> noise;
+    int num_steps = (num_samples + simd::WIDTH - 1) / simd::WIDTH;
+    for (int step = 0; step < num_steps; step++)
+    {
+        for (int lane = 0; lane < simd::WIDTH; lane++)
+        {
+            auto x = static_cast<uint32_t>(dither.state[lane]);
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            dither.state[lane] = static_cast<int32_t>(x);
+            float a = static_cast<float>(x >> 16);
+            float b = static_cast<float>(x & 0xFFFF);
+            noise.push_back((a - b) * (1.0f / 65536.0f));
+        }
+    }
+    return noise;
+}
+
+// Size of the buffers of the known answer tests, covering vectors and tail
+const int KNOWN_ANSWER_SIZE = 2 * simd::WIDTH + 1;
+
+void check_known_decode(uint8_t format, uint32_t word, float expected)
+{
+    SampleFormatParams params{};
+    get_sample_format_params(format, params);
+    float sample = decode_sample(static_cast<int32_t>(word), params);
+    TEST_CHECK(same_bits(sample, expected), "decode_sample format %d 0x%08x: %.9g != %.9g",
+               format, unsigned(word), sample, expected);
+
+    std::vector<int32_t> words(KNOWN_ANSWER_SIZE, static_cast<int32_t>(word));
+    std::vector<float> samples(KNOWN_ANSWER_SIZE);
+    convert_to_float(format, words.data(), samples.data(), KNOWN_ANSWER_SIZE);
+    for (int i = 0; i < KNOWN_ANSWER_SIZE; i++)
+    {
+        TEST_CHECK(same_bits(samples[i], expected), "decode format %d [%d] 0x%08x: %.9g != %.9g",
+                   format, i, unsigned(word), samples[i], expected);
+    }
+}
+
+void check_known_encode(uint8_t format, float sample, uint32_t expected)
+{
+    SampleFormatParams params{};
+    get_sample_format_params(format, params);
+    auto word = static_cast<uint32_t>(encode_sample(sample, params));
+    TEST_CHECK(word == expected, "encode_sample format %d %.9g: 0x%08x != 0x%08x",
+               format, sample, unsigned(word), unsigned(expected));
+
+    std::vector<float> samples(KNOWN_ANSWER_SIZE, sample);
+    std::vector<int32_t> words(KNOWN_ANSWER_SIZE);
+    convert_from_float(format, samples.data(), words.data(), KNOWN_ANSWER_SIZE);
+    for (int i = 0; i < KNOWN_ANSWER_SIZE; i++)
+    {
+        TEST_CHECK(static_cast<uint32_t>(words[i]) == expected, "encode format %d [%d] %.9g: 0x%08x != 0x%08x",
+                   format, i, sample, unsigned(words[i]), unsigned(expected));
+    }
+}
+
+void test_known_answers()
+{
+    const float LSB_24 = 1.0f / 8388608.0f;
+    const float MAX_24 = 1.0f - LSB_24;
+
+    // Left justified, the low byte is ignored
+    check_known_decode(INT24_LJ, 0x80000000, -1.0f);
+    check_known_decode(INT24_LJ, 0x7FFFFF00, MAX_24);
+    check_known_decode(INT24_LJ, 0x7FFFFFFF, MAX_24);
+    check_known_decode(INT24_LJ, 0x00000100, LSB_24);
+    check_known_decode(INT24_LJ, 0xFFFFFF00, -LSB_24);
+    check_known_decode(INT24_LJ, 0x000000FF, 0.0f);
+    check_known_encode(INT24_LJ, 1.0f, 0x7FFFFF00);
+    check_known_encode(INT24_LJ, 1.5f, 0x7FFFFF00);
+    check_known_encode(INT24_LJ, -1.0f, 0x80000000);
+    check_known_encode(INT24_LJ, -1.5f, 0x80000000);
+    check_known_encode(INT24_LJ, 0.5f, 0x40000000);
+    check_known_encode(INT24_LJ, -LSB_24, 0xFFFFFF00);
+
+    // I2S, left justified one bit late, the msb of the word is ignored
+    check_known_decode(INT24_I2S, 0x40000000, -1.0f);
+    check_known_decode(INT24_I2S, 0xC0000000, -1.0f);
+    check_known_decode(INT24_I2S, 0x3FFFFF80, MAX_24);
+    check_known_decode(INT24_I2S, 0x00000080, LSB_24);
+    check_known_decode(INT24_I2S, 0x7FFFFF80, -LSB_24);
+    check_known_encode(INT24_I2S, 1.0f, 0x3FFFFF80);
+    check_known_encode(INT24_I2S, 1.5f, 0x3FFFFF80);
+    check_known_encode(INT24_I2S, -1.0f, 0x40000000);
+    check_known_encode(INT24_I2S, -1.5f, 0x40000000);
+    check_known_encode(INT24_I2S, -LSB_24, 0x7FFFFF80);
+
+    // Right justified, the high byte is ignored when decoding and zero when encoding
+    check_known_decode(INT24_RJ, 0x00800000, -1.0f);
+    check_known_decode(INT24_RJ, 0xFF800000, -1.0f);
+    check_known_decode(INT24_RJ, 0x007FFFFF, MAX_24);
+    check_known_decode(INT24_RJ, 0x00FFFFFF, -LSB_24);
+    check_known_decode(INT24_RJ, 0x7F000001, LSB_24);
+    check_known_encode(INT24_RJ, 1.0f, 0x007FFFFF);
+    check_known_encode(INT24_RJ, 1.5f, 0x007FFFFF);
+    check_known_encode(INT24_RJ, -1.0f, 0x00800000);
+    check_known_encode(INT24_RJ, -1.5f, 0x00800000);
+    check_known_encode(INT24_RJ, -LSB_24, 0x00FFFFFF);
+
+    // Right justified in 32 bits, sign extended
+    check_known_decode(INT24_32RJ, 0xFF800000, -1.0f);
+    check_known_decode(INT24_32RJ, 0x007FFFFF, MAX_24);
+    check_known_decode(INT24_32RJ, 0xFFFFFFFF, -LSB_24);
+    check_known_encode(INT24_32RJ, 1.0f, 0x007FFFFF);
+    check_known_encode(INT24_32RJ, 1.5f, 0x007FFFFF);
+    check_known_encode(INT24_32RJ, -1.0f, 0xFF800000);
+    check_known_encode(INT24_32RJ, -1.5f, 0xFF800000);
+    check_known_encode(INT24_32RJ, -LSB_24, 0xFFFFFFFF);
+
+    // 32 bit, positive full scale saturates to the largest float below 2^31
+    check_known_decode(INT32, 0x80000000, -1.0f);
+    check_known_decode(INT32, 0x40000000, 0.5f);
+    check_known_decode(INT32, 0x7FFFFF80, 2147483520.0f / 2147483648.0f);
+    check_known_decode(INT32, 0xFFFFFFFF, -1.0f / 2147483648.0f);
+    check_known_encode(INT32, 1.0f, 0x7FFFFF80);
+    check_known_encode(INT32, 1.5f, 0x7FFFFF80);
+    check_known_encode(INT32, -1.0f, 0x80000000);
+    check_known_encode(INT32, -1.5f, 0x80000000);
+    check_known_encode(INT32, 0.5f, 0x40000000);
+
+    // Binary passes the bits through, including out of range values and NaN
+    const uint32_t binary_words[] = {0x3F800000, 0xBFC00000, 0x7F800000, 0x00000001, 0x80000000};
+    for (uint32_t word : binary_words)
+    {
+        float sample;
+        std::memcpy(&sample, &word, sizeof(sample));
+        check_known_decode(BINARY, word, sample);
+        check_known_encode(BINARY, sample, word);
+    }
+    const uint32_t nan_word = 0x7FC01234;
+    std::vector<int32_t> words(KNOWN_ANSWER_SIZE, static_cast<int32_t>(nan_word));
+    std::vector<int32_t> copy(KNOWN_ANSWER_SIZE);
+    std::vector<float> samples(KNOWN_ANSWER_SIZE);
+    convert_to_float(BINARY, words.data(), samples.data(), KNOWN_ANSWER_SIZE);
+    convert_from_float(BINARY, samples.data(), copy.data(), KNOWN_ANSWER_SIZE);
+    TEST_CHECK(words == copy, "binary NaN not passed through");
+}
+
+void test_decode(uint8_t format, std::mt19937& rng)
+{
+    SampleFormatParams params{};
+    TEST_CHECK(get_sample_format_params(format, params), "format %d unknown", format);
+    for (int size : SIZES)
+    {
+        std::vector<int32_t> words = make_words(size, rng);
+        std::vector<float> samples(size);
+        TEST_CHECK(convert_to_float(format, words.data(), samples.data(), size), "format %d", format);
+        for (int i = 0; i < size; i++)
+        {
+            float expected = decode_sample(words[i], params);
+            TEST_CHECK(same_bits(samples[i], expected), "decode format %d size %d [%d] 0x%08x: %.9g != %.9g",
+                       format, size, i, unsigned(words[i]), samples[i], expected);
+        }
+
+        // In place conversion
+        std::vector<int32_t> buffer = words;
+        decode_buffer(buffer.data(), reinterpret_cast<float*>(buffer.data()), size, params);
+        TEST_CHECK(size == 0 || std::memcmp(buffer.data(), samples.data(), size * sizeof(float)) == 0,
+                   "in place decode format %d size %d", format, size);
+    }
+}
+
+void test_encode(uint8_t format, std::mt19937& rng)
+{
+    SampleFormatParams params{};
+    get_sample_format_params(format, params);
+    for (int size : SIZES)
+    {
+        std::vector<float> samples = make_samples(size, rng);
+        std::vector<int32_t> words(size);
+        TEST_CHECK(convert_from_float(format, samples.data(), words.data(), size), "format %d", format);
+        for (int i = 0; i < size; i++)
+        {
+            int32_t expected = encode_sample(samples[i], params);
+            TEST_CHECK(words[i] == expected, "encode format %d size %d [%d] %.9g: 0x%08x != 0x%08x",
+                       format, size, i, samples[i], unsigned(words[i]), unsigned(expected));
+        }
+    }
+}
+
+void test_encode_dither(uint8_t format, std::mt19937& rng)
+{
+    SampleFormatParams params{};
+    get_sample_format_params(format, params);
+    for (int size : SIZES)
+    {
+        uint32_t seed = rng();
+        std::vector<float> samples = make_samples(size, rng);
+        std::vector<float> noise = reference_dither(seed, size);
+        std::vector<int32_t> words(size);
+        TpdfDither dither;
+        init_tpdf_dither(dither, seed);
+        TEST_CHECK(convert_from_float(format, samples.data(), words.data(), size, &dither), "format %d", format);
+        for (int i = 0; i < size; i++)
+        {
+            int32_t expected = encode_sample(samples[i], params, noise[i]);
+            TEST_CHECK(words[i] == expected, "dithered encode format %d size %d [%d] %.9g: 0x%08x != 0x%08x",
+                       format, size, i, samples[i], unsigned(words[i]), unsigned(expected));
+        }
+    }
+}
+
+void test_dither_determinism()
+{
+    constexpr int SIZE = 1000;
+    std::mt19937 rng(7);
+    std::vector<float> samples = make_samples(SIZE, rng);
+    std::vector<int32_t> first(SIZE);
+    std::vector<int32_t> second(SIZE);
+
+    // Same seed, same noise, also when the buffer is split in several calls
+    TpdfDither dither_a;
+    TpdfDither dither_b;
+    init_tpdf_dither(dither_a, 1234);
+    init_tpdf_dither(dither_b, 1234);
+    TEST_CHECK(std::memcmp(&dither_a, &dither_b, sizeof(TpdfDither)) == 0, "initial dither state");
+    convert_from_float(INT24_LJ, samples.data(), first.data(), SIZE, &dither_a);
+    convert_from_float(INT24_LJ, samples.data(), second.data(), 8 * simd::WIDTH, &dither_b);
+    convert_from_float(INT24_LJ, samples.data() + 8 * simd::WIDTH, second.data() + 8 * simd::WIDTH,
+                       SIZE - 8 * simd::WIDTH, &dither_b);
+    TEST_CHECK(first == second, "dither with the same seed differs");
+    TEST_CHECK(std::memcmp(&dither_a, &dither_b, sizeof(TpdfDither)) == 0, "final dither state");
+
+    // A different seed gives different noise
+    init_tpdf_dither(dither_b, 1235);
+    convert_from_float(INT24_LJ, samples.data(), second.data(), SIZE, &dither_b);
+    TEST_CHECK(first != second, "dither with different seeds is equal");
+
+    // The noise is TPDF, within (-1, 1) lsb
+    std::vector<float> noise = reference_dither(99, SIZE);
+    for (float n : noise)
+    {
+        TEST_CHECK(n > -1.0f && n < 1.0f, "dither out of range %g", n);
+    }
+}
+
+void test_unknown_format()
+{
+    float sample = 0.0f;
+    int32_t word = 0;
+    TEST_CHECK(!convert_to_float(0, &word, &sample, 1), "format 0 accepted");
+    TEST_CHECK(!convert_from_float(BINARY + 1, &sample, &word, 1), "unknown format accepted");
+}
+
+} // anonymous namespace
+
+int main()
+{
+#if defined(AUDIO_CTRL_SIMD_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    if (!__builtin_cpu_supports("avx2"))
+    {
+        std::printf("avx2 not supported by the cpu, skipped\n");
+        return 77;
+    }
+#endif
+#ifdef TEST_SIMD_BACKEND
+    TEST_CHECK(std::strcmp(backend_name(), TEST_SIMD_BACKEND) == 0, "backend %s instead of %s",
+               backend_name(), TEST_SIMD_BACKEND);
+#endif
+
+    test_known_answers();
+
+    std::mt19937 rng(1);
+    for (uint8_t format : FORMATS)
+    {
+        test_decode(format, rng);
+        test_encode(format, rng);
+        test_encode_dither(format, rng);
+    }
+    test_dither_determinism();
+    test_unknown_format();
+
+    std::printf("%s backend\n", backend_name());
+    return test::test_result("sample_format_conversion_test");
+}
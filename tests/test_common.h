@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Minimal check macro shared by the tests. Failed checks are printed,
+ *        up to a limit, and counted, main() returns test_result().
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#ifndef AUDIO_CONTROL_PROTOCOL_TEST_COMMON_H_
+#define AUDIO_CONTROL_PROTOCOL_TEST_COMMON_H_
+
+#include <cstdio>
+
+namespace test {
+
+inline int& num_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+/**
+ * @brief Print the outcome of the test.
+ *
+ * @return The exit code of the test
+ */
+inline int test_result(const char* name)
+{
+    std::printf("%s: %s\n", name, num_failures() == 0 ? "passed" : "FAILED");
+    return num_failures() == 0 ? 0 : 1;
+}
+
+} // namespace test
+
+#define TEST_CHECK(cond, ...)                                           \
+    do                                                                  \
+    {                                                                   \
+        if (!(cond))                                                    \
+        {                                                               \
+            if (test::num_failures()++ < 20)                            \
+            {                                                           \
+                std::printf("FAILED %s:%d: ", __FILE__, __LINE__);      \
+                std::printf(__VA_ARGS__);                               \
+                std::printf("\n");                                      \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
+#endif // AUDIO_CONTROL_PROTOCOL_TEST_COMMON_H_
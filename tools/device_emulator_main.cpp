@@ -0,0 +1,427 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+
+/**
+ * @brief Command line front end of DeviceEmulator.
+ *
+ *        By default a built-in host brings the emulated device up with the
+ *        device control queries, streams for the given duration and prints
+ *        what it received, e.g. to measure the host side cost of a given
+ *        load on any Linux machine:
+ *
+ *            acp_device_emulator --transport shm --buffer-size 32 --midi-load 0.5 --duration 10
+ *
+ *        With --serve and the shm transport no host is started, the emulator
+ *        waits for an external host to attach to the shared memory links
+ *        <name>_ctrl and <name>_audio.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "audio_control_protocol/clock_drift_estimator.h"
+#include "audio_control_protocol/device_ctrl_session.h"
+#include "audio_control_protocol/device_emulator.h"
+#include "audio_control_protocol/seq_tracker.h"
+
+namespace {
+
+using namespace device_ctrl;
+using audio_ctrl::AudioCtrlPkt;
+using audio_ctrl::PacketLink;
+using audio_ctrl::PacketLinkSide;
+using audio_ctrl::ShmPacketLink;
+
+using ControlLink = PacketLink<struct device_ctrl_pkt>;
+using AudioLink = PacketLink<AudioCtrlPkt>;
+
+std::atomic<bool> interrupted{false};
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void on_signal(int)
+{
+    interrupted = true;
+}
+
+struct Options
+{
+    DeviceEmulatorConfig config;
+    std::string transport{"socketpair"};
+    std::string shm_name{"/acp_emulator"};
+    double duration_s{5.0};
+    bool serve{false};
+};
+
+void print_usage(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --transport socketpair|pipe|shm  Link between host and device (socketpair)\n"
+            "  --shm-name NAME                  Prefix of the shared memory links (/acp_emulator)\n"
+            "  --serve                          Do not start the built-in host, shm transport only\n"
+            "  --duration S                     Streaming time of the built-in host (5)\n"
+            "  --rate HZ                        Sampling rate (48000)\n"
+            "  --buffer-size N                  Frames per period (64)\n"
+            "  --inputs N, --outputs N          Number of audio channels (8, 8)\n"
+            "  --jitter-us US                   Max period jitter (0)\n"
+            "  --drift-ppm PPM                  Device clock drift (0)\n"
+            "  --loss P                         Audio packet loss probability (0)\n"
+            "  --midi-load P, --midi-bytes N    Probability and size of midi packets (0, 3)\n"
+            "  --timestamped-midi               Support timestamped midi, used by the built-in host\n"
+            "  --ump-midi                       Support ump midi, preferred by the built-in host\n"
+            "  --gpio-load P, --gpio-blobs N    Probability and size of gpio packets (0, 1)\n"
+            "  --seed N                         Seed of the impairments (1)\n",
+            name);
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    DeviceEmulatorConfig& config = options.config;
+    for (int arg = 1; arg < argc; arg++)
+    {
+        const char* name = argv[arg];
+        if (strcmp(name, "--timestamped-midi") == 0)
+        {
+            config.timestamped_midi = true;
+            continue;
+        }
+        if (strcmp(name, "--ump-midi") == 0)
+        {
+            config.ump_midi = true;
+            continue;
+        }
+        if (strcmp(name, "--serve") == 0)
+        {
+            options.serve = true;
+            continue;
+        }
+        if (arg + 1 >= argc)
+        {
+            return false;
+        }
+        const char* value = argv[++arg];
+        if (strcmp(name, "--transport") == 0)           options.transport = value;
+        else if (strcmp(name, "--shm-name") == 0)       options.shm_name = value;
+        else if (strcmp(name, "--duration") == 0)       options.duration_s = atof(value);
+        else if (strcmp(name, "--rate") == 0)           config.sampling_rate = static_cast<uint32_t>(atoi(value));
+        else if (strcmp(name, "--buffer-size") == 0)    config.buffer_size = atoi(value);
+        else if (strcmp(name, "--inputs") == 0)         config.num_audio_inputs = static_cast<uint8_t>(atoi(value));
+        else if (strcmp(name, "--outputs") == 0)        config.num_audio_outputs = static_cast<uint8_t>(atoi(value));
+        else if (strcmp(name, "--jitter-us") == 0)      config.jitter_us = atof(value);
+        else if (strcmp(name, "--drift-ppm") == 0)      config.drift_ppm = atof(value);
+        else if (strcmp(name, "--loss") == 0)           config.packet_loss = atof(value);
+        else if (strcmp(name, "--midi-load") == 0)      config.midi_load = atof(value);
+        else if (strcmp(name, "--midi-bytes") == 0)     config.midi_bytes_per_pkt = atoi(value);
+        else if (strcmp(name, "--gpio-load") == 0)      config.gpio_load = atof(value);
+        else if (strcmp(name, "--gpio-blobs") == 0)     config.gpio_blobs_per_pkt = atoi(value);
+        else if (strcmp(name, "--seed") == 0)           config.seed = static_cast<uint32_t>(atoi(value));
+        else return false;
+    }
+    return options.transport == "socketpair" || options.transport == "pipe" || options.transport == "shm";
+}
+
+/**
+ * @brief Host and device ends of the control and audio links.
+ */
+struct Links
+{
+    std::unique_ptr<ControlLink> host_control;
+    std::unique_ptr<ControlLink> device_control;
+    std::unique_ptr<AudioLink> host_audio;
+    std::unique_ptr<AudioLink> device_audio;
+};
+
+template <typename PacketType>
+bool make_shm_link(const std::string& name, bool with_host,
+                   std::unique_ptr<PacketLink<PacketType>>& host_end,
+                   std::unique_ptr<PacketLink<PacketType>>& device_end)
+{
+    auto device = std::make_unique<ShmPacketLink<PacketType>>();
+    if (!device->create(name, PacketLinkSide::DEVICE))
+    {
+        return false;
+    }
+    if (with_host)
+    {
+        auto host = std::make_unique<ShmPacketLink<PacketType>>();
+        if (!host->open(name, PacketLinkSide::HOST))
+        {
+            return false;
+        }
+        host_end = std::move(host);
+    }
+    device_end = std::move(device);
+    return true;
+}
+
+bool make_links(const Options& options, Links& links)
+{
+    if (options.transport == "socketpair")
+    {
+        return audio_ctrl::make_socketpair_link(links.host_control, links.device_control) &&
+               audio_ctrl::make_socketpair_link(links.host_audio, links.device_audio);
+    }
+    if (options.transport == "pipe")
+    {
+        return audio_ctrl::make_pipe_link(links.host_control, links.device_control) &&
+               audio_ctrl::make_pipe_link(links.host_audio, links.device_audio);
+    }
+    return make_shm_link(options.shm_name + "_ctrl", !options.serve, links.host_control, links.device_control) &&
+           make_shm_link(options.shm_name + "_audio", !options.serve, links.host_audio, links.device_audio);
+}
+
+/**
+ * @brief Brings the device up with DeviceCtrlSession, as a driver would.
+ *
+ * @return true if all the queries were answered
+ */
+bool bring_up(ControlLink& link, const DeviceEmulatorConfig& config)
+{
+    int num_ok = 0;
+    int num_queries = 0;
+    bool has_timestamped_midi = false;
+    bool has_ump_midi = false;
+    DeviceCtrlSession session([&](const struct device_ctrl_pkt& pkt) { return link.send(pkt); });
+    auto count_reply = [&](QueryStatus status, const struct device_ctrl_pkt*) { num_ok += status == QueryStatus::OK; };
+
+    struct device_ctrl_pkt query;
+    prepare_ping_cmd_query_pkt(&query, 0x1234);
+    session.send_query(query, count_reply);
+    prepare_version_check_query_pkt(&query);
+    session.send_query(query, count_reply);
+    prepare_system_info_cmd_query_pkt(&query);
+    session.send_query(query, [&](QueryStatus status, const struct device_ctrl_pkt* reply) {
+        if (status == QueryStatus::OK)
+        {
+            const struct system_info_data* info = get_system_info_data(reply);
+            printf("device \"%.*s\", %u Hz, %u inputs, %u outputs\n", DEVICE_CTRL_PKT_HAT_NAME_SIZE,
+                   reinterpret_cast<const char*>(info->hat_name), info->sampling_rate, info->num_audio_inputs,
+                   info->num_audio_outputs);
+            has_timestamped_midi = info->flags & DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_TIMESTAMPED_MIDI;
+            has_ump_midi = info->flags & DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_UMP_MIDI;
+        }
+        count_reply(status, reply);
+    });
+    num_queries = 3;
+    for (int direction = INPUT_DIRECTION; direction <= OUTPUT_DIRECTION; direction++)
+    {
+        int num_channels = direction == INPUT_DIRECTION ? config.num_audio_inputs : config.num_audio_outputs;
+        for (int ch = 0; ch < num_channels; ch++)
+        {
+            prepare_audio_channel_info_cmd_query_pkt(&query, config.buffer_size, ch,
+                                                     static_cast<audio_channel_direction>(direction));
+            session.send_query(query, count_reply);
+            num_queries++;
+        }
+    }
+
+    auto wait_for_replies = [&] {
+        while (session.num_in_flight() + session.num_pending() > 0 && !interrupted)
+        {
+            struct device_ctrl_pkt reply;
+            while (link.receive(reply))
+            {
+                session.process_reply(reply);
+            }
+            session.poll();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    };
+    wait_for_replies();
+
+    // Negotiated once the system info is known
+    if (has_ump_midi || has_timestamped_midi)
+    {
+        prepare_midi_mode_cmd_query_pkt(&query, has_ump_midi ? DEVICE_MIDI_MODE_UMP : DEVICE_MIDI_MODE_TIMESTAMPED);
+        session.send_query(query, [&](QueryStatus status, const struct device_ctrl_pkt* reply) {
+            if (status == QueryStatus::OK)
+            {
+                uint32_t midi_mode = get_midi_mode_data(reply);
+                printf("midi mode: %s\n", midi_mode == DEVICE_MIDI_MODE_UMP ? "ump" :
+                                          midi_mode == DEVICE_MIDI_MODE_TIMESTAMPED ? "timestamped" : "raw");
+            }
+            count_reply(status, reply);
+        });
+        num_queries++;
+        wait_for_replies();
+    }
+    printf("bring up: %d of %d queries answered\n", num_ok, num_queries);
+    return num_ok == num_queries;
+}
+
+/**
+ * @brief Streams for the given duration, tracking the sequence numbers and
+ *        the clock drift of the received packets.
+ */
+void run_host(Links& links, const Options& options)
+{
+    const DeviceEmulatorConfig& config = options.config;
+    if (!bring_up(*links.host_control, config))
+    {
+        return;
+    }
+
+    double packets_per_s = double(config.sampling_rate) / double(config.buffer_size);
+    double period_ns = 1e9 / packets_per_s;
+    audio_ctrl::SeqTracker seq_tracker(static_cast<uint32_t>(packets_per_s));
+    audio_ctrl::ClockDriftEstimator drift_estimator(period_ns, packets_per_s);
+
+    struct device_ctrl_pkt start;
+    prepare_start_cmd_pkt(&start, config.buffer_size);
+    links.host_control->send(start);
+    AudioCtrlPkt unmute;
+    audio_ctrl::prepare_audio_unmute_pkt(&unmute, 0);
+    links.host_audio->send(unmute);
+
+    uint64_t num_pkts = 0;
+    uint64_t num_bad_crc = 0;
+    uint64_t num_midi_bytes = 0;
+    uint64_t num_gpio_blobs = 0;
+    uint64_t max_interval_ns = 0;
+    uint64_t host_ns = 0;
+    uint64_t last_arrival_ns = 0;
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto end_time = start_time + std::chrono::duration<double>(options.duration_s);
+    while (std::chrono::steady_clock::now() < end_time && !interrupted)
+    {
+        AudioCtrlPkt pkt;
+        if (!links.host_audio->receive(pkt))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        uint64_t arrival_ns = now_ns();
+        if (last_arrival_ns != 0)
+        {
+            max_interval_ns = std::max(max_interval_ns, arrival_ns - last_arrival_ns);
+        }
+        last_arrival_ns = arrival_ns;
+
+        if (!audio_ctrl::check_audio_pkt_crc(&pkt))
+        {
+            num_bad_crc++;
+            continue;
+        }
+        seq_tracker.process(&pkt);
+        drift_estimator.update(&pkt);
+        if (audio_ctrl::check_for_timestamped_midi_data(&pkt))
+        {
+            audio_ctrl::MidiEventIterator midi_events;
+            audio_ctrl::init_midi_event_iterator(&midi_events, &pkt);
+            uint32_t frame_offset;
+            int num_bytes;
+            while (audio_ctrl::next_midi_event(&midi_events, &frame_offset, &num_bytes))
+            {
+                num_midi_bytes += num_bytes;
+            }
+        }
+        else if (int num_bytes = audio_ctrl::check_for_midi_data(&pkt))
+        {
+            // get_midi_data() returns 1 on success, not the number of bytes
+            uint8_t midi_data[AUDIO_CTRL_PKT_PAYLOAD_SIZE];
+            num_bytes = std::min(num_bytes, AUDIO_CTRL_PKT_PAYLOAD_SIZE);
+            if (audio_ctrl::get_midi_data(&pkt, midi_data, 0, num_bytes))
+            {
+                num_midi_bytes += num_bytes;
+            }
+        }
+        else
+        {
+            uint8_t midi_data[UMP_MIDI1_MAX_SIZE];
+            int offset = 0;
+            int num_words;
+            while (const uint32_t* message = audio_ctrl::next_ump_message(&pkt, &offset, &num_words))
+            {
+                num_midi_bytes += audio_ctrl::ump_to_midi1(message, midi_data);
+            }
+        }
+        num_gpio_blobs += audio_ctrl::check_for_gpio_data(&pkt);
+        num_pkts++;
+        host_ns += now_ns() - arrival_ns;
+    }
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    struct device_ctrl_pkt stop;
+    prepare_stop_cmd_pkt(&stop);
+    links.host_control->send(stop);
+
+    audio_ctrl::SeqStats seq = seq_tracker.totals();
+    audio_ctrl::ClockDriftSnapshot drift = drift_estimator.snapshot();
+    printf("host: %" PRIu64 " packets in %.2f s (%.1f/s, nominal %.1f/s), %" PRIu64 " bad crc\n", num_pkts,
+           elapsed_s, double(num_pkts) / elapsed_s, packets_per_s, num_bad_crc);
+    printf("host: %" PRIu64 " gaps, %" PRIu64 " lost, %" PRIu64 " duplicates, %" PRIu64 " late, %" PRIu64 " resyncs\n",
+           seq.gaps, seq.lost_pkts, seq.duplicates, seq.late, seq.resyncs);
+    printf("host: drift %.1f ppm, jitter %.1f us, max interval %.1f us\n", (drift.clock_ratio - 1.0) * 1e6,
+           drift.jitter * 1e-3, max_interval_ns * 1e-3);
+    printf("host: %" PRIu64 " midi bytes, %" PRIu64 " gpio blobs, %.1f ns per packet\n", num_midi_bytes,
+           num_gpio_blobs, num_pkts > 0 ? double(host_ns) / double(num_pkts) : 0.0);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options) || (options.serve && options.transport != "shm"))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    Links links;
+    if (!make_links(options, links))
+    {
+        fprintf(stderr, "Could not create the %s links\n", options.transport.c_str());
+        return 1;
+    }
+
+    DeviceEmulator emulator(options.config, *links.device_control, *links.device_audio);
+    emulator.start();
+    if (options.serve)
+    {
+        printf("serving on %s_ctrl and %s_audio, ctrl-c to stop\n", options.shm_name.c_str(), options.shm_name.c_str());
+        while (!interrupted)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    else
+    {
+        run_host(links, options);
+        // Let the emulator handle the stop command
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    emulator.stop();
+
+    DeviceEmulatorStats stats = emulator.stats();
+    printf("device: %" PRIu64 " control packets, %" PRIu64 " replies, %" PRIu64 " audio packets sent, %" PRIu64
+           " lost, %" PRIu64 " received, %s\n", stats.control_pkts_received, stats.control_replies_sent,
+           stats.audio_pkts_sent, stats.audio_pkts_lost, stats.audio_pkts_received,
+           emulator.streaming() ? "streaming" : "stopped");
+    return 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+
+/**
+ * @brief Prints the content of trace files written by PacketTraceRecorder in
+ *        human readable form, decoding the payload of every audio and device
+ *        command.
+ *
+ *        Usage: acp_trace_decode [--hex] <file.trace>...
+ *
+ *        Files are decoded in the order given, timestamps are relative to the
+ *        first record of the first file.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "audio_control_protocol/audio_packet_helper.h"
+#include "audio_control_protocol/device_packet_helper.h"
+#include "audio_control_protocol/midi_timestamp_helper.h"
+#include "audio_control_protocol/midi_ump_helper.h"
+#include "audio_control_protocol/packet_trace.h"
+
+namespace {
+
+using namespace audio_ctrl;
+using namespace device_ctrl;
+
+void print_hex(const char* label, const uint8_t* data, int size)
+{
+    for (int i = 0; i < size; i += 16)
+    {
+        printf("    %-8s", i == 0 ? label : "");
+        for (int j = i; j < i + 16 && j < size; j++)
+        {
+            printf(" %02x", data[j]);
+        }
+        printf("\n");
+    }
+}
+
+// Prints a fixed size string field which might not be null terminated
+void print_name(const char* label, const uint8_t* name, int size)
+{
+    int length = static_cast<int>(strnlen(reinterpret_cast<const char*>(name), size));
+    printf("    %s \"%.*s\"\n", label, length, reinterpret_cast<const char*>(name));
+}
+
+const char* audio_cmd_name(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case AUDIO_CMD_NULL:    return "NULL";
+    case AUDIO_CMD_MUTE:    return "MUTE";
+    case AUDIO_CMD_UNMUTE:  return "UNMUTE";
+    case AUDIO_CMD_CEASE:   return "CEASE";
+    case GPIO_DATA:         return "GPIO_DATA";
+    case MIDI_DATA:         return "MIDI_DATA";
+    case MIDI_UMP_DATA:     return "MIDI_UMP_DATA";
+    default:                return "UNKNOWN";
+    }
+}
+
+const char* device_cmd_name(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case DEVICE_CMD_NULL:               return "NULL";
+    case DEVICE_PING:                   return "PING";
+    case DEVICE_FIRMWARE_VERSION_CHECK: return "FIRMWARE_VERSION_CHECK";
+    case DEVICE_SYSTEM_INFO:            return "SYSTEM_INFO";
+    case DEVICE_AUDIO_CHANNEL_INFO:     return "AUDIO_CHANNEL_INFO";
+    case DEVICE_START:                  return "START";
+    case DEVICE_CHANGE_INPUT_GAIN:      return "CHANGE_INPUT_GAIN";
+    case DEVICE_CHANGE_HP_VOL:          return "CHANGE_HP_VOL";
+    case DEVICE_SET_RGB_LED_VAL:        return "SET_RGB_LED_VAL";
+    case DEVICE_MIDI_MODE:              return "MIDI_MODE";
+    case DEVICE_STOP:                   return "STOP";
+    case DEVICE_RAW_DATA:               return "RAW_DATA";
+    default:                            return "UNKNOWN";
+    }
+}
+
+const char* sample_format_name(uint8_t format)
+{
+    switch (format)
+    {
+    case INT24_LJ:      return "INT24_LJ";
+    case INT24_I2S:     return "INT24_I2S";
+    case INT24_RJ:      return "INT24_RJ";
+    case INT24_32RJ:    return "INT24_32RJ";
+    case INT32:         return "INT32";
+    case BINARY:        return "BINARY";
+    default:            return "UNKNOWN";
+    }
+}
+
+const char* channel_direction_name(uint8_t direction)
+{
+    return direction == INPUT_DIRECTION ? "input" : direction == OUTPUT_DIRECTION ? "output" : "unknown";
+}
+
+void decode_audio_pkt(const AudioCtrlPkt* pkt, bool hex)
+{
+    printf("audio  %-22s seq %" PRIu32 " timing_error %" PRId32 " gate_in 0x%04" PRIx32
+           " gate_out 0x%04" PRIx32 " continuation %u",
+           audio_cmd_name(pkt->cmd_msb), pkt->seq, pkt->timing_error, pkt->gate_in, pkt->gate_out,
+           pkt->continuation);
+    if (!check_audio_pkt_for_magic_words(pkt))
+    {
+        printf(" BAD_MAGIC");
+    }
+    if (pkt->crc != 0)
+    {
+        printf(check_audio_pkt_crc(pkt) ? " crc ok" : " BAD_CRC");
+    }
+    printf("\n");
+    if (pkt->reserved[0] != 0 || pkt->reserved[1] != 0)
+    {
+        printf("    gate edge offsets");
+        for (int gate = 0; gate < AUDIO_CTRL_PKT_MAX_NUM_CV_IN_GATES; gate++)
+        {
+            printf(" %" PRIu32, get_gate_in_edge_offset(pkt, gate));
+        }
+        printf("\n");
+    }
+
+    switch (pkt->cmd_msb)
+    {
+    case GPIO_DATA:
+    {
+        int num_blobs = pkt->cmd_lsb;
+        printf("    %d gpio data blobs\n", num_blobs);
+        if (num_blobs > AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS)
+        {
+            printf("    INVALID number of blobs\n");
+            num_blobs = AUDIO_CTRL_PKT_MAX_NUM_GPIO_DATA_BLOBS;
+        }
+        for (int i = 0; i < num_blobs; i++)
+        {
+            char label[16];
+            snprintf(label, sizeof(label), "blob %d", i);
+            print_hex(label, pkt->payload.gpio_data_blob[i].data, AUDIO_CTRL_PKT_GPIO_DATA_BLOB_SIZE);
+        }
+        break;
+    }
+    case MIDI_DATA:
+    {
+        int num_bytes = check_for_midi_data(pkt);
+        bool timestamped = check_for_timestamped_midi_data(pkt);
+        printf("    %d midi bytes%s\n", num_bytes, timestamped ? ", timestamped" : "");
+        if (num_bytes > AUDIO_CTRL_PKT_PAYLOAD_SIZE)
+        {
+            printf("    INVALID number of bytes\n");
+            num_bytes = AUDIO_CTRL_PKT_PAYLOAD_SIZE;
+        }
+        if (!timestamped)
+        {
+            print_hex("midi", pkt->payload.midi_data, num_bytes);
+            break;
+        }
+        MidiEventIterator events;
+        init_midi_event_iterator(&events, pkt);
+        uint32_t frame_offset;
+        int event_size;
+        while (const uint8_t* event = next_midi_event(&events, &frame_offset, &event_size))
+        {
+            char label[16];
+            snprintf(label, sizeof(label), "@%" PRIu32, frame_offset);
+            print_hex(label, event, event_size);
+        }
+        if (events.malformed)
+        {
+            printf("    MALFORMED midi events\n");
+        }
+        break;
+    }
+    case MIDI_UMP_DATA:
+    {
+        int num_words = check_for_midi_ump_data(pkt);
+        printf("    %d ump words\n", num_words);
+        if (num_words > AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS)
+        {
+            printf("    INVALID number of words\n");
+            num_words = AUDIO_CTRL_PKT_MAX_NUM_UMP_WORDS;
+        }
+        int offset = 0;
+        int msg_words;
+        while (const uint32_t* msg = next_ump_message(pkt, &offset, &msg_words))
+        {
+            printf("    ump mt %d group %2d :", ump_message_type(msg[0]), ump_group(msg[0]));
+            for (int i = 0; i < msg_words; i++)
+            {
+                printf(" %08" PRIx32, msg[i]);
+            }
+            printf("\n");
+        }
+        if (offset < num_words)
+        {
+            printf("    MALFORMED ump messages\n");
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    if (hex)
+    {
+        print_hex("raw", reinterpret_cast<const uint8_t*>(pkt), AUDIO_CTRL_PKT_SIZE);
+    }
+}
+
+void decode_device_pkt(const struct device_ctrl_pkt* pkt, bool is_reply, bool hex)
+{
+    const union device_pkt_payload& payload = pkt->payload;
+
+    printf("device %-22s %s", device_cmd_name(pkt->device_cmd), is_reply ? "reply" : "query");
+    if (!check_device_pkt_for_magic_words(pkt))
+    {
+        printf(" BAD_MAGIC");
+    }
+    if (pkt->crc != 0)
+    {
+        printf(check_device_pkt_crc(pkt) ? " crc ok" : " BAD_CRC");
+    }
+    printf("\n");
+
+    switch (pkt->device_cmd)
+    {
+    case DEVICE_PING:
+        printf("    ping_code %" PRIu32 "\n", payload.ping_code);
+        break;
+
+    case DEVICE_FIRMWARE_VERSION_CHECK:
+        if (is_reply)
+        {
+            printf("    version %u.%u board %u\n", payload.version_data.major_vers,
+                   payload.version_data.minor_vers, payload.version_data.board_vers);
+        }
+        break;
+
+    case DEVICE_SYSTEM_INFO:
+        if (is_reply)
+        {
+            const struct system_info_data& info = payload.system_info_data;
+            print_name("hat_name", info.hat_name, DEVICE_CTRL_PKT_HAT_NAME_SIZE);
+            printf("    flags 0x%08" PRIx32 "%s%s%s%s\n", info.flags,
+                   info.flags & DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_MICROCONTROLLER_USB ? " (has microcontroller usb)" : "",
+                   info.flags & DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_TIMESTAMPED_MIDI ? " (has timestamped midi)" : "",
+                   info.flags & DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_UMP_MIDI ? " (has ump midi)" : "",
+                   info.flags & DEVICE_CTRL_SYSTEM_INFO_FLAGS_HAS_GATE_EDGE_OFFSETS ? " (has gate edge offsets)" : "");
+            printf("    sampling_rate %" PRIu32 " audio in %u out %u midi in %u out %u\n", info.sampling_rate,
+                   info.num_audio_inputs, info.num_audio_outputs, info.num_midi_inputs, info.num_midi_outputs);
+        }
+        break;
+
+    case DEVICE_AUDIO_CHANNEL_INFO:
+        if (is_reply)
+        {
+            const struct audio_channel_info_data& info = payload.audio_channel_info_data;
+            printf("    sw_ch_id %u hw_ch_id %u %s %s start_offset %" PRIu32 " stride %" PRIu32 " words\n",
+                   info.sw_ch_id, info.hw_ch_id, channel_direction_name(info.direction),
+                   sample_format_name(info.sample_format), info.start_offset_in_words, info.stride_in_words);
+            print_name("name", info.channel_name, DEVICE_CTRL_PKT_AUDIO_CHANNEL_NAME_SIZE);
+        }
+        else
+        {
+            const struct audio_channel_info_req& req = payload.audio_channel_info_req;
+            printf("    sw_ch_id %u %s buffer_size %" PRIu32 " frames\n", req.sw_ch_id,
+                   channel_direction_name(req.direction), req.buffer_size_in_frames);
+        }
+        break;
+
+    case DEVICE_START:
+        printf("    buffer_size %d\n", payload.buffer_size);
+        break;
+
+    case DEVICE_CHANGE_INPUT_GAIN:
+        printf("    jack_id %" PRIu32 " gain_val %" PRIu32 "\n", payload.input_gain_data.jack_id,
+               payload.input_gain_data.gain_val);
+        break;
+
+    case DEVICE_CHANGE_HP_VOL:
+        printf("    hp_vol %" PRIu32 "\n", payload.hp_vol_data);
+        break;
+
+    case DEVICE_SET_RGB_LED_VAL:
+    {
+        const struct device_rgb_led_data& led = payload.rgb_led_data;
+        printf("    led %" PRIu32 " brightness %u rgb %u %u %u\n", led.rgb_led_id, led.rgb_led_val.brightness,
+               led.rgb_led_val.r_val, led.rgb_led_val.g_val, led.rgb_led_val.b_val);
+        break;
+    }
+
+    case DEVICE_MIDI_MODE:
+        printf("    midi_mode %s\n", payload.midi_mode == DEVICE_MIDI_MODE_TIMESTAMPED ? "timestamped" :
+                                     payload.midi_mode == DEVICE_MIDI_MODE_RAW ? "raw" :
+                                     payload.midi_mode == DEVICE_MIDI_MODE_UMP ? "ump" : "UNKNOWN");
+        break;
+
+    case DEVICE_RAW_DATA:
+        printf("    subcmd %u\n", pkt->device_subcmd);
+        print_hex("data", payload.raw_data, DEVICE_CTRL_PKT_PAYLOAD_SIZE);
+        break;
+
+    default:
+        break;
+    }
+    if (hex)
+    {
+        print_hex("raw", reinterpret_cast<const uint8_t*>(pkt), DEVICE_CTRL_PKT_SIZE);
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    bool hex = false;
+    int first_file = 1;
+    if (argc > 1 && strcmp(argv[1], "--hex") == 0)
+    {
+        hex = true;
+        first_file = 2;
+    }
+    if (first_file >= argc)
+    {
+        fprintf(stderr, "Usage: %s [--hex] <file.trace>...\n", argv[0]);
+        return 1;
+    }
+
+    bool first_record = true;
+    uint64_t start_time_ns = 0;
+    bool first_of_type[PKT_TRACE_NUM_PKT_TYPES] = {true, true};
+    uint32_t next_record_seqs[PKT_TRACE_NUM_PKT_TYPES] = {};
+    for (int arg = first_file; arg < argc; arg++)
+    {
+        PacketTraceReader reader;
+        if (!reader.open(argv[arg]))
+        {
+            fprintf(stderr, "Could not open trace file %s\n", argv[arg]);
+            return 1;
+        }
+        const PacketTraceFileHeader& header = reader.header();
+        printf("# %s: file %" PRIu32 ", %" PRIu32 " records, protocol %" PRIu32 ".%" PRIu32 ".%" PRIu32 "\n",
+               argv[arg], header.file_index, reader.num_records(), header.protocol_version >> 16,
+               (header.protocol_version >> 8) & 0xFF, header.protocol_version & 0xFF);
+
+        for (uint32_t i = 0; i < reader.num_records(); i++)
+        {
+            const PacketTraceRecord& record = reader.record(i);
+            if (first_record)
+            {
+                start_time_ns = record.timestamp_ns;
+                first_record = false;
+            }
+            // Version 1 files count records of both types in one sequence
+            int seq_index = header.version == 1 || record.pkt_type >= PKT_TRACE_NUM_PKT_TYPES ? 0 : record.pkt_type;
+            if (first_of_type[seq_index])
+            {
+                next_record_seqs[seq_index] = record.record_seq;
+                first_of_type[seq_index] = false;
+            }
+            if (record.record_seq != next_record_seqs[seq_index])
+            {
+                printf("# %" PRIu32 " records dropped\n", record.record_seq - next_record_seqs[seq_index]);
+            }
+            next_record_seqs[seq_index] = record.record_seq + 1;
+
+            bool to_device = record.direction == PKT_TRACE_HOST_TO_DEVICE;
+            printf("%14.6f ms #%-8" PRIu32 " %s ", (record.timestamp_ns - start_time_ns) * 1e-6,
+                   record.record_seq, to_device ? "->" : "<-");
+            if (record.pkt_type == PKT_TRACE_AUDIO_PKT && record.pkt_size == AUDIO_CTRL_PKT_SIZE)
+            {
+                decode_audio_pkt(&record.data.audio_pkt, hex);
+            }
+            else if (record.pkt_type == PKT_TRACE_DEVICE_PKT && record.pkt_size == DEVICE_CTRL_PKT_SIZE)
+            {
+                decode_device_pkt(&record.data.device_pkt, !to_device, hex);
+            }
+            else
+            {
+                printf("INVALID record, type %u size %u\n", record.pkt_type, record.pkt_size);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2022 Modern Ancient Instruments Networked AB, dba Elk
+ * Audio Control Protocol is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * Audio Control Protocol is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audio Control Protocol. If not, see http://www.gnu.org/licenses/ .
+ */
+
+
+/**
+ * @brief Replays trace files written by PacketTraceRecorder through the host
+ *        side parsing helpers and prints per stage timing histograms.
+ *
+ *        Usage: acp_trace_replay [--realtime] [--repeat N] [--channels N]
+ *                                [--device-to-host] [--json] <file.trace>...
+ *
+ *        Run the same traces with two builds of the library to compare them.
+ * @copyright 2022 Modern Ancient Instruments Networked AB, dba Elk, Stockholm
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "audio_control_protocol/packet_trace_replay.h"
+
+namespace {
+
+using namespace audio_ctrl;
+
+const double PERCENTILES[] = {50.0, 90.0, 99.0, 99.9};
+
+void print_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [--realtime] [--repeat N] [--channels N] [--device-to-host] [--json] <file.trace>...\n",
+            name);
+}
+
+void print_histogram_json(const char* name, const ReplayHistogram& histogram, bool last)
+{
+    printf("    %-12s {\"count\": %" PRIu64 ", \"min\": %" PRIu64 ", \"mean\": %.1f",
+           (std::string("\"") + name + "\":").c_str(), histogram.count(), histogram.min(), histogram.mean());
+    for (double percent : PERCENTILES)
+    {
+        printf(", \"p%g\": %" PRIu64, percent, histogram.percentile(percent));
+    }
+    printf(", \"max\": %" PRIu64 "}%s\n", histogram.max(), last ? "" : ",");
+}
+
+void print_histogram_row(const char* name, const ReplayHistogram& histogram)
+{
+    printf("%-12s %12" PRIu64 " %8" PRIu64 " %10.1f", name, histogram.count(), histogram.min(), histogram.mean());
+    for (double percent : PERCENTILES)
+    {
+        printf(" %8" PRIu64, histogram.percentile(percent));
+    }
+    printf(" %10" PRIu64 "\n", histogram.max());
+}
+
+void print_json(const ReplayReport& report, const ReplayOptions& options)
+{
+    printf("{\n  \"context\": {\n");
+    printf("    \"mode\": \"%s\",\n", options.mode == ReplayMode::REALTIME ? "realtime" : "fast");
+    printf("    \"repeat\": %d,\n", options.repeat);
+    printf("    \"num_channels\": %d,\n", options.num_channels);
+    printf("    \"protocol_version\": \"%d.%d.%d\",\n", AUDIO_PROTOCOL_VERSION_MAJ, AUDIO_PROTOCOL_VERSION_MIN,
+           AUDIO_PROTOCOL_VERSION_REV);
+    printf("    \"timer_overhead_ns\": %.1f\n", report.timer_overhead_ns);
+    printf("  },\n  \"totals\": {\n");
+    printf("    \"packets\": %" PRIu64 ",\n", report.num_packets);
+    printf("    \"invalid\": %" PRIu64 ",\n", report.num_invalid);
+    printf("    \"midi_bytes\": %" PRIu64 ",\n", report.num_midi_bytes);
+    printf("    \"gpio_blobs\": %" PRIu64 ",\n", report.num_gpio_blobs);
+    printf("    \"ch_status_changes\": %" PRIu64 ",\n", report.num_ch_status_changes);
+    printf("    \"seq_gaps\": %" PRIu64 ",\n", report.num_seq_gaps);
+    printf("    \"elapsed_s\": %.6f,\n", report.elapsed_s);
+    printf("    \"packets_per_s\": %.1f\n", report.packets_per_s);
+    printf("  },\n  \"stages_ns\": {\n");
+    for (int stage = 0; stage < REPLAY_NUM_STAGES; stage++)
+    {
+        print_histogram_json(replay_stage_name(stage), report.stages[stage], false);
+    }
+    print_histogram_json("lateness", report.lateness, true);
+    printf("  }\n}\n");
+}
+
+void print_table(const ReplayReport& report)
+{
+    printf("%" PRIu64 " packets (%" PRIu64 " invalid) in %.3f s, %.0f packets/s\n", report.num_packets,
+           report.num_invalid, report.elapsed_s, report.packets_per_s);
+    printf("%" PRIu64 " midi bytes, %" PRIu64 " gpio blobs, %" PRIu64 " channel status changes, %" PRIu64
+           " sequence gaps\n", report.num_midi_bytes, report.num_gpio_blobs, report.num_ch_status_changes,
+           report.num_seq_gaps);
+    printf("timer overhead %.1f ns, included in all stage timings\n\n", report.timer_overhead_ns);
+
+    printf("%-12s %12s %8s %10s", "stage [ns]", "count", "min", "mean");
+    for (double percent : PERCENTILES)
+    {
+        char label[16];
+        snprintf(label, sizeof(label), "p%g", percent);
+        printf(" %8s", label);
+    }
+    printf(" %10s\n", "max");
+    for (int stage = 0; stage < REPLAY_NUM_STAGES; stage++)
+    {
+        print_histogram_row(replay_stage_name(stage), report.stages[stage]);
+    }
+    if (report.lateness.count() > 0)
+    {
+        print_histogram_row("lateness", report.lateness);
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions options;
+    bool json = false;
+    PacketTraceReplay replay;
+    bool has_files = false;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--realtime") == 0)
+        {
+            options.mode = ReplayMode::REALTIME;
+        }
+        else if (strcmp(argv[arg], "--repeat") == 0 && arg + 1 < argc)
+        {
+            options.repeat = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--channels") == 0 && arg + 1 < argc)
+        {
+            options.num_channels = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--device-to-host") == 0)
+        {
+            options.device_to_host_only = true;
+        }
+        else if (strcmp(argv[arg], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (argv[arg][0] == '-')
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            if (!replay.load(argv[arg]))
+            {
+                fprintf(stderr, "Could not open trace file %s\n", argv[arg]);
+                return 1;
+            }
+            has_files = true;
+        }
+    }
+    if (!has_files)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ReplayReport report = replay.run(options);
+    if (json)
+    {
+        print_json(report, options);
+    }
+    else
+    {
+        print_table(report);
+    }
+    return 0;
+}